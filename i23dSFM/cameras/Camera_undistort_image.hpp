@@ -1,4 +1,3 @@
-
 // Copyright (c) 2015 Pierre MOULON.
 
 // This Source Code Form is subject to the terms of the Mozilla Public
@@ -8,11 +7,281 @@
 #ifndef I23DSFM_CAMERA_UNDISTORT_IMAGE_HPP
 #define I23DSFM_CAMERA_UNDISTORT_IMAGE_HPP
 
+#include "i23dSFM/types.hpp"
+#include "i23dSFM/cameras/Camera_Intrinsics.hpp"
 #include "i23dSFM/image/image.hpp"
 
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
 namespace i23dSFM {
 namespace cameras {
 
+/// Undistortion remapping of a camera, computed once and shared by all the
+/// images of the same intrinsic.
+/// For each pixel of the undistorted image it stores the top-left source pixel
+/// and the bilinear weights in 8 bit fixed point, so that undistorting an image
+/// is only some integer arithmetic per pixel (no distortion model evaluation).
+/// The sampling is the one of image::Sampler2d<image::SamplerLinear>.
+class Undistortion_Map
+{
+public:
+  Undistortion_Map() : _width(0), _height(0) {}
+
+  /// Compute the mapping of the cam camera for a width x height image
+  void Init(const IntrinsicBase * cam, const int width, const int height)
+  {
+    _width = width;
+    _height = height;
+    _entries.resize(static_cast<size_t>(width) * height);
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int j = 0; j < height; ++j)
+    {
+      Entry * row = &_entries[static_cast<size_t>(j) * width];
+      for (int i = 0; i < width; ++i)
+      {
+        // compute coordinates with distortion
+        const Vec2 disto_pix = cam->get_d_pixel(Vec2(i,j));
+        row[i] = MakeEntry(disto_pix(0), disto_pix(1));
+      }
+    }
+  }
+
+  int Width() const { return _width; }
+  int Height() const { return _height; }
+
+  /// Undistort imageIn (of the size given to Init) into image_ud
+  template <typename T>
+  void Apply(
+    const image::Image<T> & imageIn,
+    image::Image<T> & image_ud,
+    const T fillcolor = T(0)) const
+  {
+    image_ud.resize(_width, _height, false);
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int j = 0; j < _height; ++j)
+    {
+      const Entry * entries = &_entries[static_cast<size_t>(j) * _width];
+      T * row_ud = image_ud.data() + static_cast<size_t>(j) * _width;
+      SampleRow(imageIn.data(), entries, _width, fillcolor, row_ud);
+    }
+  }
+
+private:
+
+  struct Entry
+  {
+    int32_t offset;  // index of the top-left source pixel (-1: outside the image)
+    uint16_t fx, fy; // weights of the right and bottom pixels (in 1/256)
+  };
+
+  /// Bilinear sampling setup at (x,y), matching Sampler2d<SamplerLinear>:
+  /// the neighbours outside the image are ignored and the weights renormalized,
+  /// which amounts to clamp the coordinates; the sample is invalid if the
+  /// remaining weight is too small.
+  Entry MakeEntry(const double x, const double y) const
+  {
+    Entry entry = {-1, 0, 0};
+    // pick pixel if it is in the image domain
+    if (_width < 2 || _height < 2 ||
+        !(static_cast<int>(x) >= 0 && static_cast<int>(x) < _width &&
+          static_cast<int>(y) >= 0 && static_cast<int>(y) < _height))
+      return entry;
+
+    int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(std::floor(y));
+    const double dx = x - x0, dy = y - y0;
+    double weight_x = 1.0, weight_y = 1.0;
+    int fx = static_cast<int>(dx * 256.0 + 0.5), fy = static_cast<int>(dy * 256.0 + 0.5);
+    // Clamp to the image border, the second pixel of the neighbourhood is
+    // always kept inside the image to read it without a bound check.
+    if (x0 < 0)                { weight_x = dx;       x0 = 0;           fx = 0; }
+    else if (x0 + 1 >= _width) { weight_x = 1.0 - dx; x0 = _width - 2;  fx = 256; }
+    if (y0 < 0)                { weight_y = dy;       y0 = 0;           fy = 0; }
+    else if (y0 + 1 >= _height){ weight_y = 1.0 - dy; y0 = _height - 2; fy = 256; }
+    if (weight_x * weight_y <= 0.2)
+      return entry;
+
+    entry.offset = y0 * _width + x0;
+    entry.fx = static_cast<uint16_t>(fx);
+    entry.fy = static_cast<uint16_t>(fy);
+    return entry;
+  }
+
+  /// 8 bit channels images (gray, RGB, RGBA): integer only sampling
+  /// (the channels loop has a constant size and is unrolled by the compiler)
+  template <int NB_CHANNELS, typename T>
+  void SampleRow_uint8(
+    const T * src,
+    const Entry * entries,
+    const int width,
+    const T & fillcolor,
+    T * row_ud) const
+  {
+    const unsigned char * src_bytes = reinterpret_cast<const unsigned char*>(src);
+    const size_t row_size = static_cast<size_t>(_width) * NB_CHANNELS;
+    unsigned char * out = reinterpret_cast<unsigned char*>(row_ud);
+    for (int i = 0; i < width; ++i, out += NB_CHANNELS)
+    {
+      const Entry & entry = entries[i];
+      if (entry.offset < 0)
+      {
+        row_ud[i] = fillcolor;
+        continue;
+      }
+      const int fx = entry.fx, fy = entry.fy;
+      const unsigned char * p00 = src_bytes + static_cast<size_t>(entry.offset) * NB_CHANNELS;
+      const unsigned char * p10 = p00 + row_size;
+      for (int c = 0; c < NB_CHANNELS; ++c)
+      {
+        const int top = (p00[c] << 8) + (p00[NB_CHANNELS + c] - p00[c]) * fx;
+        const int bottom = (p10[c] << 8) + (p10[NB_CHANNELS + c] - p10[c]) * fx;
+        out[c] = static_cast<unsigned char>(((top << 8) + (bottom - top) * fy + 32768) >> 16);
+      }
+    }
+  }
+
+  void SampleRow(const unsigned char * src, const Entry * entries, const int width,
+    const unsigned char & fillcolor, unsigned char * row_ud) const
+  {
+    SampleRow_uint8<1>(src, entries, width, fillcolor, row_ud);
+  }
+
+  void SampleRow(const image::RGBColor * src, const Entry * entries, const int width,
+    const image::RGBColor & fillcolor, image::RGBColor * row_ud) const
+  {
+    static_assert(sizeof(image::RGBColor) == 3, "RGBColor must be 3 contiguous bytes");
+    SampleRow_uint8<3>(src, entries, width, fillcolor, row_ud);
+  }
+
+  void SampleRow(const image::RGBAColor * src, const Entry * entries, const int width,
+    const image::RGBAColor & fillcolor, image::RGBAColor * row_ud) const
+  {
+    static_assert(sizeof(image::RGBAColor) == 4, "RGBAColor must be 4 contiguous bytes");
+    SampleRow_uint8<4>(src, entries, width, fillcolor, row_ud);
+  }
+
+  /// Other pixel types: floating point sampling
+  template <typename T>
+  void SampleRow(const T * src, const Entry * entries, const int width,
+    const T & fillcolor, T * row_ud) const
+  {
+    typedef image::RealPixel<T> RealT;
+    for (int i = 0; i < width; ++i)
+    {
+      const Entry & entry = entries[i];
+      if (entry.offset < 0)
+      {
+        row_ud[i] = fillcolor;
+        continue;
+      }
+      const double wx = entry.fx / 256.0, wy = entry.fy / 256.0;
+      const T * p00 = src + entry.offset;
+      const T * p10 = p00 + _width;
+      row_ud[i] = RealT::convert_from_real(
+        RealT::convert_to_real(p00[0]) * ((1.0 - wx) * (1.0 - wy)) +
+        RealT::convert_to_real(p00[1]) * (wx * (1.0 - wy)) +
+        RealT::convert_to_real(p10[0]) * ((1.0 - wx) * wy) +
+        RealT::convert_to_real(p10[1]) * (wx * wy));
+    }
+  }
+
+  int _width, _height;
+  std::vector<Entry> _entries;
+};
+
+/// Undistortion maps of the last used intrinsics (the least recently used map
+/// is released when more than max_maps intrinsics are in use).
+/// The cache can be shared by several threads: a map is computed outside of
+/// the cache lock, only the threads that need this map wait for it.
+class Undistortion_Map_Cache
+{
+public:
+  explicit Undistortion_Map_Cache(size_t max_maps = 4) : _max_maps(max_maps > 0 ? max_maps : 1) {}
+
+  /// Return the map of an intrinsic for a width x height image (computed on first use).
+  /// The map stays valid as long as the returned pointer is alive, even if it
+  /// is released from the cache meanwhile.
+  std::shared_ptr<const Undistortion_Map> Acquire(
+    const IndexT id_intrinsic,
+    const IntrinsicBase * cam,
+    const int width,
+    const int height)
+  {
+    std::shared_ptr<Cache_Entry> entry;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::list<Cache_Item>::iterator it = _maps.begin();
+      while (it != _maps.end() &&
+        !(it->id_intrinsic == id_intrinsic && it->width == width && it->height == height))
+        ++it;
+      if (it != _maps.end())
+      {
+        _maps.splice(_maps.begin(), _maps, it);
+      }
+      else
+      {
+        // Placeholder entry, its map is computed below
+        if (_maps.size() >= _max_maps)
+          _maps.pop_back();
+        const Cache_Item item = {id_intrinsic, width, height, std::make_shared<Cache_Entry>()};
+        _maps.push_front(item);
+      }
+      entry = _maps.front().entry;
+    }
+    std::call_once(entry->once, [&]() { entry->map.Init(cam, width, height); });
+    // The returned pointer shares the ownership of the entry
+    return std::shared_ptr<const Undistortion_Map>(entry, &entry->map);
+  }
+
+  /// Return the map of an intrinsic for a width x height image (computed on first use).
+  /// The reference is valid until the map is released from the cache
+  /// (i.e. single threaded use).
+  const Undistortion_Map & Get(
+    const IndexT id_intrinsic,
+    const IntrinsicBase * cam,
+    const int width,
+    const int height)
+  {
+    return *Acquire(id_intrinsic, cam, width, height);
+  }
+
+private:
+  struct Cache_Entry
+  {
+    std::once_flag once; // the map is computed by the first user
+    Undistortion_Map map;
+  };
+  struct Cache_Item
+  {
+    IndexT id_intrinsic;
+    int width, height;
+    std::shared_ptr<Cache_Entry> entry;
+  };
+  const size_t _max_maps;
+  std::list<Cache_Item> _maps; // most recently used first
+  std::mutex _mutex;
+};
+
+/// Undistort an image with a precomputed undistortion map
+template <typename Image>
+void UndistortImage(
+  const Image& imageIn,
+  const Undistortion_Map & undistortion_map,
+  Image & image_ud,
+  typename Image::Tpixel fillcolor = typename Image::Tpixel(0))
+{
+  undistortion_map.Apply(imageIn, image_ud, fillcolor);
+}
+
 /// Undistort an image according a given camera & it's distortion model
 template <typename Image>
 void UndistortImage(
@@ -27,21 +296,9 @@ void UndistortImage(
   }
   else // There is distortion
   {
-    image_ud.resize(imageIn.Width(), imageIn.Height(), true, fillcolor);
-    const image::Sampler2d<image::SamplerLinear> sampler;
-#ifdef I23DSFM_USE_OPENMP
-    #pragma omp parallel for
-#endif
-    for (int j = 0; j < imageIn.Height(); ++j)
-    for (int i = 0; i < imageIn.Width(); ++i)
-    {
-      const Vec2 undisto_pix(i,j);
-      // compute coordinates with distortion
-      const Vec2 disto_pix = cam->get_d_pixel(undisto_pix);
-      // pick pixel if it is in the image domain
-      if ( imageIn.Contains(disto_pix(1), disto_pix(0)) )
-        image_ud( j, i ) = sampler(imageIn, disto_pix(1), disto_pix(0));
-    }
+    Undistortion_Map undistortion_map;
+    undistortion_map.Init(cam, imageIn.Width(), imageIn.Height());
+    undistortion_map.Apply(imageIn, image_ud, fillcolor);
   }
 }
 
@@ -49,4 +306,3 @@ void UndistortImage(
 } // namespace i23dSFM
 
 #endif // #ifndef I23DSFM_CAMERA_UNDISTORT_IMAGE_HPP
-
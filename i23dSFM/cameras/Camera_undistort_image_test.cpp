@@ -0,0 +1,129 @@
+// Copyright (c) 2015 Pierre MOULON.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/cameras/cameras.hpp"
+using namespace i23dSFM;
+using namespace i23dSFM::cameras;
+using namespace i23dSFM::image;
+
+#include "testing/testing.h"
+
+#include <cstdlib>
+#include <vector>
+
+// Reference undistortion: distortion model evaluated and sampled per pixel
+template <typename T>
+void UndistortImage_Reference(
+  const Image<T> & imageIn, const IntrinsicBase * cam, Image<T> & image_ud)
+{
+  image_ud.resize(imageIn.Width(), imageIn.Height(), true, T(0));
+  const Sampler2d<SamplerLinear> sampler;
+  for (int j = 0; j < imageIn.Height(); ++j)
+  for (int i = 0; i < imageIn.Width(); ++i)
+  {
+    const Vec2 disto_pix = cam->get_d_pixel(Vec2(i,j));
+    if (imageIn.Contains(disto_pix(1), disto_pix(0)))
+      image_ud(j, i) = sampler(imageIn, disto_pix(1), disto_pix(0));
+  }
+}
+
+//-----------------
+// Test summary:
+//-----------------
+// - Undistort a random image with a strong radial distortion
+// - Compare the precomputed map result to the per pixel reference
+//   (8 bit fixed point weights: at most one gray level of difference)
+//-----------------
+TEST(Undistortion_Map, gray_rgb)
+{
+  const Pinhole_Intrinsic_Radial_K3 cam(120, 80, 100, 60, 40, -0.2, 0.05, 0.01);
+
+  Image<unsigned char> gray(120, 80);
+  Image<RGBColor> rgb(120, 80);
+  for (int j = 0; j < gray.Height(); ++j)
+    for (int i = 0; i < gray.Width(); ++i)
+    {
+      gray(j,i) = static_cast<unsigned char>(std::rand() % 256);
+      rgb(j,i) = RGBColor(std::rand() % 256, std::rand() % 256, std::rand() % 256);
+    }
+
+  Undistortion_Map undistortion_map;
+  undistortion_map.Init(&cam, gray.Width(), gray.Height());
+
+  Image<unsigned char> gray_ud, gray_ref;
+  UndistortImage(gray, undistortion_map, gray_ud);
+  UndistortImage_Reference(gray, &cam, gray_ref);
+  Image<RGBColor> rgb_ud, rgb_ref;
+  UndistortImage(rgb, undistortion_map, rgb_ud, BLACK);
+  UndistortImage_Reference(rgb, &cam, rgb_ref);
+
+  int max_diff = 0;
+  for (int j = 0; j < gray.Height(); ++j)
+    for (int i = 0; i < gray.Width(); ++i)
+    {
+      max_diff = std::max(max_diff, std::abs(gray_ud(j,i) - gray_ref(j,i)));
+      for (int c = 0; c < 3; ++c)
+        max_diff = std::max(max_diff, std::abs(rgb_ud(j,i)(c) - rgb_ref(j,i)(c)));
+    }
+  EXPECT_TRUE(max_diff <= 1);
+
+  // The camera based function gives the same result
+  Image<RGBColor> rgb_cam;
+  UndistortImage(rgb, &cam, rgb_cam, BLACK);
+  EXPECT_TRUE(rgb_cam == rgb_ud);
+}
+
+//-----------------
+// Test summary:
+//-----------------
+// - Acquire the maps of two cameras from a cache that keeps a single map
+//   (concurrently if OpenMP is enabled)
+// - The acquired maps stay valid after their eviction and give the same
+//   result as the maps computed directly
+//-----------------
+TEST(Undistortion_Map_Cache, eviction)
+{
+  const Pinhole_Intrinsic_Radial_K3 cam_0(120, 80, 100, 60, 40, -0.2, 0.05, 0.01);
+  const Pinhole_Intrinsic_Radial_K3 cam_1(120, 80, 110, 58, 42, 0.1, -0.02, 0.0);
+  const IntrinsicBase * cams[2] = {&cam_0, &cam_1};
+
+  Image<unsigned char> gray(120, 80);
+  for (int j = 0; j < gray.Height(); ++j)
+    for (int i = 0; i < gray.Width(); ++i)
+      gray(j,i) = static_cast<unsigned char>(std::rand() % 256);
+
+  Image<unsigned char> gray_ref[2];
+  for (int c = 0; c < 2; ++c)
+  {
+    Undistortion_Map undistortion_map;
+    undistortion_map.Init(cams[c], gray.Width(), gray.Height());
+    UndistortImage(gray, undistortion_map, gray_ref[c]);
+  }
+
+  Undistortion_Map_Cache cache(1);
+  const int nb_acquisitions = 16;
+  std::vector<int> vec_bSame(nb_acquisitions, 0);
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int k = 0; k < nb_acquisitions; ++k)
+  {
+    const int c = k % 2;
+    const std::shared_ptr<const Undistortion_Map> undistortion_map =
+      cache.Acquire(c, cams[c], gray.Width(), gray.Height());
+    // Evict the map while it is in use
+    cache.Acquire(1 - c, cams[1 - c], gray.Width(), gray.Height());
+    Image<unsigned char> gray_ud;
+    UndistortImage(gray, *undistortion_map, gray_ud);
+    vec_bSame[k] = (gray_ud == gray_ref[c]);
+  }
+  for (int k = 0; k < nb_acquisitions; ++k)
+    EXPECT_TRUE(vec_bSame[k] == 1);
+}
+
+/* ************************************************************************* */
+int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
+/* ************************************************************************* */
@@ -10,6 +10,8 @@
 #include "i23dSFM/exif/exif_IO.hpp"
 #include "third_party/easyexif/exif.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <vector>
@@ -31,27 +33,41 @@ class Exif_IO_EasyExif : public Exif_IO
 
     bool open( const std::string & sFileName )
     {
-      // Read the file into a buffer
+      bHaveExifInfo_ = false;
+
+      // Read only the JPEG header segments up to the EXIF one:
+      //  the compressed image data is never read.
       FILE *fp = fopen(sFileName.c_str(), "rb");
       if (!fp) {
         return false;
       }
-      fseek(fp, 0, SEEK_END);
-      unsigned long fsize = ftell(fp);
-      rewind(fp);
-      std::vector<unsigned char> buf(fsize);
-      if (fread(&buf[0], 1, fsize, fp) != fsize) {
+      unsigned char soi[2];
+      if (fread(soi, 1, 2, fp) != 2 || soi[0] != 0xFF || soi[1] != 0xD8) {
+        fclose(fp);
         return false;
       }
+      unsigned char marker[4];
+      while (!bHaveExifInfo_ && fread(marker, 1, 4, fp) == 4 && marker[0] == 0xFF)
+      {
+        const unsigned length = (marker[2] << 8) | marker[3];
+        // Start of scan or end of image: no more metadata segments
+        if (marker[1] == 0xDA || marker[1] == 0xD9 || length < 2)
+          break;
+        if (marker[1] != 0xE1) {
+          if (fseek(fp, length - 2, SEEK_CUR) != 0)
+            break;
+          continue;
+        }
+        // APP1 segment (EXIF or XMP): parse it as a JPEG stream (SOI + APP1)
+        std::vector<unsigned char> buf(2 + 2 + length);
+        buf[0] = 0xFF; buf[1] = 0xD8;
+        std::copy(marker, marker + 4, buf.begin() + 2);
+        if (fread(buf.data() + 6, 1, length - 2, fp) != length - 2)
+          break;
+        bHaveExifInfo_ = (exifInfo_.parseFrom(&buf[0], buf.size()) == PARSE_EXIF_SUCCESS);
+      }
       fclose(fp);
 
-      // Parse EXIF
-      int code = exifInfo_.parseFrom(&buf[0], fsize);
-      if (code)
-        bHaveExifInfo_ = false;
-      else
-        bHaveExifInfo_ = true;
-
       return bHaveExifInfo_;
     }
 
@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <fstream>
 #include <iterator>
+#include <set>
+#include <unordered_map>
 
 #include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
 
@@ -64,4 +66,93 @@ bool getInfo( const std::string& sBrand, const std::string& sModel, const std::v
   return existInDatabase;
 }
 
+// Hashed lookup of a parsed database, same result as getInfo:
+// - the datasheets are indexed by lower case brand,
+// - each datasheet keeps the set of its lower case model words,
+// - the results are cached per (brand, model) query (not thread safe).
+class Datasheet_Database
+{
+public:
+  explicit Datasheet_Database( const std::vector<Datasheet>& vec_database ):
+    vec_database_(vec_database)
+  {
+    vec_model_words_.resize( vec_database_.size() );
+    for ( size_t i = 0; i < vec_database_.size(); ++i )
+    {
+      map_brand_datasheets_[ toLower( vec_database_[i]._brand ) ].push_back( i );
+      std::vector<std::string> vec_model;
+      stl::split( vec_database_[i]._model, " ", vec_model );
+      for ( size_t j = 0; j < vec_model.size(); ++j )
+        vec_model_words_[i].insert( toLower( vec_model[j] ) );
+    }
+  }
+
+  // Get information for the given camera model
+  bool getInfo( const std::string& sBrand, const std::string& sModel, Datasheet& datasheetContent ) const
+  {
+    const std::string sKey = sBrand + '\n' + sModel;
+    std::unordered_map<std::string, size_t>::const_iterator it_cache = map_cache_.find( sKey );
+    size_t index;
+    if ( it_cache != map_cache_.end() )
+      index = it_cache->second;
+    else
+    {
+      index = find( sBrand, sModel );
+      map_cache_[ sKey ] = index;
+    }
+    if ( index == vec_database_.size() )
+      return false;
+    datasheetContent = vec_database_[index];
+    return true;
+  }
+
+private:
+  static std::string toLower( std::string s )
+  {
+    std::transform( s.begin(), s.end(), s.begin(), ::tolower );
+    return s;
+  }
+
+  // Index of the first datasheet matching the camera (database size if none):
+  // the datasheet brand is one of the brand words and every model word
+  // with a digit is one of the datasheet model words.
+  size_t find( const std::string& sBrand, const std::string& sModel ) const
+  {
+    std::vector<std::string> vec_model;
+    stl::split( sModel, " ", vec_model );
+    std::vector<std::string> vec_model_digit_words;
+    for ( size_t i = 0; i < vec_model.size(); ++i )
+    {
+      if ( std::find_if( vec_model[i].begin(), vec_model[i].end(), ::isdigit ) != vec_model[i].end() )
+        vec_model_digit_words.push_back( toLower( vec_model[i] ) );
+    }
+
+    size_t best = vec_database_.size();
+    std::vector<std::string> vec_brand;
+    stl::split( sBrand, " ", vec_brand );
+    for ( size_t i = 0; i < vec_brand.size(); ++i )
+    {
+      std::unordered_map<std::string, std::vector<size_t> >::const_iterator it_brand =
+        map_brand_datasheets_.find( toLower( vec_brand[i] ) );
+      if ( it_brand == map_brand_datasheets_.end() )
+        continue;
+      for ( size_t j = 0; j < it_brand->second.size() && it_brand->second[j] < best; ++j )
+      {
+        const std::set<std::string>& model_words = vec_model_words_[ it_brand->second[j] ];
+        bool isAllFind = true;
+        for ( size_t k = 0; k < vec_model_digit_words.size() && isAllFind; ++k )
+          isAllFind = model_words.count( vec_model_digit_words[k] ) > 0;
+        if ( isAllFind )
+          best = it_brand->second[j];
+      }
+    }
+    return best;
+  }
+
+  std::vector<Datasheet> vec_database_;
+  std::vector<std::set<std::string> > vec_model_words_;
+  std::unordered_map<std::string, std::vector<size_t> > map_brand_datasheets_;
+  mutable std::unordered_map<std::string, size_t> map_cache_;
+};
+
 #endif // PARSE_DATABASE_HPP
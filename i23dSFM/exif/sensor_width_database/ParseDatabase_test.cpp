@@ -107,6 +107,44 @@ TEST(Matching, ParseDatabaseCanon_EOS_1100D)
   EXPECT_EQ( 22.2, datasheet._sensorSize );
 }
 
+TEST(Matching, DatasheetDatabaseSameAsGetInfo)
+{
+  std::vector<Datasheet> vec_database;
+  const std::string sfileDatabase = stlplus::create_filespec( std::string(THIS_SOURCE_DIR), sDatabase );
+  EXPECT_TRUE( parseDatabase( sfileDatabase, vec_database ) );
+  const Datasheet_Database database( vec_database );
+
+  // Database cameras, with EXIF like brands and partial models
+  std::vector<std::pair<std::string, std::string> > vec_camera;
+  for ( size_t i = 0; i < vec_database.size(); ++i )
+  {
+    vec_camera.push_back( std::make_pair( vec_database[i]._brand, vec_database[i]._model ) );
+    vec_camera.push_back( std::make_pair( vec_database[i]._brand + " CORPORATION", vec_database[i]._model ) );
+    std::vector<std::string> vec_model;
+    stl::split( vec_database[i]._model, " ", vec_model );
+    vec_camera.push_back( std::make_pair( vec_database[i]._brand, vec_model.back() ) );
+  }
+  vec_camera.push_back( std::make_pair( "NotExistBrand", "NotExistModel" ) );
+  vec_camera.push_back( std::make_pair( "EASTMAN KODAK COMPANY", "KODAK Z612 ZOOM DIGITAL CAMERA" ) );
+
+  // Twice: the second lookup comes from the cache
+  for ( int pass = 0; pass < 2; ++pass )
+  {
+    for ( size_t i = 0; i < vec_camera.size(); ++i )
+    {
+      Datasheet expected, datasheet;
+      const bool bExpected = getInfo( vec_camera[i].first, vec_camera[i].second, vec_database, expected );
+      EXPECT_EQ( bExpected, database.getInfo( vec_camera[i].first, vec_camera[i].second, datasheet ) );
+      if ( bExpected )
+      {
+        EXPECT_EQ( expected._brand, datasheet._brand );
+        EXPECT_EQ( expected._model, datasheet._model );
+        EXPECT_EQ( expected._sensorSize, datasheet._sensorSize );
+      }
+    }
+  }
+}
+
 
 /* ************************************************************************* */
 int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
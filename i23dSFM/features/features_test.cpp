@@ -5,6 +5,7 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include "i23dSFM/features/features.hpp"
+#include "i23dSFM/features/regions_container.hpp"
 using namespace i23dSFM;
 using namespace i23dSFM::features;
 
@@ -101,6 +102,54 @@ TEST(descriptorIO, BINARY) {
   }
 }
 
+//Test the binary regions container (views added out of order, empty view)
+TEST(regionsContainer, BINARY) {
+  typedef Scalar_Regions<SIOPointFeature, unsigned char, 128> Regions_T;
+  Regions_T regions_a;
+  for(int i = 0; i < CARD; ++i)
+  {
+    regions_a.Features().push_back(SIOPointFeature(i, i*2, i%3, i*3, i*4));
+    Regions_T::DescriptorT desc;
+    for (int j = 0; j < 128; ++j)
+      desc[j] = static_cast<unsigned char>(i+j);
+    regions_a.Descriptors().push_back(desc);
+  }
+  const Regions_T regions_empty;
+
+  {
+    Regions_Container_Writer writer;
+    EXPECT_TRUE(writer.Open("tempRegions.bin", regions_a, 2));
+    EXPECT_TRUE(writer.Add(7, regions_a));
+    EXPECT_TRUE(writer.Add(3, regions_empty));
+    EXPECT_TRUE(writer.Close());
+  }
+
+  Regions_Container container;
+  EXPECT_TRUE(container.Open("tempRegions.bin", regions_a));
+  EXPECT_EQ(2, container.nb_views());
+
+  Packed_Regions packed;
+  EXPECT_FALSE(container.Get(5, packed));
+  EXPECT_TRUE(container.Get(3, packed));
+  EXPECT_EQ(0, packed.count);
+  EXPECT_TRUE(container.Get(7, packed));
+  EXPECT_EQ(CARD, packed.count);
+
+  Regions_T regions_read;
+  regions_read.LoadPacked(packed);
+  EXPECT_EQ(CARD, regions_read.RegionCount());
+  for(int i = 0; i < CARD; ++i) {
+    EXPECT_EQ(regions_a.Features()[i], regions_read.Features()[i]);
+    EXPECT_EQ(regions_a.Features()[i].semanticLabel(), regions_read.Features()[i].semanticLabel());
+    for (int j = 0; j < 128; ++j)
+      EXPECT_EQ(regions_a.Descriptors()[i][j], regions_read.Descriptors()[i][j]);
+  }
+
+  // A container of another regions type is rejected
+  const Binary_Regions<SIOPointFeature, 64> binary_regions;
+  EXPECT_FALSE(container.Open("tempRegions.bin", binary_regions));
+}
+
 /* ************************************************************************* */
 int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
 /* ************************************************************************* */
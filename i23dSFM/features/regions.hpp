@@ -13,12 +13,63 @@
 #include "i23dSFM/features/descriptor.hpp"
 #include "i23dSFM/matching/metric.hpp"
 #include "cereal/types/vector.hpp"
+#include <cstring>
 #include <string>
 #include <typeinfo>
 
 namespace i23dSFM {
 namespace features {
 
+/// Non-owning view on the regions of an image stored as packed arrays
+/// (structure of arrays, see regions_container.hpp)
+struct Packed_Regions
+{
+  size_t count;
+  const float * x;
+  const float * y;
+  const int32_t * semantic_label;
+  const float * scale;                // NULL if the features are not scale invariant
+  const float * orientation;          // NULL if the features are not oriented
+  const unsigned char * descriptors;  // count contiguous raw descriptors
+
+  Packed_Regions()
+    : count(0), x(NULL), y(NULL), semantic_label(NULL),
+      scale(NULL), orientation(NULL), descriptors(NULL) {}
+};
+
+/// Copy of the attributes of a feature from/to packed arrays
+/// (PointFeature: position & semantic label, SIOPointFeature: + scale & orientation)
+template<typename FeatT>
+struct Packed_Feature_Traits
+{
+  static const bool bScaleOrientation = false;
+  static void Set(FeatT & feat, const Packed_Regions & packed, size_t i)
+  {
+    feat = FeatT(packed.x[i], packed.y[i], packed.semantic_label[i]);
+  }
+  static void Get(const FeatT &, float & scale, float & orientation)
+  {
+    scale = orientation = 0.f;
+  }
+};
+
+template<>
+struct Packed_Feature_Traits<SIOPointFeature>
+{
+  static const bool bScaleOrientation = true;
+  static void Set(SIOPointFeature & feat, const Packed_Regions & packed, size_t i)
+  {
+    feat = SIOPointFeature(packed.x[i], packed.y[i], packed.semantic_label[i],
+      packed.scale ? packed.scale[i] : 0.f,
+      packed.orientation ? packed.orientation[i] : 0.f);
+  }
+  static void Get(const SIOPointFeature & feat, float & scale, float & orientation)
+  {
+    scale = feat.scale();
+    orientation = feat.orientation();
+  }
+};
+
 /// Describe an image a set of regions (position, ...) + attributes
 /// Each region is described by a set of attributes (descriptor)
 class Regions
@@ -43,6 +94,22 @@ public:
   virtual bool LoadFeatures(
     const std::string& sfileNameFeats) = 0;
 
+  //--
+  // Packed IO (see regions_container.hpp)
+  //--
+
+  /// Fill the regions with a copy of the packed arrays
+  virtual void LoadPacked(const Packed_Regions & packed) = 0;
+
+  /// Tell if the features have a scale and an orientation to store
+  virtual bool HasScaleOrientation() const = 0;
+
+  /// Scale and orientation of the Inth region (0 if not defined)
+  virtual void GetRegionScaleOrientation(size_t i, float & scale, float & orientation) const = 0;
+
+  /// Size in bytes of a descriptor
+  virtual size_t DescriptorByteSize() const = 0;
+
   //--
   //- Basic description of a descriptor [Type, Length]
   //--
@@ -130,6 +197,25 @@ public:
     return loadFeatsFromFile(sfileNameFeats, _vec_feats);
   }
 
+  void LoadPacked(const Packed_Regions & packed)
+  {
+    _vec_feats.resize(packed.count);
+    for (size_t i = 0; i < packed.count; ++i)
+      Packed_Feature_Traits<FeatT>::Set(_vec_feats[i], packed, i);
+    _vec_descs.resize(packed.count);
+    if (packed.count > 0 && packed.descriptors)
+      std::memcpy(_vec_descs[0].getData(), packed.descriptors, packed.count * DescriptorByteSize());
+  }
+
+  bool HasScaleOrientation() const {return Packed_Feature_Traits<FeatT>::bScaleOrientation;}
+
+  void GetRegionScaleOrientation(size_t i, float & scale, float & orientation) const
+  {
+    Packed_Feature_Traits<FeatT>::Get(_vec_feats[i], scale, orientation);
+  }
+
+  size_t DescriptorByteSize() const {return DescriptorT::static_size * sizeof(typename DescriptorT::bin_type);}
+
   PointFeatures GetRegionsPositions() const
   {
     return PointFeatures(_vec_feats.begin(), _vec_feats.end());
@@ -249,6 +335,25 @@ public:
     return loadFeatsFromFile(sfileNameFeats, _vec_feats);
   }
 
+  void LoadPacked(const Packed_Regions & packed)
+  {
+    _vec_feats.resize(packed.count);
+    for (size_t i = 0; i < packed.count; ++i)
+      Packed_Feature_Traits<FeatT>::Set(_vec_feats[i], packed, i);
+    _vec_descs.resize(packed.count);
+    if (packed.count > 0 && packed.descriptors)
+      std::memcpy(_vec_descs[0].getData(), packed.descriptors, packed.count * DescriptorByteSize());
+  }
+
+  bool HasScaleOrientation() const {return Packed_Feature_Traits<FeatT>::bScaleOrientation;}
+
+  void GetRegionScaleOrientation(size_t i, float & scale, float & orientation) const
+  {
+    Packed_Feature_Traits<FeatT>::Get(_vec_feats[i], scale, orientation);
+  }
+
+  size_t DescriptorByteSize() const {return DescriptorT::static_size * sizeof(typename DescriptorT::bin_type);}
+
   PointFeatures GetRegionsPositions() const
   {
     return PointFeatures(_vec_feats.begin(), _vec_feats.end());
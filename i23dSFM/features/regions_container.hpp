@@ -0,0 +1,349 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_FEATURES_REGIONS_CONTAINER_HPP
+#define I23DSFM_FEATURES_REGIONS_CONTAINER_HPP
+
+#include "i23dSFM/types.hpp"
+#include "i23dSFM/features/regions.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define I23DSFM_REGIONS_CONTAINER_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace i23dSFM {
+namespace features {
+
+// Binary container of the regions of all the views of a project.
+// It replaces the per view .feat (text) & .desc files by a single file that
+// is memory mapped, so that the regions are read without any parsing.
+//
+// Layout (little endian, every block is 64 bytes aligned):
+// - Regions_Container_Header
+// - offset table: one Regions_Container_Entry per view, sorted by view id
+// - one block per view:
+//   float x[n], float y[n], int32 semantic_label[n],
+//   [float scale[n], float orientation[n]] (if HAS_SCALE_ORIENTATION),
+//   padding, n descriptors (DescriptorByteSize() bytes each)
+
+/// Basename of the container file in a features directory ("regions.bin")
+static const char REGIONS_CONTAINER_BASENAME[] = "regions";
+
+static const char REGIONS_CONTAINER_MAGIC[8] = {'I','2','3','D','R','E','G','S'};
+static const uint32_t REGIONS_CONTAINER_VERSION = 1;
+static const size_t REGIONS_CONTAINER_ALIGNMENT = 64;
+
+struct Regions_Container_Header
+{
+  enum EFLAGS { HAS_SCALE_ORIENTATION = 1 };
+
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t descriptor_length;     // number of values of a descriptor
+  uint32_t descriptor_byte_size;  // size in bytes of a descriptor
+  uint64_t nb_views;
+  char type_id[32];               // Regions::Type_id() of the descriptor values
+};
+
+struct Regions_Container_Entry
+{
+  uint32_t view_id;
+  uint32_t reserved;
+  uint64_t region_count;
+  uint64_t block_offset; // from the beginning of the file
+};
+
+inline bool operator<(const Regions_Container_Entry & a, const Regions_Container_Entry & b)
+{
+  return a.view_id < b.view_id;
+}
+
+inline uint64_t Regions_Container_Align(uint64_t offset)
+{
+  return (offset + REGIONS_CONTAINER_ALIGNMENT - 1) / REGIONS_CONTAINER_ALIGNMENT * REGIONS_CONTAINER_ALIGNMENT;
+}
+
+/// Fill the header describing the regions type
+inline void Regions_Container_Init_Header
+(
+  const Regions & regions_type,
+  Regions_Container_Header & header
+)
+{
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, REGIONS_CONTAINER_MAGIC, sizeof(header.magic));
+  header.version = REGIONS_CONTAINER_VERSION;
+  header.flags = regions_type.HasScaleOrientation() ?
+    Regions_Container_Header::HAS_SCALE_ORIENTATION : 0;
+  header.descriptor_length = static_cast<uint32_t>(regions_type.DescriptorLength());
+  header.descriptor_byte_size = static_cast<uint32_t>(regions_type.DescriptorByteSize());
+  const std::string type_id = regions_type.Type_id() + (regions_type.IsBinary() ? "_binary" : "");
+  std::strncpy(header.type_id, type_id.c_str(), sizeof(header.type_id) - 1);
+}
+
+/// Write the regions of a set of views in a binary container.
+/// The views can be added in any order.
+class Regions_Container_Writer
+{
+public:
+  Regions_Container_Writer() : _nb_views(0) {}
+  ~Regions_Container_Writer() { Close(); }
+
+  /// Create the file; nb_views is the maximal number of views that will be added
+  bool Open(const std::string & filename, const Regions & regions_type, size_t nb_views)
+  {
+    _stream.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!_stream.is_open())
+      return false;
+    Regions_Container_Init_Header(regions_type, _header);
+    _nb_views = nb_views;
+    _entries.clear();
+    _entries.reserve(nb_views);
+    // Reserve the header & offset table, written once all the views are known
+    _offset = Regions_Container_Align(sizeof(Regions_Container_Header)
+      + nb_views * sizeof(Regions_Container_Entry));
+    _stream.seekp(_offset);
+    return _stream.good();
+  }
+
+  bool IsOpen() const { return _stream.is_open(); }
+
+  /// Append the regions of a view
+  bool Add(IndexT view_id, const Regions & regions)
+  {
+    if (!_stream.is_open() || _entries.size() >= _nb_views
+      || regions.DescriptorByteSize() != _header.descriptor_byte_size)
+      return false;
+
+    const size_t n = regions.RegionCount();
+    const bool bScaleOrientation =
+      (_header.flags & Regions_Container_Header::HAS_SCALE_ORIENTATION) != 0;
+    std::vector<float> x(n), y(n), scale, orientation;
+    std::vector<int32_t> semantic_label(n);
+    if (bScaleOrientation)
+    {
+      scale.resize(n);
+      orientation.resize(n);
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+      const Vec2 position = regions.GetRegionPosition(i);
+      x[i] = static_cast<float>(position(0));
+      y[i] = static_cast<float>(position(1));
+      semantic_label[i] = regions.GetRegionsPositionLabel(i);
+      if (bScaleOrientation)
+        regions.GetRegionScaleOrientation(i, scale[i], orientation[i]);
+    }
+
+    Regions_Container_Entry entry;
+    entry.view_id = view_id;
+    entry.reserved = 0;
+    entry.region_count = n;
+    entry.block_offset = _offset;
+    _entries.push_back(entry);
+
+    Write(x.data(), n * sizeof(float));
+    Write(y.data(), n * sizeof(float));
+    Write(semantic_label.data(), n * sizeof(int32_t));
+    if (bScaleOrientation)
+    {
+      Write(scale.data(), n * sizeof(float));
+      Write(orientation.data(), n * sizeof(float));
+    }
+    Pad();
+    if (n > 0)
+      Write(regions.DescriptorRawData(), n * _header.descriptor_byte_size);
+    Pad();
+    return _stream.good();
+  }
+
+  /// Write the header & offset table and close the file
+  bool Close()
+  {
+    if (!_stream.is_open())
+      return false;
+    std::sort(_entries.begin(), _entries.end());
+    _header.nb_views = _entries.size();
+    _stream.seekp(0);
+    _stream.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+    if (!_entries.empty())
+      _stream.write(reinterpret_cast<const char*>(&_entries[0]),
+        _entries.size() * sizeof(Regions_Container_Entry));
+    const bool bOk = _stream.good();
+    _stream.close();
+    return bOk;
+  }
+
+private:
+  void Write(const void * data, size_t size)
+  {
+    if (size > 0)
+      _stream.write(reinterpret_cast<const char*>(data), size);
+    _offset += size;
+  }
+
+  void Pad()
+  {
+    static const char zeros[REGIONS_CONTAINER_ALIGNMENT] = {0};
+    Write(zeros, Regions_Container_Align(_offset) - _offset);
+  }
+
+  std::ofstream _stream;
+  Regions_Container_Header _header;
+  std::vector<Regions_Container_Entry> _entries;
+  size_t _nb_views;
+  uint64_t _offset;
+};
+
+/// Read only access to a regions container.
+/// The file is memory mapped: the packed arrays are used in place.
+class Regions_Container
+{
+public:
+  Regions_Container() : _data(NULL), _size(0), _header(NULL), _entries(NULL) {}
+  ~Regions_Container() { Close(); }
+
+  /// Map the file and check it is a container of the regions_type regions
+  bool Open(const std::string & filename, const Regions & regions_type)
+  {
+    Close();
+    if (!Map(filename))
+      return false;
+
+    Regions_Container_Header expected;
+    Regions_Container_Init_Header(regions_type, expected);
+    _header = reinterpret_cast<const Regions_Container_Header*>(_data);
+    if (_size < sizeof(Regions_Container_Header)
+      || std::memcmp(_header->magic, REGIONS_CONTAINER_MAGIC, sizeof(_header->magic)) != 0
+      || _header->version != REGIONS_CONTAINER_VERSION
+      || _header->flags != expected.flags
+      || _header->descriptor_length != expected.descriptor_length
+      || _header->descriptor_byte_size != expected.descriptor_byte_size
+      || std::strncmp(_header->type_id, expected.type_id, sizeof(expected.type_id)) != 0
+      || _size < sizeof(Regions_Container_Header) + _header->nb_views * sizeof(Regions_Container_Entry))
+    {
+      std::cerr << "Invalid or incompatible regions container: " << filename << std::endl;
+      Close();
+      return false;
+    }
+    _entries = reinterpret_cast<const Regions_Container_Entry*>(_data + sizeof(Regions_Container_Header));
+    return true;
+  }
+
+  bool IsOpen() const { return _data != NULL; }
+
+  size_t nb_views() const { return _header ? _header->nb_views : 0; }
+
+  /// Packed regions of a view (return false if the view is not in the container)
+  bool Get(IndexT view_id, Packed_Regions & packed) const
+  {
+    if (!_entries)
+      return false;
+    Regions_Container_Entry key;
+    key.view_id = view_id;
+    const Regions_Container_Entry * end = _entries + _header->nb_views;
+    const Regions_Container_Entry * entry = std::lower_bound(_entries, end, key);
+    if (entry == end || entry->view_id != view_id)
+      return false;
+
+    const uint64_t n = entry->region_count;
+    const bool bScaleOrientation =
+      (_header->flags & Regions_Container_Header::HAS_SCALE_ORIENTATION) != 0;
+    const uint64_t features_size = n * (bScaleOrientation ? 5 : 3) * sizeof(float);
+    const uint64_t descriptors_offset = Regions_Container_Align(entry->block_offset + features_size);
+    if (descriptors_offset + n * _header->descriptor_byte_size > _size)
+      return false;
+
+    const unsigned char * block = _data + entry->block_offset;
+    packed.count = n;
+    packed.x = reinterpret_cast<const float*>(block);
+    packed.y = packed.x + n;
+    packed.semantic_label = reinterpret_cast<const int32_t*>(packed.y + n);
+    packed.scale = bScaleOrientation ? reinterpret_cast<const float*>(packed.semantic_label + n) : NULL;
+    packed.orientation = bScaleOrientation ? packed.scale + n : NULL;
+    packed.descriptors = _data + descriptors_offset;
+    return true;
+  }
+
+  void Close()
+  {
+#ifdef I23DSFM_REGIONS_CONTAINER_NO_MMAP
+    std::vector<unsigned char>().swap(_buffer);
+#else
+    if (_data)
+      munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+    _data = NULL;
+    _size = 0;
+    _header = NULL;
+    _entries = NULL;
+  }
+
+private:
+  bool Map(const std::string & filename)
+  {
+#ifdef I23DSFM_REGIONS_CONTAINER_NO_MMAP
+    // No memory mapping: read the whole file
+    std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    if (!stream.is_open())
+      return false;
+    _buffer.resize(static_cast<size_t>(stream.tellg()));
+    stream.seekg(0);
+    if (_buffer.empty() || !stream.read(reinterpret_cast<char*>(&_buffer[0]), _buffer.size()))
+      return false;
+    _data = &_buffer[0];
+    _size = _buffer.size();
+    return true;
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+      close(fd);
+      return false;
+    }
+    void * data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+      return false;
+    _data = static_cast<const unsigned char*>(data);
+    _size = file_stat.st_size;
+    return true;
+#endif
+  }
+
+  Regions_Container(const Regions_Container &);
+  Regions_Container & operator=(const Regions_Container &);
+
+  const unsigned char * _data;
+  size_t _size;
+  const Regions_Container_Header * _header;
+  const Regions_Container_Entry * _entries;
+#ifdef I23DSFM_REGIONS_CONTAINER_NO_MMAP
+  std::vector<unsigned char> _buffer;
+#endif
+};
+
+} // namespace features
+} // namespace i23dSFM
+
+#endif // I23DSFM_FEATURES_REGIONS_CONTAINER_HPP
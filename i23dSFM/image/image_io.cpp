@@ -6,6 +6,7 @@
 
 #include "i23dSFM/image/image.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <cmath>
@@ -93,6 +94,97 @@ int WriteImage(const char * filename,
   };
 }
 
+/// Box filter downscaling of an image by an integer factor
+/// (the partial blocks of the right and bottom borders are averaged as well)
+static void BoxDownscale(const vector<unsigned char> & in,
+                         int w,
+                         int h,
+                         int depth,
+                         int factor,
+                         vector<unsigned char> * out,
+                         int * w_out,
+                         int * h_out) {
+  *w_out = (w + factor - 1) / factor;
+  *h_out = (h + factor - 1) / factor;
+  out->resize((*w_out) * (*h_out) * depth);
+  vector<unsigned int> sum((*w_out) * depth);
+  for (int y_out = 0; y_out < *h_out; ++y_out) {
+    std::fill(sum.begin(), sum.end(), 0);
+    const int y_begin = y_out * factor, y_end = std::min(h, y_begin + factor);
+    for (int y = y_begin; y < y_end; ++y) {
+      const unsigned char * row = &in[y * w * depth];
+      for (int x = 0; x < w; ++x)
+        for (int c = 0; c < depth; ++c)
+          sum[(x / factor) * depth + c] += row[x * depth + c];
+    }
+    unsigned char * row_out = &(*out)[y_out * (*w_out) * depth];
+    for (int x_out = 0; x_out < *w_out; ++x_out) {
+      const int nb_pixels = (y_end - y_begin) * (std::min(w, (x_out + 1) * factor) - x_out * factor);
+      for (int c = 0; c < depth; ++c)
+        row_out[x_out * depth + c] = static_cast<unsigned char>(
+          (sum[x_out * depth + c] + nb_pixels / 2) / nb_pixels);
+    }
+  }
+}
+
+int ReadImage(const char *filename,
+              vector<unsigned char> * ptr,
+              int * w,
+              int * h,
+              int * depth,
+              int scale_denom,
+              int row_begin,
+              int row_end) {
+  if (scale_denom != 1 && scale_denom != 2 && scale_denom != 4 && scale_denom != 8) {
+    cerr << "Error: The scale denominator should be 1, 2, 4 or 8";
+    return 0;
+  }
+  row_begin = std::max(0, row_begin);
+  const Format f = GetFormat(filename);
+  if (f == Jpg) // native reduced decoding
+    return ReadJpg(filename, ptr, w, h, depth, scale_denom, row_begin, row_end);
+
+  // Decode the corresponding rows of the full resolution image
+  const int full_row_begin = row_begin * scale_denom;
+  const int full_row_end = (row_end < 0) ? -1 : row_end * scale_denom;
+  vector<unsigned char> full_ptr;
+  int full_w, full_h, full_depth;
+  int res = 0;
+  if (f == Png) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+      cerr << "Error: Couldn't open " << filename << " fopen returned 0";
+      return 0;
+    }
+    res = ReadPngStream(file, &full_ptr, &full_w, &full_h, &full_depth,
+      full_row_begin, full_row_end);
+    fclose(file);
+  }
+  else {
+    res = ReadImage(filename, &full_ptr, &full_w, &full_h, &full_depth);
+    if (res == 1) {
+      const int begin = std::min(full_row_begin, full_h);
+      const int end = (full_row_end < 0) ? full_h : std::max(begin, std::min(full_row_end, full_h));
+      const size_t row_size = full_w * full_depth;
+      full_ptr.erase(full_ptr.begin() + end * row_size, full_ptr.end());
+      full_ptr.erase(full_ptr.begin(), full_ptr.begin() + begin * row_size);
+      full_h = end - begin;
+    }
+  }
+  if (res != 1)
+    return res;
+
+  *depth = full_depth;
+  if (scale_denom == 1) {
+    ptr->swap(full_ptr);
+    *w = full_w;
+    *h = full_h;
+  }
+  else
+    BoxDownscale(full_ptr, full_w, full_h, full_depth, scale_denom, ptr, w, h);
+  return 1;
+}
+
 int ReadJpg(const char * filename,
             vector<unsigned char> * ptr,
             int * w,
@@ -109,6 +201,25 @@ int ReadJpg(const char * filename,
   return res;
 }
 
+int ReadJpg(const char * filename,
+            vector<unsigned char> * ptr,
+            int * w,
+            int * h,
+            int * depth,
+            int scale_denom,
+            int row_begin,
+            int row_end) {
+
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+    cerr << "Error: Couldn't open " << filename << " fopen returned 0";
+    return 0;
+  }
+  int res = ReadJpgStream(file, ptr, w, h, depth, scale_denom, row_begin, row_end);
+  fclose(file);
+  return res;
+}
+
 struct my_error_mgr {
   struct jpeg_error_mgr pub;
   jmp_buf setjmp_buffer;
@@ -127,10 +238,22 @@ int ReadJpgStream(FILE * file,
                   int * w,
                   int * h,
                   int * depth) {
+  return ReadJpgStream(file, ptr, w, h, depth, 1, 0, -1);
+}
+
+int ReadJpgStream(FILE * file,
+                  vector<unsigned char> * ptr,
+                  int * w,
+                  int * h,
+                  int * depth,
+                  int scale_denom,
+                  int row_begin,
+                  int row_end) {
   jpeg_decompress_struct cinfo;
   struct my_error_mgr jerr;
   cinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.error_exit = &jpeg_error;
+  vector<unsigned char> skipped_row;
 
   if (setjmp(jerr.setjmp_buffer)) {
     cerr << "Error JPG: Failed to decompress.";
@@ -141,24 +264,45 @@ int ReadJpgStream(FILE * file,
   jpeg_create_decompress(&cinfo);
   jpeg_stdio_src(&cinfo, file);
   jpeg_read_header(&cinfo, TRUE);
+  // DCT domain downscaling (1/2, 1/4, 1/8)
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = scale_denom;
   jpeg_start_decompress(&cinfo);
 
   int row_stride = cinfo.output_width * cinfo.output_components;
+  const JDIMENSION begin = std::min<JDIMENSION>(std::max(0, row_begin), cinfo.output_height);
+  const JDIMENSION end = (row_end < 0) ? cinfo.output_height :
+    std::max(begin, std::min<JDIMENSION>(row_end, cinfo.output_height));
 
-  *h = cinfo.output_height;
+  *h = end - begin;
   *w = cinfo.output_width;
   *depth = cinfo.output_components;
   ptr->resize((*h)*(*w)*(*depth));
 
-  unsigned char *ptrCpy = &(*ptr)[0];
+  // Skip the rows before the range
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER) && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+  if (begin > 0)
+    jpeg_skip_scanlines(&cinfo, begin);
+#endif
+  skipped_row.resize(row_stride);
+  while (cinfo.output_scanline < begin) {
+    JSAMPROW scanline[1] = { &skipped_row[0] };
+    jpeg_read_scanlines(&cinfo, scanline, 1);
+  }
+
+  unsigned char *ptrCpy = ptr->empty() ? NULL : &(*ptr)[0];
 
-  while (cinfo.output_scanline < cinfo.output_height) {
+  while (cinfo.output_scanline < end) {
     JSAMPROW scanline[1] = { ptrCpy };
     jpeg_read_scanlines(&cinfo, scanline, 1);
     ptrCpy += row_stride;
   }
 
-  jpeg_finish_decompress(&cinfo);
+  // Stop the decoding after the last requested row
+  if (cinfo.output_scanline < cinfo.output_height)
+    jpeg_abort_decompress(&cinfo);
+  else
+    jpeg_finish_decompress(&cinfo);
   jpeg_destroy_decompress(&cinfo);
   return 1;
 }
@@ -255,6 +399,16 @@ int ReadPngStream(FILE *file,
                   int * w,
                   int * h,
                   int * depth)  {
+  return ReadPngStream(file, ptr, w, h, depth, 0, -1);
+}
+
+int ReadPngStream(FILE *file,
+                  vector<unsigned char> * ptr,
+                  int * w,
+                  int * h,
+                  int * depth,
+                  int row_begin,
+                  int row_end)  {
 
   // first check the eight byte PNG signature
   png_byte  pbSig[8];
@@ -312,6 +466,9 @@ int ReadPngStream(FILE *file,
   if (png_get_gAMA(png_ptr, info_ptr, &dGamma))
     png_set_gamma(png_ptr, (double) 2.2, dGamma);
 
+  // interlaced images are decoded in several passes over the whole image
+  const int nb_passes = png_set_interlace_handling(png_ptr);
+
   // after the transformations are registered, update info_ptr data
 
   png_read_update_info(png_ptr, info_ptr);
@@ -325,33 +482,62 @@ int ReadPngStream(FILE *file,
   png_uint_32         ulRowBytes;
   ulRowBytes = png_get_rowbytes(png_ptr, info_ptr);
 
-  // and allocate memory for an array of row-pointers
-  png_byte   **ppbRowPointers = NULL;
-  if ((ppbRowPointers = (png_bytepp) malloc(hPNG
-    * sizeof(png_bytep))) == NULL)
-  {
-    std::cerr << "PNG: out of memory" << std::endl;
-    return 0;
-  }
+  // rows range to decode
+  const png_uint_32 begin = std::min<png_uint_32>(std::max(0, row_begin), hPNG);
+  const png_uint_32 end = (row_end < 0) ? hPNG :
+    std::max(begin, std::min<png_uint_32>(row_end, hPNG));
 
   *w = wPNG;
-  *h = hPNG;
+  *h = end - begin;
   *depth = png_get_channels(png_ptr, info_ptr);
 
   // now we can allocate memory to store the image
   ptr->resize((*h)*(*w)*(*depth));
 
-  // set the individual row-pointers to point at the correct offsets
-  for (int i = 0; i < hPNG; i++)
-    ppbRowPointers[i] = &((*ptr)[0]) + i * ulRowBytes;
+  if (nb_passes > 1 || (begin == 0 && end == hPNG))
+  {
+    // and allocate memory for an array of row-pointers
+    png_byte   **ppbRowPointers = NULL;
+    if ((ppbRowPointers = (png_bytepp) malloc(hPNG
+      * sizeof(png_bytep))) == NULL)
+    {
+      std::cerr << "PNG: out of memory" << std::endl;
+      png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+      return 0;
+    }
 
-  // now we can go ahead and just read the whole image
-  png_read_image(png_ptr, ppbRowPointers);
+    // set the individual row-pointers to point at the correct offsets
+    // (the rows outside of the range are decoded in a temporary buffer)
+    vector<unsigned char> full_image;
+    if (begin != 0 || end != hPNG)
+      full_image.resize(hPNG * ulRowBytes);
+    unsigned char * ptrImage = full_image.empty() ? &((*ptr)[0]) : &full_image[0];
+    for (png_uint_32 i = 0; i < hPNG; i++)
+      ppbRowPointers[i] = ptrImage + i * ulRowBytes;
 
-  // read the additional chunks in the PNG file (not really needed)
-  png_read_end(png_ptr, NULL);
+    // now we can go ahead and just read the whole image
+    png_read_image(png_ptr, ppbRowPointers);
 
-  free (ppbRowPointers);
+    // read the additional chunks in the PNG file (not really needed)
+    png_read_end(png_ptr, NULL);
+
+    free (ppbRowPointers);
+
+    if (!full_image.empty())
+      std::copy(full_image.begin() + begin * ulRowBytes, full_image.begin() + end * ulRowBytes,
+        ptr->begin());
+  }
+  else
+  {
+    // read the rows one by one and stop after the last requested row
+    vector<png_byte> skipped_row(ulRowBytes);
+    for (png_uint_32 i = 0; i < begin; i++)
+      png_read_row(png_ptr, &skipped_row[0], NULL);
+    for (png_uint_32 i = begin; i < end; i++)
+      png_read_row(png_ptr, &((*ptr)[0]) + (i - begin) * ulRowBytes, NULL);
+    if (end == hPNG)
+      png_read_end(png_ptr, NULL);
+  }
 
   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
   return 1;
@@ -659,6 +845,7 @@ bool Read_PNG_ImageHeader(const char * filename, ImageHeader * imgheader)
   size_t readcnt = fread(pbSig, 1, 8, file);
   (void) readcnt;
   if (png_sig_cmp(pbSig, 0, 8)) {
+    fclose(file);
     return false;
   }
 
@@ -667,12 +854,14 @@ bool Read_PNG_ImageHeader(const char * filename, ImageHeader * imgheader)
   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
     (png_error_ptr)NULL, (png_error_ptr)NULL);
   if (!png_ptr) {
+    fclose(file);
     return false;
   }
   png_infop info_ptr = NULL;
   info_ptr = png_create_info_struct(png_ptr);
   if (!info_ptr)  {
     png_destroy_read_struct(&png_ptr, NULL, NULL);
+    fclose(file);
     return false;
   }
 
@@ -695,9 +884,20 @@ bool Read_PNG_ImageHeader(const char * filename, ImageHeader * imgheader)
   {
     imgheader->width = wPNG;
     imgheader->height = hPNG;
+    // number of channel once expanded as in ReadPngStream
+    const bool bTransparency = png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS) != 0;
+    switch (iColorType)
+    {
+      case PNG_COLOR_TYPE_GRAY: imgheader->depth = bTransparency ? 2 : 1; break;
+      case PNG_COLOR_TYPE_GRAY_ALPHA: imgheader->depth = 2; break;
+      case PNG_COLOR_TYPE_PALETTE:
+      case PNG_COLOR_TYPE_RGB: imgheader->depth = bTransparency ? 4 : 3; break;
+      default: imgheader->depth = 4; break;
+    }
     bStatus = true;
   }
 
+  png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
   fclose(file);
   return bStatus;
 }
@@ -719,20 +919,24 @@ bool Read_JPG_ImageHeader(const char * filename, ImageHeader * imgheader)
 
   if (setjmp(jerr.setjmp_buffer)) {
     jpeg_destroy_decompress(&cinfo);
+    fclose(file);
     return false;
   }
 
   jpeg_create_decompress(&cinfo);
   jpeg_stdio_src(&cinfo, file);
   jpeg_read_header(&cinfo, TRUE);
-  jpeg_start_decompress(&cinfo);
+  // output size and channels without decoding
+  jpeg_calc_output_dimensions(&cinfo);
 
   if (imgheader)
   {
     imgheader->width = cinfo.output_width;
     imgheader->height = cinfo.output_height;
+    imgheader->depth = cinfo.output_components;
     bStatus = true;
   }
+  jpeg_destroy_decompress(&cinfo);
   fclose(file);
   return bStatus;
 }
@@ -755,6 +959,7 @@ bool Read_PNM_ImageHeader(const char * filename, ImageHeader * imgheader)
   // Check magic number.
   res = size_t(fscanf(file, "P%d", &magicnumber));
   if (res != 1) {
+    fclose(file);
     return false;
   }
   // Test if we have a Gray or RGB image, else return false
@@ -764,6 +969,7 @@ bool Read_PNM_ImageHeader(const char * filename, ImageHeader * imgheader)
     case 6:
       break;
     default:
+      fclose(file);
       return false;
   }
 
@@ -805,14 +1011,15 @@ bool Read_PNM_ImageHeader(const char * filename, ImageHeader * imgheader)
       return false;
     }
   }
+  fclose(file);
   if (imgheader)
   {
     // Save value and return
     imgheader->width = values[0];
     imgheader->height = values[1];
+    imgheader->depth = (magicnumber == 5) ? 1 : 3;
     return true;
   }
-  fclose(file);
   return false;
 }
 
@@ -829,6 +1036,10 @@ bool Read_TIFF_ImageHeader(const char * filename, ImageHeader * imgheader)
   {
     TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &imgheader->width);
     TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &imgheader->height);
+    uint16 bps = 0, spp = 0;
+    TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &bps);
+    TIFFGetField(tiff, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    imgheader->depth = bps * spp / 8;
     bStatus = true;
   }
 
@@ -30,6 +30,19 @@ int WriteImage(const char *, const Image<T>&);
 /// Unsigned char specialization (The memory pointer must be null as input)
 int ReadImage(const char *, std::vector<unsigned char> *, int * w, int * h, int * depth);
 
+/// Reduced decoding (unsigned char specialization):
+/// - the image is decoded at 1/scale_denom of its resolution (1, 2, 4 or 8),
+///   JPEG images use the DCT scaling of libjpeg, other formats are box filtered,
+/// - only the rows [row_begin, row_end) of the reduced image are returned
+///   (row_end < 0: up to the last row), the decoding stops after row_end.
+/// w and h are the size of the returned array (h: the number of returned rows).
+int ReadImage(const char *, std::vector<unsigned char> *, int * w, int * h, int * depth,
+  int scale_denom, int row_begin = 0, int row_end = -1);
+
+/// Load an image<T> with a reduced decoding (see the unsigned char version)
+template<typename T>
+int ReadImage(const char *, Image<T> *, int scale_denom, int row_begin = 0, int row_end = -1);
+
 /// Unsigned char specialization
 int WriteImage(const char *, const std::vector<unsigned char>& array, int w, int h, int depth);
 
@@ -38,6 +51,9 @@ int WriteImage(const char *, const std::vector<unsigned char>& array, int w, int
 //--
 int ReadPng(const char *, std::vector<unsigned char> *, int * w, int * h, int * depth);
 int ReadPngStream(FILE *, std::vector<unsigned char> *, int * w, int * h, int * depth);
+/// Decode only the rows [row_begin, row_end) (row_end < 0: up to the last row)
+int ReadPngStream(FILE *, std::vector<unsigned char> *, int * w, int * h, int * depth,
+  int row_begin, int row_end);
 int WritePng(const char *, const std::vector<unsigned char>& array, int w, int h, int depth);
 int WritePngStream(FILE *,  const std::vector<unsigned char>& array, int w, int h, int depth);
 
@@ -46,6 +62,10 @@ int WritePngStream(FILE *,  const std::vector<unsigned char>& array, int w, int
 //--
 int ReadJpg(const char *, std::vector<unsigned char> *, int * w, int * h, int * depth);
 int ReadJpgStream(FILE *, std::vector<unsigned char> *, int * w, int * h, int * depth);
+int ReadJpg(const char *, std::vector<unsigned char> *, int * w, int * h, int * depth,
+  int scale_denom, int row_begin = 0, int row_end = -1);
+int ReadJpgStream(FILE *, std::vector<unsigned char> *, int * w, int * h, int * depth,
+  int scale_denom, int row_begin = 0, int row_end = -1);
 
 template<typename T>
 int WriteJpg(const char *, const Image<T>&, int quality=90);
@@ -68,14 +88,17 @@ int WritePnmStream(FILE *,  const std::vector<unsigned char>& array, int w, int
 int ReadTiff(const char *, std::vector<unsigned char> *, int * w, int * h, int * depth);
 int WriteTiff(const char *, const std::vector<unsigned char>& array, int w, int h, int depth);
 
-// ImageHeader: structure used to know the size of an image
-// Note: can be extented later to support the pixel data type and the number of channel:
+// ImageHeader: structure used to know the size of an image (read without
+// decoding the pixels) and the number of channel of the decoded image:
 // i.e: - unsigned char, 1 => gray image
 //      - unsigned char, 3 => rgb image
 //      - unsigned char, 4 => rgba image
 struct ImageHeader
 {
   int width, height;
+  int depth;
+
+  ImageHeader() : width(0), height(0), depth(0) {}
 };
 
 bool ReadImageHeader(const char *, ImageHeader *);
@@ -157,6 +180,47 @@ inline int ReadImage(const char * path, Image<RGBAColor> * im)
   return res;
 }
 
+/// Copy a raw unsigned char array (gray, rgb or rgba) to an image<T>
+template<typename T>
+inline int RawArrayToImage(std::vector<unsigned char> & ptr, int w, int h, int depth, Image<T> * im)
+{
+  if (depth == 1) {
+    Image<unsigned char> grayIm;
+    grayIm = Eigen::Map<Image<unsigned char>::Base>(&ptr[0], h, w);
+    ConvertPixelType(grayIm, im);
+  }
+  else
+  if (depth == 3) {
+    Image<RGBColor> rgbColIm;
+    rgbColIm = Eigen::Map<Image<RGBColor>::Base>((RGBColor*) &ptr[0], h, w);
+    ConvertPixelType(rgbColIm, im);
+  }
+  else
+  if (depth == 4) {
+    Image<RGBAColor> rgbaColIm;
+    rgbaColIm = Eigen::Map<Image<RGBAColor>::Base>((RGBAColor*) &ptr[0], h, w);
+    ConvertPixelType(rgbaColIm, im);
+  }
+  else
+    return 0;
+  return 1;
+}
+
+template<typename T>
+int ReadImage(const char * path, Image<T> * im, int scale_denom, int row_begin, int row_end)
+{
+  std::vector<unsigned char> ptr;
+  int w, h, depth;
+  const int res = ReadImage(path, &ptr, &w, &h, &depth, scale_denom, row_begin, row_end);
+  if (res != 1)
+    return 0;
+  if (ptr.empty()) {
+    (*im) = Image<T>();
+    return res;
+  }
+  return RawArrayToImage(ptr, w, h, depth, im);
+}
+
 //--------
 //-- Image Writing
 //--------
@@ -257,6 +257,104 @@ TEST(ImageHeader, AllFormats) {
   }
 }
 
+TEST(ImageHeader, Depth) {
+
+  const std::vector<std::string> ext_Type = {"jpg", "png", "pgm"};
+  for (int i=0; i < ext_Type.size(); ++i)
+  {
+    const std::string filename = "img_depth." + ext_Type[i];
+    Image<unsigned char> gray_image(10, 8);
+    EXPECT_TRUE(WriteImage(filename.c_str(), gray_image));
+    ImageHeader imgHeader;
+    EXPECT_TRUE(ReadImageHeader(filename.c_str(), &imgHeader));
+    EXPECT_EQ(10, imgHeader.width);
+    EXPECT_EQ(8, imgHeader.height);
+    EXPECT_EQ(1, imgHeader.depth);
+    remove(filename.c_str());
+  }
+  {
+    Image<RGBColor> rgb_image(10, 8);
+    EXPECT_TRUE(WriteImage("img_depth.png", rgb_image));
+    ImageHeader imgHeader;
+    EXPECT_TRUE(ReadImageHeader("img_depth.png", &imgHeader));
+    EXPECT_EQ(3, imgHeader.depth);
+    remove("img_depth.png");
+  }
+}
+
+// Gradient image with some uniform blocks
+static Image<RGBColor> Make_Test_Image(int w, int h)
+{
+  Image<RGBColor> image(w, h);
+  for (int y = 0; y < h; ++y)
+    for (int x = 0; x < w; ++x)
+      image(y, x) = RGBColor((x / 8) * 20, (y / 8) * 30, 128);
+  return image;
+}
+
+TEST(ImageIOTest, Reduced_Png) {
+  const Image<RGBColor> image = Make_Test_Image(37, 21);
+  EXPECT_TRUE(WriteImage("reduced.png", image));
+
+  // Full resolution rows range
+  Image<RGBColor> rows_image;
+  EXPECT_TRUE(ReadImage("reduced.png", &rows_image, 1, 5, 12));
+  EXPECT_EQ(37, rows_image.Width());
+  EXPECT_EQ(7, rows_image.Height());
+  EXPECT_TRUE(rows_image.GetMat() == image.GetMat().block(5, 0, 7, 37));
+
+  // Half resolution (box filter, partial border blocks)
+  Image<RGBColor> half_image;
+  EXPECT_TRUE(ReadImage("reduced.png", &half_image, 2));
+  EXPECT_EQ(19, half_image.Width());
+  EXPECT_EQ(11, half_image.Height());
+  EXPECT_EQ(image(2, 2), half_image(1, 1));
+  EXPECT_EQ(image(20, 36), half_image(10, 18));
+
+  // Half resolution rows range, the rows after the range are not decoded
+  Image<RGBColor> half_rows_image;
+  EXPECT_TRUE(ReadImage("reduced.png", &half_rows_image, 2, 3, 7));
+  EXPECT_EQ(4, half_rows_image.Height());
+  EXPECT_TRUE(half_rows_image.GetMat() == half_image.GetMat().block(3, 0, 4, 19));
+
+  // Out of range rows
+  EXPECT_TRUE(ReadImage("reduced.png", &half_rows_image, 2, 20));
+  EXPECT_EQ(0, half_rows_image.Height());
+  // Invalid scale
+  EXPECT_FALSE(ReadImage("reduced.png", &half_image, 3));
+  remove("reduced.png");
+}
+
+TEST(ImageIOTest, Reduced_Jpg) {
+  const Image<RGBColor> image = Make_Test_Image(64, 48);
+  EXPECT_TRUE(WriteJpg("reduced.jpg", image, 100));
+
+  Image<RGBColor> full_image;
+  EXPECT_TRUE(ReadImage("reduced.jpg", &full_image));
+  for (int scale = 1; scale <= 8; scale *= 2)
+  {
+    // DCT scaling
+    Image<RGBColor> reduced_image;
+    EXPECT_TRUE(ReadImage("reduced.jpg", &reduced_image, scale));
+    EXPECT_EQ(64 / scale, reduced_image.Width());
+    EXPECT_EQ(48 / scale, reduced_image.Height());
+    // Center of an uniform 8x8 block
+    EXPECT_NEAR(full_image(20, 20).g(), reduced_image(20 / scale, 20 / scale).g(), 4);
+
+    // Rows range
+    const int row_begin = 2 / scale, row_end = 40 / scale;
+    Image<unsigned char> reduced_gray, rows_gray;
+    EXPECT_TRUE(ReadImage("reduced.jpg", &reduced_gray, scale));
+    EXPECT_TRUE(ReadImage("reduced.jpg", &rows_gray, scale, row_begin, row_end));
+    EXPECT_EQ(64 / scale, rows_gray.Width());
+    EXPECT_EQ(row_end - row_begin, rows_gray.Height());
+    for (int y = 0; y < rows_gray.Height(); ++y)
+      for (int x = 0; x < rows_gray.Width(); ++x)
+        EXPECT_NEAR(reduced_gray(y + row_begin, x), rows_gray(y, x), 2);
+  }
+  remove("reduced.jpg");
+}
+
 /* ************************************************************************* */
 int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
 /* ************************************************************************* */
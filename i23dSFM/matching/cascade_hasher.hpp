@@ -59,21 +59,20 @@
 
 #include "i23dSFM/numeric/numeric.h"
 #include "i23dSFM/matching/metric.hpp"
+#include "i23dSFM/matching/cascade_hasher_kernels.hpp"
 #include "i23dSFM/matching/indMatch.hpp"
-#include "i23dSFM/stl/dynamic_bitset.hpp"
+#include "i23dSFM/matching/semantic_label_compatibility.hpp"
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <type_traits>
 #include <random>
 #include <cmath>
 
-#define USE_SEMANTIC_LABEL 1 // added by chenyu
-
 namespace i23dSFM {
 namespace matching {
 
 struct HashedDescription {
-  // Hash code generated by the primary hashing function.
-  stl::dynamic_bitset hash_code;
-
   // Each bucket_ids[x] = y means the descriptor belongs to bucket y in bucket
   // group x.
   std::vector<uint16_t> bucket_ids;
@@ -83,9 +82,23 @@ struct HashedDescriptions{
   // The hash information.
   std::vector<HashedDescription> hashed_desc;
 
+  // Hash codes generated by the primary hashing function, packed contiguously
+  // (nb_hash_words 64 bit words per description, bit j of the code of the
+  // description i is bit j % 64 of hash_codes[i * nb_hash_words + j / 64]).
+  std::vector<uint64_t> hash_codes;
+  size_t nb_hash_words = 0;
+
   typedef std::vector<int> Bucket;
   // buckets[bucket_group][bucket_id] = bucket (container of description ids).
   std::vector<std::vector<Bucket> > buckets;
+
+  // Semantic label of each description (empty if the descriptions are not labelled).
+  std::vector<int> semantic_labels;
+  // label_buckets[label][bucket_group][bucket_id] = bucket restricted to the
+  // descriptions that carry this semantic label.
+  std::map<int, std::vector<std::vector<Bucket> > > label_buckets;
+
+  bool IsSemanticPartitioned() const { return !label_buckets.empty(); }
 };
 
 // This hasher will hash descriptors with a two-step hashing system:
@@ -200,6 +213,9 @@ public:
       // Allocate space for hash codes.
       const typename MatrixT::Index nbDescriptions = descriptions.rows();
       hashed_descriptions.hashed_desc.resize(nbDescriptions);
+      hashed_descriptions.nb_hash_words = (nb_hash_code_ + 63) / 64;
+      hashed_descriptions.hash_codes.assign(
+        nbDescriptions * hashed_descriptions.nb_hash_words, 0);
       Eigen::VectorXf descriptor(descriptions.cols());
       for (int i = 0; i < nbDescriptions; ++i)
       {
@@ -212,14 +228,14 @@ public:
         }
         descriptor -= zero_mean_descriptor;
 
-        auto& hash_code = hashed_descriptions.hashed_desc[i].hash_code;
-        hash_code = stl::dynamic_bitset(descriptions.cols());
-
         // Compute hash code.
         const Eigen::VectorXf primary_projection = primary_hash_projection_ * descriptor;
+        uint64_t * packed_code =
+          &hashed_descriptions.hash_codes[i * hashed_descriptions.nb_hash_words];
         for (int j = 0; j < nb_hash_code_; ++j)
         {
-          hash_code[j] = primary_projection(j) > 0;
+          if (primary_projection(j) > 0)
+            packed_code[j / 64] |= uint64_t(1) << (j % 64);
         }
 
         // Determine the bucket index for each group.
@@ -255,8 +271,49 @@ public:
     return hashed_descriptions;
   }
 
+  // Same as above, but the buckets are also partitioned by semantic label
+  // (one label per description row), so that the retrieval step can only
+  // visit the descriptions that have a compatible label.
+  template <typename MatrixT>
+  HashedDescriptions CreateHashedDescriptions
+  (
+    const MatrixT & descriptions,
+    const Eigen::VectorXf & zero_mean_descriptor,
+    const std::vector<int> & semantic_labels
+  ) const
+  {
+    HashedDescriptions hashed_descriptions =
+      CreateHashedDescriptions(descriptions, zero_mean_descriptor);
+    if (hashed_descriptions.hashed_desc.empty() ||
+        semantic_labels.size() != hashed_descriptions.hashed_desc.size())
+    {
+      return hashed_descriptions;
+    }
+
+    hashed_descriptions.semantic_labels = semantic_labels;
+    for (int j = 0; j < hashed_descriptions.hashed_desc.size(); ++j)
+    {
+      std::vector<std::vector<HashedDescriptions::Bucket> > & label_buckets =
+        hashed_descriptions.label_buckets[semantic_labels[j]];
+      if (label_buckets.empty())
+      {
+        label_buckets.resize(nb_bucket_groups_,
+          std::vector<HashedDescriptions::Bucket>(nb_buckets_per_group_));
+      }
+      for (int i = 0; i < nb_bucket_groups_; ++i)
+      {
+        const uint16_t bucket_id = hashed_descriptions.hashed_desc[j].bucket_ids[i];
+        label_buckets[i][bucket_id].push_back(j);
+      }
+    }
+    return hashed_descriptions;
+  }
+
   // Matches two collection of hashed descriptions with a fast matching scheme
   // based on the hash codes previously generated.
+  // If a label compatibility table is provided and both collections are
+  // partitioned by semantic label, a query description is only compared to the
+  // descriptions that have a compatible label.
   template <typename MatrixT, typename DistanceType>
   void Match_HashedDescriptions
   (
@@ -266,27 +323,40 @@ public:
     const MatrixT & descriptions2,
     IndMatches * pvec_indices,
     std::vector<DistanceType> * pvec_distances,
-    const int NN = 2
+    const int NN = 2,
+    const SemanticLabelCompatibility * semantic_compatibility = nullptr
   ) const
   {
-    typedef L2_Vectorized<typename MatrixT::Scalar> MetricT;
-    MetricT metric;
+    typedef std::vector<std::vector<HashedDescriptions::Bucket> > BucketGroups;
+    // For each query label, list the bucket partitions of the database it can visit
+    const bool bSemanticGating = semantic_compatibility != nullptr
+      && hashed_descriptions1.IsSemanticPartitioned()
+      && hashed_descriptions2.IsSemanticPartitioned();
+    std::map<int, std::vector<const BucketGroups*> > compatible_partitions;
+    if (bSemanticGating)
+    {
+      for (const auto & query_partition : hashed_descriptions1.label_buckets)
+      {
+        std::vector<const BucketGroups*> & partitions =
+          compatible_partitions[query_partition.first];
+        for (const auto & database_partition : hashed_descriptions2.label_buckets)
+        {
+          if (semantic_compatibility->IsCompatible(
+                query_partition.first, database_partition.first))
+            partitions.push_back(&database_partition.second);
+        }
+      }
+    }
 
     static const int kNumTopCandidates = 10;
 
     // Preallocate the candidate descriptors container.
     std::vector<int> candidate_descriptors;
     candidate_descriptors.reserve(hashed_descriptions2.hashed_desc.size());
-
-    // cout << "declaration of cadidate_hamming_distances" << endl;
-    // Preallocated hamming distances. Each column indicates the hamming distance
-    // and the rows collect the descriptor ids with that
-    // distance. num_descriptors_with_hamming_distance keeps track of how many
-    // descriptors have that distance.
-    Eigen::MatrixXi candidate_hamming_distances(
-      hashed_descriptions2.hashed_desc.size(), nb_hash_code_ + 1);
-    Eigen::VectorXi num_descriptors_with_hamming_distance(nb_hash_code_ + 1);
-    // cout << "end of declaration of candidate_euclidean_distances" << endl;
+    // Unique candidates, their hamming distance and their ids sorted by
+    // hamming distance (counting sort, stable w.r.t. the retrieval order).
+    std::vector<int> unique_candidates, candidate_hamming_distances, sorted_candidates;
+    std::vector<int> num_descriptors_with_hamming_distance(nb_hash_code_ + 2);
 
     // Preallocate the container for keeping euclidean distances.
     std::vector<std::pair<DistanceType, int> > candidate_euclidean_distances;
@@ -296,27 +366,44 @@ public:
     // feature for matching (i.e., prevents duplicates).
     std::vector<bool> used_descriptor(hashed_descriptions2.hashed_desc.size());
 
-    // cout << "declaration of HammingMetricType" << endl;
-
-    typedef matching::Hamming<stl::dynamic_bitset::BlockType> HammingMetricType;
-    static const HammingMetricType metricH = {};
+    const cascade_kernels::EKERNEL_ISA isa = cascade_kernels::HostISA();
     for (int i = 0; i < hashed_descriptions1.hashed_desc.size(); ++i)
     {
       candidate_descriptors.clear();
-      num_descriptors_with_hamming_distance.setZero();
       candidate_euclidean_distances.clear();
 
       const auto& hashed_desc = hashed_descriptions1.hashed_desc[i];
 
       // Accumulate all descriptors in each bucket group that are in the same
       // bucket id as the query descriptor.
-      for (int j = 0; j < nb_bucket_groups_; ++j)
+      if (bSemanticGating)
       {
-        const uint16_t bucket_id = hashed_desc.bucket_ids[j];
-        for (const auto& feature_id : hashed_descriptions2.buckets[j][bucket_id])
+        // Only visit the partitions with a compatible semantic label
+        const std::vector<const BucketGroups*> & partitions =
+          compatible_partitions[hashed_descriptions1.semantic_labels[i]];
+        for (const BucketGroups * partition : partitions)
         {
-          candidate_descriptors.emplace_back(feature_id);
-          used_descriptor[feature_id] = false;
+          for (int j = 0; j < nb_bucket_groups_; ++j)
+          {
+            const uint16_t bucket_id = hashed_desc.bucket_ids[j];
+            for (const auto& feature_id : (*partition)[j][bucket_id])
+            {
+              candidate_descriptors.emplace_back(feature_id);
+              used_descriptor[feature_id] = false;
+            }
+          }
+        }
+      }
+      else
+      {
+        for (int j = 0; j < nb_bucket_groups_; ++j)
+        {
+          const uint16_t bucket_id = hashed_desc.bucket_ids[j];
+          for (const auto& feature_id : hashed_descriptions2.buckets[j][bucket_id])
+          {
+            candidate_descriptors.emplace_back(feature_id);
+            used_descriptor[feature_id] = false;
+          }
         }
       }
 
@@ -326,52 +413,50 @@ public:
         continue;
       }
 
-      // Skip matching this descriptor if the corresponding features don't have
-      // the same semantic label
-      // if()
-      // {
-      //   continue;
-      // }
-
-
-      // Compute the hamming distance of all candidates based on the comp hash
-      // code. Put the descriptors into buckets corresponding to their hamming
-      // distance.
+      // Avoid selecting the same candidate multiple times
+      unique_candidates.clear();
       for (const int candidate_id : candidate_descriptors)
       {
-        if (!used_descriptor[candidate_id]) // avoid selecting the same candidate multiple times
+        if (!used_descriptor[candidate_id])
         {
           used_descriptor[candidate_id] = true;
-
-          const HammingMetricType::ResultType hamming_distance = metricH(
-            hashed_desc.hash_code.data(),
-            hashed_descriptions2.hashed_desc[candidate_id].hash_code.data(),
-            hashed_desc.hash_code.num_blocks());
-          candidate_hamming_distances(
-              num_descriptors_with_hamming_distance(hamming_distance)++,
-              hamming_distance) = candidate_id;
+          unique_candidates.emplace_back(candidate_id);
         }
       }
 
-      // Compute the euclidean distance of the k descriptors with the best hamming
-      // distance.
-      candidate_euclidean_distances.reserve(kNumTopCandidates);
-      for (int j = 0; j < candidate_hamming_distances.cols() &&
-        (candidate_euclidean_distances.size() < kNumTopCandidates); ++j)
+      // Compute the hamming distance of all candidates at once based on the
+      // comp hash code.
+      candidate_hamming_distances.resize(unique_candidates.size());
+      cascade_kernels::HammingDistances(
+        &hashed_descriptions1.hash_codes[i * hashed_descriptions1.nb_hash_words],
+        &hashed_descriptions2.hash_codes[0],
+        hashed_descriptions2.nb_hash_words,
+        &unique_candidates[0], unique_candidates.size(),
+        &candidate_hamming_distances[0], isa);
+
+      // Sort the candidates by hamming distance (counting sort).
+      std::fill(num_descriptors_with_hamming_distance.begin(),
+        num_descriptors_with_hamming_distance.end(), 0);
+      for (const int hamming_distance : candidate_hamming_distances)
+        ++num_descriptors_with_hamming_distance[hamming_distance + 1];
+      for (int j = 1; j < num_descriptors_with_hamming_distance.size(); ++j)
+        num_descriptors_with_hamming_distance[j] += num_descriptors_with_hamming_distance[j-1];
+      sorted_candidates.resize(unique_candidates.size());
+      for (int j = 0; j < unique_candidates.size(); ++j)
       {
-        for(int k = 0; k < num_descriptors_with_hamming_distance(j) &&
-          (candidate_euclidean_distances.size() < kNumTopCandidates); ++k)
-        {
-          const int candidate_id = candidate_hamming_distances(k, j);
-          const DistanceType distance = metric(
-            descriptions2.row(candidate_id).data(),
-            descriptions1.row(i).data(),
-            descriptions1.cols());
-
-          candidate_euclidean_distances.emplace_back(distance, candidate_id);
-        }
+        sorted_candidates[num_descriptors_with_hamming_distance[
+          candidate_hamming_distances[j]]++] = unique_candidates[j];
       }
 
+      // Compute the euclidean distance of the k descriptors with the best hamming
+      // distance.
+      const size_t nb_top_candidates =
+        std::min(sorted_candidates.size(), static_cast<size_t>(kNumTopCandidates));
+      CandidatesL2<MatrixT, DistanceType>::Compute(
+        descriptions1, i, descriptions2,
+        &sorted_candidates[0], nb_top_candidates,
+        &candidate_euclidean_distances, isa);
+
       // Assert that each query is having at least NN retrieved neighbors
       if (candidate_euclidean_distances.size() >= NN)
       {
@@ -392,6 +477,62 @@ public:
 
 
   private:
+
+  // Squared L2 distances between the i-th query description and a block of
+  // candidate descriptions (generic metric).
+  template <typename MatrixT, typename DistanceType, typename ScalarT = typename MatrixT::Scalar>
+  struct CandidatesL2
+  {
+    static void Compute
+    (
+      const MatrixT & descriptions1, const int i,
+      const MatrixT & descriptions2,
+      const int * candidate_ids, const size_t nb_candidates,
+      std::vector<std::pair<DistanceType, int> > * distances,
+      const cascade_kernels::EKERNEL_ISA
+    )
+    {
+      L2_Vectorized<ScalarT> metric;
+      for (size_t k = 0; k < nb_candidates; ++k)
+      {
+        const DistanceType distance = metric(
+          descriptions2.row(candidate_ids[k]).data(),
+          descriptions1.row(i).data(),
+          descriptions1.cols());
+        distances->emplace_back(distance, candidate_ids[k]);
+      }
+    }
+  };
+
+  // uint8 descriptions (SIFT): the block is scored by the batched kernel.
+  template <typename MatrixT, typename DistanceType>
+  struct CandidatesL2<MatrixT, DistanceType, unsigned char>
+  {
+    static void Compute
+    (
+      const MatrixT & descriptions1, const int i,
+      const MatrixT & descriptions2,
+      const int * candidate_ids, const size_t nb_candidates,
+      std::vector<std::pair<DistanceType, int> > * distances,
+      const cascade_kernels::EKERNEL_ISA isa
+    )
+    {
+      static_assert(MatrixT::IsRowMajor, "descriptions must be stored by row");
+      float block_distances[kMaxBlockSize];
+      for (size_t begin = 0; begin < nb_candidates; begin += kMaxBlockSize)
+      {
+        const size_t nb = std::min(nb_candidates - begin, size_t(kMaxBlockSize));
+        cascade_kernels::L2Distances_uint8(
+          descriptions1.row(i).data(), descriptions2.data(), descriptions2.cols(),
+          candidate_ids + begin, nb, block_distances, isa);
+        for (size_t k = 0; k < nb; ++k)
+          distances->emplace_back(static_cast<DistanceType>(block_distances[k]),
+            candidate_ids[begin + k]);
+      }
+    }
+    static const size_t kMaxBlockSize = 16;
+  };
+
   // Primary hashing function.
   Eigen::MatrixXf primary_hash_projection_;
 
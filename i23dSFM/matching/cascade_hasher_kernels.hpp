@@ -0,0 +1,299 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_MATCHING_CASCADE_HASHER_KERNELS_HPP
+#define I23DSFM_MATCHING_CASCADE_HASHER_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Batched distance kernels used by the CascadeHasher retrieval step:
+// - Hamming distances between a query hash code and a list of candidate codes,
+// - squared L2 distances between a uint8 query descriptor and a list of
+//   candidate descriptors.
+// The SIMD paths (AVX2, AVX-512) are compiled with function level target
+// attributes and selected at runtime according to the host CPU, so the
+// binary still runs on CPUs without these instruction sets.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define I23DSFM_CASCADE_KERNELS_X86
+#include <immintrin.h>
+#if (defined(__clang__) && __clang_major__ >= 6) || (!defined(__clang__) && __GNUC__ >= 8)
+#define I23DSFM_CASCADE_KERNELS_AVX512
+#endif
+#endif
+
+namespace i23dSFM {
+namespace matching {
+namespace cascade_kernels {
+
+/// Instruction set used by the kernels
+enum EKERNEL_ISA
+{
+  SCALAR_ISA,
+  AVX2_ISA,
+  AVX512_ISA
+};
+
+/// Best instruction set supported by the host CPU
+inline EKERNEL_ISA HostISA()
+{
+#ifdef I23DSFM_CASCADE_KERNELS_X86
+  static const EKERNEL_ISA isa = []()
+  {
+    __builtin_cpu_init();
+#ifdef I23DSFM_CASCADE_KERNELS_AVX512
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq"))
+      return AVX512_ISA;
+#endif
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+      return AVX2_ISA;
+    return SCALAR_ISA;
+  }();
+  return isa;
+#else
+  return SCALAR_ISA;
+#endif
+}
+
+//--
+//-- Hamming distances
+//--
+
+/// Reference implementation (any code length)
+/// codes: contiguous hash codes of nb_words 64 bit words each.
+inline void Hamming_Scalar
+(
+  const uint64_t * query,
+  const uint64_t * codes,
+  const size_t nb_words,
+  const int * ids,
+  const size_t nb_ids,
+  int * distances
+)
+{
+  for (size_t i = 0; i < nb_ids; ++i)
+  {
+    const uint64_t * code = codes + ids[i] * nb_words;
+    int distance = 0;
+    for (size_t k = 0; k < nb_words; ++k)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+      distance += __builtin_popcountll(query[k] ^ code[k]);
+#else
+      uint64_t n = query[k] ^ code[k];
+      n -= ((n >> 1) & 0x5555555555555555LL);
+      n = (n & 0x3333333333333333LL) + ((n >> 2) & 0x3333333333333333LL);
+      distance += static_cast<int>((((n + (n >> 4)) & 0x0f0f0f0f0f0f0f0fLL) * 0x0101010101010101LL) >> 56);
+#endif
+    }
+    distances[i] = distance;
+  }
+}
+
+#ifdef I23DSFM_CASCADE_KERNELS_X86
+
+/// 128 bit codes, two candidates per 256 bit register.
+/// Byte popcount by nibble lookup table, horizontal sums with SAD.
+__attribute__((target("avx2,popcnt")))
+inline void Hamming128_AVX2
+(
+  const uint64_t * query,
+  const uint64_t * codes,
+  const int * ids,
+  const size_t nb_ids,
+  int * distances
+)
+{
+  const __m256i lut = _mm256_setr_epi8(
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i q = _mm256_broadcastsi128_si256(
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(query)));
+  size_t i = 0;
+  for (; i + 2 <= nb_ids; i += 2)
+  {
+    const __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 2 * ids[i]));
+    const __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 2 * ids[i+1]));
+    const __m256i x = _mm256_xor_si256(q,
+      _mm256_inserti128_si256(_mm256_castsi128_si256(c0), c1, 1));
+    const __m256i cnt = _mm256_add_epi8(
+      _mm256_shuffle_epi8(lut, _mm256_and_si256(x, low_mask)),
+      _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask)));
+    // 4 partial sums: [c0 low, c0 high, c1 low, c1 high]
+    const __m256i sums = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+    distances[i] = _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1);
+    distances[i+1] = _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+  }
+  for (; i < nb_ids; ++i)
+  {
+    const uint64_t * code = codes + 2 * ids[i];
+    distances[i] = __builtin_popcountll(query[0] ^ code[0])
+      + __builtin_popcountll(query[1] ^ code[1]);
+  }
+}
+
+#ifdef I23DSFM_CASCADE_KERNELS_AVX512
+/// 128 bit codes, four candidates per 512 bit register (native 64 bit popcount)
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+inline void Hamming128_AVX512
+(
+  const uint64_t * query,
+  const uint64_t * codes,
+  const int * ids,
+  const size_t nb_ids,
+  int * distances
+)
+{
+  const __m512i q = _mm512_broadcast_i32x4(
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(query)));
+  alignas(64) uint64_t counts[8];
+  size_t i = 0;
+  for (; i + 4 <= nb_ids; i += 4)
+  {
+    __m512i c = _mm512_castsi128_si512(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 2 * ids[i])));
+    c = _mm512_inserti32x4(c,
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 2 * ids[i+1])), 1);
+    c = _mm512_inserti32x4(c,
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 2 * ids[i+2])), 2);
+    c = _mm512_inserti32x4(c,
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + 2 * ids[i+3])), 3);
+    _mm512_store_si512(counts, _mm512_popcnt_epi64(_mm512_xor_si512(q, c)));
+    for (int k = 0; k < 4; ++k)
+      distances[i+k] = static_cast<int>(counts[2*k] + counts[2*k+1]);
+  }
+  for (; i < nb_ids; ++i)
+  {
+    const uint64_t * code = codes + 2 * ids[i];
+    distances[i] = __builtin_popcountll(query[0] ^ code[0])
+      + __builtin_popcountll(query[1] ^ code[1]);
+  }
+}
+#endif // I23DSFM_CASCADE_KERNELS_AVX512
+
+#endif // I23DSFM_CASCADE_KERNELS_X86
+
+/// Hamming distance between the query code and each candidate codes[ids[i]].
+/// 128 bit codes use the best SIMD kernel available on the host CPU.
+inline void HammingDistances
+(
+  const uint64_t * query,
+  const uint64_t * codes,
+  const size_t nb_words,
+  const int * ids,
+  const size_t nb_ids,
+  int * distances,
+  const EKERNEL_ISA isa = HostISA()
+)
+{
+#ifdef I23DSFM_CASCADE_KERNELS_X86
+  if (nb_words == 2)
+  {
+#ifdef I23DSFM_CASCADE_KERNELS_AVX512
+    if (isa == AVX512_ISA)
+      return Hamming128_AVX512(query, codes, ids, nb_ids, distances);
+#endif
+    if (isa >= AVX2_ISA)
+      return Hamming128_AVX2(query, codes, ids, nb_ids, distances);
+  }
+#endif
+  Hamming_Scalar(query, codes, nb_words, ids, nb_ids, distances);
+}
+
+//--
+//-- Squared L2 distances on uint8 descriptors
+//--
+
+/// Reference implementation
+/// descriptions: contiguous rows of dimension uint8 values.
+inline void L2_uint8_Scalar
+(
+  const uint8_t * query,
+  const uint8_t * descriptions,
+  const size_t dimension,
+  const int * ids,
+  const size_t nb_ids,
+  float * distances
+)
+{
+  for (size_t i = 0; i < nb_ids; ++i)
+  {
+    const uint8_t * row = descriptions + ids[i] * dimension;
+    int distance = 0;
+    for (size_t k = 0; k < dimension; ++k)
+    {
+      const int diff = static_cast<int>(query[k]) - static_cast<int>(row[k]);
+      distance += diff * diff;
+    }
+    distances[i] = static_cast<float>(distance);
+  }
+}
+
+#ifdef I23DSFM_CASCADE_KERNELS_X86
+/// Dimension multiple of 16, at most 128 (SIFT).
+/// The query is widened to 16 bit once and reused for the whole block of
+/// candidates; the differences are squared and summed by pairs with madd.
+__attribute__((target("avx2")))
+inline void L2_uint8_AVX2
+(
+  const uint8_t * query,
+  const uint8_t * descriptions,
+  const size_t dimension,
+  const int * ids,
+  const size_t nb_ids,
+  float * distances
+)
+{
+  const size_t nb_chunks = dimension / 16;
+  __m256i q[8];
+  for (size_t k = 0; k < nb_chunks; ++k)
+    q[k] = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(query + 16 * k)));
+
+  for (size_t i = 0; i < nb_ids; ++i)
+  {
+    const uint8_t * row = descriptions + ids[i] * dimension;
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t k = 0; k < nb_chunks; ++k)
+    {
+      const __m256i r = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 16 * k)));
+      const __m256i diff = _mm256_sub_epi16(q[k], r);
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(diff, diff));
+    }
+    // horizontal sum of the 8 int32
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    distances[i] = static_cast<float>(_mm_cvtsi128_si32(sum));
+  }
+}
+#endif // I23DSFM_CASCADE_KERNELS_X86
+
+/// Squared L2 distance between the query and each candidate descriptions[ids[i]]
+inline void L2Distances_uint8
+(
+  const uint8_t * query,
+  const uint8_t * descriptions,
+  const size_t dimension,
+  const int * ids,
+  const size_t nb_ids,
+  float * distances,
+  const EKERNEL_ISA isa = HostISA()
+)
+{
+#ifdef I23DSFM_CASCADE_KERNELS_X86
+  if (isa >= AVX2_ISA && dimension % 16 == 0 && dimension <= 128)
+    return L2_uint8_AVX2(query, descriptions, dimension, ids, nb_ids, distances);
+#endif
+  L2_uint8_Scalar(query, descriptions, dimension, ids, nb_ids, distances);
+}
+
+} // namespace cascade_kernels
+} // namespace matching
+} // namespace i23dSFM
+
+#endif // I23DSFM_MATCHING_CASCADE_HASHER_KERNELS_HPP
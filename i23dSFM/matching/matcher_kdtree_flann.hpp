@@ -9,6 +9,8 @@
 
 #include "i23dSFM/matching/matching_interface.hpp"
 #include "flann/flann.hpp"
+#include <fstream>
+#include <iostream>
 #include <memory>
 
 namespace i23dSFM {
@@ -63,6 +65,71 @@ class ArrayMatcher_Kdtree_Flann : public ArrayMatcher<Scalar, Metric>
     return false;
   }
 
+  /**
+   * Build the matching structure from a saved FLANN index
+   * (the index must have been built on the same dataset).
+   *
+   * \param[in] dataset   Input data.
+   * \param[in] nbRows    The number of component.
+   * \param[in] dimension Length of the data contained in the each
+   *  row of the dataset.
+   * \param[in] filename  The saved index.
+   *
+   * \return True if success.
+   */
+  bool Load( const Scalar * dataset, int nbRows, int dimension,
+             const std::string & filename)  {
+
+    if (nbRows <= 0 || !std::ifstream(filename.c_str()).good())
+      return false;
+
+    _dimension = dimension;
+    _datasetM.reset(
+        new flann::Matrix<Scalar>((Scalar*)dataset, nbRows, dimension));
+    try
+    {
+      _index.reset(
+          new flann::Index<Metric> (*_datasetM, flann::SavedIndexParams(filename)));
+    }
+    catch (const flann::FLANNException & e)
+    {
+      std::cerr << "Cannot load the FLANN index: " << e.what() << std::endl;
+      _index.reset();
+      return false;
+    }
+    // The saved index must describe this dataset
+    if (_index->size() != static_cast<size_t>(nbRows)
+      || _index->veclen() != static_cast<size_t>(dimension))
+    {
+      _index.reset();
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Save the FLANN index (the dataset is not saved).
+   *
+   * \param[in] filename  The output file.
+   *
+   * \return True if success.
+   */
+  bool Save(const std::string & filename)  {
+
+    if (_index.get() == NULL)
+      return false;
+    try
+    {
+      _index->save(filename);
+    }
+    catch (const flann::FLANNException & e)
+    {
+      std::cerr << "Cannot save the FLANN index: " << e.what() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
   /**
    * Search the nearest Neighbor of the scalar array query.
    *
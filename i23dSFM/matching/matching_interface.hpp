@@ -8,6 +8,7 @@
 #ifndef I23DSFM_MATCHING_MATCHINGINTERFACE_H
 #define I23DSFM_MATCHING_MATCHINGINTERFACE_H
 
+#include <string>
 #include <vector>
 #include "i23dSFM/numeric/numeric.h"
 #include "i23dSFM/matching/indMatch.hpp"
@@ -39,6 +40,29 @@ class ArrayMatcher
    */
   virtual bool Build( const Scalar * dataset, int nbRows, int dimension)=0;
 
+  /**
+   * Build the matching structure from a file saved by Save
+   * (only for the matchers with a serializable structure).
+   *
+   * \param[in] dataset   Input data (the one used to build the saved structure).
+   * \param[in] nbRows    The number of component.
+   * \param[in] dimension Length of the data contained in the dataset.
+   * \param[in] filename  The saved matching structure.
+   *
+   * \return True if success.
+   */
+  virtual bool Load( const Scalar * /*dataset*/, int /*nbRows*/, int /*dimension*/,
+                     const std::string & /*filename*/) { return false; }
+
+  /**
+   * Save the matching structure (the dataset is not saved).
+   *
+   * \param[in] filename  The output file.
+   *
+   * \return True if success.
+   */
+  virtual bool Save(const std::string & /*filename*/) { return false; }
+
   /**
    * Search the nearest Neighbor of the scalar array query.
    *
@@ -111,6 +111,36 @@ TEST(Matching, ArrayMatcher_Kdtree_Flann_Simple__NN)
   EXPECT_EQ(IndMatch(0,4), vec_nIndice[4]);
 }
 
+TEST(Matching, ArrayMatcher_Kdtree_Flann_Save_Load)
+{
+  const float array[] = {0, 1, 2, 5, 6};
+  const std::string sIndexFile = "ArrayMatcher_Kdtree_Flann.flann";
+  {
+    ArrayMatcher_Kdtree_Flann<float> matcher;
+    EXPECT_FALSE( matcher.Save(sIndexFile) ); // no index built yet
+    EXPECT_TRUE( matcher.Build(array, 5, 1) );
+    EXPECT_TRUE( matcher.Save(sIndexFile) );
+  }
+
+  // The saved index gives the same neighbours
+  ArrayMatcher_Kdtree_Flann<float> matcher;
+  EXPECT_TRUE( matcher.Load(array, 5, 1, sIndexFile) );
+  const float query[] = {2};
+  IndMatches vec_nIndice;
+  vector<float> vec_fDistance;
+  EXPECT_TRUE( matcher.SearchNeighbours(query, 1, &vec_nIndice, &vec_fDistance, 3) );
+  EXPECT_EQ( 3, vec_nIndice.size());
+  EXPECT_EQ(IndMatch(0,2), vec_nIndice[0]);
+  EXPECT_EQ(IndMatch(0,1), vec_nIndice[1]);
+  EXPECT_EQ(IndMatch(0,0), vec_nIndice[2]);
+
+  // A saved index cannot be used for another dataset or a missing file
+  const float other_array[] = {0, 1, 2, 5};
+  ArrayMatcher_Kdtree_Flann<float> other_matcher;
+  EXPECT_FALSE( other_matcher.Load(other_array, 4, 1, sIndexFile) );
+  EXPECT_FALSE( other_matcher.Load(array, 5, 1, "missing.flann") );
+}
+
 //-- Test LIMIT case (empty arrays)
 
 TEST(Matching, ArrayMatcherBruteForce_Simple_EmptyArrays)
@@ -146,6 +176,69 @@ TEST(Matching, Cascade_Hashing_Simple_EmptyArrays)
   EXPECT_FALSE( matcher.SearchNeighbour( &array[0], &nIndice, &fDistance) );
 }
 
+TEST(Matching, SemanticLabelCompatibility)
+{
+  SemanticLabelCompatibility compatibility;
+  // Default: same label matching
+  EXPECT_TRUE( compatibility.IsCompatible(1, 1) );
+  EXPECT_FALSE( compatibility.IsCompatible(1, 2) );
+
+  compatibility.SetNeverMatch(0); // sky
+  compatibility.SetCompatible(3, 3); // building
+  compatibility.SetCompatible(3, -1); // building - unknown
+  EXPECT_FALSE( compatibility.IsCompatible(0, 0) );
+  EXPECT_TRUE( compatibility.IsCompatible(3, 3) );
+  EXPECT_TRUE( compatibility.IsCompatible(3, -1) );
+  EXPECT_TRUE( compatibility.IsCompatible(-1, 3) );
+  EXPECT_TRUE( compatibility.IsCompatible(-1, -1) );
+  EXPECT_FALSE( compatibility.IsCompatible(3, 1) );
+}
+
+TEST(Matching, Cascade_Hashing_SemanticPartition)
+{
+  // Two identical sets of random descriptions: each description has a
+  // perfect match in the other set, but half of them have an incompatible label.
+  typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> BaseMat;
+  const int nbDescriptions = 64, dimension = 128;
+  BaseMat descriptions = BaseMat::Random(nbDescriptions, dimension);
+  std::vector<int> labels1(nbDescriptions), labels2(nbDescriptions);
+  for (int i = 0; i < nbDescriptions; ++i)
+  {
+    labels1[i] = i % 2;
+    labels2[i] = (i < nbDescriptions / 2) ? labels1[i] : 2;
+  }
+
+  CascadeHasher cascade_hasher;
+  cascade_hasher.Init(dimension);
+  const Eigen::VectorXf zero_mean = CascadeHasher::GetZeroMeanDescriptor(descriptions);
+  const HashedDescriptions hashed1 =
+    cascade_hasher.CreateHashedDescriptions(descriptions, zero_mean, labels1);
+  const HashedDescriptions hashed2 =
+    cascade_hasher.CreateHashedDescriptions(descriptions, zero_mean, labels2);
+  EXPECT_TRUE( hashed1.IsSemanticPartitioned() );
+  EXPECT_EQ( 2, hashed1.label_buckets.size() );
+  EXPECT_EQ( 3, hashed2.label_buckets.size() );
+
+  SemanticLabelCompatibility compatibility;
+  IndMatches vec_indices;
+  std::vector<float> vec_distances;
+  // Nearest neighbour only: the compatible duplicate is retrieved in every
+  // bucket group, while a second neighbour depends on random bucket collisions
+  cascade_hasher.Match_HashedDescriptions(
+    hashed1, descriptions, hashed2, descriptions,
+    &vec_indices, &vec_distances, 1, &compatibility);
+
+  // Each description with a compatible label matches its duplicate
+  size_t nb_duplicate_matches = 0;
+  for (size_t i = 0; i < vec_indices.size(); ++i)
+  {
+    EXPECT_EQ( labels1[vec_indices[i]._i], labels2[vec_indices[i]._j] );
+    if (vec_indices[i]._i == vec_indices[i]._j)
+      ++nb_duplicate_matches;
+  }
+  EXPECT_EQ( nbDescriptions / 2, nb_duplicate_matches );
+}
+
 /* ************************************************************************* */
 int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
 /* ************************************************************************* */
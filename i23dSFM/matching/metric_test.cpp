@@ -7,8 +7,11 @@
 
 #include "testing/testing.h"
 #include "i23dSFM/matching/metric.hpp"
+#include "i23dSFM/matching/cascade_hasher_kernels.hpp"
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
 using namespace std;
 
 using namespace i23dSFM;
@@ -131,6 +134,60 @@ TEST(Metric, HAMMING_BITSET_RAW_MEMORY_32BITS)
   }
 }
 
+TEST(Metric, CASCADE_KERNELS_HAMMING_128BITS)
+{
+  // Random 128 bit codes, compared to the reference byte metric
+  const int COUNT = 37;
+  std::vector<uint64_t> codes(2 * COUNT);
+  for (size_t i = 0; i < codes.size(); ++i)
+    codes[i] = (uint64_t(rand()) << 48) ^ (uint64_t(rand()) << 24) ^ uint64_t(rand());
+  std::vector<int> ids(COUNT);
+  for (int i = 0; i < COUNT; ++i)
+    ids[i] = (i * 7) % COUNT;
+
+  Hamming< unsigned char > metricHamming;
+  const cascade_kernels::EKERNEL_ISA host_isa = cascade_kernels::HostISA();
+  for (int isa = cascade_kernels::SCALAR_ISA; isa <= host_isa; ++isa)
+  {
+    std::vector<int> distances(COUNT, -1);
+    cascade_kernels::HammingDistances(&codes[0], &codes[0], 2, &ids[0], COUNT,
+      &distances[0], cascade_kernels::EKERNEL_ISA(isa));
+    for (int i = 0; i < COUNT; ++i)
+    {
+      const unsigned int gtDist = metricHamming(
+        reinterpret_cast<unsigned char*>(&codes[0]),
+        reinterpret_cast<unsigned char*>(&codes[2 * ids[i]]), 16);
+      EXPECT_EQ(gtDist, distances[i]);
+    }
+  }
+}
+
+TEST(Metric, CASCADE_KERNELS_L2_UINT8)
+{
+  // Random SIFT like descriptions, compared to the reference L2 metric
+  const int COUNT = 21, DIM = 128;
+  std::vector<unsigned char> descriptions(COUNT * DIM);
+  for (size_t i = 0; i < descriptions.size(); ++i)
+    descriptions[i] = static_cast<unsigned char>(rand() % 256);
+  std::vector<int> ids(COUNT);
+  for (int i = 0; i < COUNT; ++i)
+    ids[i] = (i * 5) % COUNT;
+
+  L2_Simple<unsigned char> metricL2;
+  const cascade_kernels::EKERNEL_ISA host_isa = cascade_kernels::HostISA();
+  for (int isa = cascade_kernels::SCALAR_ISA; isa <= host_isa; ++isa)
+  {
+    std::vector<float> distances(COUNT, -1.f);
+    cascade_kernels::L2Distances_uint8(&descriptions[0], &descriptions[0], DIM,
+      &ids[0], COUNT, &distances[0], cascade_kernels::EKERNEL_ISA(isa));
+    for (int i = 0; i < COUNT; ++i)
+    {
+      const float gtDist = metricL2(&descriptions[0], &descriptions[ids[i] * DIM], DIM);
+      EXPECT_EQ(gtDist, distances[i]);
+    }
+  }
+}
+
 /* ************************************************************************* */
 int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
 /* ************************************************************************* */
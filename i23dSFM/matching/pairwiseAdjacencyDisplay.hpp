@@ -17,11 +17,12 @@ namespace i23dSFM  {
 namespace matching {
 
 /// Display pair wises matches as an Adjacency matrix in svg format
+/// (pairs: the pairs that have matches)
 void PairWiseMatchingToAdjacencyMatrixSVG(const size_t NbImages,
-  const matching::PairWiseMatches & map_Matches,
+  const Pair_Set & pairs,
   const std::string & sOutName)
 {
-  if ( !map_Matches.empty())
+  if ( !pairs.empty())
   {
     float scaleFactor = 5.0f;
     svgDrawer svgStream((NbImages+3)*5, (NbImages+3)*5);
@@ -29,13 +30,8 @@ void PairWiseMatchingToAdjacencyMatrixSVG(const size_t NbImages,
     for (size_t I = 0; I < NbImages; ++I) {
       for (size_t J = 0; J < NbImages; ++J) {
         // If the pair have matches display a blue boxes at I,J position.
-        matching::PairWiseMatches::const_iterator iterSearch =
-          map_Matches.find(std::make_pair(I,J));
-        if (iterSearch != map_Matches.end() && !iterSearch->second.empty())
+        if (pairs.count(std::make_pair(I,J)))
         {
-          // Display as a tooltip: (IndexI, IndexJ NbMatches)
-          std::ostringstream os;
-          os << "(" << J << "," << I << " " << iterSearch->second.size() <<")";
           svgStream.drawSquare(J*scaleFactor, I*scaleFactor, scaleFactor/2.0f,
             svgStyle().fill("blue").noStroke());
         } // HINT : THINK ABOUT OPACITY [0.4 -> 1.0] TO EXPRESS MATCH COUNT
@@ -63,6 +59,21 @@ void PairWiseMatchingToAdjacencyMatrixSVG(const size_t NbImages,
   }
 }
 
+/// Display pair wises matches as an Adjacency matrix in svg format
+void PairWiseMatchingToAdjacencyMatrixSVG(const size_t NbImages,
+  const matching::PairWiseMatches & map_Matches,
+  const std::string & sOutName)
+{
+  Pair_Set pairs;
+  for (matching::PairWiseMatches::const_iterator iter = map_Matches.begin();
+    iter != map_Matches.end(); ++iter)
+  {
+    if (!iter->second.empty())
+      pairs.insert(iter->first);
+  }
+  PairWiseMatchingToAdjacencyMatrixSVG(NbImages, pairs, sOutName);
+}
+
 } // namespace matching
 } // namespace i23dSFM
 
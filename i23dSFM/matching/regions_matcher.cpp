@@ -46,6 +46,11 @@ bool Matcher_Regions_Database::Match
   return false;
 }
 
+bool Matcher_Regions_Database::Save(const std::string & sIndexFile) const
+{
+  return _matching_interface && _matching_interface->Save_database(sIndexFile);
+}
+
 Matcher_Regions_Database::Matcher_Regions_Database():
   _eMatcherType(BRUTE_FORCE_L2),
   _matching_interface(nullptr)
@@ -54,7 +59,8 @@ Matcher_Regions_Database::Matcher_Regions_Database():
 Matcher_Regions_Database::Matcher_Regions_Database
 (
   matching::EMatcherType eMatcherType,
-  const features::Regions & database_regions // database
+  const features::Regions & database_regions, // database
+  const std::string & sIndexFile
 ):
   _eMatcherType(eMatcherType)
 {
@@ -76,21 +82,21 @@ Matcher_Regions_Database::Matcher_Regions_Database
         {
           typedef L2_Vectorized<unsigned char> MetricT;
           typedef ArrayMatcherBruteForce<unsigned char, MetricT> MatcherT;
-          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true));
+          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true, sIndexFile));
         }
         break;
         case ANN_L2:
         {
           typedef flann::L2<unsigned char> MetricT;
           typedef ArrayMatcher_Kdtree_Flann<unsigned char, MetricT> MatcherT;
-          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true));
+          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true, sIndexFile));
         }
         break;
         case CASCADE_HASHING_L2:
         {
           typedef L2_Vectorized<unsigned char> MetricT;
           typedef ArrayMatcherCascadeHashing<unsigned char, MetricT> MatcherT;
-          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true));
+          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true, sIndexFile));
         }
         break;
         default:
@@ -106,21 +112,21 @@ Matcher_Regions_Database::Matcher_Regions_Database
         {
           typedef L2_Vectorized<float> MetricT;
           typedef ArrayMatcherBruteForce<float, MetricT> MatcherT;
-          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true));
+          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true, sIndexFile));
         }
         break;
         case ANN_L2:
         {
           typedef flann::L2<float> MetricT;
           typedef ArrayMatcher_Kdtree_Flann<float, MetricT> MatcherT;
-          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true));
+          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true, sIndexFile));
         }
         break;
         case CASCADE_HASHING_L2:
         {
           typedef L2_Vectorized<float> MetricT;
           typedef ArrayMatcherCascadeHashing<float, MetricT> MatcherT;
-          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true));
+          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true, sIndexFile));
         }
         break;
         default:
@@ -136,14 +142,14 @@ Matcher_Regions_Database::Matcher_Regions_Database
         {
           typedef L2_Vectorized<double> MetricT;
           typedef ArrayMatcherBruteForce<double, MetricT> MatcherT;
-          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true));
+          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true, sIndexFile));
         }
         break;
         case ANN_L2:
         {
           typedef flann::L2<double> MetricT;
           typedef ArrayMatcher_Kdtree_Flann<double, MetricT> MatcherT;
-          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true));
+          _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, true, sIndexFile));
         }
         break;
         case CASCADE_HASHING_L2:
@@ -164,7 +170,7 @@ Matcher_Regions_Database::Matcher_Regions_Database
       {
         typedef Hamming<unsigned char> Metric;
         typedef ArrayMatcherBruteForce<unsigned char, Metric> MatcherT;
-        _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, false));
+        _matching_interface.reset(new matching::RegionsMatcherT<MatcherT>(database_regions, false, sIndexFile));
       }
       break;
       default:
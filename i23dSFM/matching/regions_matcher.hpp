@@ -15,6 +15,7 @@
 #include "i23dSFM/numeric/numeric.h"
 #include "i23dSFM/features/regions.hpp"
 
+#include <string>
 #include <vector>
 
 namespace i23dSFM {
@@ -54,6 +55,14 @@ class RegionsMatcher
     const features::Regions& query_regions,
     matching::IndMatches & vec_putative_matches
   ) =0;
+
+  /**
+   * @brief Save the matching structure of the database (if it is serializable)
+   */
+  virtual bool Save_database
+  (
+    const std::string & sIndexFile
+  ) = 0;
 };
 
 /**
@@ -67,11 +76,13 @@ class Matcher_Regions_Database
 
   /**
    * @brief Initialize the retrieval database
+   * (from the saved matching structure sIndexFile if it is valid)
    */
   Matcher_Regions_Database
   (
     matching::EMatcherType eMatcherType,
-    const features::Regions & database_regions // database
+    const features::Regions & database_regions, // database
+    const std::string & sIndexFile = ""
   );
 
   /// Find corresponding points between the query regions and the database one
@@ -82,6 +93,9 @@ class Matcher_Regions_Database
     matching::IndMatches & matches // photometric corresponding points
   )const;
 
+  /// Save the matching structure of the database (ANN_L2 only)
+  bool Save(const std::string & sIndexFile) const;
+
   private:
   // Matcher Type
   matching::EMatcherType _eMatcherType;
@@ -106,16 +120,24 @@ public:
   RegionsMatcherT() :regions_(NULL) {}
 
   /**
-   * @brief Init the matcher with some reference regions.
+   * @brief Init the matcher with some reference regions
+   * (the matching structure is loaded from sIndexFile if it is valid).
    */
-  RegionsMatcherT(const features::Regions& regions, bool b_squared_metric = false)
+  RegionsMatcherT
+  (
+    const features::Regions& regions,
+    bool b_squared_metric = false,
+    const std::string & sIndexFile = ""
+  )
     : regions_(&regions), b_squared_metric_(b_squared_metric)
   {
     if (regions_->RegionCount() == 0)
       return;
 
     const Scalar * tab = reinterpret_cast<const Scalar *>(regions_->DescriptorRawData());
-    matcher_.Build(tab, regions_->RegionCount(), regions_->DescriptorLength());
+    if (sIndexFile.empty() ||
+        !matcher_.Load(tab, regions_->RegionCount(), regions_->DescriptorLength(), sIndexFile))
+      matcher_.Build(tab, regions_->RegionCount(), regions_->DescriptorLength());
   }
 
   void Init_database
@@ -181,6 +203,14 @@ public:
 
     return (!vec_putative_matches.empty());
   }
+
+  bool Save_database
+  (
+    const std::string & sIndexFile
+  )
+  {
+    return matcher_.Save(sIndexFile);
+  }
 };
 
 }  // namespace matching
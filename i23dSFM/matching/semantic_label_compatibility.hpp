@@ -0,0 +1,122 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace i23dSFM {
+namespace matching {
+
+/// Symmetric compatibility table between semantic labels.
+/// It tells if two features with the given labels are allowed to be matched.
+/// A negative label stands for an unknown/unlabelled feature.
+///
+/// By default a label is only compatible with itself (same label matching).
+/// A label row can be redefined explicitly:
+/// - SetCompatible(3, -1): "building" can match "building" and "unknown",
+/// - SetNeverMatch(0): "sky" never matches anything.
+class SemanticLabelCompatibility
+{
+public:
+
+  /// Allow (or forbid) the matching between labels a and b (symmetric)
+  void SetCompatible(int a, int b, bool compatible = true)
+  {
+    const std::pair<int,int> key(std::min(a,b), std::max(a,b));
+    if (a == b)
+      explicit_rows_.insert(a);
+    if (compatible)
+      compatible_pairs_.insert(key);
+    else
+      compatible_pairs_.erase(key);
+  }
+
+  /// Features with this label will never be matched
+  void SetNeverMatch(int label)
+  {
+    explicit_rows_.insert(label);
+    for (std::set<std::pair<int,int> >::iterator it = compatible_pairs_.begin();
+      it != compatible_pairs_.end();)
+    {
+      if (it->first == label || it->second == label)
+        compatible_pairs_.erase(it++);
+      else
+        ++it;
+    }
+  }
+
+  /// Tell if two features with label a and b can be matched
+  bool IsCompatible(int a, int b) const
+  {
+    if (compatible_pairs_.count(std::make_pair(std::min(a,b), std::max(a,b))))
+      return true;
+    return (a == b && explicit_rows_.count(a) == 0);
+  }
+
+  /// Return the labels of the candidate_labels list that are compatible with label
+  std::vector<int> CompatibleLabels
+  (
+    int label,
+    const std::vector<int> & candidate_labels
+  ) const
+  {
+    std::vector<int> compatible_labels;
+    for (size_t i = 0; i < candidate_labels.size(); ++i)
+    {
+      if (IsCompatible(label, candidate_labels[i]))
+        compatible_labels.push_back(candidate_labels[i]);
+    }
+    return compatible_labels;
+  }
+
+  /// Load a compatibility table from an ascii file.
+  /// Each line lists a label followed by all the labels it can be matched with:
+  ///   3 3 -1  -> "building" matches "building" and "unknown"
+  ///   0       -> "sky" never matches
+  /// Rows are merged symmetrically: a pair listed in any row is compatible.
+  /// Empty lines and lines starting with '#' are ignored.
+  bool Load(const std::string & filename)
+  {
+    std::ifstream in(filename.c_str());
+    if (!in.is_open())
+    {
+      std::cerr << "Cannot open the semantic compatibility file: " << filename << std::endl;
+      return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+      if (line.empty() || line[0] == '#')
+        continue;
+      std::istringstream iss(line);
+      int label;
+      if (!(iss >> label))
+        continue;
+      explicit_rows_.insert(label);
+      int other;
+      while (iss >> other)
+        SetCompatible(label, other);
+    }
+    return !in.bad();
+  }
+
+private:
+  /// Labels for which the default "same label" rule is overridden
+  std::set<int> explicit_rows_;
+  /// Compatible label pairs (stored as (min, max))
+  std::set<std::pair<int,int> > compatible_pairs_;
+};
+
+}  // namespace matching
+}  // namespace i23dSFM
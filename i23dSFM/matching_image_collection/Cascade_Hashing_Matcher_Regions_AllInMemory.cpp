@@ -13,9 +13,6 @@
 #include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
 #include "third_party/progress/progress.hpp"
 
-
-// #define USE_SEMANTIC_LABEL
-
 namespace i23dSFM {
 namespace matching_image_collection {
 
@@ -25,8 +22,9 @@ using namespace i23dSFM::features;
 Cascade_Hashing_Matcher_Regions_AllInMemory
 ::Cascade_Hashing_Matcher_Regions_AllInMemory
 (
-  float distRatio
-):Matcher(), f_dist_ratio_(distRatio)
+  float distRatio,
+  std::shared_ptr<SemanticLabelCompatibility> semantic_compatibility
+):Matcher(), f_dist_ratio_(distRatio), semantic_compatibility_(semantic_compatibility)
 {
 }
 
@@ -39,6 +37,7 @@ void Match
   const sfm::Regions_Provider & regions_provider,
   const Pair_Set & pairs,
   float fDistRatio,
+  const SemanticLabelCompatibility * semantic_compatibility,
   PairWiseMatches & map_PutativesMatches // the pairwise photometric corresponding points
 )
 {
@@ -112,8 +111,21 @@ void Match
     const size_t dimension = regionsI.DescriptorLength();
 
     Eigen::Map<BaseMat> mat_I( (ScalarT*)tabI, regionsI.RegionCount(), dimension);
-    const HashedDescriptions hashed_description = cascade_hasher.CreateHashedDescriptions(mat_I,
-      zero_mean_descriptor);
+    HashedDescriptions hashed_description;
+    if (semantic_compatibility)
+    {
+      // Partition the hashing buckets by semantic label
+      std::vector<int> semantic_labels(regionsI.RegionCount());
+      for (size_t k = 0; k < semantic_labels.size(); ++k)
+        semantic_labels[k] = regionsI.GetRegionsPositionLabel(k);
+      hashed_description = cascade_hasher.CreateHashedDescriptions(mat_I,
+        zero_mean_descriptor, semantic_labels);
+    }
+    else
+    {
+      hashed_description = cascade_hasher.CreateHashedDescriptions(mat_I,
+        zero_mean_descriptor);
+    }
     #ifdef I23DSFM_USE_OPENMP
         #pragma omp critical
     #endif
@@ -140,25 +152,6 @@ void Match
     const size_t dimension = regionsI.DescriptorLength();
     Eigen::Map<BaseMat> mat_I( (ScalarT*)tabI, regionsI.RegionCount(), dimension);
 
-    // #ifdef USE_SEMANTIC_LABEL
-    // // Group descriptor by semantic label of corresponding features
-    // vector<ScalarT> tabI0, tabI1, tabI2;
-    // for(int i = 0; i < pointFeaturesI.size(); i++)
-    // {
-    //   if(pointFeaturesI[i].semanticLabel() == 0) tabI0.push_back(tabI[i]);
-    //   else if(pointFeaturesI[i].semanticLabel() == 1) tabI1.push_back(tabI[i]);
-    //   else tabI2.push_back(tabI[i]);
-    // }
-
-    // // cout << "mapping to left image: " << endl;
-
-    // Eigen::Map<BaseMat> mat_I0(&tabI0[0], tabI0.size(), dimension);
-    // Eigen::Map<BaseMat> mat_I1(&tabI1[0], tabI1.size(), dimension);
-    // Eigen::Map<BaseMat> mat_I2(&tabI2[0], tabI2.size(), dimension);
-    
-    // // cout << "ending of map to left image" << endl;
-    // #endif
-
     #ifdef I23DSFM_USE_OPENMP
         #pragma omp parallel for schedule(dynamic)
     #endif
@@ -182,75 +175,9 @@ void Match
       const ScalarT * tabJ = reinterpret_cast<const ScalarT*>(regionsJ.DescriptorRawData());    
       Eigen::Map<BaseMat> mat_J( (ScalarT*)tabJ, regionsJ.RegionCount(), dimension);
 
-      //  #ifdef USE_SEMANTIC_LABEL
-      // // Group descriptor by semantic label of corresponding features
-      // vector<ScalarT> tabJ0, tabJ1, tabJ2;
-      // for(int i = 0; i < pointFeaturesJ.size(); i++)
-      // {
-      //   if(pointFeaturesJ[i].semanticLabel() == 0) tabJ0.push_back(tabJ[i]);
-      //   else if(pointFeaturesJ[i].semanticLabel() == 1) tabJ1.push_back(tabJ[i]);
-      //   else tabJ2.push_back(tabJ[i]);
-      // }
-
-      // // cout << "mapping to right image" << endl;
-
-      // Eigen::Map<BaseMat> mat_J0(&tabJ0[0], tabJ0.size(), dimension);
-      // Eigen::Map<BaseMat> mat_J1(&tabJ1[0], tabJ1.size(), dimension);
-      // Eigen::Map<BaseMat> mat_J2(&tabJ2[0], tabJ2.size(), dimension);
-
-      // // cout << "end of map to right image" << endl;
-      // #endif
-
-
       typedef typename Accumulator<ScalarT>::Type ResultType;      
       matching::IndMatches vec_putative_matches;
 
-// #ifdef USE_SEMANTIC_LABEL
-//       IndMatches pvec_indices0, pvec_indices1, pvec_indices2;
-//       std::vector<ResultType> pvec_distances0, pvec_distances1, pvec_distances2;
-//       pvec_distances0.reserve(tabJ0.size() * 2);
-//       pvec_distances1.reserve(tabJ1.size() * 2);
-//       pvec_distances2.reserve(tabJ2.size() * 2);
-//       pvec_indices0.reserve(tabJ0.size() * 2);
-//       pvec_indices1.reserve(tabJ1.size() * 2);
-//       pvec_indices2.reserve(tabJ2.size() * 2);
-      
-//       cout << "begin semantic cascade hashing matching" << endl;
-//       // Match the query descriptors to the database
-//       cascade_hasher.Match_HashedDescriptions<BaseMat, ResultType>(
-//         hashed_base_[J], mat_J0, hashed_base_[I], mat_I0, &pvec_indices0, &pvec_distances0);
-//       cascade_hasher.Match_HashedDescriptions<BaseMat, ResultType>(
-//         hashed_base_[J], mat_J1, hashed_base_[I], mat_I1, &pvec_indices1, &pvec_distances1);
-//       cascade_hasher.Match_HashedDescriptions<BaseMat, ResultType>(
-//         hashed_base_[J], mat_J2, hashed_base_[I], mat_I2, &pvec_indices2, &pvec_distances2);
-//       cout << "end of semantic cascade hashing matching" << endl;
-
-//       std::vector<int> vec_nn_ratio_idx0, vec_nn_ratio_idx1, vec_nn_ratio_idx2;
-//       // Filter the matches using a distance ratio test:
-//       //   The probability that a match is correct is determined by taking
-//       //   the ratio of distance from the closest neighbor to the distance
-//       //   of the second closest.
-//       matching::NNdistanceRatio(pvec_distances0.begin(), pvec_distances0.end(), 2, vec_nn_ratio_idx0, Square(fDistRatio));
-//       matching::NNdistanceRatio(pvec_distances1.begin(), pvec_distances1.end(), 2, vec_nn_ratio_idx1, Square(fDistRatio));
-//       matching::NNdistanceRatio(pvec_distances2.begin(), pvec_distances2.end(), 2, vec_nn_ratio_idx2, Square(fDistRatio));      
-
-//       vec_putative_matches.reserve(vec_nn_ratio_idx0.size() + vec_nn_ratio_idx1.size() + vec_nn_ratio_idx2.size());
-//       for (size_t k=0; k < vec_nn_ratio_idx0.size(); ++k)
-//       {
-//         const size_t index = vec_nn_ratio_idx0[k];
-//         vec_putative_matches.emplace_back(pvec_indices0[index*2]._j, pvec_indices0[index*2]._i);
-//       }
-//       for (size_t k=0; k < vec_nn_ratio_idx1.size(); ++k)
-//       {
-//         const size_t index = vec_nn_ratio_idx1[k];
-//         vec_putative_matches.emplace_back(pvec_indices1[index*2]._j, pvec_indices1[index*2]._i);
-//       }      
-//       for (size_t k=0; k < vec_nn_ratio_idx2.size(); ++k)
-//       {
-//         const size_t index = vec_nn_ratio_idx2[k];
-//         vec_putative_matches.emplace_back(pvec_indices2[index*2]._j, pvec_indices2[index*2]._i);
-//       }
-// #else
       IndMatches pvec_indices;
       std::vector<ResultType> pvec_distances;
       pvec_distances.reserve(regionsJ.RegionCount() * 2);
@@ -259,7 +186,8 @@ void Match
       cascade_hasher.Match_HashedDescriptions<BaseMat, ResultType>(
         hashed_base_[J], mat_J,
         hashed_base_[I], mat_I,
-        &pvec_indices, &pvec_distances);
+        &pvec_indices, &pvec_distances,
+        2, semantic_compatibility);
 
       std::vector<int> vec_nn_ratio_idx;
       // Filter the matches using a distance ratio test:
@@ -273,14 +201,12 @@ void Match
         vec_nn_ratio_idx, // output (indices that respect the distance Ratio)
         Square(fDistRatio));
 
-      // matching::IndMatches vec_putative_matches;
       vec_putative_matches.reserve(vec_nn_ratio_idx.size());
       for (size_t k=0; k < vec_nn_ratio_idx.size(); ++k)
       {
         const size_t index = vec_nn_ratio_idx[k];
         vec_putative_matches.emplace_back(pvec_indices[index*2]._j, pvec_indices[index*2]._i);
       }
-// #endif
 
       // Remove duplicates
       matching::IndMatch::getDeduplicated(vec_putative_matches);
@@ -332,6 +258,7 @@ void Cascade_Hashing_Matcher_Regions_AllInMemory::Match
       *regions_provider.get(),
       pairs,
       f_dist_ratio_,
+      semantic_compatibility_.get(),
       map_PutativesMatches);
   }
   else
@@ -342,6 +269,7 @@ void Cascade_Hashing_Matcher_Regions_AllInMemory::Match
       *regions_provider.get(),
       pairs,
       f_dist_ratio_,
+      semantic_compatibility_.get(),
       map_PutativesMatches);
   }
   else
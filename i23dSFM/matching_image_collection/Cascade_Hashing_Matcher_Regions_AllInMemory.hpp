@@ -8,6 +8,7 @@
 #pragma once
 
 #include "i23dSFM/matching_image_collection/Matcher.hpp"
+#include "i23dSFM/matching/semantic_label_compatibility.hpp"
 
 namespace i23dSFM {
 namespace matching_image_collection {
@@ -18,13 +19,16 @@ namespace matching_image_collection {
 ///  a threshold over the distance ratio of the 2 nearest neighbours.
 /// Using a Cascade Hashing matching
 /// Cascade hashing tables are computed once and used for all the regions.
+/// If a semantic label compatibility table is provided, the hashing tables are
+///  partitioned by semantic label and only compatible regions are compared.
 ///
 class Cascade_Hashing_Matcher_Regions_AllInMemory : public Matcher
 {
   public:
   Cascade_Hashing_Matcher_Regions_AllInMemory
   (
-    float dist_ratio
+    float dist_ratio,
+    std::shared_ptr<matching::SemanticLabelCompatibility> semantic_compatibility = nullptr
   );
 
   /// Find corresponding points between some pair of view Ids
@@ -39,6 +43,8 @@ class Cascade_Hashing_Matcher_Regions_AllInMemory : public Matcher
   private:
   // Distance ratio used to discard spurious correspondence
   float f_dist_ratio_;
+  // Semantic label gating (no gating if null)
+  std::shared_ptr<matching::SemanticLabelCompatibility> semantic_compatibility_;
 };
 
 } // namespace i23dSFM
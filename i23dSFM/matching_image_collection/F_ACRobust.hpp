@@ -27,8 +27,10 @@ struct GeometricFilter_FMatrix_AC
 {
   GeometricFilter_FMatrix_AC(
     double dPrecision = std::numeric_limits<double>::infinity(),
-    size_t iteration = 1024)
-    : m_dPrecision(dPrecision), m_stIteration(iteration), m_F(Mat3::Identity()),
+    size_t iteration = 1024,
+    const robust::ACRANSAC_Options & ransac_options = robust::ACRANSAC_Options())
+    : m_dPrecision(dPrecision), m_stIteration(iteration), m_ransac_options(ransac_options),
+      m_F(Mat3::Identity()),
       m_dPrecision_robust(std::numeric_limits<double>::infinity()){};
 
   /// Robust fitting of the FUNDAMENTAL matrix
@@ -75,7 +77,8 @@ struct GeometricFilter_FMatrix_AC
     const double upper_bound_precision = Square(m_dPrecision);
     std::vector<size_t> vec_inliers;
     const std::pair<double,double> ACRansacOut =
-      ACRANSAC(kernel, vec_inliers, m_stIteration, &m_F, upper_bound_precision);
+      ACRANSAC(kernel, vec_inliers, m_stIteration, &m_F, upper_bound_precision,
+        false, m_ransac_options);
 
     if (vec_inliers.size() > KernelType::MINIMUM_SAMPLES *2.5)  {
       m_dPrecision_robust = ACRansacOut.first;
@@ -134,6 +137,7 @@ struct GeometricFilter_FMatrix_AC
 
   double m_dPrecision;  //upper_bound precision used for robust estimation
   size_t m_stIteration; //maximal number of iteration for robust estimation
+  robust::ACRANSAC_Options m_ransac_options; //adaptive iteration count & early rejection
   //
   //-- Stored data
   Mat3 m_F;
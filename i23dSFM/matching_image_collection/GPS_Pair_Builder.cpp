@@ -0,0 +1,314 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/matching_image_collection/GPS_Pair_Builder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace i23dSFM {
+namespace matching_image_collection {
+
+Vec3 GPSToLocalENU
+(
+  const Vec3 & lat_lon_alt,
+  const Vec3 & reference_lat_lon_alt
+)
+{
+  static const double earth_radius = 6378137.0; // WGS84 semi-major axis (m)
+  const double deg_to_rad = M_PI / 180.0;
+  const double cos_lat0 = std::cos(reference_lat_lon_alt(0) * deg_to_rad);
+  return Vec3(
+    (lat_lon_alt(1) - reference_lat_lon_alt(1)) * deg_to_rad * earth_radius * cos_lat0,
+    (lat_lon_alt(0) - reference_lat_lon_alt(0)) * deg_to_rad * earth_radius,
+    lat_lon_alt(2) - reference_lat_lon_alt(2));
+}
+
+GPS_Grid_Index::GPS_Grid_Index
+(
+  const std::vector<Vec2> & positions,
+  const std::vector<bool> & valid,
+  double cell_size
+)
+: _cell_size(cell_size > 0.0 ? cell_size : 1.0), _positions(positions),
+  _min_cx(0), _max_cx(-1), _min_cy(0), _max_cy(-1)
+{
+  // Sort the positions by cell key
+  std::vector<std::pair<uint64_t, size_t> > vec_key_index;
+  vec_key_index.reserve(positions.size());
+  for (size_t i = 0; i < positions.size(); ++i)
+  {
+    if (!valid[i])
+      continue;
+    const int64_t cx = CellCoordinate(positions[i](0));
+    const int64_t cy = CellCoordinate(positions[i](1));
+    if (vec_key_index.empty())
+    {
+      _min_cx = _max_cx = cx;
+      _min_cy = _max_cy = cy;
+    }
+    _min_cx = std::min(_min_cx, cx); _max_cx = std::max(_max_cx, cx);
+    _min_cy = std::min(_min_cy, cy); _max_cy = std::max(_max_cy, cy);
+    vec_key_index.push_back(std::make_pair(CellKey(cx, cy), i));
+  }
+  std::sort(vec_key_index.begin(), vec_key_index.end());
+
+  _indexes.reserve(vec_key_index.size());
+  for (size_t i = 0; i < vec_key_index.size(); ++i)
+  {
+    if (i == 0 || vec_key_index[i].first != vec_key_index[i-1].first)
+    {
+      _cell_keys.push_back(vec_key_index[i].first);
+      _cell_offsets.push_back(i);
+    }
+    _indexes.push_back(vec_key_index[i].second);
+  }
+  _cell_offsets.push_back(_indexes.size());
+}
+
+int64_t GPS_Grid_Index::CellCoordinate(double x) const
+{
+  return static_cast<int64_t>(std::floor(x / _cell_size));
+}
+
+uint64_t GPS_Grid_Index::CellKey(int64_t cx, int64_t cy)
+{
+  return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) |
+    static_cast<uint64_t>(static_cast<uint32_t>(cy));
+}
+
+void GPS_Grid_Index::CellPositions
+(
+  int64_t cx,
+  int64_t cy,
+  std::vector<size_t> & indexes
+) const
+{
+  const std::vector<uint64_t>::const_iterator it =
+    std::lower_bound(_cell_keys.begin(), _cell_keys.end(), CellKey(cx, cy));
+  if (it == _cell_keys.end() || *it != CellKey(cx, cy))
+    return;
+  const size_t cell = std::distance(_cell_keys.begin(), it);
+  indexes.insert(indexes.end(),
+    _indexes.begin() + _cell_offsets[cell], _indexes.begin() + _cell_offsets[cell+1]);
+}
+
+void GPS_Grid_Index::RadiusSearch
+(
+  const Vec2 & p,
+  double radius,
+  std::vector<size_t> & indexes
+) const
+{
+  indexes.clear();
+  if (_indexes.empty() || radius <= 0.0)
+    return;
+  const int64_t cx_begin = std::max(_min_cx, CellCoordinate(p(0) - radius));
+  const int64_t cx_end = std::min(_max_cx, CellCoordinate(p(0) + radius));
+  const int64_t cy_begin = std::max(_min_cy, CellCoordinate(p(1) - radius));
+  const int64_t cy_end = std::min(_max_cy, CellCoordinate(p(1) + radius));
+  if (cx_begin > cx_end || cy_begin > cy_end)
+    return;
+
+  std::vector<size_t> candidates;
+  if (static_cast<double>(cx_end - cx_begin + 1) * (cy_end - cy_begin + 1) > _cell_keys.size())
+  {
+    // The disk covers more cells than the non empty ones: scan all the positions
+    candidates = _indexes;
+  }
+  else
+  {
+    for (int64_t cx = cx_begin; cx <= cx_end; ++cx)
+      for (int64_t cy = cy_begin; cy <= cy_end; ++cy)
+        CellPositions(cx, cy, candidates);
+  }
+  const double radius2 = radius * radius;
+  for (const size_t index : candidates)
+  {
+    if ((_positions[index] - p).squaredNorm() < radius2)
+      indexes.push_back(index);
+  }
+}
+
+void GPS_Grid_Index::KNearestSearch
+(
+  const Vec2 & p,
+  size_t k,
+  std::vector<size_t> & indexes
+) const
+{
+  indexes.clear();
+  if (_indexes.empty() || k == 0)
+    return;
+  const int64_t cx = CellCoordinate(p(0));
+  const int64_t cy = CellCoordinate(p(1));
+  // Largest ring needed to cover the whole grid
+  const int64_t max_ring = std::max(
+    std::max(std::abs(cx - _min_cx), std::abs(cx - _max_cx)),
+    std::max(std::abs(cy - _min_cy), std::abs(cy - _max_cy)));
+
+  // Visit the cells by increasing rings around the cell of p: the positions
+  // outside the ring r are farther than r * cell_size from p.
+  std::vector<std::pair<double, size_t> > vec_distance_index;
+  std::vector<size_t> candidates;
+  for (int64_t ring = 0; ring <= max_ring; ++ring)
+  {
+    candidates.clear();
+    for (int64_t x = cx - ring; x <= cx + ring; ++x)
+    {
+      if (x < _min_cx || x > _max_cx)
+        continue;
+      if (x == cx - ring || x == cx + ring)
+      {
+        for (int64_t y = cy - ring; y <= cy + ring; ++y)
+          CellPositions(x, y, candidates);
+      }
+      else
+      {
+        CellPositions(x, cy - ring, candidates);
+        CellPositions(x, cy + ring, candidates);
+      }
+    }
+    for (const size_t index : candidates)
+      vec_distance_index.push_back(
+        std::make_pair((_positions[index] - p).squaredNorm(), index));
+
+    if (vec_distance_index.size() >= k)
+    {
+      std::nth_element(vec_distance_index.begin(), vec_distance_index.begin() + (k - 1),
+        vec_distance_index.end());
+      const double covered = ring * _cell_size;
+      if (vec_distance_index[k - 1].first <= covered * covered)
+        break;
+    }
+  }
+  const size_t nb = std::min(k, vec_distance_index.size());
+  std::partial_sort(vec_distance_index.begin(), vec_distance_index.begin() + nb,
+    vec_distance_index.end());
+  for (size_t i = 0; i < nb; ++i)
+    indexes.push_back(vec_distance_index[i].second);
+}
+
+// Do the two images pass the altitude and heading gating
+static bool GatingPass
+(
+  const GPS_Image_Position & a,
+  const GPS_Image_Position & b,
+  const GPS_Pair_Options & options
+)
+{
+  if (options._max_altitude_difference >= 0.0 &&
+      std::abs(a._enu(2) - b._enu(2)) > options._max_altitude_difference)
+    return false;
+  if (options._max_heading_difference >= 0.0 && a._heading >= 0.0 && b._heading >= 0.0)
+  {
+    const double difference = std::fmod(std::abs(a._heading - b._heading), 360.0);
+    if (std::min(difference, 360.0 - difference) > options._max_heading_difference)
+      return false;
+  }
+  return true;
+}
+
+Pair_Set GPSNeighborPairs
+(
+  const std::vector<GPS_Image_Position> & positions,
+  const GPS_Pair_Options & options
+)
+{
+  const size_t nb_images = positions.size();
+  std::vector<Vec2> vec_xy(nb_images);
+  std::vector<bool> vec_valid(nb_images);
+  std::vector<double> vec_radius;
+  for (size_t i = 0; i < nb_images; ++i)
+  {
+    vec_xy[i] = positions[i]._enu.head<2>();
+    vec_valid[i] = positions[i]._bValid;
+    if (positions[i]._bValid && positions[i]._radius > 0.0)
+      vec_radius.push_back(positions[i]._radius);
+  }
+
+  // Cell size: the typical search radius
+  double cell_size = options._max_distance;
+  if (cell_size <= 0.0 && !vec_radius.empty())
+  {
+    std::nth_element(vec_radius.begin(), vec_radius.begin() + vec_radius.size() / 2, vec_radius.end());
+    cell_size = vec_radius[vec_radius.size() / 2];
+  }
+  if (cell_size <= 0.0)
+  {
+    // Only k-nearest queries: about one image per cell
+    Vec2 min_xy = Vec2::Constant(std::numeric_limits<double>::max());
+    Vec2 max_xy = -min_xy;
+    size_t nb_valid = 0;
+    for (size_t i = 0; i < nb_images; ++i)
+    {
+      if (!vec_valid[i])
+        continue;
+      min_xy = min_xy.cwiseMin(vec_xy[i]);
+      max_xy = max_xy.cwiseMax(vec_xy[i]);
+      ++nb_valid;
+    }
+    if (nb_valid > 0)
+      cell_size = std::max((max_xy - min_xy).maxCoeff() / std::sqrt(static_cast<double>(nb_valid)), 1.0);
+  }
+  const GPS_Grid_Index grid(vec_xy, vec_valid, cell_size);
+
+  std::vector<std::vector<size_t> > vec_neighbors(nb_images);
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < static_cast<int>(nb_images); ++i)
+  {
+    std::vector<size_t> & neighbors = vec_neighbors[i];
+    if (!positions[i]._bValid)
+    {
+      // Bounded fallback: the neighbours of the image in the listing order
+      const size_t begin = (static_cast<size_t>(i) > options._no_gps_neighbors) ? i - options._no_gps_neighbors : 0;
+      const size_t end = std::min(nb_images, i + options._no_gps_neighbors + 1);
+      for (size_t j = begin; j < end; ++j)
+        neighbors.push_back(j);
+      continue;
+    }
+
+    const double radius = (options._max_distance > 0.0) ? options._max_distance : positions[i]._radius;
+    std::vector<size_t> candidates;
+    if (radius > 0.0)
+      grid.RadiusSearch(vec_xy[i], radius, candidates);
+    else if (options._max_neighbors > 0)
+      // Unknown footprint: ask more neighbours than needed to leave room for the gating
+      grid.KNearestSearch(vec_xy[i], 2 * options._max_neighbors + 1, candidates);
+
+    std::vector<std::pair<double, size_t> > vec_distance_index;
+    for (const size_t j : candidates)
+    {
+      if (j != static_cast<size_t>(i) && GatingPass(positions[i], positions[j], options))
+        vec_distance_index.push_back(std::make_pair((vec_xy[j] - vec_xy[i]).squaredNorm(), j));
+    }
+    if (options._max_neighbors > 0 && vec_distance_index.size() > options._max_neighbors)
+    {
+      std::partial_sort(vec_distance_index.begin(),
+        vec_distance_index.begin() + options._max_neighbors, vec_distance_index.end());
+      vec_distance_index.resize(options._max_neighbors);
+    }
+    for (const auto & distance_index : vec_distance_index)
+      neighbors.push_back(distance_index.second);
+  }
+
+  Pair_Set pairs;
+  for (size_t i = 0; i < nb_images; ++i)
+  {
+    for (const size_t j : vec_neighbors[i])
+    {
+      if (i != j)
+        pairs.insert(Pair(static_cast<IndexT>(std::min(i, j)), static_cast<IndexT>(std::max(i, j))));
+    }
+  }
+  return pairs;
+}
+
+} // namespace matching_image_collection
+} // namespace i23dSFM
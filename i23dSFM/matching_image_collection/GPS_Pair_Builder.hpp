@@ -0,0 +1,109 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_MATCHING_IMAGE_COLLECTION_GPS_PAIR_BUILDER_HPP
+#define I23DSFM_MATCHING_IMAGE_COLLECTION_GPS_PAIR_BUILDER_HPP
+
+#include "i23dSFM/types.hpp"
+#include "i23dSFM/numeric/numeric.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace i23dSFM {
+namespace matching_image_collection {
+
+/// Local ENU (east, north, up) coordinates in meters of a GPS position
+/// (latitude, longitude in degrees, altitude in meters) around a reference
+/// position (equirectangular approximation, valid for survey extents).
+Vec3 GPSToLocalENU(
+  const Vec3 & lat_lon_alt,
+  const Vec3 & reference_lat_lon_alt);
+
+/// Geotag of an image
+struct GPS_Image_Position
+{
+  bool _bValid;     // the image has a GPS position
+  Vec3 _enu;        // local ENU position (m)
+  double _radius;   // ground footprint (m): images closer than the largest
+                    //  footprint of the two images overlap (0: unknown)
+  double _heading;  // camera heading in degrees (negative: unknown)
+
+  GPS_Image_Position() : _bValid(false), _enu(Vec3::Zero()), _radius(0.0), _heading(-1.0) {}
+};
+
+/// Uniform grid index of 2D positions with radius and k-nearest queries
+/// (the positions are sorted by cell: a query only visits the cells that
+/// intersect the search disk).
+class GPS_Grid_Index
+{
+public:
+  /// Index the given positions (invalid positions are not indexed)
+  GPS_Grid_Index(
+    const std::vector<Vec2> & positions,
+    const std::vector<bool> & valid,
+    double cell_size);
+
+  /// Indexes of the positions closer than radius to p (unsorted)
+  void RadiusSearch(const Vec2 & p, double radius, std::vector<size_t> & indexes) const;
+
+  /// Indexes of the k nearest positions to p (sorted by increasing distance)
+  void KNearestSearch(const Vec2 & p, size_t k, std::vector<size_t> & indexes) const;
+
+private:
+  int64_t CellCoordinate(double x) const;
+  static uint64_t CellKey(int64_t cx, int64_t cy);
+  /// Append the positions of the cell (cx, cy)
+  void CellPositions(int64_t cx, int64_t cy, std::vector<size_t> & indexes) const;
+
+  double _cell_size;
+  std::vector<Vec2> _positions;
+  std::vector<uint64_t> _cell_keys;     // sorted keys of the non empty cells
+  std::vector<size_t> _cell_offsets;    // positions of a cell: [_cell_offsets[i], _cell_offsets[i+1][
+  std::vector<size_t> _indexes;         // position indexes sorted by cell
+  int64_t _min_cx, _max_cx, _min_cy, _max_cy; // extent of the grid
+};
+
+/// GPS pair generation parameters
+struct GPS_Pair_Options
+{
+  double _max_distance;            // pairs the images closer than this distance (m),
+                                   //  0: use the images footprint
+  size_t _max_neighbors;           // keep only the k nearest images of each image (0: all)
+  double _max_altitude_difference; // reject pairs with a larger altitude difference (m, negative: no gating)
+  double _max_heading_difference;  // reject pairs with a larger heading difference (degrees, negative: no gating)
+  size_t _no_gps_neighbors;        // an image without GPS is paired with this number
+                                   //  of previous and next images of the listing
+
+  GPS_Pair_Options
+  (
+    double max_distance = 0.0,
+    size_t max_neighbors = 0,
+    double max_altitude_difference = -1.0,
+    double max_heading_difference = -1.0,
+    size_t no_gps_neighbors = 10
+  )
+  : _max_distance(max_distance), _max_neighbors(max_neighbors),
+    _max_altitude_difference(max_altitude_difference),
+    _max_heading_difference(max_heading_difference),
+    _no_gps_neighbors(no_gps_neighbors)
+  {}
+};
+
+/// Generate the image pairs from the image geotags with a spatial index:
+/// - an image with GPS is paired with the images with GPS in its search radius
+///   (the fixed distance or the largest footprint of the two images),
+///   that pass the altitude and heading gating, limited to its k nearest ones,
+/// - an image without GPS is paired with its neighbours in the listing order.
+/// The pairs are computed in O(N log N + #pairs) instead of comparing all the images.
+Pair_Set GPSNeighborPairs(
+  const std::vector<GPS_Image_Position> & positions,
+  const GPS_Pair_Options & options);
+
+} // namespace matching_image_collection
+} // namespace i23dSFM
+
+#endif // I23DSFM_MATCHING_IMAGE_COLLECTION_GPS_PAIR_BUILDER_HPP
@@ -0,0 +1,159 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/matching_image_collection/GPS_Pair_Builder.hpp"
+#include "testing/testing.h"
+
+#include <algorithm>
+
+using namespace i23dSFM;
+using namespace i23dSFM::matching_image_collection;
+
+// Random positions in a 1000m x 1000m area, one out of ten without GPS
+static std::vector<GPS_Image_Position> randomPositions(size_t nb_images)
+{
+  std::srand(42);
+  std::vector<GPS_Image_Position> positions(nb_images);
+  for (size_t i = 0; i < nb_images; ++i)
+  {
+    positions[i]._bValid = (i % 10 != 3);
+    positions[i]._enu = Vec3(std::rand() % 1000, std::rand() % 1000, std::rand() % 50);
+    positions[i]._radius = 20.0 + std::rand() % 60;
+  }
+  return positions;
+}
+
+TEST(GPS_Pair_Builder, LocalENU)
+{
+  const Vec3 reference(45.0, 5.0, 100.0);
+  EXPECT_MATRIX_NEAR(Vec3::Zero(), GPSToLocalENU(reference, reference), 1e-9);
+  // One thousandth of degree: ~111m to the north, ~79m to the east at 45 degrees
+  const Vec3 enu = GPSToLocalENU(Vec3(45.001, 5.001, 110.0), reference);
+  EXPECT_NEAR(78.7, enu(0), 0.1);
+  EXPECT_NEAR(111.3, enu(1), 0.1);
+  EXPECT_NEAR(10.0, enu(2), 1e-9);
+}
+
+TEST(GPS_Pair_Builder, GridSearch)
+{
+  const std::vector<GPS_Image_Position> positions = randomPositions(500);
+  std::vector<Vec2> vec_xy;
+  std::vector<bool> vec_valid;
+  for (const GPS_Image_Position & position : positions)
+  {
+    vec_xy.push_back(position._enu.head<2>());
+    vec_valid.push_back(position._bValid);
+  }
+  const GPS_Grid_Index grid(vec_xy, vec_valid, 35.0);
+
+  for (size_t q = 0; q < 50; ++q)
+  {
+    const Vec2 p(std::rand() % 1200 - 100, std::rand() % 1200 - 100);
+    // Brute force neighbours sorted by distance
+    std::vector<std::pair<double, size_t> > vec_distance_index;
+    for (size_t i = 0; i < vec_xy.size(); ++i)
+    {
+      if (vec_valid[i])
+        vec_distance_index.push_back(std::make_pair((vec_xy[i] - p).norm(), i));
+    }
+    std::sort(vec_distance_index.begin(), vec_distance_index.end());
+
+    const double radius = 10.0 + q * 5.0;
+    std::vector<size_t> expected, found;
+    for (const auto & distance_index : vec_distance_index)
+    {
+      if (distance_index.first < radius)
+        expected.push_back(distance_index.second);
+    }
+    grid.RadiusSearch(p, radius, found);
+    std::sort(expected.begin(), expected.end());
+    std::sort(found.begin(), found.end());
+    EXPECT_TRUE(expected == found);
+
+    const size_t k = 1 + q % 12;
+    grid.KNearestSearch(p, k, found);
+    CHECK_EQUAL(k, found.size());
+    for (size_t i = 0; i < found.size(); ++i)
+      EXPECT_NEAR(vec_distance_index[i].first, (vec_xy[found[i]] - p).norm(), 1e-9);
+  }
+}
+
+TEST(GPS_Pair_Builder, SameAsAllPairs)
+{
+  const std::vector<GPS_Image_Position> positions = randomPositions(300);
+  const GPS_Pair_Options options(0.0, 0, 30.0, -1.0, 2);
+  const Pair_Set pairs = GPSNeighborPairs(positions, options);
+
+  // Exhaustive pairing: footprint overlap for the geotagged images,
+  // listing neighbours for the others
+  Pair_Set expected;
+  for (size_t i = 0; i < positions.size(); ++i)
+  {
+    for (size_t j = i + 1; j < positions.size(); ++j)
+    {
+      const GPS_Image_Position & a = positions[i];
+      const GPS_Image_Position & b = positions[j];
+      bool bPair = false;
+      if (!a._bValid || !b._bValid)
+        bPair = (j - i <= 2);
+      else
+        bPair = (a._enu - b._enu).head<2>().norm() < std::max(a._radius, b._radius) &&
+          std::abs(a._enu(2) - b._enu(2)) <= 30.0;
+      if (bPair)
+        expected.insert(Pair(i, j));
+    }
+  }
+  CHECK_EQUAL(expected.size(), pairs.size());
+  EXPECT_TRUE(expected == pairs);
+}
+
+TEST(GPS_Pair_Builder, NearestNeighbors)
+{
+  std::vector<GPS_Image_Position> positions = randomPositions(200);
+  for (GPS_Image_Position & position : positions)
+    position._radius = 0.0; // unknown footprint: k nearest queries
+  const GPS_Pair_Options options(0.0, 4, -1.0, -1.0, 0);
+  const Pair_Set pairs = GPSNeighborPairs(positions, options);
+
+  std::vector<size_t> degree(positions.size(), 0);
+  for (const Pair & pair : pairs)
+  {
+    ++degree[pair.first];
+    ++degree[pair.second];
+  }
+  for (size_t i = 0; i < positions.size(); ++i)
+  {
+    if (positions[i]._bValid)
+    {
+      EXPECT_TRUE(degree[i] >= 4);
+    }
+    else
+    {
+      CHECK_EQUAL(0, degree[i]);
+    }
+  }
+}
+
+TEST(GPS_Pair_Builder, HeadingGating)
+{
+  std::vector<GPS_Image_Position> positions(3);
+  for (size_t i = 0; i < positions.size(); ++i)
+  {
+    positions[i]._bValid = true;
+    positions[i]._enu = Vec3(i, 0, 0);
+    positions[i]._radius = 10.0;
+  }
+  positions[0]._heading = 350.0;
+  positions[1]._heading = 10.0;
+  positions[2]._heading = 180.0;
+  const Pair_Set pairs = GPSNeighborPairs(positions, GPS_Pair_Options(0.0, 0, -1.0, 45.0));
+  CHECK_EQUAL(1, pairs.size());
+  EXPECT_TRUE(pairs.count(Pair(0, 1)) == 1);
+}
+
+/* ************************************************************************* */
+int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
+/* ************************************************************************* */
@@ -62,15 +62,28 @@ void MatchesPairToMat
     sfm_data->GetIntrinsics().count(view_J->id_intrinsic) ?
       sfm_data->GetIntrinsics().at(view_J->id_intrinsic).get() : NULL;
 
-  // Load features of Inth and Jnth images
-  const features::PointFeatures feature_I = regions_provider->regions_per_view.at(pairIndex.first)->GetRegionsPositions();
-  const features::PointFeatures feature_J = regions_provider->regions_per_view.at(pairIndex.second)->GetRegionsPositions();
+  // Access the features of Inth and Jnth images
+  // (only the matched positions are read, the feature arrays are not copied)
+  const features::Regions * regions_I = regions_provider->regions_per_view.at(pairIndex.first).get();
+  const features::Regions * regions_J = regions_provider->regions_per_view.at(pairIndex.second).get();
 
-  MatchesPointsToMat(
-    putativeMatches,
-    cam_I, feature_I,
-    cam_J, feature_J,
-    x_I, x_J);
+  const size_t n = putativeMatches.size();
+  x_I.resize(2, n);
+  x_J.resize(2, n);
+  typedef typename MatT::Scalar Scalar; // Output matrix type
+  for (size_t i=0; i < n; ++i)  {
+    const Vec2 pt_I = regions_I->GetRegionPosition(putativeMatches[i]._i);
+    const Vec2 pt_J = regions_J->GetRegionPosition(putativeMatches[i]._j);
+    if (cam_I)
+      x_I.col(i) = cam_I->get_ud_pixel(pt_I).cast<Scalar>();
+    else
+      x_I.col(i) = pt_I.cast<Scalar>();
+
+    if (cam_J)
+      x_J.col(i) = cam_J->get_ud_pixel(pt_J).cast<Scalar>();
+    else
+      x_J.col(i) = pt_J.cast<Scalar>();
+  }
 }
 
 } // namespace i23dSFM
@@ -26,8 +26,10 @@ struct GeometricFilter_HMatrix_AC
 {
   GeometricFilter_HMatrix_AC(
     double dPrecision = std::numeric_limits<double>::infinity(),
-    size_t iteration = 1024)
-    : m_dPrecision(dPrecision), m_stIteration(iteration), m_H(Mat3::Identity()),
+    size_t iteration = 1024,
+    const robust::ACRANSAC_Options & ransac_options = robust::ACRANSAC_Options())
+    : m_dPrecision(dPrecision), m_stIteration(iteration), m_ransac_options(ransac_options),
+      m_H(Mat3::Identity()),
       m_dPrecision_robust(std::numeric_limits<double>::infinity()){};
 
   /// Robust fitting of the HOMOGRAPHY matrix
@@ -74,7 +76,8 @@ struct GeometricFilter_HMatrix_AC
     const double upper_bound_precision = Square(m_dPrecision);
     std::vector<size_t> vec_inliers;
     const std::pair<double,double> ACRansacOut =
-      ACRANSAC(kernel, vec_inliers, m_stIteration, &m_H, upper_bound_precision);
+      ACRANSAC(kernel, vec_inliers, m_stIteration, &m_H, upper_bound_precision,
+        false, m_ransac_options);
 
     if (vec_inliers.size() > KernelType::MINIMUM_SAMPLES *2.5)  {
       m_dPrecision_robust = ACRansacOut.first;
@@ -177,6 +180,7 @@ struct GeometricFilter_HMatrix_AC
 
   double m_dPrecision;  //upper_bound precision used for robust estimation
   size_t m_stIteration; //maximal number of iteration for robust estimation
+  robust::ACRANSAC_Options m_ransac_options; //adaptive iteration count & early rejection
   //
   //-- Stored data
   Mat3 m_H;
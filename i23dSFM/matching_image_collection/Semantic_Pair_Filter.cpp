@@ -0,0 +1,283 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/matching_image_collection/Semantic_Pair_Filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+namespace i23dSFM {
+namespace matching_image_collection {
+
+using namespace i23dSFM::features;
+using namespace i23dSFM::matching;
+
+void Semantic_View_Signature::Compute
+(
+  const Regions & regions,
+  const size_t image_height,
+  const size_t bands,
+  const float min_label_frequency
+)
+{
+  labels.clear();
+  frequency.clear();
+  layout.clear();
+  nb_bands = std::max<size_t>(1, bands);
+  nb_features = regions.RegionCount();
+  if (nb_features == 0)
+    return;
+
+  float height = static_cast<float>(image_height);
+  if (image_height == 0)
+  {
+    for (size_t i = 0; i < nb_features; ++i)
+      height = std::max(height, static_cast<float>(regions.GetRegionPosition(i)(1)) + 1.f);
+  }
+
+  // Per label: features count in each rows band
+  std::map<int, std::vector<size_t> > map_label_bands;
+  for (size_t i = 0; i < nb_features; ++i)
+  {
+    std::vector<size_t> & label_bands = map_label_bands[regions.GetRegionsPositionLabel(i)];
+    label_bands.resize(nb_bands, 0);
+    const float y = static_cast<float>(regions.GetRegionPosition(i)(1));
+    const size_t band = std::min(nb_bands - 1,
+      static_cast<size_t>(std::max(0.f, y) / height * nb_bands));
+    ++label_bands[band];
+  }
+
+  for (const auto & label_bands : map_label_bands)
+  {
+    size_t count = 0;
+    for (const size_t band_count : label_bands.second)
+      count += band_count;
+    const float label_frequency = count / static_cast<float>(nb_features);
+    // Ignore the labels of a few isolated features (segmentation noise)
+    if (label_frequency < min_label_frequency)
+      continue;
+    labels.push_back(label_bands.first);
+    frequency.push_back(label_frequency);
+    for (const size_t band_count : label_bands.second)
+      layout.push_back(band_count / static_cast<float>(count));
+  }
+}
+
+namespace impl
+{
+/// Semantic overlap from two label lists and a label compatibility predicate
+template <typename CompatibilityT>
+float Overlap
+(
+  const std::vector<int> & labels_I,
+  const std::vector<float> & frequency_I,
+  const std::vector<int> & labels_J,
+  const std::vector<float> & frequency_J,
+  const CompatibilityT & isCompatible
+)
+{
+  float matchable_I = 0.f;
+  std::vector<bool> matchable_J(labels_J.size(), false);
+  for (size_t a = 0; a < labels_I.size(); ++a)
+  {
+    bool bMatchable = false;
+    for (size_t b = 0; b < labels_J.size(); ++b)
+    {
+      if (isCompatible(labels_I[a], labels_J[b]))
+      {
+        bMatchable = true;
+        matchable_J[b] = true;
+      }
+    }
+    if (bMatchable)
+      matchable_I += frequency_I[a];
+  }
+  float matchable_J_sum = 0.f;
+  for (size_t b = 0; b < labels_J.size(); ++b)
+  {
+    if (matchable_J[b])
+      matchable_J_sum += frequency_J[b];
+  }
+  return std::min(matchable_I, matchable_J_sum);
+}
+} // namespace impl
+
+float SemanticOverlap
+(
+  const Semantic_View_Signature & signature_I,
+  const Semantic_View_Signature & signature_J,
+  const SemanticLabelCompatibility & compatibility
+)
+{
+  return impl::Overlap(signature_I.labels, signature_I.frequency,
+    signature_J.labels, signature_J.frequency,
+    [&compatibility](int a, int b) { return compatibility.IsCompatible(a, b); });
+}
+
+float SemanticLayoutSimilarity
+(
+  const Semantic_View_Signature & signature_I,
+  const Semantic_View_Signature & signature_J
+)
+{
+  if (signature_I.nb_bands != signature_J.nb_bands)
+    return 0.f;
+  const size_t nb_bands = signature_I.nb_bands;
+  float similarity = 0.f, weight_sum = 0.f;
+  // Merge of the sorted label lists
+  size_t a = 0, b = 0;
+  while (a < signature_I.labels.size() && b < signature_J.labels.size())
+  {
+    if (signature_I.labels[a] < signature_J.labels[b])
+      ++a;
+    else if (signature_J.labels[b] < signature_I.labels[a])
+      ++b;
+    else
+    {
+      const float weight = std::min(signature_I.frequency[a], signature_J.frequency[b]);
+      float distance = 0.f;
+      for (size_t k = 0; k < nb_bands; ++k)
+        distance += std::abs(signature_I.layout[a * nb_bands + k] - signature_J.layout[b * nb_bands + k]);
+      similarity += weight * (1.f - 0.5f * distance);
+      weight_sum += weight;
+      ++a;
+      ++b;
+    }
+  }
+  return weight_sum > 0.f ? similarity / weight_sum : 0.f;
+}
+
+size_t semanticPairFilter
+(
+  const sfm::SfM_Data & sfm_data,
+  const sfm::Regions_Provider & regions_provider,
+  const SemanticLabelCompatibility & compatibility,
+  const Semantic_Pair_Filter_Options & options,
+  Pair_Set & pairs
+)
+{
+  if (pairs.empty())
+    return 0;
+
+  // Signatures of the views used by the pairs
+  std::vector<IndexT> vec_views;
+  {
+    std::set<IndexT> set_views;
+    for (const Pair & pair : pairs)
+    {
+      set_views.insert(pair.first);
+      set_views.insert(pair.second);
+    }
+    vec_views.assign(set_views.begin(), set_views.end());
+  }
+  std::vector<Semantic_View_Signature> vec_signatures(vec_views.size());
+  std::vector<bool> vec_bFiltered(vec_views.size(), false);
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int v = 0; v < static_cast<int>(vec_views.size()); ++v)
+  {
+    const auto it_regions = regions_provider.regions_per_view.find(vec_views[v]);
+    const auto it_view = sfm_data.GetViews().find(vec_views[v]);
+    if (it_regions == regions_provider.regions_per_view.end() || !it_regions->second)
+      continue;
+    const size_t height = (it_view != sfm_data.GetViews().end()) ? it_view->second->ui_height : 0;
+    vec_signatures[v].Compute(*it_regions->second, height, options._nb_bands);
+    // Too few features to trust the semantic content
+    vec_bFiltered[v] = vec_signatures[v].nb_features >= options._min_features;
+  }
+
+  // Dense compatibility table between all the labels of the collection
+  std::vector<int> all_labels;
+  for (const Semantic_View_Signature & signature : vec_signatures)
+    all_labels.insert(all_labels.end(), signature.labels.begin(), signature.labels.end());
+  std::sort(all_labels.begin(), all_labels.end());
+  all_labels.erase(std::unique(all_labels.begin(), all_labels.end()), all_labels.end());
+  const size_t nb_labels = all_labels.size();
+  std::vector<char> compatibility_table(nb_labels * nb_labels);
+  for (size_t a = 0; a < nb_labels; ++a)
+    for (size_t b = 0; b < nb_labels; ++b)
+      compatibility_table[a * nb_labels + b] = compatibility.IsCompatible(all_labels[a], all_labels[b]);
+  // Labels of each view as index in the table
+  std::vector<std::vector<int> > vec_label_indexes(vec_signatures.size());
+  for (size_t v = 0; v < vec_signatures.size(); ++v)
+  {
+    for (const int label : vec_signatures[v].labels)
+      vec_label_indexes[v].push_back(static_cast<int>(
+        std::lower_bound(all_labels.begin(), all_labels.end(), label) - all_labels.begin()));
+  }
+  const auto isCompatible = [&compatibility_table, nb_labels](int a, int b)
+  {
+    return compatibility_table[a * nb_labels + b] != 0;
+  };
+
+  // Score the pairs (negative score: rejected pair, NaN: pair not scored)
+  const std::vector<Pair> vec_pairs(pairs.begin(), pairs.end());
+  std::vector<float> vec_scores(vec_pairs.size(), std::numeric_limits<float>::quiet_NaN());
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(static)
+#endif
+  for (int p = 0; p < static_cast<int>(vec_pairs.size()); ++p)
+  {
+    const size_t I = std::lower_bound(vec_views.begin(), vec_views.end(), vec_pairs[p].first) - vec_views.begin();
+    const size_t J = std::lower_bound(vec_views.begin(), vec_views.end(), vec_pairs[p].second) - vec_views.begin();
+    if (!vec_bFiltered[I] || !vec_bFiltered[J])
+      continue;
+    const float overlap = impl::Overlap(
+      vec_label_indexes[I], vec_signatures[I].frequency,
+      vec_label_indexes[J], vec_signatures[J].frequency,
+      isCompatible);
+    if (overlap < options._min_overlap)
+      vec_scores[p] = -1.f;
+    else
+      vec_scores[p] = overlap * (0.5f + 0.5f * SemanticLayoutSimilarity(vec_signatures[I], vec_signatures[J]));
+  }
+
+  // The pairs that cannot be scored pass through, outside the ranking
+  std::vector<bool> vec_bKeep(vec_pairs.size(), false);
+  for (size_t p = 0; p < vec_pairs.size(); ++p)
+    vec_bKeep[p] = std::isnan(vec_scores[p]);
+  if (options._nb_max_pairs_per_view == 0)
+  {
+    for (size_t p = 0; p < vec_pairs.size(); ++p)
+      vec_bKeep[p] = vec_bKeep[p] || vec_scores[p] >= 0.f;
+  }
+  else
+  {
+    // Keep the best ranked pairs of each view
+    std::map<IndexT, std::vector<std::pair<float, size_t> > > map_view_pairs;
+    for (size_t p = 0; p < vec_pairs.size(); ++p)
+    {
+      if (vec_bKeep[p] || vec_scores[p] < 0.f)
+        continue;
+      map_view_pairs[vec_pairs[p].first].push_back(std::make_pair(-vec_scores[p], p));
+      map_view_pairs[vec_pairs[p].second].push_back(std::make_pair(-vec_scores[p], p));
+    }
+    for (auto & view_pairs : map_view_pairs)
+    {
+      std::vector<std::pair<float, size_t> > & ranked = view_pairs.second;
+      const size_t nb_kept = std::min(options._nb_max_pairs_per_view, ranked.size());
+      std::partial_sort(ranked.begin(), ranked.begin() + nb_kept, ranked.end());
+      for (size_t k = 0; k < nb_kept; ++k)
+        vec_bKeep[ranked[k].second] = true;
+    }
+  }
+
+  Pair_Set kept_pairs;
+  for (size_t p = 0; p < vec_pairs.size(); ++p)
+  {
+    if (vec_bKeep[p])
+      kept_pairs.insert(kept_pairs.end(), vec_pairs[p]);
+  }
+  const size_t nb_rejected = pairs.size() - kept_pairs.size();
+  pairs.swap(kept_pairs);
+  return nb_rejected;
+}
+
+} // namespace matching_image_collection
+} // namespace i23dSFM
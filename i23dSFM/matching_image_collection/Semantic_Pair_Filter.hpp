@@ -0,0 +1,92 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_MATCHING_IMAGE_COLLECTION_SEMANTIC_PAIR_FILTER_HPP
+#define I23DSFM_MATCHING_IMAGE_COLLECTION_SEMANTIC_PAIR_FILTER_HPP
+
+#include "i23dSFM/types.hpp"
+#include "i23dSFM/features/regions.hpp"
+#include "i23dSFM/matching/semantic_label_compatibility.hpp"
+#include "i23dSFM/sfm/sfm_data.hpp"
+#include "i23dSFM/sfm/pipelines/sfm_regions_provider.hpp"
+
+#include <vector>
+
+namespace i23dSFM {
+namespace matching_image_collection {
+
+/// Semantic content of a view computed from the labels of its features:
+/// - the label histogram (frequency of each label),
+/// - the label layout (vertical distribution of each label in the image).
+struct Semantic_View_Signature
+{
+  std::vector<int> labels;     // sorted labels present in the view
+  std::vector<float> frequency; // frequency of each label
+  std::vector<float> layout;    // per label: normalized histogram over the image rows bands
+  size_t nb_bands;
+  size_t nb_features;
+
+  Semantic_View_Signature() : nb_bands(0), nb_features(0) {}
+
+  /// Compute the signature from the regions of a view
+  /// (image_height: used to define the rows bands, 0 to use the features extent).
+  void Compute(
+    const features::Regions & regions,
+    const size_t image_height,
+    const size_t nb_bands = 4,
+    const float min_label_frequency = 0.01f);
+};
+
+/// Fraction of the features of both views that have a semantically compatible
+/// counterpart label in the other view (0: the views cannot overlap).
+float SemanticOverlap(
+  const Semantic_View_Signature & signature_I,
+  const Semantic_View_Signature & signature_J,
+  const matching::SemanticLabelCompatibility & compatibility);
+
+/// Similarity of the label layouts of two views in [0,1]
+/// (weighted agreement of the vertical distributions of the shared labels).
+float SemanticLayoutSimilarity(
+  const Semantic_View_Signature & signature_I,
+  const Semantic_View_Signature & signature_J);
+
+/// Semantic pair filtering parameters
+struct Semantic_Pair_Filter_Options
+{
+  float _min_overlap;             // reject the pairs with a lower semantic overlap
+  size_t _nb_max_pairs_per_view;  // keep only the best ranked pairs of each view (0: all)
+  size_t _min_features;           // the pairs of views with fewer features are kept and not ranked
+  size_t _nb_bands;               // number of rows bands of the label layout
+
+  Semantic_Pair_Filter_Options
+  (
+    float min_overlap = 0.05f,
+    size_t nb_max_pairs_per_view = 0,
+    size_t min_features = 50,
+    size_t nb_bands = 4
+  )
+  : _min_overlap(min_overlap), _nb_max_pairs_per_view(nb_max_pairs_per_view),
+    _min_features(min_features), _nb_bands(nb_bands)
+  {}
+};
+
+/// Filter the putative pairs according to the semantic content of the views.
+/// The pairs whose label histograms cannot overlap are rejected, then the
+/// remaining pairs are ranked by overlap and layout similarity (a pair is kept
+/// if it is one of the nb_max_pairs_per_view best pairs of one of its views).
+/// The pairs of views with too few features to be scored are always kept.
+/// Return the number of rejected pairs.
+size_t semanticPairFilter(
+  const sfm::SfM_Data & sfm_data,
+  const sfm::Regions_Provider & regions_provider,
+  const matching::SemanticLabelCompatibility & compatibility,
+  const Semantic_Pair_Filter_Options & options,
+  Pair_Set & pairs);
+
+} // namespace matching_image_collection
+} // namespace i23dSFM
+
+#endif // I23DSFM_MATCHING_IMAGE_COLLECTION_SEMANTIC_PAIR_FILTER_HPP
@@ -0,0 +1,112 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/matching_image_collection/Semantic_Pair_Filter.hpp"
+#include "i23dSFM/matching_image_collection/Pair_Builder.hpp"
+#include "i23dSFM/features/regions_factory.hpp"
+#include "testing/testing.h"
+
+using namespace i23dSFM;
+using namespace i23dSFM::features;
+using namespace i23dSFM::matching;
+using namespace i23dSFM::matching_image_collection;
+
+// Regions of a 100x100 image: each (label, count, y) adds count features at row y
+static std::unique_ptr<Regions> makeRegions(
+  const std::vector<std::pair<int, std::pair<size_t, float> > > & content)
+{
+  std::unique_ptr<SIFT_Regions> regions(new SIFT_Regions);
+  for (const auto & label_content : content)
+  {
+    for (size_t i = 0; i < label_content.second.first; ++i)
+    {
+      regions->Features().push_back(SIOPointFeature(
+        static_cast<float>(i % 100), label_content.second.second, label_content.first));
+      regions->Descriptors().push_back(SIFT_Regions::DescriptorT());
+    }
+  }
+  return std::unique_ptr<Regions>(regions.release());
+}
+
+TEST(Semantic_Pair_Filter, Signature)
+{
+  // sky (0) on top, road (1) at the bottom, a few noisy labels (2)
+  std::unique_ptr<Regions> regions = makeRegions({
+    {0, {60, 10.f}}, {1, {139, 90.f}}, {2, {1, 50.f}}});
+  Semantic_View_Signature signature;
+  signature.Compute(*regions, 100, 4);
+  EXPECT_EQ(200, signature.nb_features);
+  EXPECT_EQ(2, signature.labels.size()); // the noisy label is ignored
+  EXPECT_NEAR(0.3, signature.frequency[0], 1e-6);
+  EXPECT_NEAR(1.0, signature.layout[0], 1e-6); // sky: first band
+  EXPECT_NEAR(1.0, signature.layout[4 + 3], 1e-6); // road: last band
+  EXPECT_NEAR(1.0, SemanticLayoutSimilarity(signature, signature), 1e-6);
+}
+
+TEST(Semantic_Pair_Filter, Filter)
+{
+  sfm::SfM_Data sfm_data;
+  sfm::Regions_Provider regions_provider;
+  // 0: all sky, 1: all road, 2 & 3: sky and road
+  regions_provider.regions_per_view[0] = makeRegions({{0, {100, 10.f}}});
+  regions_provider.regions_per_view[1] = makeRegions({{1, {100, 90.f}}});
+  regions_provider.regions_per_view[2] = makeRegions({{0, {50, 10.f}}, {1, {50, 90.f}}});
+  regions_provider.regions_per_view[3] = makeRegions({{0, {40, 10.f}}, {1, {60, 90.f}}});
+
+  SemanticLabelCompatibility compatibility;
+  const Pair_Set all_pairs = exhaustivePairs(4);
+  {
+    Pair_Set pairs = all_pairs;
+    EXPECT_EQ(1, semanticPairFilter(sfm_data, regions_provider, compatibility,
+      Semantic_Pair_Filter_Options(0.05f), pairs));
+    EXPECT_EQ(5, pairs.size());
+    EXPECT_TRUE(pairs.count(Pair(0,1)) == 0);
+  }
+  // Sky can match road: nothing is rejected
+  {
+    compatibility.SetCompatible(0, 1);
+    Pair_Set pairs = all_pairs;
+    EXPECT_EQ(0, semanticPairFilter(sfm_data, regions_provider, compatibility,
+      Semantic_Pair_Filter_Options(0.05f), pairs));
+    compatibility.SetCompatible(0, 1, false);
+  }
+  // Keep only the best pair of each view
+  // (scores: (0,2) 0.5, (0,3) 0.4, (1,2) 0.5, (1,3) 0.6, (2,3) 1)
+  {
+    Pair_Set pairs = all_pairs;
+    EXPECT_EQ(3, semanticPairFilter(sfm_data, regions_provider, compatibility,
+      Semantic_Pair_Filter_Options(0.05f, 1), pairs));
+    EXPECT_EQ(3, pairs.size());
+    EXPECT_TRUE(pairs.count(Pair(0,2)) == 1);
+    EXPECT_TRUE(pairs.count(Pair(1,3)) == 1);
+    EXPECT_TRUE(pairs.count(Pair(2,3)) == 1);
+  }
+  // The pairs of a view with too few features are kept
+  // without outranking the scored pairs
+  {
+    regions_provider.regions_per_view[4] = makeRegions({{0, {10, 10.f}}});
+    Pair_Set pairs = exhaustivePairs(5);
+    EXPECT_EQ(3, semanticPairFilter(sfm_data, regions_provider, compatibility,
+      Semantic_Pair_Filter_Options(0.05f, 1), pairs));
+    EXPECT_EQ(7, pairs.size());
+    EXPECT_TRUE(pairs.count(Pair(0,2)) == 1);
+    EXPECT_TRUE(pairs.count(Pair(1,3)) == 1);
+    EXPECT_TRUE(pairs.count(Pair(2,3)) == 1);
+    for (IndexT i = 0; i < 4; ++i)
+      EXPECT_TRUE(pairs.count(Pair(i,4)) == 1);
+    regions_provider.regions_per_view.erase(4);
+  }
+  // Views with too few features are never filtered
+  {
+    Pair_Set pairs = all_pairs;
+    EXPECT_EQ(0, semanticPairFilter(sfm_data, regions_provider, compatibility,
+      Semantic_Pair_Filter_Options(0.05f, 0, 1000), pairs));
+  }
+}
+
+/* ************************************************************************* */
+int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
+/* ************************************************************************* */
@@ -0,0 +1,606 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/matching_image_collection/Vocabulary_Tree.hpp"
+#include "i23dSFM/stl/split.hpp"
+#include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <typeinfo>
+
+namespace i23dSFM {
+namespace matching_image_collection {
+
+using namespace i23dSFM::features;
+
+namespace impl
+{
+inline float SquaredL2(const float * a, const float * b, const size_t dimension)
+{
+  float distance = 0.f;
+  for (size_t k = 0; k < dimension; ++k)
+  {
+    const float diff = a[k] - b[k];
+    distance += diff * diff;
+  }
+  return distance;
+}
+
+/// Index of the closest center (among nb_centers contiguous centers)
+inline size_t Closest
+(
+  const float * descriptor,
+  const float * centers,
+  const size_t nb_centers,
+  const size_t dimension
+)
+{
+  size_t best = 0;
+  float best_distance = std::numeric_limits<float>::max();
+  for (size_t c = 0; c < nb_centers; ++c)
+  {
+    const float distance = SquaredL2(descriptor, centers + c * dimension, dimension);
+    if (distance < best_distance)
+    {
+      best_distance = distance;
+      best = c;
+    }
+  }
+  return best;
+}
+} // namespace impl
+
+//--
+//-- Vocabulary_Tree
+//--
+
+bool Vocabulary_Tree::Train
+(
+  const std::vector<float> & descriptors,
+  const size_t dimension,
+  const size_t branching,
+  const size_t depth,
+  const size_t max_iterations,
+  const unsigned int seed
+)
+{
+  if (dimension == 0 || branching < 2 || descriptors.size() < dimension
+    || descriptors.size() % dimension != 0)
+  {
+    std::cerr << "Vocabulary_Tree::Train: invalid training data." << std::endl;
+    return false;
+  }
+  _dimension = dimension;
+  _branching = branching;
+  _word_count = 0;
+  _nodes.clear();
+  _centers.clear();
+
+  // Root node (its center is never used)
+  const Node root = {0, 0, 0};
+  _nodes.push_back(root);
+  _centers.resize(_dimension, 0.f);
+
+  std::vector<uint32_t> ids(descriptors.size() / _dimension);
+  for (size_t i = 0; i < ids.size(); ++i)
+    ids[i] = static_cast<uint32_t>(i);
+
+  Split(descriptors, ids, 0, depth, max_iterations, seed);
+  return true;
+}
+
+void Vocabulary_Tree::Split
+(
+  const std::vector<float> & descriptors,
+  std::vector<uint32_t> & ids,
+  const size_t node_index,
+  const size_t depth,
+  const size_t max_iterations,
+  unsigned int seed
+)
+{
+  // Not enough data or last level: the node is a visual word
+  if (depth == 0 || ids.size() <= _branching)
+  {
+    _nodes[node_index].nb_children = 0;
+    _nodes[node_index].word = static_cast<uint32_t>(_word_count++);
+    return;
+  }
+
+  const size_t K = _branching;
+  const int nb_ids = static_cast<int>(ids.size());
+
+  // Init the centers by k-means++ seeding: each new center is drawn with a
+  // probability proportional to the squared distance to the closest chosen center
+  std::mt19937 random_generator(seed);
+  std::vector<float> centers(K * _dimension);
+  {
+    std::vector<double> min_distances(ids.size(), std::numeric_limits<double>::max());
+    size_t chosen = std::uniform_int_distribution<size_t>(0, ids.size() - 1)(random_generator);
+    for (size_t c = 0; c < K; ++c)
+    {
+      const float * center = &descriptors[ids[chosen] * _dimension];
+      std::copy(center, center + _dimension, &centers[c * _dimension]);
+      if (c + 1 == K)
+        break;
+      double sum = 0.0;
+      for (size_t i = 0; i < ids.size(); ++i)
+      {
+        min_distances[i] = std::min(min_distances[i],
+          static_cast<double>(impl::SquaredL2(&descriptors[ids[i] * _dimension], center, _dimension)));
+        sum += min_distances[i];
+      }
+      if (sum <= 0.0) // less distinct descriptors than centers
+      {
+        chosen = std::uniform_int_distribution<size_t>(0, ids.size() - 1)(random_generator);
+        continue;
+      }
+      double target = std::uniform_real_distribution<double>(0.0, sum)(random_generator);
+      for (chosen = 0; chosen + 1 < ids.size(); ++chosen)
+      {
+        target -= min_distances[chosen];
+        if (target < 0.0)
+          break;
+      }
+    }
+  }
+
+  // Lloyd iterations
+  std::vector<uint32_t> assignment(ids.size(), 0);
+  for (size_t iter = 0; iter < max_iterations; ++iter)
+  {
+    size_t nb_changes = 0;
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:nb_changes) if (nb_ids > 10000)
+#endif
+    for (int i = 0; i < nb_ids; ++i)
+    {
+      const uint32_t closest = static_cast<uint32_t>(impl::Closest(
+        &descriptors[ids[i] * _dimension], &centers[0], K, _dimension));
+      if (iter == 0 || closest != assignment[i])
+      {
+        assignment[i] = closest;
+        ++nb_changes;
+      }
+    }
+    if (nb_changes == 0 || iter + 1 == max_iterations)
+      break;
+
+    // Update the centers (an empty cluster keeps its previous center)
+    std::vector<double> sums(K * _dimension, 0.0);
+    std::vector<size_t> counts(K, 0);
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+      const float * descriptor = &descriptors[ids[i] * _dimension];
+      double * sum = &sums[assignment[i] * _dimension];
+      for (size_t k = 0; k < _dimension; ++k)
+        sum[k] += descriptor[k];
+      ++counts[assignment[i]];
+    }
+    for (size_t c = 0; c < K; ++c)
+    {
+      if (counts[c] == 0)
+        continue;
+      for (size_t k = 0; k < _dimension; ++k)
+        centers[c * _dimension + k] = static_cast<float>(sums[c * _dimension + k] / counts[c]);
+    }
+  }
+
+  // Create the children nodes
+  const size_t first_child = _nodes.size();
+  _nodes[node_index].first_child = static_cast<uint32_t>(first_child);
+  _nodes[node_index].nb_children = static_cast<uint32_t>(K);
+  const Node child = {0, 0, 0};
+  _nodes.resize(first_child + K, child);
+  _centers.insert(_centers.end(), centers.begin(), centers.end());
+
+  // Dispatch the descriptors to the children and cluster them
+  std::vector<std::vector<uint32_t> > children_ids(K);
+  for (size_t i = 0; i < ids.size(); ++i)
+    children_ids[assignment[i]].push_back(ids[i]);
+  std::vector<uint32_t>().swap(ids);
+  std::vector<uint32_t>().swap(assignment);
+
+  for (size_t c = 0; c < K; ++c)
+  {
+    Split(descriptors, children_ids[c], first_child + c, depth - 1,
+      max_iterations, seed * static_cast<unsigned int>(K) + static_cast<unsigned int>(c) + 1);
+  }
+}
+
+size_t Vocabulary_Tree::Quantize(const float * descriptor) const
+{
+  size_t node_index = 0;
+  while (_nodes[node_index].nb_children > 0)
+  {
+    const Node & node = _nodes[node_index];
+    node_index = node.first_child + impl::Closest(descriptor,
+      &_centers[node.first_child * _dimension], node.nb_children, _dimension);
+  }
+  return _nodes[node_index].word;
+}
+
+bool Vocabulary_Tree::Save(const std::string & sFileName) const
+{
+  if (_nodes.empty())
+    return false;
+  std::ofstream stream(sFileName.c_str(), std::ios::out | std::ios::binary);
+  if (!stream.is_open())
+  {
+    std::cerr << "Vocabulary_Tree::Save: cannot open the file: " << sFileName << std::endl;
+    return false;
+  }
+  const uint64_t header[4] = {_dimension, _branching, _word_count, _nodes.size()};
+  stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+  stream.write(reinterpret_cast<const char*>(&_nodes[0]), _nodes.size() * sizeof(Node));
+  stream.write(reinterpret_cast<const char*>(&_centers[0]), _centers.size() * sizeof(float));
+  return !stream.bad();
+}
+
+bool Vocabulary_Tree::Load(const std::string & sFileName)
+{
+  std::ifstream stream(sFileName.c_str(), std::ios::in | std::ios::binary);
+  if (!stream.is_open())
+  {
+    std::cerr << "Vocabulary_Tree::Load: cannot open the file: " << sFileName << std::endl;
+    return false;
+  }
+  uint64_t header[4];
+  stream.read(reinterpret_cast<char*>(header), sizeof(header));
+  // The node and center arrays must fill the rest of the file
+  const std::streamoff data_begin = stream.tellg();
+  stream.seekg(0, std::ios::end);
+  const uint64_t data_size = static_cast<uint64_t>(stream.tellg() - data_begin);
+  stream.seekg(data_begin);
+  if (!stream || header[0] == 0 || header[0] > data_size || header[1] < 2 || header[3] == 0
+    || header[3] > std::numeric_limits<uint32_t>::max()
+    || data_size / header[3] != sizeof(Node) + header[0] * sizeof(float)
+    || data_size % header[3] != 0)
+  {
+    std::cerr << "Vocabulary_Tree::Load: invalid file: " << sFileName << std::endl;
+    return false;
+  }
+  std::vector<Node> nodes(header[3]);
+  std::vector<float> centers(header[3] * header[0]);
+  stream.read(reinterpret_cast<char*>(&nodes[0]), nodes.size() * sizeof(Node));
+  stream.read(reinterpret_cast<char*>(&centers[0]), centers.size() * sizeof(float));
+  if (!stream)
+  {
+    std::cerr << "Vocabulary_Tree::Load: invalid file: " << sFileName << std::endl;
+    return false;
+  }
+
+  // The children of a node follow it (Quantize always terminates) and
+  // the leaves are valid visual words
+  for (size_t i = 0; i < nodes.size(); ++i)
+  {
+    const Node & node = nodes[i];
+    const bool bValid = (node.nb_children == 0) ?
+      node.word < header[2] :
+      node.nb_children <= header[1] && node.first_child > i
+        && static_cast<uint64_t>(node.first_child) + node.nb_children <= nodes.size();
+    if (!bValid)
+    {
+      std::cerr << "Vocabulary_Tree::Load: invalid node " << i << " in the file: " << sFileName << std::endl;
+      return false;
+    }
+  }
+  _dimension = header[0];
+  _branching = header[1];
+  _word_count = header[2];
+  _nodes.swap(nodes);
+  _centers.swap(centers);
+  return true;
+}
+
+//--
+//-- Vocabulary_Tree_Database
+//--
+
+void Vocabulary_Tree_Database::Add
+(
+  const IndexT image_id,
+  const std::vector<uint32_t> & words,
+  const std::vector<float> & weights
+)
+{
+  const uint32_t image_index = static_cast<uint32_t>(_image_ids.size());
+  _image_ids.push_back(image_id);
+  _image_index[image_id] = image_index;
+  _bFinalized = false;
+
+  // Term frequencies
+  std::map<uint32_t, float> map_tf;
+  for (size_t i = 0; i < words.size(); ++i)
+    map_tf[words[i]] += weights.empty() ? 1.f : weights[i];
+
+  std::vector<uint32_t> image_words;
+  image_words.reserve(map_tf.size());
+  for (const auto & tf : map_tf)
+  {
+    if (tf.second <= 0.f || tf.first >= _inverted_file.size())
+      continue;
+    const Posting posting = {image_index, tf.second};
+    _inverted_file[tf.first].push_back(posting);
+    image_words.push_back(tf.first);
+  }
+  _image_words.push_back(std::move(image_words));
+}
+
+void Vocabulary_Tree_Database::Finalize()
+{
+  const double nb_images = static_cast<double>(_image_ids.size());
+  std::vector<double> squared_norms(_image_ids.size(), 0.0);
+  for (std::vector<Posting> & postings : _inverted_file)
+  {
+    if (postings.empty())
+      continue;
+    const float idf = static_cast<float>(std::log(nb_images / postings.size()));
+    for (Posting & posting : postings)
+    {
+      posting.weight *= idf;
+      squared_norms[posting.image] += posting.weight * posting.weight;
+    }
+  }
+  for (std::vector<Posting> & postings : _inverted_file)
+  {
+    for (Posting & posting : postings)
+    {
+      if (squared_norms[posting.image] > 0.0)
+        posting.weight /= static_cast<float>(std::sqrt(squared_norms[posting.image]));
+    }
+  }
+  _bFinalized = true;
+}
+
+void Vocabulary_Tree_Database::Query
+(
+  const IndexT image_id,
+  const size_t K,
+  std::vector<std::pair<IndexT, float> > & vec_neighbors
+) const
+{
+  vec_neighbors.clear();
+  const std::map<IndexT, uint32_t>::const_iterator it_index = _image_index.find(image_id);
+  if (!_bFinalized || it_index == _image_index.end())
+    return;
+  const uint32_t image_index = it_index->second;
+
+  struct ComparePostingImage
+  {
+    bool operator()(const Posting & posting, uint32_t image) const
+    {
+      return posting.image < image;
+    }
+  };
+
+  // Dot product of the normalized TF-IDF vectors, accumulated word by word
+  std::vector<float> scores(_image_ids.size(), 0.f);
+  for (const uint32_t word : _image_words[image_index])
+  {
+    const std::vector<Posting> & postings = _inverted_file[word];
+    // Postings are sorted by image index (images are added in order)
+    const std::vector<Posting>::const_iterator it_query =
+      std::lower_bound(postings.begin(), postings.end(), image_index, ComparePostingImage());
+    if (it_query == postings.end() || it_query->image != image_index || it_query->weight == 0.f)
+      continue;
+    const float query_weight = it_query->weight;
+    for (const Posting & posting : postings)
+      scores[posting.image] += query_weight * posting.weight;
+  }
+  scores[image_index] = 0.f;
+
+  std::vector<std::pair<float, uint32_t> > vec_scores;
+  for (uint32_t i = 0; i < scores.size(); ++i)
+  {
+    if (scores[i] > 0.f)
+      vec_scores.push_back(std::make_pair(-scores[i], i));
+  }
+  const size_t nb_neighbors = std::min(K, vec_scores.size());
+  std::partial_sort(vec_scores.begin(), vec_scores.begin() + nb_neighbors, vec_scores.end());
+  vec_neighbors.reserve(nb_neighbors);
+  for (size_t i = 0; i < nb_neighbors; ++i)
+    vec_neighbors.push_back(std::make_pair(_image_ids[vec_scores[i].second], -vec_scores[i].first));
+}
+
+//--
+//-- Pair selection
+//--
+
+bool loadSemanticWeights
+(
+  const std::string & sFileName,
+  std::map<int, float> & semantic_weights
+)
+{
+  std::ifstream in(sFileName.c_str());
+  if (!in.is_open())
+  {
+    std::cerr << std::endl
+      << "loadSemanticWeights: Impossible to read the specified file: \"" << sFileName << "\"." << std::endl;
+    return false;
+  }
+  std::string sValue;
+  std::vector<std::string> vec_str;
+  while (std::getline(in, sValue))
+  {
+    vec_str.clear();
+    stl::split(sValue, " ", vec_str);
+    if (vec_str.empty() || vec_str[0].empty())
+      continue;
+    int label;
+    float weight;
+    std::istringstream iss(sValue);
+    if (!(iss >> label >> weight) || weight < 0.f)
+    {
+      std::cerr << "loadSemanticWeights: Invalid line: \"" << sValue << "\"." << std::endl;
+      return false;
+    }
+    semantic_weights[label] = weight;
+  }
+  return true;
+}
+
+namespace impl
+{
+template <typename ScalarT>
+void ToFloat(const Regions & regions, const size_t i, float * descriptor)
+{
+  const size_t dimension = regions.DescriptorLength();
+  const ScalarT * tab = reinterpret_cast<const ScalarT*>(regions.DescriptorRawData()) + i * dimension;
+  for (size_t k = 0; k < dimension; ++k)
+    descriptor[k] = static_cast<float>(tab[k]);
+}
+} // namespace impl
+
+bool vocabularyTreePairs
+(
+  const sfm::SfM_Data & sfm_data,
+  const sfm::Regions_Provider & regions_provider,
+  const Vocabulary_Tree_Options & options,
+  Pair_Set & pairs
+)
+{
+  // List the views that have some regions
+  std::vector<IndexT> vec_views;
+  size_t nb_descriptors = 0;
+  for (const auto & view : sfm_data.GetViews())
+  {
+    const auto it_regions = regions_provider.regions_per_view.find(view.second->id_view);
+    if (it_regions == regions_provider.regions_per_view.end() || !it_regions->second
+        || it_regions->second->RegionCount() == 0)
+      continue;
+    vec_views.push_back(view.second->id_view);
+    nb_descriptors += it_regions->second->RegionCount();
+  }
+  if (vec_views.size() < 2)
+    return true;
+
+  const Regions & first_regions = *regions_provider.regions_per_view.at(vec_views[0]);
+  void (*toFloat)(const Regions &, const size_t, float *) = nullptr;
+  if (first_regions.IsScalar() && first_regions.Type_id() == typeid(unsigned char).name())
+    toFloat = &impl::ToFloat<unsigned char>;
+  else if (first_regions.IsScalar() && first_regions.Type_id() == typeid(float).name())
+    toFloat = &impl::ToFloat<float>;
+  if (toFloat == nullptr)
+  {
+    std::cerr << "vocabularyTreePairs: not implemented for this region type." << std::endl;
+    return false;
+  }
+  const size_t dimension = first_regions.DescriptorLength();
+
+  Vocabulary_Tree tree;
+  if (!options._sTreeFilename.empty() && stlplus::file_exists(options._sTreeFilename))
+  {
+    if (!tree.Load(options._sTreeFilename))
+      return false;
+    if (tree.Dimension() != dimension)
+    {
+      std::cerr << "vocabularyTreePairs: the vocabulary tree dimension (" << tree.Dimension()
+        << ") does not match the descriptor dimension (" << dimension << ")." << std::endl;
+      return false;
+    }
+    std::cout << "Vocabulary tree loaded from: " << options._sTreeFilename << std::endl;
+  }
+  else
+  {
+    // Training set: descriptors evenly sampled over the collection
+    std::vector<float> training;
+    {
+      const size_t step = std::max<size_t>(1,
+        nb_descriptors / std::max<size_t>(1, options._nb_training_descriptors));
+      training.reserve((nb_descriptors / step + 1) * dimension);
+      size_t counter = 0;
+      for (const IndexT view_id : vec_views)
+      {
+        const Regions & regions = *regions_provider.regions_per_view.at(view_id);
+        for (size_t i = 0; i < regions.RegionCount(); ++i, ++counter)
+        {
+          if (counter % step != 0)
+            continue;
+          training.resize(training.size() + dimension);
+          toFloat(regions, i, &training[training.size() - dimension]);
+        }
+      }
+    }
+    std::cout << "Vocabulary tree training on " << training.size() / dimension
+      << " descriptors" << std::endl;
+
+    if (!tree.Train(training, dimension, options._branching, options._depth))
+      return false;
+    std::vector<float>().swap(training);
+    if (!options._sTreeFilename.empty() && !tree.Save(options._sTreeFilename))
+      return false;
+  }
+  std::cout << "Vocabulary tree: " << tree.WordCount() << " visual words" << std::endl;
+
+  // Quantize the descriptors of each view
+  std::vector<std::vector<uint32_t> > vec_words(vec_views.size());
+  std::vector<std::vector<float> > vec_weights(vec_views.size());
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int v = 0; v < static_cast<int>(vec_views.size()); ++v)
+  {
+    const Regions & regions = *regions_provider.regions_per_view.at(vec_views[v]);
+    std::vector<float> descriptor(dimension);
+    vec_words[v].resize(regions.RegionCount());
+    if (!options._semantic_weights.empty())
+      vec_weights[v].resize(regions.RegionCount(), 1.f);
+    for (size_t i = 0; i < regions.RegionCount(); ++i)
+    {
+      toFloat(regions, i, &descriptor[0]);
+      vec_words[v][i] = static_cast<uint32_t>(tree.Quantize(&descriptor[0]));
+      if (!options._semantic_weights.empty())
+      {
+        const std::map<int, float>::const_iterator it_weight =
+          options._semantic_weights.find(regions.GetRegionsPositionLabel(i));
+        if (it_weight != options._semantic_weights.end())
+          vec_weights[v][i] = it_weight->second;
+      }
+    }
+  }
+
+  // Inverted file
+  Vocabulary_Tree_Database database(tree.WordCount());
+  for (size_t v = 0; v < vec_views.size(); ++v)
+  {
+    database.Add(vec_views[v], vec_words[v], vec_weights[v]);
+    std::vector<uint32_t>().swap(vec_words[v]);
+    std::vector<float>().swap(vec_weights[v]);
+  }
+  database.Finalize();
+
+  // Retrieve the K nearest images of each view
+  std::vector<std::vector<std::pair<IndexT, float> > > vec_neighbors(vec_views.size());
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int v = 0; v < static_cast<int>(vec_views.size()); ++v)
+  {
+    database.Query(vec_views[v], options._nb_neighbors, vec_neighbors[v]);
+  }
+
+  for (size_t v = 0; v < vec_views.size(); ++v)
+  {
+    const IndexT I = vec_views[v];
+    for (const auto & neighbor : vec_neighbors[v])
+    {
+      const IndexT J = neighbor.first;
+      pairs.insert((I < J) ? std::make_pair(I, J) : std::make_pair(J, I));
+    }
+  }
+  return true;
+}
+
+} // namespace matching_image_collection
+} // namespace i23dSFM
@@ -0,0 +1,155 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_MATCHING_IMAGE_COLLECTION_VOCABULARY_TREE_HPP
+#define I23DSFM_MATCHING_IMAGE_COLLECTION_VOCABULARY_TREE_HPP
+
+#include "i23dSFM/types.hpp"
+#include "i23dSFM/sfm/sfm_data.hpp"
+#include "i23dSFM/sfm/pipelines/sfm_regions_provider.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace i23dSFM {
+namespace matching_image_collection {
+
+/// Hierarchical k-means vocabulary tree [1].
+/// Each node of the tree is a cluster center, the leaves are the visual words.
+/// [1] "Scalable recognition with a vocabulary tree."
+///     Nister D. and Stewenius H. CVPR 2006.
+class Vocabulary_Tree
+{
+public:
+  Vocabulary_Tree() : _dimension(0), _branching(0), _word_count(0) {}
+
+  /// Build the tree by recursive k-means clustering of the training descriptors
+  /// (contiguous rows of dimension values).
+  bool Train(
+    const std::vector<float> & descriptors,
+    const size_t dimension,
+    const size_t branching = 10,
+    const size_t depth = 5,
+    const size_t max_iterations = 10,
+    const unsigned int seed = 0);
+
+  /// Return the visual word of a descriptor (descent to the closest leaf)
+  size_t Quantize(const float * descriptor) const;
+
+  size_t WordCount() const { return _word_count; }
+  size_t Dimension() const { return _dimension; }
+
+  /// Binary serialization of the tree
+  bool Save(const std::string & sFileName) const;
+  /// Load a tree (the node links are validated: a corrupted file is rejected)
+  bool Load(const std::string & sFileName);
+
+private:
+
+  struct Node
+  {
+    uint32_t first_child; // index of the first child node
+    uint32_t nb_children; // 0 for a leaf
+    uint32_t word;        // visual word id of a leaf
+  };
+
+  /// Cluster the descriptors of ids below node_index on the remaining levels
+  void Split(
+    const std::vector<float> & descriptors,
+    std::vector<uint32_t> & ids,
+    const size_t node_index,
+    const size_t depth,
+    const size_t max_iterations,
+    unsigned int seed);
+
+  size_t _dimension, _branching, _word_count;
+  std::vector<Node> _nodes;     // node 0 is the root
+  std::vector<float> _centers;  // one center per node (_dimension values)
+};
+
+/// Inverted file of visual words with TF-IDF weighting.
+/// The term frequency of a feature can be weighted according to its semantic
+/// label (i.e. the words of "building" regions can dominate the words of
+/// "vegetation" regions).
+class Vocabulary_Tree_Database
+{
+public:
+  explicit Vocabulary_Tree_Database(const size_t word_count)
+    : _inverted_file(word_count), _bFinalized(false) {}
+
+  /// Add an image to the database from the visual words of its features
+  /// (weights: optional per feature term frequency weight).
+  void Add(
+    const IndexT image_id,
+    const std::vector<uint32_t> & words,
+    const std::vector<float> & weights = std::vector<float>());
+
+  /// Compute the inverse document frequencies and normalize the image vectors
+  void Finalize();
+
+  /// Return the K images most similar to a database image (sorted by decreasing score)
+  void Query(
+    const IndexT image_id,
+    const size_t K,
+    std::vector<std::pair<IndexT, float> > & vec_neighbors) const;
+
+  size_t ImageCount() const { return _image_ids.size(); }
+
+private:
+  struct Posting
+  {
+    uint32_t image; // internal image index
+    float weight;
+  };
+  std::vector<std::vector<Posting> > _inverted_file;  // per word image postings
+  std::vector<IndexT> _image_ids;                     // internal index -> image id
+  std::map<IndexT, uint32_t> _image_index;            // image id -> internal index
+  std::vector<std::vector<uint32_t> > _image_words;   // words of each image (sorted, unique)
+  bool _bFinalized;
+};
+
+/// Vocabulary tree pair selection parameters
+struct Vocabulary_Tree_Options
+{
+  size_t _nb_neighbors;            // number of retrieved images per image
+  size_t _branching;               // k-means branching factor
+  size_t _depth;                   // number of levels of the tree
+  size_t _nb_training_descriptors; // max number of descriptors used for the training
+  std::map<int, float> _semantic_weights; // per semantic label weight (default 1)
+  std::string _sTreeFilename;      // tree file: loaded if it exists, else the trained tree
+                                   //  is saved to it (empty: always train)
+
+  Vocabulary_Tree_Options
+  (
+    size_t nb_neighbors = 20,
+    size_t branching = 10,
+    size_t depth = 5,
+    size_t nb_training_descriptors = 200000
+  )
+  : _nb_neighbors(nb_neighbors), _branching(branching), _depth(depth),
+    _nb_training_descriptors(nb_training_descriptors)
+  {}
+};
+
+/// Load the semantic label weights (one line per label: <label> <weight>)
+bool loadSemanticWeights(
+  const std::string & sFileName,
+  std::map<int, float> & semantic_weights);
+
+/// Generate, for each view, the pairs with its K most similar views
+/// (retrieved with a vocabulary tree trained on the view regions,
+/// or loaded from the options tree file).
+bool vocabularyTreePairs(
+  const sfm::SfM_Data & sfm_data,
+  const sfm::Regions_Provider & regions_provider,
+  const Vocabulary_Tree_Options & options,
+  Pair_Set & pairs);
+
+} // namespace matching_image_collection
+} // namespace i23dSFM
+
+#endif // I23DSFM_MATCHING_IMAGE_COLLECTION_VOCABULARY_TREE_HPP
@@ -0,0 +1,155 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/matching_image_collection/Vocabulary_Tree.hpp"
+#include "testing/testing.h"
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <random>
+
+using namespace i23dSFM;
+using namespace i23dSFM::matching_image_collection;
+
+// Descriptors sampled around nb_clusters well separated centers
+static void makeClusters(
+  size_t nb_clusters, size_t nb_per_cluster, size_t dimension,
+  std::vector<float> & descriptors, std::vector<size_t> & labels)
+{
+  std::mt19937 gen(42);
+  std::normal_distribution<float> noise(0.f, 1.f);
+  for (size_t c = 0; c < nb_clusters; ++c)
+  {
+    for (size_t i = 0; i < nb_per_cluster; ++i)
+    {
+      for (size_t k = 0; k < dimension; ++k)
+        descriptors.push_back(((k % nb_clusters) == c ? 100.f : 0.f) + noise(gen));
+      labels.push_back(c);
+    }
+  }
+}
+
+TEST(Vocabulary_Tree, Quantize)
+{
+  const size_t dimension = 16, nb_clusters = 8;
+  std::vector<float> descriptors;
+  std::vector<size_t> labels;
+  makeClusters(nb_clusters, 50, dimension, descriptors, labels);
+
+  Vocabulary_Tree tree;
+  EXPECT_TRUE(tree.Train(descriptors, dimension, nb_clusters, 1));
+  EXPECT_EQ(8, tree.WordCount());
+
+  // Each cluster must be quantized to its own word
+  std::vector<size_t> cluster_word(nb_clusters);
+  std::set<size_t> words;
+  for (size_t c = 0; c < nb_clusters; ++c)
+  {
+    cluster_word[c] = tree.Quantize(&descriptors[c * 50 * dimension]);
+    words.insert(cluster_word[c]);
+  }
+  EXPECT_EQ(nb_clusters, words.size());
+  for (size_t i = 0; i < labels.size(); ++i)
+    EXPECT_EQ(cluster_word[labels[i]], tree.Quantize(&descriptors[i * dimension]));
+
+  // Serialization round trip
+  const std::string sFileName = "vocabulary_tree_test.bin";
+  EXPECT_TRUE(tree.Save(sFileName));
+  Vocabulary_Tree tree_loaded;
+  EXPECT_TRUE(tree_loaded.Load(sFileName));
+  EXPECT_EQ(tree.WordCount(), tree_loaded.WordCount());
+  for (size_t i = 0; i < labels.size(); ++i)
+    EXPECT_EQ(tree.Quantize(&descriptors[i * dimension]), tree_loaded.Quantize(&descriptors[i * dimension]));
+  std::remove(sFileName.c_str());
+}
+
+TEST(Vocabulary_Tree, Load_Corrupted)
+{
+  const size_t dimension = 16, nb_clusters = 8;
+  std::vector<float> descriptors;
+  std::vector<size_t> labels;
+  makeClusters(nb_clusters, 50, dimension, descriptors, labels);
+  Vocabulary_Tree tree;
+  EXPECT_TRUE(tree.Train(descriptors, dimension, 4, 2));
+
+  const std::string sFileName = "vocabulary_tree_corrupted_test.bin";
+  // Header: 4 uint64 (dimension, branching, word count, node count),
+  // then the nodes (first_child, nb_children, word), then the centers
+  EXPECT_TRUE(tree.Save(sFileName));
+  uint64_t header[4];
+  {
+    std::ifstream stream(sFileName.c_str(), std::ios::binary);
+    stream.read(reinterpret_cast<char*>(header), sizeof(header));
+  }
+  const std::streamoff root_offset = sizeof(header);
+  // The last node is a leaf
+  const std::streamoff leaf_offset = root_offset + (header[3] - 1) * 3 * sizeof(uint32_t);
+  const uint32_t corrupted_values[3] = {0, 1000, 1000};
+  const std::streamoff corrupted_offsets[3] = {
+    root_offset,                        // the root is its own child: infinite descent
+    root_offset + sizeof(uint32_t),     // more children than the nodes
+    leaf_offset + 2 * sizeof(uint32_t)  // word out of the vocabulary
+  };
+  for (int i = 0; i < 3; ++i)
+  {
+    EXPECT_TRUE(tree.Save(sFileName));
+    {
+      std::fstream stream(sFileName.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+      stream.seekp(corrupted_offsets[i]);
+      stream.write(reinterpret_cast<const char*>(&corrupted_values[i]), sizeof(uint32_t));
+    }
+    Vocabulary_Tree tree_loaded;
+    EXPECT_FALSE(tree_loaded.Load(sFileName));
+  }
+
+  // Truncated file
+  EXPECT_TRUE(tree.Save(sFileName));
+  {
+    std::ifstream stream(sFileName.c_str(), std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    stream.close();
+    std::ofstream out(sFileName.c_str(), std::ios::binary);
+    out.write(&data[0], data.size() - 1);
+  }
+  Vocabulary_Tree tree_loaded;
+  EXPECT_FALSE(tree_loaded.Load(sFileName));
+  std::remove(sFileName.c_str());
+}
+
+TEST(Vocabulary_Tree_Database, Query)
+{
+  // 4 images: 0 & 1 share most of their words, 2 & 3 too
+  Vocabulary_Tree_Database database(20);
+  database.Add(0, {0, 1, 2, 3, 4, 10});
+  database.Add(1, {0, 1, 2, 3, 5, 11});
+  database.Add(2, {6, 7, 8, 9, 10, 12});
+  database.Add(3, {6, 7, 8, 9, 11, 13});
+  database.Finalize();
+
+  std::vector<std::pair<IndexT, float> > neighbors;
+  database.Query(0, 1, neighbors);
+  EXPECT_EQ(1, neighbors.size());
+  EXPECT_EQ(1, neighbors[0].first);
+  database.Query(3, 3, neighbors);
+  EXPECT_EQ(2, neighbors.size()); // image 0 does not share any word with 3
+  EXPECT_EQ(2, neighbors[0].first);
+  EXPECT_TRUE(neighbors[0].second > neighbors[1].second);
+
+  // Semantic weighting: the words shared with image 0 have a null weight
+  Vocabulary_Tree_Database weighted_database(20);
+  weighted_database.Add(0, {0, 1, 2, 3, 4, 10});
+  weighted_database.Add(1, {0, 1, 2, 3, 5, 11}, {0.f, 0.f, 0.f, 0.f, 1.f, 1.f});
+  weighted_database.Add(2, {6, 7, 8, 9, 10, 12});
+  weighted_database.Finalize();
+  weighted_database.Query(0, 1, neighbors);
+  EXPECT_EQ(1, neighbors.size());
+  EXPECT_EQ(2, neighbors[0].first);
+}
+
+/* ************************************************************************* */
+int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
+/* ************************************************************************* */
@@ -31,14 +31,274 @@ using namespace lemon;
 #include "ceres/ceres.h"
 #include "ceres/rotation.h"
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include <map>
 #include <queue>
 #include <stdint.h>
+#include <vector>
 
 namespace i23dSFM   {
 namespace rotation_averaging  {
 namespace l1  {
 
+// Solver of the normal equations (At*W*A) x = rhs, with W = diag(w),
+// refactorized for each new weighting w:
+// - dense A: Cholesky (LDLT) of the dense normal matrix,
+// - sparse A: sparse Cholesky (LDLt) of the sparse normal matrix.
+//   The sparsity pattern of At*W*A does not depend on w, so the symbolic
+//   analysis (minimum degree ordering, elimination tree, pattern of L) is done
+//   once and each new weighting only runs the numeric factorization
+//   (memory and time scale with the view graph edges and the fill-in,
+//   instead of n^2 and n^3).
+template<typename MATRIX_TYPE>
+class NormalEquationsSolver;
+
+template<>
+class NormalEquationsSolver< Eigen::Matrix<REAL, Eigen::Dynamic, Eigen::Dynamic> >
+{
+  typedef Eigen::Matrix<REAL, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+  typedef Eigen::Matrix<REAL, Eigen::Dynamic, 1> Vector;
+public:
+  explicit NormalEquationsSolver(const Matrix& A) : A_(A) {}
+
+  bool Factorize(const Vector& w)
+  {
+    solver_.compute(A_.transpose()*(w.asDiagonal()*A_));
+    return solver_.info() == Eigen::Success;
+  }
+
+  bool Solve(const Vector& rhs, Vector& x)
+  {
+    x = solver_.solve(rhs);
+    return solver_.info() == Eigen::Success;
+  }
+
+private:
+  const Matrix& A_;
+  Eigen::LDLT<Matrix> solver_;
+};
+
+template<>
+class NormalEquationsSolver< Eigen::SparseMatrix<REAL, Eigen::ColMajor> >
+{
+  typedef Eigen::SparseMatrix<REAL, Eigen::ColMajor> SparseMatrix;
+  typedef Eigen::SparseMatrix<REAL, Eigen::RowMajor> SparseMatrixRowMajor;
+  typedef Eigen::Matrix<REAL, Eigen::Dynamic, 1> Vector;
+  typedef SparseMatrix::Index Index;
+
+  // A(row,i)*A(row,j) contribution to a coefficient value of At*W*A
+  struct Product
+  {
+    Index value, row;
+    REAL a;
+  };
+public:
+  explicit NormalEquationsSolver(const SparseMatrix& A)
+  {
+    n_ = A.cols();
+
+    // Pattern of N = At*A: (i,j) for any two non-zeros of a row of A
+    const SparseMatrixRowMajor Ar(A);
+    std::vector< Eigen::Triplet<REAL> > vec_triplets;
+    for (Index r = 0; r < Ar.outerSize(); ++r)
+      for (SparseMatrixRowMajor::InnerIterator iti(Ar, r); iti; ++iti)
+        for (SparseMatrixRowMajor::InnerIterator itj(Ar, r); itj; ++itj)
+          vec_triplets.push_back(Eigen::Triplet<REAL>(iti.col(), itj.col(), REAL(1)));
+    N_.resize(n_, n_);
+    N_.setFromTriplets(vec_triplets.begin(), vec_triplets.end());
+    N_.makeCompressed();
+    std::vector< Eigen::Triplet<REAL> >().swap(vec_triplets);
+
+    // Products summed in each coefficient of N
+    for (Index r = 0; r < Ar.outerSize(); ++r)
+      for (SparseMatrixRowMajor::InnerIterator iti(Ar, r); iti; ++iti)
+        for (SparseMatrixRowMajor::InnerIterator itj(Ar, r); itj; ++itj)
+        {
+          const Index * const begin = N_.innerIndexPtr() + N_.outerIndexPtr()[itj.col()];
+          const Index * const end = N_.innerIndexPtr() + N_.outerIndexPtr()[itj.col()+1];
+          const Product product = {
+            Index(std::lower_bound(begin, end, iti.col()) - N_.innerIndexPtr()),
+            r, iti.value()*itj.value()};
+          vec_products_.push_back(product);
+        }
+
+    MinimumDegreeOrdering();
+    SymbolicFactorization();
+  }
+
+  bool Factorize(const Vector& w)
+  {
+    std::fill(N_.valuePtr(), N_.valuePtr() + N_.nonZeros(), REAL(0));
+    for (const Product & product : vec_products_)
+      N_.valuePtr()[product.value] += w(product.row)*product.a;
+    return NumericFactorization();
+  }
+
+  bool Solve(const Vector& rhs, Vector& x)
+  {
+    // x = P' L'^-1 D^-1 L^-1 P rhs
+    Vector y(n_);
+    for (Index k = 0; k < n_; ++k)
+      y(k) = rhs(perm_[k]);
+    for (Index j = 0; j < n_; ++j)
+      for (Index p = Lp_[j]; p < Lp_[j+1]; ++p)
+        y(Li_[p]) -= Lx_[p] * y(j);
+    for (Index j = 0; j < n_; ++j)
+      y(j) /= D_[j];
+    for (Index j = n_ - 1; j >= 0; --j)
+      for (Index p = Lp_[j]; p < Lp_[j+1]; ++p)
+        y(j) -= Lx_[p] * y(Li_[p]);
+    x.resize(n_);
+    for (Index k = 0; k < n_; ++k)
+      x(perm_[k]) = y(k);
+    return x.allFinite();
+  }
+
+private:
+  // Greedy minimum degree ordering on the elimination graph of N
+  void MinimumDegreeOrdering()
+  {
+    std::vector< std::vector<Index> > adjacency(n_);
+    for (Index j = 0; j < n_; ++j)
+      for (SparseMatrix::InnerIterator it(N_, j); it; ++it)
+        if (it.row() != j)
+          adjacency[j].push_back(it.row());
+
+    typedef std::pair<size_t, Index> DegreeNode;
+    std::priority_queue< DegreeNode, std::vector<DegreeNode>, std::greater<DegreeNode> > queue;
+    for (Index j = 0; j < n_; ++j)
+      queue.push(DegreeNode(adjacency[j].size(), j));
+    std::vector<bool> vec_eliminated(n_, false);
+    std::vector<Index> merged;
+    perm_.clear();
+    perm_.reserve(n_);
+    while (!queue.empty())
+    {
+      const Index v = queue.top().second;
+      const size_t degree = queue.top().first;
+      queue.pop();
+      if (vec_eliminated[v] || degree != adjacency[v].size())
+        continue; // outdated entry
+      vec_eliminated[v] = true;
+      perm_.push_back(v);
+      // The neighbours of v become a clique
+      const std::vector<Index> & neighbours = adjacency[v];
+      for (const Index u : neighbours)
+      {
+        merged.clear();
+        std::set_union(adjacency[u].begin(), adjacency[u].end(),
+          neighbours.begin(), neighbours.end(), std::back_inserter(merged));
+        merged.erase(std::remove_if(merged.begin(), merged.end(),
+          [u, v](Index i) { return i == u || i == v; }), merged.end());
+        adjacency[u].swap(merged);
+        queue.push(DegreeNode(adjacency[u].size(), u));
+      }
+      std::vector<Index>().swap(adjacency[v]);
+    }
+    iperm_.resize(n_);
+    for (Index k = 0; k < n_; ++k)
+      iperm_[perm_[k]] = k;
+  }
+
+  // Elimination tree and pattern size of L for the permuted matrix P N P'
+  void SymbolicFactorization()
+  {
+    parent_.assign(n_, -1);
+    flag_.assign(n_, -1);
+    Lnz_.assign(n_, 0);
+    Ap_.assign(1, 0);
+    Ai_.clear();
+    Av_.clear();
+    for (Index k = 0; k < n_; ++k)
+    {
+      flag_[k] = k;
+      // upper part of the column k of P N P'
+      for (Index q = N_.outerIndexPtr()[perm_[k]]; q < N_.outerIndexPtr()[perm_[k]+1]; ++q)
+      {
+        Index i = iperm_[N_.innerIndexPtr()[q]];
+        if (i > k)
+          continue;
+        Ai_.push_back(i);
+        Av_.push_back(q);
+        // walk up the elimination tree from i to the already visited nodes
+        for (; flag_[i] != k; i = parent_[i])
+        {
+          if (parent_[i] == -1)
+            parent_[i] = k;
+          ++Lnz_[i];
+          flag_[i] = k;
+        }
+      }
+      Ap_.push_back(Ai_.size());
+    }
+    Lp_.assign(n_ + 1, 0);
+    for (Index k = 0; k < n_; ++k)
+      Lp_[k+1] = Lp_[k] + Lnz_[k];
+    Li_.resize(Lp_[n_]);
+    Lx_.resize(Lp_[n_]);
+    D_.resize(n_);
+    Y_.assign(n_, REAL(0));
+    pattern_.resize(n_);
+  }
+
+  // Up-looking LDL' factorization: the row k of L is the solution of a
+  // sparse triangular system whose pattern is given by the elimination tree
+  bool NumericFactorization()
+  {
+    std::fill(Lnz_.begin(), Lnz_.end(), 0);
+    for (Index k = 0; k < n_; ++k)
+    {
+      Y_[k] = REAL(0);
+      Index top = n_;
+      flag_[k] = k;
+      for (Index p = Ap_[k]; p < Ap_[k+1]; ++p)
+      {
+        Index i = Ai_[p];
+        Y_[i] += N_.valuePtr()[Av_[p]];
+        Index len = 0;
+        for (; flag_[i] != k; i = parent_[i])
+        {
+          pattern_[len++] = i;
+          flag_[i] = k;
+        }
+        while (len > 0)
+          pattern_[--top] = pattern_[--len];
+      }
+      D_[k] = Y_[k];
+      Y_[k] = REAL(0);
+      for (; top < n_; ++top)
+      {
+        const Index i = pattern_[top];
+        const REAL yi = Y_[i];
+        Y_[i] = REAL(0);
+        const Index p2 = Lp_[i] + Lnz_[i];
+        for (Index p = Lp_[i]; p < p2; ++p)
+          Y_[Li_[p]] -= Lx_[p] * yi;
+        const REAL l_ki = yi / D_[i];
+        D_[k] -= l_ki * yi;
+        Li_[p2] = k;
+        Lx_[p2] = l_ki;
+        ++Lnz_[i];
+      }
+      if (!(D_[k] > REAL(0)))
+        return false; // not positive definite
+    }
+    return true;
+  }
+
+  Index n_;
+  SparseMatrix N_; // At*W*A
+  std::vector<Product> vec_products_;
+  std::vector<Index> perm_, iperm_;     // ordering: new -> old, old -> new
+  std::vector<Index> Ap_, Ai_, Av_;     // upper part of P N P' (index of the values in N)
+  std::vector<Index> parent_, flag_, Lnz_, Lp_, Li_, pattern_; // elimination tree and L
+  std::vector<REAL> Lx_, D_, Y_;
+};
+
+/*----------------------------------------------------------------*/
+
 // Minimum l1 error approximation:
 //
 // Let A be a M x N matrix with full rank. Given y of R^M, the problem
@@ -58,11 +318,11 @@ namespace l1  {
 template<typename MATRIX_TYPE>
 inline bool TRobustRegressionL1PD(
   const MATRIX_TYPE& A,
+  NormalEquationsSolver<MATRIX_TYPE>& solver,
   const Eigen::Matrix<REAL, Eigen::Dynamic, 1>& y,
   Eigen::Matrix<REAL, Eigen::Dynamic, 1>& xp,
   REAL pdtol, unsigned pdmaxiter)
 {
-  typedef Eigen::Matrix<REAL, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Matrix;
   typedef Eigen::Matrix<REAL, Eigen::Dynamic, 1> Vector;
   const unsigned M = (unsigned)y.size();
   const unsigned N = (unsigned)xp.size();
@@ -92,10 +352,9 @@ inline bool TRobustRegressionL1PD(
   Vector rdual((-lamu1-lamu2).array() + REAL(1));
   REAL rdualNormSq = rdual.squaredNorm();
 
-  Vector w2(M), sig1(M), sig2(M), sigx(M), dx(N), up(N), Atdv(N);
-  Vector Axp(M), Atvp(M);
-  Vector &Adx(sigx), &du(w2), &w1p(dx);
-  Matrix H11p(N,N);
+  Vector w2(M), sig1(M), sig2(M), sigx(M), dx(Vector::Zero(N)), up(N), Atdv(N);
+  Vector Axp(M), Atvp(M), w1p(N);
+  Vector &Adx(sigx), &du(w2);
   Vector &dlamu1(tmpM3), &dlamu2(tmpM4);
   for (unsigned pditer=0; pditer<pdmaxiter; ++pditer) {
     // surrogate duality gap
@@ -122,11 +381,11 @@ inline bool TRobustRegressionL1PD(
     sig2 = tmpM1 - tmpM2;
     sigx = sig1 - sig2.cwiseAbs2().cwiseQuotient(sig1);
 
-    H11p = At*(Eigen::DiagonalMatrix<REAL,Eigen::Dynamic>(sigx)*A);
     w1p = At*(tmpM4 - tmpM3 - (sig2.cwiseQuotient(sig1).cwiseProduct(w2)));
 
-    // optimized solver as A is positive definite and symmetric
-    dx = H11p.ldlt().solve(w1p);
+    // optimized solver as H11p = At*diag(sigx)*A is positive definite and symmetric
+    if (!solver.Factorize(sigx) || !solver.Solve(w1p, dx))
+      return false;
 
     Adx = A*dx;
 
@@ -206,7 +465,8 @@ bool RobustRegressionL1PD(
   Eigen::Matrix<REAL, Eigen::Dynamic, 1>& x,
   REAL pdtol, unsigned pdmaxiter)
 {
-  return TRobustRegressionL1PD(A, b, x, pdtol, pdmaxiter);
+  NormalEquationsSolver< Eigen::Matrix<REAL, Eigen::Dynamic, Eigen::Dynamic> > solver(A);
+  return TRobustRegressionL1PD(A, solver, b, x, pdtol, pdmaxiter);
 }
 bool RobustRegressionL1PD(
   const Eigen::SparseMatrix<REAL, Eigen::ColMajor>& A,
@@ -214,7 +474,8 @@ bool RobustRegressionL1PD(
   Eigen::Matrix<REAL, Eigen::Dynamic, 1>& x,
   REAL pdtol, unsigned pdmaxiter)
 {
-  return TRobustRegressionL1PD(A, b, x, pdtol, pdmaxiter);
+  NormalEquationsSolver< Eigen::SparseMatrix<REAL, Eigen::ColMajor> > solver(A);
+  return TRobustRegressionL1PD(A, solver, b, x, pdtol, pdmaxiter);
 }
 
 /*----------------------------------------------------------------*/
@@ -223,11 +484,11 @@ bool RobustRegressionL1PD(
 template<typename MATRIX_TYPE>
 inline bool TIterativelyReweightedLeastSquares(
   const MATRIX_TYPE& A,
+  NormalEquationsSolver<MATRIX_TYPE>& solver,
   const Eigen::Matrix<REAL, Eigen::Dynamic, 1>& b,
   Eigen::Matrix<REAL, Eigen::Dynamic, 1>& x,
   REAL sigma, REAL eps)
 {
-  typedef Eigen::Matrix<REAL, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Matrix;
   typedef Eigen::Matrix<REAL, Eigen::Dynamic, 1> Vector;
   const unsigned m = (unsigned)b.size();
   const unsigned n = (unsigned)x.size();
@@ -249,14 +510,11 @@ inline bool TIterativelyReweightedLeastSquares(
       err = sigmaSq / (errSq + sigmaSq);
     }
     // solve the linear system using l2 norm
-    const MATRIX_TYPE AtF(A.transpose()*e.asDiagonal());
-    const Eigen::LDLT<Matrix> solver(AtF*A); // compute the Cholesky decomposition
-    if (solver.info() != Eigen::Success) {
+    if (!solver.Factorize(e)) {
       std::cerr << "error: decomposing linear system failed" << std::endl;
       return false;
     }
-    x = solver.solve(AtF*b);
-    if (solver.info() != Eigen::Success) {
+    if (!solver.Solve(A.transpose()*e.cwiseProduct(b), x)) {
       std::cerr << "error: solving linear system failed" << std::endl;
       return false;
     }
@@ -273,7 +531,8 @@ bool IterativelyReweightedLeastSquares(
   Eigen::Matrix<REAL, Eigen::Dynamic, 1>& x,
   REAL sigma, REAL eps)
 {
-  return TIterativelyReweightedLeastSquares(A, b, x, sigma, eps);
+  NormalEquationsSolver< Eigen::Matrix<REAL, Eigen::Dynamic, Eigen::Dynamic> > solver(A);
+  return TIterativelyReweightedLeastSquares(A, solver, b, x, sigma, eps);
 }
 bool IterativelyReweightedLeastSquares(
   const Eigen::SparseMatrix<REAL, Eigen::ColMajor>& A,
@@ -281,7 +540,8 @@ bool IterativelyReweightedLeastSquares(
   Eigen::Matrix<REAL, Eigen::Dynamic, 1>& x,
   REAL sigma, REAL eps)
 {
-  return TIterativelyReweightedLeastSquares(A, b, x, sigma, eps);
+  NormalEquationsSolver< Eigen::SparseMatrix<REAL, Eigen::ColMajor> > solver(A);
+  return TIterativelyReweightedLeastSquares(A, solver, b, x, sigma, eps);
 }
 
 /////////////////////////
@@ -645,6 +905,8 @@ bool RefineRotationsAvgL1IRLS(
   // build mapping matrix A in Ax=b
   Eigen::SparseMatrix<REAL,Eigen::ColMajor> A(m, n);
   _FillMappingMatrix(RelRs, nMainViewID, A);
+  // normal equations solver (symbolic analysis shared by the L1RA and IRLS steps)
+  NormalEquationsSolver< Eigen::SparseMatrix<REAL,Eigen::ColMajor> > solver(A);
 
   // init x with 0 that corresponds to trusting completely the initial Ri guess
   Vec x(Vec::Zero(n)), b(m);
@@ -656,7 +918,7 @@ bool RefineRotationsAvgL1IRLS(
     // compute errors for each relative rotation
     _FillErrorMatrix(RelRs, Rs, b);
     // solve the linear system using l1 norm
-    if (!RobustRegressionL1PD(A, b, x)) {
+    if (!TRobustRegressionL1PD(A, solver, b, x, REAL(1e-3), 50)) {
       std::cerr << "error: l1 robust regression failed." << std::endl;
       return false;
     }
@@ -674,7 +936,7 @@ bool RefineRotationsAvgL1IRLS(
     // compute errors for each relative rotation
     _FillErrorMatrix(RelRs, Rs, b);
     // solve the linear system using l2 norm
-    if (!IterativelyReweightedLeastSquares(A, b, x, sigma)) {
+    if (!TIterativelyReweightedLeastSquares(A, solver, b, x, sigma, REAL(1e-5))) {
       std::cerr << "error: l2 iterative regression failed" << std::endl;
       return false;
     }
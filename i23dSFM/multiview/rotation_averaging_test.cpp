@@ -316,6 +316,56 @@ TEST ( rotation_averaging, RefineRotationsAvgL1IRLS_CompleteGraph_outliers)
   }
 }
 
+// The sparse and the dense solvers of the L1RA and IRLS steps give the same solution
+TEST ( rotation_averaging, SparseDenseRegression)
+{
+  typedef Eigen::Matrix<REAL, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+  typedef Eigen::SparseMatrix<REAL, Eigen::ColMajor> SparseMatrix;
+  typedef Eigen::Matrix<REAL, Eigen::Dynamic, 1> Vector;
+
+  // Mapping matrix of a random view graph (view 0 is kept constant):
+  //  a chain of views and random edges, relative error x_j - x_i per edge
+  srand(0);
+  const int nViews = 40;
+  std::vector<std::pair<int,int> > vec_edges;
+  for (int i = 0; i + 1 < nViews; ++i)
+    vec_edges.push_back(std::make_pair(i, i+1));
+  for (int k = 0; k < 4 * nViews; ++k)
+  {
+    const int i = rand() % nViews, j = rand() % nViews;
+    if (i != j)
+      vec_edges.push_back(std::make_pair(i, j));
+  }
+  Matrix A(Matrix::Zero(vec_edges.size(), nViews - 1));
+  for (size_t r = 0; r < vec_edges.size(); ++r)
+  {
+    if (vec_edges[r].first != 0)
+      A(r, vec_edges[r].first - 1) = -1;
+    if (vec_edges[r].second != 0)
+      A(r, vec_edges[r].second - 1) = 1;
+  }
+  const SparseMatrix As(A.sparseView());
+
+  // Observations with noise and 10% outliers
+  const Vector x_gt(Vector::Random(nViews - 1));
+  Vector b(A * x_gt + 0.01 * Vector::Random(A.rows()));
+  for (int r = 0; r < b.size(); r += 10)
+    b(r) += 1.0;
+
+  Vector x_dense(Vector::Zero(nViews - 1)), x_sparse(Vector::Zero(nViews - 1));
+  EXPECT_TRUE(IterativelyReweightedLeastSquares(A, b, x_dense, 0.05));
+  EXPECT_TRUE(IterativelyReweightedLeastSquares(As, b, x_sparse, 0.05));
+  EXPECT_MATRIX_NEAR(x_dense, x_sparse, 1e-6);
+  EXPECT_MATRIX_NEAR(x_gt, x_sparse, 0.05);
+
+  x_dense.setZero();
+  x_sparse.setZero();
+  RobustRegressionL1PD(A, b, x_dense);
+  RobustRegressionL1PD(As, b, x_sparse);
+  EXPECT_MATRIX_NEAR(x_dense, x_sparse, 1e-6);
+  EXPECT_MATRIX_NEAR(x_gt, x_sparse, 0.05);
+}
+
 /*
 template<typename TYPE, int N>
 inline REAL ComputePSNR(const Eigen::Matrix<REAL, N,1>& x0, const Eigen::Matrix<REAL, N,1>& x)
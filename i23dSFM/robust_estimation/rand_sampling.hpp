@@ -71,12 +71,15 @@ static void UniformSample(
 }
 
 /// Get a (sorted) random sample of size X in [0:n-1]
+/// drawn with the given generator of non negative integers
 /// samples array must be pre-allocated
-static void random_sample(size_t X, size_t n, std::vector<size_t> *samples)
+template <typename RandomGenerator>
+static void random_sample(size_t X, size_t n, std::vector<size_t> *samples,
+  RandomGenerator & generator)
 {
   samples->resize(X);
   for(size_t i=0; i < X; ++i) {
-    size_t r = (rand()>>3)%(n-i), j;
+    size_t r = (size_t(generator())>>3)%(n-i), j;
     for(j=0; j<i && r>=(*samples)[j]; ++j)
       ++r;
     size_t j0 = j;
@@ -86,6 +89,13 @@ static void random_sample(size_t X, size_t n, std::vector<size_t> *samples)
   }
 }
 
+/// Get a (sorted) random sample of size X in [0:n-1]
+/// samples array must be pre-allocated
+static void random_sample(size_t X, size_t n, std::vector<size_t> *samples)
+{
+  random_sample(X, n, samples, rand);
+}
+
 } // namespace robust
 } // namespace i23dSFM
 #endif // I23DSFM_ROBUST_ESTIMATION_RAND_SAMPLING_H_
@@ -34,14 +34,21 @@
 //  Adaptive Structure from Motion with a contrario mode estimation.
 //  In 11th Asian Conference on Computer Vision (ACCV 2012)
 //--
+//  [4] Ondrej Chum, Jiri Matas.
+//  Optimal Randomized RANSAC.
+//  PAMI 2008.
+//--
 
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <limits>
 #include <numeric>
+#include <random>
 #include <vector>
 
 #include "i23dSFM/robust_estimation/rand_sampling.hpp"
@@ -62,12 +69,17 @@ static double logcombi(size_t k, size_t n)
 }
 
 /// tabulate logcombi(.,n)
+/// (same partial sums as logcombi, accumulated in a single pass)
 template<typename Type>
 static void makelogcombi_n(size_t n, std::vector<Type> & l)
 {
   l.resize(n+1);
-  for (size_t k = 0; k <= n; k++)
-    l[k] = static_cast<Type>( logcombi(k,n) );
+  l[0] = l[n] = static_cast<Type>(0.0);
+  double r = 0.0;
+  for (size_t k = 1; k < n && k <= n-k; k++)  {
+    r += log10((double)(n-k+1))-log10((double)k);
+    l[k] = l[n-k] = static_cast<Type>(r);
+  }
 }
 
 /// tabulate logcombi(k,.)
@@ -108,16 +120,137 @@ static ErrorIndex bestNFA(
   return bestIndex;
 }
 
+/// Lower bound of the best NFA of a model, computed from its unsorted residuals.
+/// The residuals below maxThreshold are binned by quarter of octave (from the
+/// bits of their floating point representation): the rank k of a residual of
+/// the bin b is in ]count(bins < b), count(bins <= b)] and its value is at
+/// least the smallest residual of the bin, what bounds every term of the NFA
+/// of the bin ranks. Allow to skip the sort of the models that cannot improve
+/// the current best NFA.
+static double lowerBoundNFA(
+  int startIndex, //number of point required for estimation
+  double logalpha0,
+  const std::vector<double>& e,
+  double loge0,
+  double maxThreshold,
+  const std::vector<float> &logc_n,
+  const std::vector<float> &logc_k,
+  double multError = 1.0)
+{
+  static const int NB_BINS = 128; // 32 octaves below the largest residual
+  const double inf = std::numeric_limits<double>::infinity();
+  const double eps = std::numeric_limits<float>::min();
+
+  // Largest admissible residual
+  double emax = -inf;
+  size_t m = 0;
+  for (size_t i = 0; i < e.size(); ++i)  {
+    if (e[i] <= maxThreshold)  {
+      emax = std::max(emax, e[i]);
+      ++m;
+    }
+  }
+  if (m <= (size_t)startIndex)
+    return inf; // no NFA can be computed
+
+  // The bits of a positive double are ordered as its value
+  const auto quarterOctave = [](double v) -> int64_t {
+    int64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits >> 50; // exponent & 2 leading bits of the mantissa
+  };
+  const int64_t top = quarterOctave(emax + eps);
+
+  size_t counts[NB_BINS] = {0};
+  double lower[NB_BINS];
+  std::fill(lower, lower + NB_BINS, inf);
+  for (size_t i = 0; i < e.size(); ++i)  {
+    if (e[i] <= maxThreshold)  {
+      const int b = NB_BINS - 1 -
+        static_cast<int>(std::min<int64_t>(NB_BINS - 1, top - quarterOctave(e[i] + eps)));
+      ++counts[b];
+      lower[b] = std::min(lower[b], e[i]);
+    }
+  }
+
+  double bound = inf;
+  size_t kmax = 0;
+  for (int b = 0; b < NB_BINS; ++b)  {
+    if (counts[b] == 0)
+      continue;
+    const size_t kmin = std::max(kmax + 1, (size_t)startIndex + 1);
+    kmax += counts[b];
+    if (kmin > kmax)
+      continue;
+    const double logalpha = logalpha0 + multError * log10(lower[b] + eps);
+    // logalpha * (k-startIndex) is minimal at one end of the rank range,
+    // logc_n is concave and logc_k increasing in k.
+    const double bin_bound = loge0 +
+      logalpha * (double)((logalpha < 0 ? kmax : kmin) - startIndex) +
+      std::min(logc_n[kmin], logc_n[kmax]) +
+      logc_k[kmin];
+    bound = std::min(bound, bin_bound);
+  }
+  return bound;
+}
+
+/// Options of the ACRANSAC routine.
+/// The default values perform the original exhaustive search.
+struct ACRANSAC_Options
+{
+  ACRANSAC_Options(
+    double dConfidence = 0.0,
+    bool bSPRT = false,
+    double dSPRT_delta = 0.05,
+    double dSPRT_model_cost = 200.0,
+    unsigned int seed = 0)
+    : _dConfidence(dConfidence), _bSPRT(bSPRT),
+      _dSPRT_delta(dSPRT_delta), _dSPRT_model_cost(dSPRT_model_cost),
+      _seed(seed)
+  {}
+
+  /// Stop once the probability that a better all-inlier sample has been
+  /// missed is below 1-_dConfidence, according to the inlier ratio of the
+  /// best model (0: run all the iterations).
+  double _dConfidence;
+  /// Reject the bad models after the evaluation of a subset of the data
+  /// with a Sequential Probability Ratio Test [4].
+  bool _bSPRT;
+  /// SPRT: probability that a point is consistent with a bad model
+  double _dSPRT_delta;
+  /// SPRT: cost of a model estimation in number of residual evaluations
+  double _dSPRT_model_cost;
+  /// Seed of a random generator private to the call (0: use the global rand()),
+  /// so that concurrent estimations are reproducible.
+  unsigned int _seed;
+};
+
+/// SPRT decision threshold [4]
+/// epsilon: inlier ratio of the best model, delta: inlier ratio of a bad model
+static double SPRT_threshold(double epsilon, double delta, double model_cost)
+{
+  const double C = (1. - delta) * log((1. - delta) / (1. - epsilon))
+    + delta * log(delta / epsilon);
+  const double A0 = model_cost / C + 1.;
+  double A = A0;
+  for (int i = 0; i < 10; ++i)
+    A = A0 + log(A);
+  return A;
+}
+
 /// Pick a random sample
 /// \param sizeSample The size of the sample.
 /// \param vec_index  The possible data indices.
 /// \param sample The random sample of sizeSample indices (output).
+/// \param generator The generator of non negative random integers.
+template <typename RandomGenerator>
 static void UniformSample(int sizeSample,
   const std::vector<size_t> &vec_index,
-  std::vector<size_t> *sample)
+  std::vector<size_t> *sample,
+  RandomGenerator & generator)
 {
   sample->resize(sizeSample);
-  random_sample(sizeSample, vec_index.size(), sample);
+  random_sample(sizeSample, vec_index.size(), sample, generator);
   for(int i = 0; i < sizeSample; ++i)
     (*sample)[i] = vec_index[ (*sample)[i] ];
 }
@@ -131,6 +264,7 @@ static void UniformSample(int sizeSample,
  * @param[out] model returned model if found
  * @param[in] precision upper bound of the precision (squared error)
  * @param[in] bVerbose display console log
+ * @param[in] options adaptive iteration count & early rejection of the models
  *
  * @return (errorMax, minNFA)
  */
@@ -140,7 +274,8 @@ std::pair<double, double> ACRANSAC(const Kernel &kernel,
   size_t nIter = 1024,
   typename Kernel::Model * model = NULL,
   double precision = std::numeric_limits<double>::infinity(),
-  bool bVerbose = false)
+  bool bVerbose = false,
+  const ACRANSAC_Options & options = ACRANSAC_Options())
 {
   vec_inliers.clear();
 
@@ -153,7 +288,8 @@ std::pair<double, double> ACRANSAC(const Kernel &kernel,
     std::numeric_limits<double>::infinity() :
     precision * kernel.normalizer2()(0,0) * kernel.normalizer2()(0,0);
 
-  std::vector<ErrorIndex> vec_residuals(nData); // [residual,index]
+  std::vector<ErrorIndex> vec_residuals; // [residual,index] (sorted admissible residuals)
+  vec_residuals.reserve(nData);
   std::vector<double> vec_residuals_(nData);
   std::vector<size_t> vec_sample(sizeSample); // Sample indices
 
@@ -175,9 +311,26 @@ std::pair<double, double> ACRANSAC(const Kernel &kernel,
   size_t nIterReserve = nIter/10;
   nIter -= nIterReserve;
 
+  // Random generator: private to the call if a seed is given
+  std::mt19937 seeded_generator(options._seed);
+  auto random_integer = [&]() -> size_t {
+    return options._seed ? size_t(seeded_generator()) : size_t(rand());
+  };
+
+  // SPRT: random evaluation order of the data & current decision threshold
+  std::vector<size_t> vec_order;
+  double sprt_A = std::numeric_limits<double>::infinity();
+  double sprt_epsilon = 0.0;
+  if (options._bSPRT)  {
+    vec_order.resize(nData);
+    std::iota(vec_order.begin(), vec_order.end(), 0);
+    for (size_t i = nData - 1; i > 0; --i)
+      std::swap(vec_order[i], vec_order[random_integer() % (i + 1)]);
+  }
+
   // Main estimation loop.
   for (size_t iter=0; iter < nIter; ++iter) {
-    UniformSample(sizeSample, vec_index, &vec_sample); // Get random sample
+    UniformSample(sizeSample, vec_index, &vec_sample, random_integer); // Get random sample
 
     std::vector<typename Kernel::Model> vec_models; // Up to max_models solutions
     kernel.Fit(vec_sample, &vec_models);
@@ -185,11 +338,45 @@ std::pair<double, double> ACRANSAC(const Kernel &kernel,
     // Evaluate models
     bool better = false;
     for (size_t k = 0; k < vec_models.size(); ++k)  {
-      // Residuals computation and ordering
-      kernel.Errors(vec_models[k], vec_residuals_);
+      // Residuals computation
+      if (options._bSPRT && sprt_epsilon > options._dSPRT_delta)  {
+        // Evaluate the data in random order, stop as soon as the model is
+        // likely to be worse than the best model (threshold errorMax)
+        double lambda = 1.0;
+        const double inlier_ratio = options._dSPRT_delta / sprt_epsilon;
+        const double outlier_ratio = (1.0 - options._dSPRT_delta) / (1.0 - sprt_epsilon);
+        bool bRejected = false;
+        for (size_t j = 0; j < nData && !bRejected; ++j)  {
+          const size_t i = vec_order[j];
+          vec_residuals_[i] = kernel.Error(i, vec_models[k]);
+          lambda *= (vec_residuals_[i] <= errorMax) ? inlier_ratio : outlier_ratio;
+          bRejected = (lambda > sprt_A);
+        }
+        if (bRejected)
+          continue;
+      }
+      else
+        kernel.Errors(vec_models[k], vec_residuals_);
+
+      // Skip the model if its NFA cannot be better than the current one
+      if (minNFA != std::numeric_limits<double>::infinity() &&
+          lowerBoundNFA(
+            sizeSample,
+            kernel.logalpha0(),
+            vec_residuals_,
+            loge0,
+            maxThreshold,
+            vec_logc_n,
+            vec_logc_k,
+            kernel.multError()) > minNFA + 1e-9)
+        continue;
+
+      // Ordering of the admissible residuals only
+      vec_residuals.clear();
       for (size_t i = 0; i < nData; ++i)  {
         const double error = vec_residuals_[i];
-        vec_residuals[i] = ErrorIndex(error, i);
+        if (error <= maxThreshold)
+          vec_residuals.push_back(ErrorIndex(error, i));
       }
       std::sort(vec_residuals.begin(), vec_residuals.end());
 
@@ -225,6 +412,14 @@ std::pair<double, double> ACRANSAC(const Kernel &kernel,
             std::ostream_iterator<size_t>(std::cout, ","));
           std::cout << ")" <<std::endl;
         }
+
+        if (options._bSPRT && minNFA < 0)  {
+          sprt_epsilon = static_cast<double>(best.second) / nData;
+          if (sprt_epsilon > options._dSPRT_delta && sprt_epsilon < 1.0)
+            sprt_A = SPRT_threshold(sprt_epsilon, options._dSPRT_delta, options._dSPRT_model_cost);
+          else
+            sprt_epsilon = 0.0; // SPRT cannot discriminate the models
+        }
       }
     }
 
@@ -240,6 +435,15 @@ std::pair<double, double> ACRANSAC(const Kernel &kernel,
             nIter = iter+1+nIterReserve;
             nIterReserve=0;
         }
+        // Adaptive iteration count: enough samples to draw an all-inlier
+        // sample with the desired confidence
+        if (better && options._dConfidence > 0.0)  {
+          const double inlier_ratio = static_cast<double>(vec_inliers.size()) / nData;
+          const double dRequired = (inlier_ratio >= 1.0) ? 0.0 :
+            log(1.0 - options._dConfidence) / log(1.0 - pow(inlier_ratio, (int)sizeSample));
+          if (dRequired < nIter)
+            nIter = std::min(nIter, iter + 1 + static_cast<size_t>(ceil(dRequired)));
+        }
       }
     }
   }
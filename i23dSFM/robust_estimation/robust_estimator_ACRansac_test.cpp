@@ -200,6 +200,51 @@ TEST(RansacLineFitter, RealisticCase) {
   EXPECT_NEAR(GTModel(1), line[1], 1e-9);
 }
 
+// Same data as RealisticCase with an adaptive iteration count or the SPRT
+TEST(RansacLineFitter, RealisticCase_Adaptive) {
+
+  const int NbPoints = 100;
+  const int inlierPourcentAmount = 30;
+  Mat2X xy(2, NbPoints);
+
+  Vec2 GTModel;
+  GTModel <<  -2.0, 6.3;
+
+  for(int i = 0; i < NbPoints; ++i) {
+    xy.col(i) << i, (double)i*GTModel[1] + GTModel[0];
+  }
+
+  int nbPtToNoise = (int) NbPoints*inlierPourcentAmount/100.0;
+  vector<size_t> vec_samples;
+  UniformSample(nbPtToNoise, NbPoints, &vec_samples);
+  for(size_t i = 0; i <vec_samples.size(); ++i)
+    xy.col(vec_samples[i]) += Vec2::Random()/10.;
+
+  ACRANSACOneViewKernel<LineSolver, pointToLineError, Vec2> lineKernel(xy, 12, 12);
+
+  // SPRT: the bad models are rejected early, the best one is kept
+  {
+    std::vector<size_t> vec_inliers;
+    Vec2 line;
+    ACRANSAC(lineKernel, vec_inliers, 300, &line, std::numeric_limits<double>::infinity(),
+      false, ACRANSAC_Options(0.0, true));
+
+    CHECK_EQUAL(NbPoints-nbPtToNoise, vec_inliers.size());
+    EXPECT_NEAR(GTModel(0), line[0], 1e-9);
+    EXPECT_NEAR(GTModel(1), line[1], 1e-9);
+  }
+  // Adaptive iteration count: a valid model is found, possibly less precise
+  {
+    std::vector<size_t> vec_inliers;
+    Vec2 line;
+    ACRANSAC(lineKernel, vec_inliers, 300, &line, std::numeric_limits<double>::infinity(),
+      false, ACRANSAC_Options(0.99));
+
+    EXPECT_TRUE(vec_inliers.size() >= NbPoints-nbPtToNoise);
+    EXPECT_NEAR(GTModel(1), line[1], 0.1);
+  }
+}
+
 // Generate a random value between [0;1]
 static inline double randValue()  {
   return rand()/double(RAND_MAX);
@@ -397,6 +442,38 @@ TEST(RansacLineFitter, ACRANSACSimu) {
   }
 }
 
+// The NFA lower bound used to skip the sort must never exceed the NFA
+TEST(ACRANSAC, lowerBoundNFA) {
+
+  const size_t nData = 500;
+  const int startIndex = 4;
+  std::vector<float> vec_logc_n, vec_logc_k;
+  makelogcombi_n(nData, vec_logc_n);
+  makelogcombi_k(startIndex, nData, vec_logc_k);
+  const double loge0 = log10(1.0 * (nData-startIndex));
+
+  for (int iTest = 0; iTest < 100; ++iTest)
+  {
+    // A mix of inliers (small residuals) and outliers
+    std::vector<double> vec_residuals_(nData);
+    for (size_t i = 0; i < nData; ++i)
+      vec_residuals_[i] = (rand() % 100 < iTest) ?
+        randValue() * 1000. : randValue() * randValue() * 2.;
+
+    const double maxThreshold = (iTest % 2) ? 10.0 : std::numeric_limits<double>::infinity();
+    std::vector<ErrorIndex> vec_residuals;
+    for (size_t i = 0; i < nData; ++i)
+      vec_residuals.push_back(ErrorIndex(vec_residuals_[i], i));
+    std::sort(vec_residuals.begin(), vec_residuals.end());
+
+    const ErrorIndex best = bestNFA(startIndex, -3.0, vec_residuals, loge0,
+      maxThreshold, vec_logc_n, vec_logc_k, 0.5);
+    const double bound = lowerBoundNFA(startIndex, -3.0, vec_residuals_, loge0,
+      maxThreshold, vec_logc_n, vec_logc_k, 0.5);
+    EXPECT_TRUE(bound <= best.first + 1e-9);
+  }
+}
+
 /* ************************************************************************* */
 int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
 /* ************************************************************************* */
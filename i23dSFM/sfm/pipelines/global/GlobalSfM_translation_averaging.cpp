@@ -378,7 +378,7 @@ void GlobalSfM_Translation_AveragingSolver::ComputePutativeTranslation_EdgesCove
       }
       // Compute tracks:
       {
-        i23dSFM::tracks::TracksBuilder tracksBuilder;
+        i23dSFM::tracks::FlatTracksBuilder tracksBuilder;
         tracksBuilder.Build(map_triplet_matches);
         tracksBuilder.Filter(3);
         #ifdef I23DSFM_USE_OPENMP
@@ -637,7 +637,7 @@ bool GlobalSfM_Translation_AveragingSolver::Estimate_T_triplet(
     }
   }
 
-  i23dSFM::tracks::TracksBuilder tracksBuilder;
+  i23dSFM::tracks::FlatTracksBuilder tracksBuilder;
   tracksBuilder.Build(map_triplet_matches);
   tracksBuilder.Filter(3);
   tracksBuilder.ExportToSTL(tracks);
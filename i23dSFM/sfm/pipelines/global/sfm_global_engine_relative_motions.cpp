@@ -148,7 +148,11 @@ bool GlobalSfMReconstructionEngine_RelativeMotions::Process() {
     std::cerr << "GlobalSfM:: Cannot initialize an initial structure!" << std::endl;
     return false;
   }
-  if (!Adjust())
+  const bool bAdjust = Adjust();
+  // The refined structure goes back to the scene
+  _landmarks.Export(_sfm_data.structure);
+  _landmarks.clear();
+  if (!bAdjust)
   {
     std::cerr << "GlobalSfM:: Non-linear adjustment failure!" << std::endl;
     return false;
@@ -275,6 +279,22 @@ bool GlobalSfMReconstructionEngine_RelativeMotions::Compute_Global_Translations
   return bTranslationAveraging;
 }
 
+/// Export (for logging) the cameras and the structure stored in a flat landmark store
+static void SaveStructure
+(
+  const SfM_Data & sfm_data,
+  const Landmarks_CSR & landmarks,
+  const std::string & sFilename
+)
+{
+  SfM_Data scene;
+  scene.views = sfm_data.views;
+  scene.intrinsics = sfm_data.intrinsics;
+  scene.poses = sfm_data.poses;
+  landmarks.Export(scene.structure);
+  Save(scene, sFilename, ESfM_Data(EXTRINSICS | STRUCTURE));
+}
+
 /// Compute the initial structure of the scene
 bool GlobalSfMReconstructionEngine_RelativeMotions::Compute_Initial_Structure
 (
@@ -284,7 +304,7 @@ bool GlobalSfMReconstructionEngine_RelativeMotions::Compute_Initial_Structure
   // Build tracks from selected triplets (Union of all the validated triplet tracks (_tripletWise_matches))
   {
     using namespace i23dSFM::tracks;
-    TracksBuilder tracksBuilder;
+    FlatTracksBuilder tracksBuilder;
 #if defined USE_ALL_VALID_MATCHES // not used by default
     matching::PairWiseMatches pose_supported_matches;
     for (const std::pair< Pair, IndMatches > & match_info :  _matches_provider->_pairWise_matches)
@@ -305,22 +325,22 @@ bool GlobalSfMReconstructionEngine_RelativeMotions::Compute_Initial_Structure
     STLMAPTracks map_selectedTracks; // reconstructed track (visibility per 3D point)
     tracksBuilder.ExportToSTL(map_selectedTracks);
 
-    // Fill sfm_data with the computed tracks (no 3D yet)
-    Landmarks & structure = _sfm_data.structure;
+    // Fill the landmark store with the computed tracks (no 3D yet)
+    // (the track observations are sorted by view id)
+    _landmarks.clear();
     IndexT idx(0);
     for (STLMAPTracks::const_iterator itTracks = map_selectedTracks.begin();
       itTracks != map_selectedTracks.end();
       ++itTracks, ++idx)
     {
       const submapTrack & track = itTracks->second;
-      structure[idx] = Landmark();
-      Observations & obs = structure.at(idx).obs;
+      _landmarks.AddLandmark(idx);
       for (submapTrack::const_iterator it = track.begin(); it != track.end(); ++it)
       {
         const size_t imaIndex = it->first;
         const size_t featIndex = it->second;
         const PointFeature & pt = _features_provider->feats_per_view.at(imaIndex)[featIndex];
-        obs[imaIndex] = Observation(pt.coords().cast<double>(), featIndex);
+        _landmarks.AddObservation(imaIndex, Observation(pt.coords().cast<double>(), featIndex));
       }
     }
 
@@ -357,23 +377,22 @@ bool GlobalSfMReconstructionEngine_RelativeMotions::Compute_Initial_Structure
   {
     i23dSFM::system::Timer timer;
 
-    const IndexT trackCountBefore = _sfm_data.GetLandmarks().size();
+    const IndexT trackCountBefore = _landmarks.size();
     SfM_Data_Structure_Computation_Blind structure_estimator(true);
-    structure_estimator.triangulate(_sfm_data);
+    structure_estimator.triangulate(_sfm_data, _landmarks);
 
     std::cout << "\n#removed tracks (invalid triangulation): " <<
-      trackCountBefore - IndexT(_sfm_data.GetLandmarks().size()) << std::endl;
+      trackCountBefore - IndexT(_landmarks.size()) << std::endl;
     std::cout << std::endl << "  Triangulation took (s): " << timer.elapsed() << std::endl;
 
     // Export initial structure
     if (!_sLoggingFile.empty())
     {
-      Save(_sfm_data,
-        stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "initial_structure", "ply"),
-        ESfM_Data(EXTRINSICS | STRUCTURE));
+      SaveStructure(_sfm_data, _landmarks,
+        stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "initial_structure", "ply"));
     }
   }
-  return !_sfm_data.structure.empty();
+  return _landmarks.size() > 0;
 }
 
 // Adjust the scene (& remove outliers)
@@ -383,43 +402,40 @@ bool GlobalSfMReconstructionEngine_RelativeMotions::Adjust()
 
   Bundle_Adjustment_Ceres bundle_adjustment_obj;
   // - refine only Structure and translations
-  bool b_BA_Status = bundle_adjustment_obj.Adjust(_sfm_data, false, true, false);
+  bool b_BA_Status = bundle_adjustment_obj.Adjust(_sfm_data, _landmarks, false, true, false);
   if (b_BA_Status)
   {
     if (!_sLoggingFile.empty())
     {
-      Save(_sfm_data,
-        stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_00_refine_T_Xi", "ply"),
-        ESfM_Data(EXTRINSICS | STRUCTURE));
+      SaveStructure(_sfm_data, _landmarks,
+        stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_00_refine_T_Xi", "ply"));
     }
 
     // - refine only Structure and Rotations & translations
-    b_BA_Status = bundle_adjustment_obj.Adjust(_sfm_data, true, true, false);
+    b_BA_Status = bundle_adjustment_obj.Adjust(_sfm_data, _landmarks, true, true, false);
     if (b_BA_Status && !_sLoggingFile.empty())
     {
-      Save(_sfm_data,
-        stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_01_refine_RT_Xi", "ply"),
-        ESfM_Data(EXTRINSICS | STRUCTURE));
+      SaveStructure(_sfm_data, _landmarks,
+        stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_01_refine_RT_Xi", "ply"));
     }
   }
 
   if (b_BA_Status && !_bFixedIntrinsics) {
     // - refine all: Structure, motion:{rotations, translations} and optics:{intrinsics}
-    b_BA_Status = bundle_adjustment_obj.Adjust(_sfm_data, true, true, true);
+    b_BA_Status = bundle_adjustment_obj.Adjust(_sfm_data, _landmarks, true, true, true);
     if (b_BA_Status && !_sLoggingFile.empty())
     {
-      Save(_sfm_data,
-        stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_02_refine_KRT_Xi", "ply"),
-        ESfM_Data(EXTRINSICS | STRUCTURE));
+      SaveStructure(_sfm_data, _landmarks,
+        stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_02_refine_KRT_Xi", "ply"));
     }
   }
 
   // Remove outliers (max_angle, residual error)
-  const size_t pointcount_initial = _sfm_data.structure.size();
-  RemoveOutliers_PixelResidualError(_sfm_data, 4.0);
-  const size_t pointcount_pixelresidual_filter = _sfm_data.structure.size();
-  RemoveOutliers_AngleError(_sfm_data, 2.0);
-  const size_t pointcount_angular_filter = _sfm_data.structure.size();
+  const size_t pointcount_initial = _landmarks.size();
+  RemoveOutliers_PixelResidualError(_sfm_data, _landmarks, 4.0);
+  const size_t pointcount_pixelresidual_filter = _landmarks.size();
+  RemoveOutliers_AngleError(_sfm_data, _landmarks, 2.0);
+  const size_t pointcount_angular_filter = _landmarks.size();
   std::cout << "Outlier removal (remaining #points):\n"
     << "\t initial structure size #3DPoints: " << pointcount_initial << "\n"
     << "\t\t pixel residual filter  #3DPoints: " << pointcount_pixelresidual_filter << "\n"
@@ -427,29 +443,27 @@ bool GlobalSfMReconstructionEngine_RelativeMotions::Adjust()
 
   if (!_sLoggingFile.empty())
   {
-    Save(_sfm_data,
-      stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_03_outlier_removed", "ply"),
-      ESfM_Data(EXTRINSICS | STRUCTURE));
+    SaveStructure(_sfm_data, _landmarks,
+      stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_03_outlier_removed", "ply"));
   }
 
   // Check that poses & intrinsic cover some measures (after outlier removal)
   const IndexT minPointPerPose = 12; // 6 min
   const IndexT minTrackLength = 3; // 2 min
-  if (eraseUnstablePosesAndObservations(_sfm_data, minPointPerPose, minTrackLength))
+  if (eraseUnstablePosesAndObservations(_sfm_data, _landmarks, minPointPerPose, minTrackLength))
   {
     // TODO: must ensure that track graph is producing a single connected component
 
-    const size_t pointcount_cleaning = _sfm_data.structure.size();
+    const size_t pointcount_cleaning = _landmarks.size();
     std::cout << "Point_cloud cleaning:\n"
       << "\t #3DPoints: " << pointcount_cleaning << "\n";
   }
 
-  b_BA_Status = bundle_adjustment_obj.Adjust(_sfm_data, true, true, !_bFixedIntrinsics);
+  b_BA_Status = bundle_adjustment_obj.Adjust(_sfm_data, _landmarks, true, true, !_bFixedIntrinsics);
   if (b_BA_Status && !_sLoggingFile.empty())
   {
-    Save(_sfm_data,
-      stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_04_outlier_removed", "ply"),
-      ESfM_Data(EXTRINSICS | STRUCTURE));
+    SaveStructure(_sfm_data, _landmarks,
+      stlplus::create_filespec(stlplus::folder_part(_sLoggingFile), "structure_04_outlier_removed", "ply"));
   }
 
   return b_BA_Status;
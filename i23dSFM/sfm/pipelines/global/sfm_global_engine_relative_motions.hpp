@@ -9,6 +9,7 @@
 #define I23DSFM_SFM_GLOBAL_ENGINE_RELATIVE_MOTIONS_HPP
 
 #include "i23dSFM/sfm/pipelines/sfm_engine.hpp"
+#include "i23dSFM/sfm/sfm_landmarks_csr.hpp"
 
 #include "i23dSFM/sfm/pipelines/global/GlobalSfM_rotation_averaging.hpp"
 #include "i23dSFM/sfm/pipelines/global/GlobalSfM_translation_averaging.hpp"
@@ -53,13 +54,13 @@ protected:
     matching::PairWiseMatches & tripletWise_matches
   );
 
-  /// Compute the initial structure of the scene
+  /// Compute the initial structure of the scene (in the flat landmark store)
   bool Compute_Initial_Structure
   (
     matching::PairWiseMatches & tripletWise_matches
   );
 
-  // Adjust the scene (& remove outliers)
+  // Adjust the scene (& remove outliers) (the structure of the flat landmark store)
   bool Adjust();
 
 private:
@@ -86,6 +87,10 @@ private:
   Matches_Provider  * _matches_provider;
 
   std::shared_ptr<Features_Provider> _normalized_features_provider;
+
+  // Structure of the scene while it is computed and refined
+  // (exported to the SfM_Data landmarks at the end of the process)
+  Landmarks_CSR _landmarks;
 };
 
 } // namespace sfm
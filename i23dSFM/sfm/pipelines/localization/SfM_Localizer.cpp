@@ -62,7 +62,8 @@ namespace sfm {
         resection_data.pt3D);
       // Robust estimation of the Projection matrix and it's precision
       const std::pair<double,double> ACRansacOut =
-        i23dSFM::robust::ACRANSAC(kernel, resection_data.vec_inliers, resection_data.max_iteration, &P, dPrecision, true);
+        i23dSFM::robust::ACRANSAC(kernel, resection_data.vec_inliers, resection_data.max_iteration, &P, dPrecision, resection_data.b_verbose,
+          resection_data.robust_options);
       // Update the upper bound precision of the model found by AC-RANSAC
       resection_data.error_max = ACRansacOut.first;
     }
@@ -80,7 +81,8 @@ namespace sfm {
       KernelType kernel(resection_data.pt2D, resection_data.pt3D, pinhole_cam->K());
       // Robust estimation of the Projection matrix and it's precision
       const std::pair<double,double> ACRansacOut =
-        i23dSFM::robust::ACRANSAC(kernel, resection_data.vec_inliers, resection_data.max_iteration, &P, dPrecision, true);
+        i23dSFM::robust::ACRANSAC(kernel, resection_data.vec_inliers, resection_data.max_iteration, &P, dPrecision, resection_data.b_verbose,
+          resection_data.robust_options);
       // Update the upper bound precision of the model found by AC-RANSAC
       resection_data.error_max = ACRansacOut.first;
     }
@@ -97,14 +99,17 @@ namespace sfm {
       pose = geometry::Pose3(R, -R.transpose() * t);
     }
 
-    std::cout << "\n"
-      << "-------------------------------" << "\n"
-      << "-- Robust Resection " << "\n"
-      << "-- Resection status: " << bResection << "\n"
-      << "-- #Points used for Resection: " << resection_data.pt2D.cols() << "\n"
-      << "-- #Points validated by robust Resection: " << resection_data.vec_inliers.size() << "\n"
-      << "-- Threshold: " << resection_data.error_max << "\n"
-      << "-------------------------------" << std::endl;
+    if (resection_data.b_verbose)
+    {
+      std::cout << "\n"
+        << "-------------------------------" << "\n"
+        << "-- Robust Resection " << "\n"
+        << "-- Resection status: " << bResection << "\n"
+        << "-- #Points used for Resection: " << resection_data.pt2D.cols() << "\n"
+        << "-- #Points validated by robust Resection: " << resection_data.vec_inliers.size() << "\n"
+        << "-- Threshold: " << resection_data.error_max << "\n"
+        << "-------------------------------" << std::endl;
+    }
 
     return bResection;
   }
@@ -10,6 +10,7 @@
 #include "i23dSFM/numeric/numeric.h"
 #include "i23dSFM/sfm/sfm_data.hpp"
 #include "i23dSFM/sfm/pipelines/sfm_regions_provider.hpp"
+#include "i23dSFM/robust_estimation/robust_estimator_ACRansac.hpp"
 
 namespace i23dSFM {
 namespace sfm {
@@ -23,6 +24,10 @@ struct Image_Localizer_Match_Data
   // Upper bound pixel(s) tolerance for residual errors
   double error_max = std::numeric_limits<double>::infinity();
   size_t max_iteration = 4096;
+  // Adaptive iteration count & early rejection of the robust estimation
+  robust::ACRANSAC_Options robust_options;
+  // Log the robust estimation to the console
+  bool b_verbose = true;
 };
 
 class SfM_Localizer
@@ -8,10 +8,34 @@
 #include "i23dSFM/sfm/pipelines/localization/SfM_Localizer_Single_3DTrackObservation_Database.hpp"
 #include "i23dSFM/matching/indMatch.hpp"
 #include "i23dSFM/matching/regions_matcher.hpp"
+#include "i23dSFM/features/regions_container.hpp"
+
+#include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
+
+#include <cstring>
+#include <fstream>
 
 namespace i23dSFM {
 namespace sfm {
 
+  // Files of a saved retrieval database
+  static const char LOCALIZATION_REGIONS_BASENAME[] = "localization_regions";
+  static const char LOCALIZATION_LANDMARKS_BASENAME[] = "localization_landmarks";
+  static const char LOCALIZATION_INDEX_BASENAME[] = "localization_index";
+
+  // Landmark ids file: header followed by one IndexT per descriptor
+  static const char LOCALIZATION_LANDMARKS_MAGIC[8] = {'I','2','3','D','L','O','C','L'};
+  static const uint32_t LOCALIZATION_LANDMARKS_VERSION = 2;
+
+  struct Localization_Landmarks_Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t descriptor_length; // dimension of the stored descriptors
+    uint64_t nb_landmarks;   // landmark count of the described scene
+    uint64_t nb_descriptors; // number of stored landmark ids
+  };
+
   SfM_Localization_Single_3DTrackObservation_Database::
   SfM_Localization_Single_3DTrackObservation_Database()
   :SfM_Localizer(), sfm_data_(nullptr), matching_interface_(nullptr)
@@ -43,6 +67,7 @@ namespace sfm {
 
     const features::Regions * regions_type = std::begin(regions_provider.regions_per_view)->second.get();
     landmark_observations_descriptors_.reset(regions_type->EmptyClone());
+    index_to_landmark_id_.clear();
     for (const auto & landmark : sfm_data.GetLandmarks())
     {
       for (const auto & observation : landmark.second.obs)
@@ -69,6 +94,156 @@ namespace sfm {
     return true;
   }
 
+  bool
+  SfM_Localization_Single_3DTrackObservation_Database::Save
+  (
+    const std::string & sDatabaseDir
+  ) const
+  {
+    if (sfm_data_ == nullptr || matching_interface_ == nullptr)
+    {
+      return false;
+    }
+    if (!stlplus::folder_exists(sDatabaseDir) && !stlplus::folder_create(sDatabaseDir))
+    {
+      std::cerr << "Cannot create the database directory: " << sDatabaseDir << std::endl;
+      return false;
+    }
+
+    // Descriptors (stored as the regions of a single view)
+    const std::string sRegionsFile =
+      stlplus::create_filespec(sDatabaseDir, LOCALIZATION_REGIONS_BASENAME, "bin");
+    features::Regions_Container_Writer regions_writer;
+    if (!regions_writer.Open(sRegionsFile, *landmark_observations_descriptors_, 1) ||
+        !regions_writer.Add(0, *landmark_observations_descriptors_) ||
+        !regions_writer.Close())
+    {
+      std::cerr << "Cannot save the database descriptors: " << sRegionsFile << std::endl;
+      return false;
+    }
+
+    // Landmark id of each descriptor
+    const std::string sLandmarksFile =
+      stlplus::create_filespec(sDatabaseDir, LOCALIZATION_LANDMARKS_BASENAME, "bin");
+    {
+      std::ofstream stream(sLandmarksFile.c_str(), std::ios::out | std::ios::binary);
+      Localization_Landmarks_Header header;
+      std::memset(&header, 0, sizeof(header));
+      std::memcpy(header.magic, LOCALIZATION_LANDMARKS_MAGIC, sizeof(header.magic));
+      header.version = LOCALIZATION_LANDMARKS_VERSION;
+      header.descriptor_length = static_cast<uint32_t>(landmark_observations_descriptors_->DescriptorLength());
+      header.nb_landmarks = sfm_data_->GetLandmarks().size();
+      header.nb_descriptors = index_to_landmark_id_.size();
+      stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      if (!index_to_landmark_id_.empty())
+        stream.write(reinterpret_cast<const char*>(&index_to_landmark_id_[0]),
+          index_to_landmark_id_.size() * sizeof(IndexT));
+      if (!stream.good())
+      {
+        std::cerr << "Cannot save the database landmarks: " << sLandmarksFile << std::endl;
+        return false;
+      }
+    }
+
+    // Matching structure
+    const std::string sIndexFile =
+      stlplus::create_filespec(sDatabaseDir, LOCALIZATION_INDEX_BASENAME, "flann");
+    if (!matching_interface_->Save(sIndexFile))
+    {
+      std::cerr << "Cannot save the database matching structure: " << sIndexFile << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool
+  SfM_Localization_Single_3DTrackObservation_Database::Load
+  (
+    const SfM_Data & sfm_data,
+    const features::Regions & regions_type,
+    const std::string & sDatabaseDir
+  )
+  {
+    sfm_data_ = nullptr;
+    matching_interface_.reset();
+
+    // Descriptors (memory mapped, then copied to the database regions)
+    const std::string sRegionsFile =
+      stlplus::create_filespec(sDatabaseDir, LOCALIZATION_REGIONS_BASENAME, "bin");
+    {
+      features::Regions_Container container;
+      features::Packed_Regions packed;
+      if (!stlplus::file_exists(sRegionsFile) ||
+          !container.Open(sRegionsFile, regions_type) ||
+          !container.Get(0, packed))
+      {
+        return false;
+      }
+      landmark_observations_descriptors_.reset(regions_type.EmptyClone());
+      landmark_observations_descriptors_->LoadPacked(packed);
+    }
+
+    // Landmark id of each descriptor (they must be the observations of this scene)
+    const std::string sLandmarksFile =
+      stlplus::create_filespec(sDatabaseDir, LOCALIZATION_LANDMARKS_BASENAME, "bin");
+    {
+      std::ifstream stream(sLandmarksFile.c_str(), std::ios::in | std::ios::binary);
+      Localization_Landmarks_Header header;
+      if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+          std::memcmp(header.magic, LOCALIZATION_LANDMARKS_MAGIC, sizeof(header.magic)) != 0 ||
+          header.version != LOCALIZATION_LANDMARKS_VERSION ||
+          header.descriptor_length != regions_type.DescriptorLength() ||
+          header.nb_landmarks != sfm_data.GetLandmarks().size() ||
+          header.nb_descriptors != landmark_observations_descriptors_->RegionCount())
+      {
+        std::cerr << "Invalid or outdated database landmarks: " << sLandmarksFile << std::endl;
+        return false;
+      }
+      index_to_landmark_id_.resize(header.nb_descriptors);
+      if (!index_to_landmark_id_.empty() &&
+          !stream.read(reinterpret_cast<char*>(&index_to_landmark_id_[0]),
+            index_to_landmark_id_.size() * sizeof(IndexT)))
+      {
+        return false;
+      }
+      // The descriptors are stored in the Init order: one per described observation
+      size_t index = 0;
+      for (const auto & landmark : sfm_data.GetLandmarks())
+      {
+        for (const auto & observation : landmark.second.obs)
+        {
+          if (observation.second.id_feat == UndefinedIndexT)
+            continue;
+          if (index >= index_to_landmark_id_.size() ||
+              index_to_landmark_id_[index] != landmark.first)
+          {
+            std::cerr << "Invalid or outdated database landmarks: " << sLandmarksFile << std::endl;
+            return false;
+          }
+          ++index;
+        }
+      }
+      if (index != index_to_landmark_id_.size())
+      {
+        std::cerr << "Invalid or outdated database landmarks: " << sLandmarksFile << std::endl;
+        return false;
+      }
+    }
+
+    // Matching structure (rebuilt if the saved one cannot be used)
+    const std::string sIndexFile =
+      stlplus::create_filespec(sDatabaseDir, LOCALIZATION_INDEX_BASENAME, "flann");
+    matching_interface_.reset(new
+      matching::Matcher_Regions_Database(matching::ANN_L2, *landmark_observations_descriptors_, sIndexFile));
+    std::cout << "Retrieval database loaded\n"
+      << "#landmark: " << sfm_data.GetLandmarks().size() << "\n"
+      << "#descriptor loaded: " << landmark_observations_descriptors_->RegionCount() << std::endl;
+
+    sfm_data_ = &sfm_data;
+
+    return true;
+  }
+
   bool
   SfM_Localization_Single_3DTrackObservation_Database::Localize
   (
@@ -96,6 +271,8 @@ namespace sfm {
     if (resection_data_ptr)
     {
       resection_data.error_max = resection_data_ptr->error_max;
+      resection_data.max_iteration = resection_data_ptr->max_iteration;
+      resection_data.robust_options = resection_data_ptr->robust_options;
     }
     resection_data.pt3D.resize(3, vec_putative_matches.size());
     resection_data.pt2D.resize(2, vec_putative_matches.size());
@@ -18,6 +18,8 @@ namespace sfm {
 // - create a large array with all the used descriptors and init a Matcher with it
 // - to localize an input image compare it's regions to the database and robust estimate
 //   the pose from found 2d-3D correspondences
+// The database can be saved once and reloaded for the next sessions (no regions
+// loading and no matching structure building), see Save and Load.
 
 class SfM_Localization_Single_3DTrackObservation_Database : public SfM_Localizer
 {
@@ -38,6 +40,38 @@ public:
     const Regions_Provider & regions_provider
   );
 
+  /**
+  * @brief Save the retrieval database in a directory:
+  *  - localization_regions.bin: the descriptors (memory mapped regions container),
+  *  - localization_landmarks.bin: the landmark id of each descriptor,
+  *  - localization_index.flann: the matching structure.
+  *
+  * @param[in] sDatabaseDir the output directory
+  * @return True if the database has been saved
+  */
+  bool Save
+  (
+    const std::string & sDatabaseDir
+  ) const;
+
+  /**
+  * @brief Load a retrieval database saved for this SfM scene
+  *  (the descriptor dimension and the landmark of each descriptor must match
+  *  the regions type and the scene observations; the matching structure is
+  *  rebuilt if its file is missing or invalid).
+  *
+  * @param[in] sfm_data the SfM scene described by the database
+  * @param[in] regions_type the regions type of the database
+  * @param[in] sDatabaseDir the directory of the saved database
+  * @return True if the database has been correctly loaded
+  */
+  bool Load
+  (
+    const SfM_Data & sfm_data,
+    const features::Regions & regions_type,
+    const std::string & sDatabaseDir
+  );
+
   /**
   * @brief Try to localize an image in the database
   *
@@ -47,6 +81,7 @@ public:
   * @param[out] pose found pose
   * @param[out] resection_data matching data (2D-3D and inliers; optional)
   * @return True if a putative pose has been estimated
+  * @note The database is read only: several images can be localized concurrently
   */
   bool Localize
   (
@@ -0,0 +1,126 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+//-----------------
+// Test summary:
+//-----------------
+// - Init a SfM_Data scene from a synthetic dataset and describe each
+//   landmark observation with a descriptor specific to the landmark
+// - Init a localization database, save it and load it in a new database
+// - Assert that:
+//   - a view is localized with the same pose by the two databases,
+//   - the loading fails if the scene observations, the regions type or
+//     the saved descriptor dimension changed.
+//-----------------
+
+#include "i23dSFM/sfm/pipelines/pipelines_test.hpp"
+#include "i23dSFM/sfm/sfm.hpp"
+#include "i23dSFM/sfm/pipelines/localization/SfM_Localizer_Single_3DTrackObservation_Database.hpp"
+#include "i23dSFM/features/regions_factory.hpp"
+using namespace i23dSFM;
+using namespace i23dSFM::cameras;
+using namespace i23dSFM::features;
+using namespace i23dSFM::geometry;
+using namespace i23dSFM::sfm;
+
+#include "testing/testing.h"
+#include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
+
+#include <fstream>
+#include <random>
+
+// Regions of each view: the feature i is the observation of the point i,
+//  described by a random descriptor of the point slightly perturbed in each view
+//  (the database nearest neighbour of a view descriptor is its own copy)
+static void Synthetic_Regions
+(
+  const NViewDataSet & d,
+  Regions_Provider & regions_provider
+)
+{
+  std::mt19937 generator(0);
+  std::uniform_int_distribution<int> distribution(16, 239);
+  std::uniform_int_distribution<int> perturbation(-8, 8);
+  std::vector<SIFT_Regions::DescriptorT> vec_descs(d._X.cols());
+  for (auto & desc : vec_descs)
+    for (int k = 0; k < SIFT_Regions::DescriptorT::static_size; ++k)
+      desc[k] = static_cast<unsigned char>(distribution(generator));
+
+  for (int j = 0; j < d._n; ++j)
+  {
+    std::unique_ptr<SIFT_Regions> regions(new SIFT_Regions);
+    for (int i = 0; i < d._x[j].cols(); ++i)
+    {
+      regions->Features().push_back(SIOPointFeature(d._x[j].col(i)(0), d._x[j].col(i)(1)));
+      SIFT_Regions::DescriptorT desc = vec_descs[i];
+      for (int k = 0; k < SIFT_Regions::DescriptorT::static_size; ++k)
+        desc[k] = static_cast<unsigned char>(desc[k] + perturbation(generator));
+      regions->Descriptors().push_back(desc);
+    }
+    regions_provider.regions_per_view[j] = std::move(regions);
+  }
+}
+
+TEST(LOCALIZATION_DATABASE, Save_Load) {
+
+  const int nviews = 6;
+  const int npoints = 64;
+  const nViewDatasetConfigurator config;
+  const NViewDataSet d = NRealisticCamerasRing(nviews, npoints, config);
+  const SfM_Data sfm_data = getInputScene(d, config, PINHOLE_CAMERA);
+
+  Regions_Provider regions_provider;
+  Synthetic_Regions(d, regions_provider);
+
+  SfM_Localization_Single_3DTrackObservation_Database localizer;
+  EXPECT_TRUE(localizer.Init(sfm_data, regions_provider));
+
+  const std::string sDatabaseDir = "./localization_database";
+  EXPECT_TRUE(localizer.Save(sDatabaseDir));
+
+  SfM_Localization_Single_3DTrackObservation_Database loaded_localizer;
+  EXPECT_TRUE(loaded_localizer.Load(sfm_data, SIFT_Regions(), sDatabaseDir));
+
+  // Localize a view with the two databases
+  const IndexT view_id = 2;
+  const View * view = sfm_data.GetViews().at(view_id).get();
+  const IntrinsicBase * intrinsic = sfm_data.GetIntrinsics().at(view->id_intrinsic).get();
+  const Pair image_size(view->ui_width, view->ui_height);
+  const Regions & query_regions = *regions_provider.regions_per_view.at(view_id);
+
+  Pose3 pose, loaded_pose;
+  EXPECT_TRUE(localizer.Localize(image_size, intrinsic, query_regions, pose));
+  EXPECT_TRUE(loaded_localizer.Localize(image_size, intrinsic, query_regions, loaded_pose));
+  EXPECT_NEAR(0.0, (pose.center() - loaded_pose.center()).norm(), 1e-4);
+  EXPECT_NEAR(0.0, (pose.center() - sfm_data.GetPoses().at(view->id_pose).center()).norm(), 1e-4);
+
+  // The database does not describe a scene with other observations
+  SfM_Data sfm_data_modified = sfm_data;
+  sfm_data_modified.structure[0].obs.erase(0);
+  sfm_data_modified.structure[1].obs[0] = sfm_data.GetLandmarks().at(0).obs.at(0);
+  SfM_Localization_Single_3DTrackObservation_Database outdated_localizer;
+  EXPECT_FALSE(outdated_localizer.Load(sfm_data_modified, SIFT_Regions(), sDatabaseDir));
+
+  // The database does not describe the regions of another type
+  EXPECT_FALSE(outdated_localizer.Load(sfm_data, AKAZE_Liop_Regions(), sDatabaseDir));
+
+  // The landmark ids must have been saved for the same descriptor dimension
+  {
+    const std::string sLandmarksFile =
+      stlplus::create_filespec(sDatabaseDir, "localization_landmarks", "bin");
+    std::fstream stream(sLandmarksFile.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    const uint32_t descriptor_length = 64;
+    stream.seekp(12); // magic and version
+    stream.write(reinterpret_cast<const char*>(&descriptor_length), sizeof(descriptor_length));
+  }
+  EXPECT_FALSE(outdated_localizer.Load(sfm_data, SIFT_Regions(), sDatabaseDir));
+
+  stlplus::folder_delete(sDatabaseDir, true);
+}
+
+/* ************************************************************************* */
+int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
+/* ************************************************************************* */
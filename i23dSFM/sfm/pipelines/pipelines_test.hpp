@@ -110,7 +110,7 @@ SfM_Data getInputScene
   {
     const IndexT id_view = i, id_pose = i, id_intrinsic = 0; //(shared intrinsics)
     sfm_data.views[i] = std::make_shared<View>
-      ("", id_view, id_intrinsic, id_pose, config._cx *2, config._cy *2);
+      ("", "", id_view, id_intrinsic, id_pose, config._cx *2, config._cy *2);
   }
 
   // 2. Poses
@@ -23,7 +23,8 @@
 
 #include "third_party/htmlDoc/htmlDoc.hpp"
 #include "third_party/progress/progress.hpp"
-#include "software/mpi/mpi_bundle_adjustment.h"
+
+#include <functional>
 #ifdef _MSC_VER
 #pragma warning( once : 4267 ) //warning C4267: 'argument' : conversion from 'size_t' to 'const int', possible loss of data
 #endif
@@ -41,7 +42,13 @@ SequentialSfMReconstructionEngine::SequentialSfMReconstructionEngine(
   : ReconstructionEngine(sfm_data, soutDirectory),
     _sLoggingFile(sloggingFile),
     _initialpair(Pair(0,0)),
-    _camType(EINTRINSIC(PINHOLE_CAMERA_RADIAL3))
+    _camType(EINTRINSIC(PINHOLE_CAMERA_RADIAL3)),
+    _bLocalBA(false),
+    _nbLocalBANeighbours(20),
+    _nbImagesBetweenGlobalBA(50),
+    _globalBAGrowthRatio(0.1),
+    _bParallelResection(false),
+    _semanticTrackMode(tracks::SEMANTIC_TRACK_VOTE)
 {
   if (!_sLoggingFile.empty())
   {
@@ -116,36 +123,79 @@ bool SequentialSfMReconstructionEngine::Process() {
   // Compute robust Resection of remaining images
   // - group of images will be selected and resection + scene completion will be tried
   size_t resectionGroupIndex = 0;
+  size_t nbImagesSinceGlobalBA = 0;
+  size_t nbPosesAtGlobalBA = _sfm_data.GetPoses().size();
   std::vector<size_t> vec_possible_resection_indexes;
   while (FindImagesWithPossibleResection(vec_possible_resection_indexes))
   {
-    bool bImageAdded = false;
+    std::set<IndexT> set_addedViewId;
     // Add images to the 3D reconstruction
-    for (std::vector<size_t>::const_iterator iter = vec_possible_resection_indexes.begin();
-      iter != vec_possible_resection_indexes.end(); ++iter)
+    if (_bParallelResection && vec_possible_resection_indexes.size() > 1)
     {
-      bImageAdded |= Resection(*iter);
-      _set_remainingViewId.erase(*iter);
+      // Localize the whole group against the current structure,
+      // then add the views in the group order.
+      std::vector<Resection_Result> vec_resection(vec_possible_resection_indexes.size());
+#ifdef I23DSFM_USE_OPENMP
+      #pragma omp parallel for schedule(dynamic)
+#endif
+      for (int i = 0; i < static_cast<int>(vec_possible_resection_indexes.size()); ++i)
+      {
+        LocalizeView(vec_possible_resection_indexes[i], vec_resection[i]);
+      }
+      for (size_t i = 0; i < vec_resection.size(); ++i)
+      {
+        if (CommitResection(vec_resection[i]))
+          set_addedViewId.insert(vec_resection[i].viewIndex);
+        _set_remainingViewId.erase(vec_resection[i].viewIndex);
+      }
+    }
+    else
+    {
+      for (std::vector<size_t>::const_iterator iter = vec_possible_resection_indexes.begin();
+        iter != vec_possible_resection_indexes.end(); ++iter)
+      {
+        if (Resection(*iter))
+          set_addedViewId.insert(*iter);
+        _set_remainingViewId.erase(*iter);
+      }
     }
 
 
-    if (bImageAdded)
+    if (!set_addedViewId.empty())
     {
       // Scene logging as ply for visual debug
       std::ostringstream os;
       os << std::setw(8) << std::setfill('0') << resectionGroupIndex << "_Resection";
       Save(_sfm_data, stlplus::create_filespec(_sOutDirectory, os.str(), ".ply"), ESfM_Data(ALL));
 
+      nbImagesSinceGlobalBA += set_addedViewId.size();
+      const bool bGlobalBA = !_bLocalBA
+        || nbImagesSinceGlobalBA >= _nbImagesBetweenGlobalBA
+        || _sfm_data.GetPoses().size() >= (1.0 + _globalBAGrowthRatio) * nbPosesAtGlobalBA;
+
       // Perform BA until all point are under the given precision
-      do
+      if (bGlobalBA)
       {
-        BundleAdjustment();
-
+        GlobalBundleAdjustment();
+        nbImagesSinceGlobalBA = 0;
+        nbPosesAtGlobalBA = _sfm_data.GetPoses().size();
+      }
+      else
+      {
+        do
+        {
+          LocalBundleAdjustment(set_addedViewId);
+        }
+        while (badTrackRejector(4.0, 50) != 0);
       }
-      while (badTrackRejector(4.0, 50) != 0);
     }
     ++resectionGroupIndex;
   }
+  // The last local adjustments must be followed by a global one
+  if (nbImagesSinceGlobalBA > 0)
+  {
+    GlobalBundleAdjustment();
+  }
   // Ensure there is no remaining outliers
   badTrackRejector(4.0, 0);
 
@@ -289,7 +339,7 @@ bool SequentialSfMReconstructionEngine::ChooseInitialPair(Pair & initialPairInde
 bool SequentialSfMReconstructionEngine::InitLandmarkTracks()
 {
   // Compute tracks from matches
-  tracks::TracksBuilder tracksBuilder;
+  tracks::FlatTracksBuilder tracksBuilder;
 
   {
     // List of features matches for each couple of images
@@ -297,6 +347,17 @@ bool SequentialSfMReconstructionEngine::InitLandmarkTracks()
     std::cout << "\n" << "Track building" << std::endl;
 
     tracksBuilder.Build(map_Matches);
+    if (_semanticTrackMode != tracks::SEMANTIC_TRACK_NONE)
+    {
+      std::cout << "\n" << "Track semantic consistency" << std::endl;
+      const Features_Provider * features_provider = _features_provider;
+      tracksBuilder.SemanticFilter(
+        [features_provider](IndexT view, IndexT feat)
+        {
+          return features_provider->feats_per_view.at(view)[feat].semanticLabel();
+        },
+        _semanticTrackMode);
+    }
     std::cout << "\n" << "Track filtering" << std::endl;
     tracksBuilder.Filter();
     std::cout << "\n" << "Track filtering : min occurence" << std::endl;
@@ -304,6 +365,8 @@ bool SequentialSfMReconstructionEngine::InitLandmarkTracks()
     std::cout << "\n" << "Track export to internal struct" << std::endl;
     //-- Build tracks with STL compliant type :
     tracksBuilder.ExportToSTL(_map_tracks);
+    _track_semantic_labels = tracksBuilder.GetTracks().semantic_labels;
+    _tracks_view_index.Init(_map_tracks);
 
     std::cout << "\n" << "Track stats" << std::endl;
     {
@@ -583,10 +646,10 @@ bool SequentialSfMReconstructionEngine::MakeInitialPair3D(const Pair & current_p
       // obs[view_I->id_view] = Observation(x1_, i);
       // obs[view_J->id_view] = Observation(x2_, j);
       obs[view_I->id_view] = Observation(x1_, i, _features_provider->feats_per_view[I][i].semanticLabel());
-      obs[view_J->id_view] = Observation(x2_, j, _features_provider->feats_per_view[I][j].semanticLabel());
+      obs[view_J->id_view] = Observation(x2_, j, _features_provider->feats_per_view[J][j].semanticLabel());
       landmarks[iterT->first].obs = std::move(obs);
       landmarks[iterT->first].X = X;
-      landmarks[iterT->first].semantic_label = _features_provider->feats_per_view[I][i].semanticLabel();
+      landmarks[iterT->first].semantic_label = TrackSemanticLabel(iterT->first, I, i);
       // cout << "semantic label is: " << landmarks[iterT->first].semantic_label << endl;
     }
     Save(tiny_scene, stlplus::create_filespec(_sOutDirectory, "initialPair.ply"), ESfM_Data(ALL));
@@ -636,6 +699,7 @@ bool SequentialSfMReconstructionEngine::MakeInitialPair3D(const Pair & current_p
            residual_J.norm() < relativePose_info.found_residual_precision)
       {
         _sfm_data.structure[trackId] = landmarks[trackId];
+        _tracks_view_index.SetReconstructed(trackId);
       }
     }
     // Save outlier residual information
@@ -775,51 +839,14 @@ bool SequentialSfMReconstructionEngine::FindImagesWithPossibleResection(
   if (_set_remainingViewId.empty() || _sfm_data.GetLandmarks().empty())
     return false;
 
-  // Collect tracksIds
-  std::set<size_t> reconstructed_trackId;
-  std::transform(_sfm_data.GetLandmarks().begin(), _sfm_data.GetLandmarks().end(),
-    std::inserter(reconstructed_trackId, reconstructed_trackId.begin()),
-    stl::RetrieveKey());
-
+  // Number of 2D-3D possible correspondences (from the incremental tracks index)
   Pair_Vec vec_putative; // ImageId, NbPutativeCommonPoint
-#ifdef I23DSFM_USE_OPENMP
-  #pragma omp parallel
-#endif
   for (std::set<size_t>::const_iterator iter = _set_remainingViewId.begin();
         iter != _set_remainingViewId.end(); ++iter)
   {
-#ifdef I23DSFM_USE_OPENMP
-  #pragma omp single nowait
-#endif
-    {
-      const size_t viewId = *iter;
-
-      // Compute 2D - 3D possible content
-      i23dSFM::tracks::STLMAPTracks map_tracksCommon;
-      const std::set<size_t> set_viewId = {viewId};
-      tracks::TracksUtilsMap::GetTracksInImages(set_viewId, _map_tracks, map_tracksCommon);
-
-      if (!map_tracksCommon.empty())
-      {
-        std::set<size_t> set_tracksIds;
-        tracks::TracksUtilsMap::GetTracksIdVector(map_tracksCommon, &set_tracksIds);
-
-        // Count the common possible putative point
-        //  with the already 3D reconstructed trackId
-        std::vector<size_t> vec_trackIdForResection;
-        std::set_intersection(set_tracksIds.begin(), set_tracksIds.end(),
-          reconstructed_trackId.begin(),
-          reconstructed_trackId.end(),
-          std::back_inserter(vec_trackIdForResection));
-
-#ifdef I23DSFM_USE_OPENMP
-        #pragma omp critical
-#endif
-        {
-          vec_putative.push_back( make_pair(viewId, vec_trackIdForResection.size()));
-        }
-      }
-    }
+    const size_t viewId = *iter;
+    if (!_tracks_view_index.TracksInView(viewId).empty())
+      vec_putative.push_back( make_pair(viewId, _tracks_view_index.ReconstructedCount(viewId)));
   }
 
   // Sort by the number of matches to the 3D scene.
@@ -862,72 +889,65 @@ bool SequentialSfMReconstructionEngine::FindImagesWithPossibleResection(
  * G. Triangulate new possible 2D tracks
  */
 bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
+{
+  Resection_Result result;
+  LocalizeView(viewIndex, result);
+  return CommitResection(result);
+}
+
+/// Steps A to D of the resection: the pose (and the intrinsic if it is unknown)
+/// are estimated from the reconstructed tracks seen by the view.
+void SequentialSfMReconstructionEngine::LocalizeView
+(
+  const size_t viewIndex,
+  Resection_Result & result
+) const
 {
   using namespace tracks;
 
+  result.viewIndex = viewIndex;
+
   // A. Compute 2D/3D matches
-  // A1. list tracks ids used by the view
-  i23dSFM::tracks::STLMAPTracks map_tracksCommon;
-  const std::set<size_t> set_viewIndex = {viewIndex};
-  TracksUtilsMap::GetTracksInImages(set_viewIndex, _map_tracks, map_tracksCommon);
-  std::set<size_t> set_tracksIds;
-  TracksUtilsMap::GetTracksIdVector(map_tracksCommon, &set_tracksIds);
-
-  // A2. intersects the track list with the reconstructed
-  std::set<size_t> reconstructed_trackId;
-  std::transform(_sfm_data.GetLandmarks().begin(), _sfm_data.GetLandmarks().end(),
-    std::inserter(reconstructed_trackId, reconstructed_trackId.begin()),
-    stl::RetrieveKey());
-
-  // Get the ids of the already reconstructed tracks
-  std::set<size_t> set_trackIdForResection;
-  std::set_intersection(set_tracksIds.begin(), set_tracksIds.end(),
-    reconstructed_trackId.begin(),
-    reconstructed_trackId.end(),
-    std::inserter(set_trackIdForResection, set_trackIdForResection.begin()));
-
-  if (set_trackIdForResection.empty())
+  // List the already reconstructed tracks seen by the view
+  // and their associated featId.
+  // These 2D/3D associations will be used for the resection.
+  std::vector<TracksViewIndex::TrackFeature> & vec_trackFeatForResection = result.vec_trackFeat;
+  _tracks_view_index.ReconstructedTracksInView(viewIndex, vec_trackFeatForResection);
+
+  if (vec_trackFeatForResection.empty())
   {
     // No match. The image has no connection with already reconstructed points.
-    std::cout << std::endl
-      << "-------------------------------" << "\n"
-      << "-- Resection of camera index: " << viewIndex << "\n"
-      << "-- Resection status: " << "FAILED" << "\n"
-      << "-------------------------------" << std::endl;
-    return false;
+    return;
   }
 
-  // Get back featId associated to a tracksID already reconstructed.
-  // These 2D/3D associations will be used for the resection.
-  std::vector<size_t> vec_featIdForResection;
-  TracksUtilsMap::GetFeatIndexPerViewAndTrackId(map_tracksCommon,
-    set_trackIdForResection,
-    viewIndex,
-    &vec_featIdForResection);
-
   // Localize the image inside the SfM reconstruction
-  Image_Localizer_Match_Data resection_data;
-  resection_data.pt2D.resize(2, set_trackIdForResection.size());
-  resection_data.pt3D.resize(3, set_trackIdForResection.size());
+  Image_Localizer_Match_Data & resection_data = result.resection_data;
+  resection_data.robust_options = _resectionRobustOptions;
+  if (_bParallelResection)
+  {
+    // Concurrent resections: a random generator per view
+    // and no interleaved robust estimation log
+    resection_data.robust_options._seed = static_cast<unsigned int>(viewIndex) + 1;
+    resection_data.b_verbose = false;
+  }
+  resection_data.pt2D.resize(2, vec_trackFeatForResection.size());
+  resection_data.pt3D.resize(3, vec_trackFeatForResection.size());
 
   // B. Look if intrinsic data is known or not
   const View * view_I = _sfm_data.GetViews().at(viewIndex).get();
-  std::shared_ptr<cameras::IntrinsicBase> optional_intrinsic (nullptr);
+  std::shared_ptr<cameras::IntrinsicBase> & optional_intrinsic = result.intrinsic;
   if (_sfm_data.GetIntrinsics().count(view_I->id_intrinsic))
   {
     optional_intrinsic = _sfm_data.GetIntrinsics().at(view_I->id_intrinsic);
   }
 
-  Mat2X pt2D_original(2, set_trackIdForResection.size());
-  size_t cpt = 0;
-  std::set<size_t>::const_iterator iterTrackId = set_trackIdForResection.begin();
-  for (std::vector<size_t>::const_iterator iterfeatId = vec_featIdForResection.begin();
-    iterfeatId != vec_featIdForResection.end();
-    ++iterfeatId, ++iterTrackId, ++cpt)
+  Mat2X pt2D_original(2, vec_trackFeatForResection.size());
+  const features::PointFeatures & view_feats = _features_provider->feats_per_view.at(viewIndex);
+  for (size_t cpt = 0; cpt < vec_trackFeatForResection.size(); ++cpt)
   {
-    resection_data.pt3D.col(cpt) = _sfm_data.GetLandmarks().at(*iterTrackId).X;
+    resection_data.pt3D.col(cpt) = _sfm_data.GetLandmarks().at(vec_trackFeatForResection[cpt].first).X;
     resection_data.pt2D.col(cpt) = pt2D_original.col(cpt) =
-      _features_provider->feats_per_view.at(viewIndex)[*iterfeatId].coords().cast<double>();
+      view_feats[vec_trackFeatForResection[cpt].second].coords().cast<double>();
     // Handle image distortion if intrinsic is known (to ease the resection)
     if (optional_intrinsic && optional_intrinsic->have_disto())
     {
@@ -935,14 +955,9 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
     }
   }
 
-
   // C. Do the resectioning: compute the camera pose.
-  std::cout << std::endl
-    << "-------------------------------" << std::endl
-    << "-- Robust Resection of view: " << viewIndex << std::endl;
-
-  geometry::Pose3 pose;
-  const bool bResection = sfm::SfM_Localizer::Localize
+  geometry::Pose3 & pose = result.pose;
+  result.bResection = sfm::SfM_Localizer::Localize
   (
     Pair(view_I->ui_width, view_I->ui_height),
     optional_intrinsic.get(),
@@ -951,6 +966,87 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
   );
   resection_data.pt2D = std::move(pt2D_original); // restore original image domain points
 
+  if (!result.bResection)
+    return;
+
+  // D. Refine the pose of the found camera.
+  // We use a local scene with only the 3D points and the new camera.
+  const bool b_new_intrinsic = result.b_new_intrinsic = (optional_intrinsic == nullptr);
+  // A valid pose has been found (try to refine it):
+  // If no valid intrinsic as input:
+  //  init a new one from the projection matrix decomposition
+  // Else use the existing one and consider it as constant.
+  if (b_new_intrinsic)
+  {
+    // setup a default camera model from the found projection matrix
+    Mat3 K, R;
+    Vec3 t;
+    KRt_From_P(resection_data.projection_matrix, &K, &R, &t);
+
+    const double focal = (K(0,0) + K(1,1))/2.0;
+    const Vec2 principal_point(K(0,2), K(1,2));
+
+    // Create the new camera intrinsic group
+    switch (_camType)
+    {
+      case PINHOLE_CAMERA:
+        optional_intrinsic =
+          std::make_shared<Pinhole_Intrinsic>
+          (view_I->ui_width, view_I->ui_height, focal, principal_point(0), principal_point(1));
+      break;
+      case PINHOLE_CAMERA_RADIAL1:
+        optional_intrinsic =
+          std::make_shared<Pinhole_Intrinsic_Radial_K1>
+          (view_I->ui_width, view_I->ui_height, focal, principal_point(0), principal_point(1));
+      break;
+      case PINHOLE_CAMERA_RADIAL3:
+        optional_intrinsic =
+          std::make_shared<Pinhole_Intrinsic_Radial_K3>
+          (view_I->ui_width, view_I->ui_height, focal, principal_point(0), principal_point(1));
+      break;
+      case PINHOLE_CAMERA_BROWN:
+        optional_intrinsic =
+          std::make_shared<Pinhole_Intrinsic_Brown_T2>
+          (view_I->ui_width, view_I->ui_height, focal, principal_point(0), principal_point(1));
+      break;
+      default:
+        std::cerr << "Try to create an unknown camera type." << std::endl;
+        return;
+    }
+  }
+  result.bValid = sfm::SfM_Localizer::RefinePose(
+    optional_intrinsic.get(), pose,
+    resection_data, true, b_new_intrinsic);
+}
+
+/// Steps E to G of the resection: the localized view is added to the scene.
+bool SequentialSfMReconstructionEngine::CommitResection(const Resection_Result & result)
+{
+  using namespace tracks;
+
+  const size_t viewIndex = result.viewIndex;
+  const std::vector<TracksViewIndex::TrackFeature> & vec_trackFeatForResection = result.vec_trackFeat;
+  const Image_Localizer_Match_Data & resection_data = result.resection_data;
+  const std::shared_ptr<cameras::IntrinsicBase> & optional_intrinsic = result.intrinsic;
+  const geometry::Pose3 & pose = result.pose;
+
+  if (vec_trackFeatForResection.empty())
+  {
+    // No match. The image has no connection with already reconstructed points.
+    std::cout << std::endl
+      << "-------------------------------" << "\n"
+      << "-- Resection of camera index: " << viewIndex << "\n"
+      << "-- Resection status: " << "FAILED" << "\n"
+      << "-------------------------------" << std::endl;
+    return false;
+  }
+
+  const View * view_I = _sfm_data.GetViews().at(viewIndex).get();
+
+  std::cout << std::endl
+    << "-------------------------------" << std::endl
+    << "-- Robust Resection of view: " << viewIndex << std::endl;
+
   if (!_sLoggingFile.empty())
   {
     using namespace htmlDocument;
@@ -965,73 +1061,21 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
       << "-- Robust Resection of camera index: <" << viewIndex << "> image: "
       <<  view_I->s_Img_path <<"<br>"
       << "-- Threshold: " << resection_data.error_max << "<br>"
-      << "-- Resection status: " << (bResection ? "OK" : "FAILED") << "<br>"
-      << "-- Nb points used for Resection: " << vec_featIdForResection.size() << "<br>"
+      << "-- Resection status: " << (result.bResection ? "OK" : "FAILED") << "<br>"
+      << "-- Nb points used for Resection: " << vec_trackFeatForResection.size() << "<br>"
       << "-- Nb points validated by robust estimation: " << resection_data.vec_inliers.size() << "<br>"
       << "-- % points validated: "
-      << resection_data.vec_inliers.size()/static_cast<float>(vec_featIdForResection.size()) << "<br>"
+      << resection_data.vec_inliers.size()/static_cast<float>(vec_trackFeatForResection.size()) << "<br>"
       << "-------------------------------" << "<br>";
     _htmlDocStream->pushInfo(os.str());
   }
 
-  if (!bResection)
+  if (!result.bValid)
     return false;
 
-  // D. Refine the pose of the found camera.
-  // We use a local scene with only the 3D points and the new camera.
+  // E. Update the global scene with the new found camera pose, intrinsic (if not defined)
   {
-    const bool b_new_intrinsic = (optional_intrinsic == nullptr);
-    // A valid pose has been found (try to refine it):
-    // If no valid intrinsic as input:
-    //  init a new one from the projection matrix decomposition
-    // Else use the existing one and consider it as constant.
-    if (b_new_intrinsic)
-    {
-      // setup a default camera model from the found projection matrix
-      Mat3 K, R;
-      Vec3 t;
-      KRt_From_P(resection_data.projection_matrix, &K, &R, &t);
-
-      const double focal = (K(0,0) + K(1,1))/2.0;
-      const Vec2 principal_point(K(0,2), K(1,2));
-
-      // Create the new camera intrinsic group
-      switch (_camType)
-      {
-        case PINHOLE_CAMERA:
-          optional_intrinsic =
-            std::make_shared<Pinhole_Intrinsic>
-            (view_I->ui_width, view_I->ui_height, focal, principal_point(0), principal_point(1));
-        break;
-        case PINHOLE_CAMERA_RADIAL1:
-          optional_intrinsic =
-            std::make_shared<Pinhole_Intrinsic_Radial_K1>
-            (view_I->ui_width, view_I->ui_height, focal, principal_point(0), principal_point(1));
-        break;
-        case PINHOLE_CAMERA_RADIAL3:
-          optional_intrinsic =
-            std::make_shared<Pinhole_Intrinsic_Radial_K3>
-            (view_I->ui_width, view_I->ui_height, focal, principal_point(0), principal_point(1));
-        break;
-        case PINHOLE_CAMERA_BROWN:
-          optional_intrinsic =
-            std::make_shared<Pinhole_Intrinsic_Brown_T2>
-            (view_I->ui_width, view_I->ui_height, focal, principal_point(0), principal_point(1));
-        break;
-        default:
-          std::cerr << "Try to create an unknown camera type." << std::endl;
-          return false;
-      }
-    }
-    if(!sfm::SfM_Localizer::RefinePose(
-      optional_intrinsic.get(), pose,
-      resection_data, true, b_new_intrinsic))
-    {
-      return false;
-    }
-
-    // E. Update the global scene with the new found camera pose, intrinsic (if not defined)
-    if (b_new_intrinsic)
+    if (result.b_new_intrinsic)
     {
       // Since the view have not yet an intrinsic group before, create a new one
       IndexT new_intrinsic_id = 0;
@@ -1055,8 +1099,7 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
 
   // F. Update the observations into the global scene structure
   // - Add the new 2D observations to the reconstructed tracks
-  iterTrackId = set_trackIdForResection.begin();
-  for (size_t i = 0; i < resection_data.pt2D.cols(); ++i, ++iterTrackId)
+  for (size_t i = 0; i < resection_data.pt2D.cols(); ++i)
   {
     const Vec3 X = resection_data.pt3D.col(i);
     const Vec2 x = resection_data.pt2D.col(i);
@@ -1065,7 +1108,8 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
         pose.depth(X) > 0)
     {
       // Inlier, add the point to the reconstructed track
-      _sfm_data.structure[*iterTrackId].obs[viewIndex] = Observation(x, vec_featIdForResection[i]);
+      _sfm_data.structure[vec_trackFeatForResection[i].first].obs[viewIndex] =
+        Observation(x, vec_trackFeatForResection[i].second);
     }
   }
 
@@ -1089,9 +1133,9 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
         const size_t J = std::max((IndexT)viewIndex, indexI);
 
         // Find track correspondences between I and J
-        const std::set<size_t> set_viewIndex = { I,J };
-        i23dSFM::tracks::STLMAPTracks map_tracksCommonIJ;
-        TracksUtilsMap::GetTracksInImages(set_viewIndex, _map_tracks, map_tracksCommonIJ);
+        // (trackId, (featId in I, featId in J))
+        std::vector<std::pair<size_t, std::pair<size_t, size_t> > > vec_tracksCommonIJ;
+        _tracks_view_index.CommonTracks(I, J, vec_tracksCommonIJ);
 
         const View * view_I = _sfm_data.GetViews().at(I).get();
         const View * view_J = _sfm_data.GetViews().at(J).get();
@@ -1101,13 +1145,14 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
         const Pose3 pose_J = _sfm_data.GetPoseOrDie(view_J);
 
         size_t new_putative_track = 0, new_added_track = 0, extented_track = 0;
-        for (const std::pair< size_t, tracks::submapTrack >& trackIt : map_tracksCommonIJ)
+        for (const std::pair<size_t, std::pair<size_t, size_t> > & trackIt : vec_tracksCommonIJ)
         {
           const size_t trackId = trackIt.first;
-          const tracks::submapTrack & track = trackIt.second;
+          const size_t featI = trackIt.second.first;
+          const size_t featJ = trackIt.second.second;
 
-          const Vec2 xI = _features_provider->feats_per_view.at(I)[track.at(I)].coords().cast<double>();
-          const Vec2 xJ = _features_provider->feats_per_view.at(J)[track.at(J)].coords().cast<double>();
+          const Vec2 xI = _features_provider->feats_per_view.at(I)[featI].coords().cast<double>();
+          const Vec2 xJ = _features_provider->feats_per_view.at(J)[featJ].coords().cast<double>();
 
           // test if the track already exists in 3D
           if (_sfm_data.structure.count(trackId) != 0)
@@ -1123,7 +1168,7 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
                 const Vec2 residual = cam_I->residual(pose_I, landmark.X, xI);
                 if (pose_I.depth(landmark.X) > 0 && residual.norm() < std::max(4.0, _map_ACThreshold.at(I)))
                 {
-                  landmark.obs[I] = Observation(xI, track.at(I));
+                  landmark.obs[I] = Observation(xI, featI);
                   ++extented_track;
                 }
               }
@@ -1132,7 +1177,7 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
                 const Vec2 residual = cam_J->residual(pose_J, landmark.X, xJ);
                 if (pose_J.depth(landmark.X) > 0 && residual.norm() < std::max(4.0, _map_ACThreshold.at(J)))
                 {
-                  landmark.obs[J] = Observation(xJ, track.at(J));
+                  landmark.obs[J] = Observation(xJ, featJ);
                   ++extented_track;
                 }
               }
@@ -1173,9 +1218,10 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
                 // Add a new track
                 Landmark & landmark = _sfm_data.structure[trackId];
                 landmark.X = X_euclidean;
-                landmark.semantic_label = _features_provider->feats_per_view.at(I)[track.at(I)].semanticLabel(); 
-                landmark.obs[I] = Observation(xI, track.at(I));
-                landmark.obs[J] = Observation(xJ, track.at(J));
+                landmark.semantic_label = TrackSemanticLabel(trackId, I, featI);
+                landmark.obs[I] = Observation(xI, featI);
+                landmark.obs[J] = Observation(xJ, featJ);
+                _tracks_view_index.SetReconstructed(trackId);
                 ++new_added_track;
               } // critical
             } // 3D point is valid
@@ -1184,7 +1230,7 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
 #ifdef I23DSFM_USE_OPENMP
         #pragma omp critical
 #endif
-        if (!map_tracksCommonIJ.empty())
+        if (!vec_tracksCommonIJ.empty())
         {
           std::cout
             << "\n--Triangulated 3D points [" << I << "-" << J << "]:"
@@ -1199,7 +1245,7 @@ bool SequentialSfMReconstructionEngine::Resection(const size_t viewIndex)
 }
 
 /// Bundle adjustment to refine Structure; Motion and Intrinsics
-bool SequentialSfMReconstructionEngine::BundleAdjustment()
+bool SequentialSfMReconstructionEngine::BundleAdjustment(Landmarks_CSR & landmarks)
 {
   Bundle_Adjustment_Ceres::BA_options options;
   if (_sfm_data.GetPoses().size() > 100)
@@ -1212,10 +1258,88 @@ bool SequentialSfMReconstructionEngine::BundleAdjustment()
     options._linear_solver_type = ceres::DENSE_SCHUR;
   }
   Bundle_Adjustment_Ceres bundle_adjustment_obj(options);
-  return bundle_adjustment_obj.Adjust(_sfm_data, true, true, !_bFixedIntrinsics);
+  return bundle_adjustment_obj.Adjust(_sfm_data, landmarks, true, true, !_bFixedIntrinsics);
   // return bundle_adjustment_obj.SemanticAdjust(_sfm_data, true, true, !_bFixedIntrinsics);
 }
 
+/// Global bundle adjustment & outlier rejection loop.
+/// The loop works on a flat copy of the structure: the scene landmarks are
+/// released meanwhile and rebuilt once the structure is stable.
+void SequentialSfMReconstructionEngine::GlobalBundleAdjustment()
+{
+  Landmarks_CSR landmarks(_sfm_data.structure);
+  Landmarks().swap(_sfm_data.structure);
+  do
+  {
+    BundleAdjustment(landmarks);
+  }
+  while (badTrackRejector(landmarks, 4.0, 50) != 0);
+  landmarks.Export(_sfm_data.structure);
+  // Unflag the rejected tracks
+  _tracks_view_index.Synchronize(_sfm_data.GetLandmarks());
+}
+
+/// Local bundle adjustment: refine the new views, their most co-visible
+/// neighbours and the points they see, the rest of the scene is kept constant.
+bool SequentialSfMReconstructionEngine::LocalBundleAdjustment(const std::set<IndexT> & new_views)
+{
+  std::set<IndexT> refined_poses;
+  for (std::set<IndexT>::const_iterator iter = new_views.begin(); iter != new_views.end(); ++iter)
+  {
+    const View * view = _sfm_data.GetViews().at(*iter).get();
+    if (_sfm_data.IsPoseAndIntrinsicDefined(view))
+      refined_poses.insert(view->id_pose);
+  }
+
+  // Count the tracks the other poses share with the new views
+  std::map<IndexT, size_t> map_covisibility;
+  for (Landmarks::const_iterator iterTracks = _sfm_data.GetLandmarks().begin();
+    iterTracks != _sfm_data.GetLandmarks().end(); ++iterTracks)
+  {
+    const Observations & obs = iterTracks->second.obs;
+    bool bSeenByNewView = false;
+    for (std::set<IndexT>::const_iterator iter = new_views.begin();
+      iter != new_views.end() && !bSeenByNewView; ++iter)
+    {
+      bSeenByNewView = (obs.count(*iter) != 0);
+    }
+    if (!bSeenByNewView)
+      continue;
+    for (Observations::const_iterator itObs = obs.begin(); itObs != obs.end(); ++itObs)
+    {
+      const IndexT id_pose = _sfm_data.GetViews().at(itObs->first)->id_pose;
+      if (refined_poses.count(id_pose) == 0)
+        ++map_covisibility[id_pose];
+    }
+  }
+
+  // Keep the most co-visible neighbours
+  std::vector<std::pair<size_t, IndexT> > vec_neighbours;
+  for (std::map<IndexT, size_t>::const_iterator iter = map_covisibility.begin();
+    iter != map_covisibility.end(); ++iter)
+  {
+    vec_neighbours.push_back(std::make_pair(iter->second, iter->first));
+  }
+  const size_t nbNeighbours = std::min(_nbLocalBANeighbours, vec_neighbours.size());
+  std::partial_sort(vec_neighbours.begin(), vec_neighbours.begin() + nbNeighbours,
+    vec_neighbours.end(), std::greater<std::pair<size_t, IndexT> >());
+  for (size_t i = 0; i < nbNeighbours; ++i)
+    refined_poses.insert(vec_neighbours[i].second);
+
+  Bundle_Adjustment_Ceres::BA_options options;
+  if (refined_poses.size() > 100)
+  {
+    options._preconditioner_type = ceres::JACOBI;
+    options._linear_solver_type = ceres::SPARSE_SCHUR;
+  }
+  else
+  {
+    options._linear_solver_type = ceres::DENSE_SCHUR;
+  }
+  Bundle_Adjustment_Ceres bundle_adjustment_obj(options);
+  return bundle_adjustment_obj.AdjustLocal(_sfm_data, refined_poses);
+}
+
 /**
  * @brief Discard tracks with too large residual error
  *
@@ -1229,10 +1353,32 @@ size_t SequentialSfMReconstructionEngine::badTrackRejector(double dPrecision, si
 {
   const size_t nbOutliers_residualErr = RemoveOutliers_PixelResidualError(_sfm_data, dPrecision, 2);
   const size_t nbOutliers_angleErr = RemoveOutliers_AngleError(_sfm_data, 2.0);
+  // Unflag the rejected tracks
+  _tracks_view_index.Synchronize(_sfm_data.GetLandmarks());
 
   return (nbOutliers_residualErr + nbOutliers_angleErr) > count;
 }
 
+size_t SequentialSfMReconstructionEngine::badTrackRejector(Landmarks_CSR & landmarks, double dPrecision, size_t count)
+{
+  const size_t nbOutliers_residualErr = RemoveOutliers_PixelResidualError(_sfm_data, landmarks, dPrecision, 2);
+  const size_t nbOutliers_angleErr = RemoveOutliers_AngleError(_sfm_data, landmarks, 2.0);
+
+  return (nbOutliers_residualErr + nbOutliers_angleErr) > count;
+}
+
+int SequentialSfMReconstructionEngine::TrackSemanticLabel
+(
+  size_t trackId,
+  IndexT viewIndex,
+  IndexT featIndex
+) const
+{
+  if (trackId < _track_semantic_labels.size())
+    return _track_semantic_labels[trackId];
+  return _features_provider->feats_per_view.at(viewIndex)[featIndex].semanticLabel();
+}
+
 } // namespace sfm
 } // namespace i23dSFM
 
@@ -10,6 +10,8 @@
 #include "i23dSFM/sfm/pipelines/sfm_engine.hpp"
 #include "i23dSFM/sfm/pipelines/sfm_features_provider.hpp"
 #include "i23dSFM/sfm/pipelines/sfm_matches_provider.hpp"
+#include "i23dSFM/sfm/pipelines/localization/SfM_Localizer.hpp"
+#include "i23dSFM/sfm/sfm_landmarks_csr.hpp"
 #include "i23dSFM/tracks/tracks.hpp"
 
 #include "third_party/htmlDoc/htmlDoc.hpp"
@@ -63,8 +65,65 @@ public:
     _camType = camType;
   }
 
+  /**
+   * Use a local (windowed) bundle adjustment after each resection round:
+   * only the new views, their most co-visible reconstructed neighbours and
+   * the points they see are refined, the rest of the scene is kept constant.
+   * A global bundle adjustment is still run every nbImagesBetweenGlobalBA
+   * added images or when the number of poses grew by globalBAGrowthRatio.
+   */
+  void SetLocalBundleAdjustment(
+    bool bLocalBA,
+    size_t nbNeighbourPoses = 20,
+    size_t nbImagesBetweenGlobalBA = 50,
+    double globalBAGrowthRatio = 0.1)
+  {
+    _bLocalBA = bLocalBA;
+    _nbLocalBANeighbours = nbNeighbourPoses;
+    _nbImagesBetweenGlobalBA = nbImagesBetweenGlobalBA;
+    _globalBAGrowthRatio = globalBAGrowthRatio;
+  }
+
+  /**
+   * Localize all the views of a resection group concurrently.
+   * The poses are estimated against the structure frozen at the beginning of
+   * the group, then committed (and new tracks triangulated) one view after
+   * the other in the group order. The robust resection of a view draws its
+   * samples from a generator seeded by the view index, so the result does
+   * not depend on the thread scheduling.
+   */
+  void SetParallelResection(bool bParallelResection)
+  {
+    _bParallelResection = bParallelResection;
+  }
+
+  /**
+   * Options of the robust resection of the new views: adaptive iteration
+   * count and SPRT early rejection of the ACRANSAC models
+   * (default: exhaustive search).
+   */
+  void SetResectionRobustOptions(const robust::ACRANSAC_Options & robustOptions)
+  {
+    _resectionRobustOptions = robustOptions;
+  }
+
+  /**
+   * Handling of the tracks whose features have different semantic labels
+   * (done at track building, so these conflicts never reach triangulation):
+   * split the tracks per label or keep their majority label (default).
+   * The landmarks get the label of their track.
+   */
+  void SetSemanticTrackMode(tracks::ESemanticTrackMode semanticTrackMode)
+  {
+    _semanticTrackMode = semanticTrackMode;
+  }
+
 protected:
 
+  /// Bundle adjustment to refine Structure; Motion and Intrinsics
+  /// (the structure is given as the flat landmark store of the global adjustment;
+  /// can be overridden to run it on another backend, i.e. MPI workers)
+  virtual bool BundleAdjustment(Landmarks_CSR & landmarks);
 
 private:
 
@@ -74,15 +133,46 @@ private:
   /// List the images that the greatest number of matches to the current 3D reconstruction.
   bool FindImagesWithPossibleResection(std::vector<size_t> & vec_possible_indexes);
 
+  /// Pose of a view estimated against the current structure, not yet added to the scene
+  struct Resection_Result
+  {
+    Resection_Result() : viewIndex(UndefinedIndexT), b_new_intrinsic(false), bResection(false), bValid(false) {}
+
+    size_t viewIndex;
+    std::vector<tracks::TracksViewIndex::TrackFeature> vec_trackFeat; // 2D-3D associations (trackId, featId)
+    Image_Localizer_Match_Data resection_data;
+    geometry::Pose3 pose;
+    std::shared_ptr<cameras::IntrinsicBase> intrinsic;
+    bool b_new_intrinsic; // the intrinsic was created from the projection matrix
+    bool bResection;      // robust resection status
+    bool bValid;          // resection and pose refinement succeeded
+  };
+
   /// Add a single Image to the scene and triangulate new possible tracks.
   bool Resection(const size_t imageIndex);
 
-  /// Bundle adjustment to refine Structure; Motion and Intrinsics
-  bool BundleAdjustment();
+  /// Robust resection and pose refinement of a view (the scene is not modified)
+  void LocalizeView(const size_t imageIndex, Resection_Result & result) const;
+
+  /// Add a localized view to the scene and triangulate new possible tracks.
+  bool CommitResection(const Resection_Result & result);
+
+  /// Global bundle adjustment and outlier rejection until the scene is stable
+  /// (run on a flat landmark store, the scene landmarks are rebuilt afterwards)
+  void GlobalBundleAdjustment();
+
+  /// Local bundle adjustment of the given new views and their co-visible neighbours
+  bool LocalBundleAdjustment(const std::set<IndexT> & new_views);
 
   /// Discard track with too large residual error
   size_t badTrackRejector(double dPrecision, size_t count = 0);
 
+  /// Discard track with too large residual error (flat landmark store version)
+  size_t badTrackRejector(Landmarks_CSR & landmarks, double dPrecision, size_t count = 0);
+
+  /// Semantic label of a track (label of the given feature if the tracks are not labelled)
+  int TrackSemanticLabel(size_t trackId, IndexT viewIndex, IndexT featIndex) const;
+
   //----
   //-- Data
   //----
@@ -101,9 +191,25 @@ private:
 
   // Temporary data
   i23dSFM::tracks::STLMAPTracks _map_tracks; // putative landmark tracks (visibility per 3D point)
+  i23dSFM::tracks::TracksViewIndex _tracks_view_index; // per view tracks & reconstructed tracks count
+  std::vector<int> _track_semantic_labels; // semantic label per track id (if the tracks are labelled)
   Hash_Map<IndexT, double> _map_ACThreshold; // Per camera confidence (A contrario estimated threshold error)
 
   std::set<size_t> _set_remainingViewId;     // Remaining camera index that can be used for resection
+
+  // Local bundle adjustment
+  bool _bLocalBA;
+  size_t _nbLocalBANeighbours;      // Co-visible poses refined with the new views
+  size_t _nbImagesBetweenGlobalBA;  // Run a global BA every N added images...
+  double _globalBAGrowthRatio;      // ...or when the scene grew by this ratio
+
+  // Concurrent resection of the views of a group
+  bool _bParallelResection;
+  // ACRANSAC options of the resection
+  robust::ACRANSAC_Options _resectionRobustOptions;
+
+  // Semantic consistency of the tracks
+  tracks::ESemanticTrackMode _semanticTrackMode;
 };
 
 } // namespace sfm
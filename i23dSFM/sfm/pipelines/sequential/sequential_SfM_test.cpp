@@ -19,6 +19,7 @@
 
 #include "i23dSFM/sfm/pipelines/pipelines_test.hpp"
 #include "i23dSFM/sfm/sfm.hpp"
+#include "i23dSFM/geometry/rigid_transformation3D_srt.hpp"
 using namespace i23dSFM;
 using namespace i23dSFM::cameras;
 using namespace i23dSFM::geometry;
@@ -29,6 +30,7 @@ using namespace i23dSFM::sfm;
 #include <cmath>
 #include <cstdio>
 #include <iostream>
+#include <limits>
 
 // Test a scene where all the camera intrinsics are known
 TEST(SEQUENTIAL_SFM, Known_Intrinsics) {
@@ -142,6 +144,151 @@ TEST(SEQUENTIAL_SFM, Partially_Known_Intrinsics) {
   EXPECT_TRUE( sfmEngine.Get_SfM_Data().GetLandmarks().size() == npoints);
 }
 
+// Test the local (windowed) bundle adjustment: the scene is only adjusted
+// globally at the end of the reconstruction
+TEST(SEQUENTIAL_SFM, Local_Bundle_Adjustment) {
+
+  const int nviews = 12;
+  const int npoints = 32;
+  const nViewDatasetConfigurator config;
+  const NViewDataSet d = NRealisticCamerasRing(nviews, npoints, config);
+
+  // Translate the input dataset to a SfM_Data scene
+  const SfM_Data sfm_data = getInputScene(d, config, PINHOLE_CAMERA);
+
+  // Remove poses and structure
+  SfM_Data sfm_data_2 = sfm_data;
+  sfm_data_2.poses.clear();
+  sfm_data_2.structure.clear();
+
+  SequentialSfMReconstructionEngine sfmEngine(
+    sfm_data_2,
+    "./",
+    stlplus::create_filespec("./", "Reconstruction_Report.html"));
+
+  // Configure the features_provider & the matches_provider from the synthetic dataset
+  std::shared_ptr<Features_Provider> feats_provider =
+    std::make_shared<Synthetic_Features_Provider>();
+  // Add a tiny noise in 2D observations to make data more realistic
+  std::normal_distribution<double> distribution(0.0,0.5);
+  dynamic_cast<Synthetic_Features_Provider*>(feats_provider.get())->load(d,distribution);
+
+  std::shared_ptr<Matches_Provider> matches_provider =
+    std::make_shared<Synthetic_Matches_Provider>();
+  dynamic_cast<Synthetic_Matches_Provider*>(matches_provider.get())->load(d);
+
+  // Configure data provider (Features and Matches)
+  sfmEngine.SetFeaturesProvider(feats_provider.get());
+  sfmEngine.SetMatchesProvider(matches_provider.get());
+
+  // Set an initial pair
+  sfmEngine.setInitialPair(Pair(0,1));
+
+  // Configure reconstruction parameters
+  sfmEngine.Set_bFixedIntrinsics(true);
+  // Refine the new views with 2 neighbours, never trigger an intermediate global BA
+  sfmEngine.SetLocalBundleAdjustment(true, 2, nviews, 10.0);
+
+  EXPECT_TRUE (sfmEngine.Process());
+
+  const double dResidual = RMSE(sfmEngine.Get_SfM_Data());
+  std::cout << "RMSE residual: " << dResidual << std::endl;
+  EXPECT_TRUE( dResidual < 0.5);
+  EXPECT_TRUE( sfmEngine.Get_SfM_Data().GetPoses().size() == nviews);
+  EXPECT_TRUE( sfmEngine.Get_SfM_Data().GetLandmarks().size() == npoints);
+}
+
+// Reconstruct the synthetic scene with the serial or the parallel resection
+static bool ReconstructRing
+(
+  const NViewDataSet & d,
+  const nViewDatasetConfigurator & config,
+  bool bParallelResection,
+  SfM_Data & sfm_data_out
+)
+{
+  SfM_Data sfm_data = getInputScene(d, config, PINHOLE_CAMERA);
+  sfm_data.poses.clear();
+  sfm_data.structure.clear();
+
+  SequentialSfMReconstructionEngine sfmEngine(
+    sfm_data,
+    "./",
+    stlplus::create_filespec("./", "Reconstruction_Report.html"));
+
+  // Same noisy observations for every run
+  std::shared_ptr<Features_Provider> feats_provider =
+    std::make_shared<Synthetic_Features_Provider>();
+  std::normal_distribution<double> distribution(0.0,0.5);
+  dynamic_cast<Synthetic_Features_Provider*>(feats_provider.get())->load(d,distribution);
+
+  std::shared_ptr<Matches_Provider> matches_provider =
+    std::make_shared<Synthetic_Matches_Provider>();
+  dynamic_cast<Synthetic_Matches_Provider*>(matches_provider.get())->load(d);
+
+  sfmEngine.SetFeaturesProvider(feats_provider.get());
+  sfmEngine.SetMatchesProvider(matches_provider.get());
+  sfmEngine.setInitialPair(Pair(0,1));
+  sfmEngine.Set_bFixedIntrinsics(true);
+  sfmEngine.SetParallelResection(bParallelResection);
+
+  const bool bProcess = sfmEngine.Process();
+  sfm_data_out = sfmEngine.Get_SfM_Data();
+  return bProcess;
+}
+
+// Largest camera center distance between two reconstructions of the same
+// views, once aligned with a similarity
+static double MaxCenterDistance(const SfM_Data & sfm_data_a, const SfM_Data & sfm_data_b)
+{
+  Mat centers_a(3, sfm_data_a.GetPoses().size()), centers_b(3, sfm_data_a.GetPoses().size());
+  size_t i = 0;
+  for (Poses::const_iterator iter = sfm_data_a.GetPoses().begin();
+    iter != sfm_data_a.GetPoses().end(); ++iter, ++i)
+  {
+    centers_a.col(i) = iter->second.center();
+    centers_b.col(i) = sfm_data_b.GetPoses().at(iter->first).center();
+  }
+  double S;
+  Vec3 t;
+  Mat3 R;
+  if (!geometry::FindRTS(centers_b, centers_a, &S, &t, &R))
+    return std::numeric_limits<double>::infinity();
+  double max_distance = 0.0;
+  for (i = 0; i < static_cast<size_t>(centers_b.cols()); ++i)
+  {
+    const Vec3 aligned = S * R * centers_b.col(i) + t;
+    max_distance = std::max(max_distance, (aligned - Vec3(centers_a.col(i))).norm());
+  }
+  return max_distance;
+}
+
+// Test the concurrent resection of the views of a group:
+// it must find the same scene as the serial resection
+TEST(SEQUENTIAL_SFM, Parallel_Resection) {
+
+  const int nviews = 12;
+  const int npoints = 32;
+  const nViewDatasetConfigurator config;
+  const NViewDataSet d = NRealisticCamerasRing(nviews, npoints, config);
+
+  SfM_Data sfm_data_serial, sfm_data_parallel;
+  EXPECT_TRUE (ReconstructRing(d, config, false, sfm_data_serial));
+  EXPECT_TRUE (ReconstructRing(d, config, true, sfm_data_parallel));
+
+  const double dResidual = RMSE(sfm_data_parallel);
+  std::cout << "RMSE residual: " << dResidual << std::endl;
+  EXPECT_TRUE( dResidual < 0.5);
+  EXPECT_TRUE( sfm_data_parallel.GetPoses().size() == nviews);
+  EXPECT_TRUE( sfm_data_parallel.GetLandmarks().size() == npoints);
+  EXPECT_TRUE( sfm_data_serial.GetPoses().size() == nviews);
+
+  // Same camera positions, up to the noise of the observations
+  const double dCenterDistance = MaxCenterDistance(sfm_data_serial, sfm_data_parallel);
+  std::cout << "Max camera center distance: " << dCenterDistance << std::endl;
+  EXPECT_TRUE( dCenterDistance < 1e-2);
+}
+
 /* ************************************************************************* */
 int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
 /* ************************************************************************* */
@@ -11,6 +11,7 @@
 #include <i23dSFM/types.hpp>
 #include <i23dSFM/sfm/sfm_data.hpp>
 #include <i23dSFM/features/features.hpp>
+#include <i23dSFM/features/regions_container.hpp>
 #include "third_party/progress/progress.hpp"
 
 #include <memory>
@@ -30,6 +31,14 @@ struct Features_Provider
     const std::string & feat_directory,
     std::unique_ptr<features::Regions>& region_type)
   {
+    // Use the packed regions of the binary container if any,
+    // the per view .feat files otherwise
+    features::Regions_Container container;
+    const std::string sContainer = stlplus::create_filespec(feat_directory,
+      features::REGIONS_CONTAINER_BASENAME, "bin");
+    if (stlplus::file_exists(sContainer))
+      container.Open(sContainer, *region_type);
+
     C_Progress_display my_progress_bar( sfm_data.GetViews().size(),
       std::cout, "\n- Features Loading -\n" );
     // Read for each view the corresponding features and store them as PointFeatures
@@ -48,21 +57,34 @@ struct Features_Provider
         const std::string basename = stlplus::basename_part(sImageName);
         const std::string featFile = stlplus::create_filespec(feat_directory, basename, ".feat");
 
-        std::unique_ptr<features::Regions> regions(region_type->EmptyClone());
-        if (!regions->LoadFeatures(featFile))
+        features::PointFeatures feats;
+        features::Packed_Regions packed;
+        if (container.IsOpen() && container.Get(iter->second.get()->id_view, packed))
+        {
+          // read the positions directly from the packed arrays
+          feats.reserve(packed.count);
+          for (size_t i = 0; i < packed.count; ++i)
+            feats.emplace_back(packed.x[i], packed.y[i], packed.semantic_label[i]);
+        }
+        else
         {
-          std::cerr << "Invalid feature files for the view: " << sImageName << std::endl;
+          std::unique_ptr<features::Regions> regions(region_type->EmptyClone());
+          if (!regions->LoadFeatures(featFile))
+          {
+            std::cerr << "Invalid feature files for the view: " << sImageName << std::endl;
 #ifdef I23DSFM_USE_OPENMP
-      #pragma omp critical
+        #pragma omp critical
 #endif
-          bContinue = false;
+            bContinue = false;
+          }
+          feats = regions->GetRegionsPositions();
         }
 #ifdef I23DSFM_USE_OPENMP
       #pragma omp critical
 #endif
         {
           // save loaded Features as PointFeature
-          feats_per_view[iter->second.get()->id_view] = regions->GetRegionsPositions();
+          feats_per_view[iter->second.get()->id_view] = std::move(feats);
           ++my_progress_bar;
         }
       }
@@ -12,6 +12,7 @@
 #include <i23dSFM/sfm/sfm_data.hpp>
 #include <i23dSFM/features/regions.hpp>
 #include <i23dSFM/features/image_describer.hpp>
+#include <i23dSFM/features/regions_container.hpp>
 #include "third_party/progress/progress.hpp"
 
 #include <memory>
@@ -32,6 +33,14 @@ struct Regions_Provider
     const std::string & feat_directory,
     std::unique_ptr<features::Regions>& region_type)
   {
+    // Use the packed regions of the binary container if any,
+    // the per view .feat/.desc files otherwise
+    features::Regions_Container container;
+    const std::string sContainer = stlplus::create_filespec(feat_directory,
+      features::REGIONS_CONTAINER_BASENAME, "bin");
+    if (stlplus::file_exists(sContainer))
+      container.Open(sContainer, *region_type);
+
     C_Progress_display my_progress_bar( sfm_data.GetViews().size(),
       std::cout, "\n- Regions Loading -\n");
     // Read for each view the corresponding regions and store them
@@ -52,7 +61,12 @@ struct Regions_Provider
         const std::string descFile = stlplus::create_filespec(feat_directory, basename, ".desc");
 
         std::unique_ptr<features::Regions> regions_ptr(region_type->EmptyClone());
-        if (!regions_ptr->Load(featFile, descFile))
+        features::Packed_Regions packed;
+        if (container.IsOpen() && container.Get(iter->second.get()->id_view, packed))
+        {
+          regions_ptr->LoadPacked(packed);
+        }
+        else if (!regions_ptr->Load(featFile, descFile))
         {
           std::cerr << "Invalid regions files for the view: " << sImageName << std::endl;
 #ifdef I23DSFM_USE_OPENMP
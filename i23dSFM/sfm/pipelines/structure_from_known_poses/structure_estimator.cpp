@@ -13,6 +13,7 @@
 #include "i23dSFM/graph/graph.hpp"
 #include "i23dSFM/tracks/tracks.hpp"
 #include "i23dSFM/sfm/sfm_data_triangulation.hpp"
+#include "i23dSFM/sfm/sfm_landmarks_csr.hpp"
 
 #include "third_party/progress/progress.hpp"
 
@@ -186,7 +187,7 @@ void SfM_Data_Structure_Estimation_From_Known_Poses::filter(
       const IndexT I = triplet.i, J = triplet.j , K = triplet.k;
 
       i23dSFM::tracks::STLMAPTracks map_tracksCommon;
-      i23dSFM::tracks::TracksBuilder tracksBuilder;
+      i23dSFM::tracks::FlatTracksBuilder tracksBuilder;
       {
         PairWiseMatches map_matchesIJK;
         if(putatives_matches.find(std::make_pair(I,J)) != putatives_matches.end())
@@ -252,38 +253,38 @@ void SfM_Data_Structure_Estimation_From_Known_Poses::triangulate(
   const std::shared_ptr<Regions_Provider> & regions_provider)
 {
   i23dSFM::tracks::STLMAPTracks map_tracksCommon;
-  i23dSFM::tracks::TracksBuilder tracksBuilder;
+  i23dSFM::tracks::FlatTracksBuilder tracksBuilder;
   tracksBuilder.Build(triplets_matches);
   tracksBuilder.Filter(3);
   tracksBuilder.ExportToSTL(map_tracksCommon);
   matching::PairWiseMatches().swap(triplets_matches);
 
-  // Generate new Structure tracks
-  sfm_data.structure.clear();
-
-  // Fill sfm_data with the computed tracks (no 3D yet)
-  Landmarks & structure = sfm_data.structure;
+  // Fill a landmark store with the computed tracks (no 3D yet)
+  // (the track observations are sorted by view id)
+  Landmarks_CSR landmarks;
   IndexT idx(0);
   for (tracks::STLMAPTracks::const_iterator itTracks = map_tracksCommon.begin();
        itTracks != map_tracksCommon.end(); ++itTracks, ++idx)
   {
     const tracks::submapTrack & track = itTracks->second;
-    structure[idx] = Landmark();
-    Observations & obs = structure.at(idx).obs;
-    int & semantic_label = structure.at(idx).semantic_label;
+    landmarks.AddLandmark(idx);
+    int & semantic_label = landmarks.semantic_labels.back();
     for (tracks::submapTrack::const_iterator it = track.begin(); it != track.end(); ++it)
     {
       const size_t imaIndex = it->first;
       const size_t featIndex = it->second;
       const Vec2 pt = regions_provider->regions_per_view.at(imaIndex)->GetRegionPosition(featIndex);
-      obs[imaIndex] = Observation(pt, featIndex);
+      landmarks.AddObservation(imaIndex, Observation(pt, featIndex));
       semantic_label = regions_provider->regions_per_view.at(imaIndex)->GetRegionsPositionLabel(featIndex);
     }
   }
 
   // Triangulate them using a robust triangulation scheme
   SfM_Data_Structure_Computation_Robust structure_estimator(true);
-  structure_estimator.triangulate(sfm_data);
+  structure_estimator.triangulate(sfm_data, landmarks);
+
+  // Generate new Structure tracks
+  landmarks.Export(sfm_data.structure);
 }
 
 } // namespace sfm
@@ -14,7 +14,9 @@
 // SfM data
 //-----------------
 #include "i23dSFM/sfm/sfm_data.hpp"
+#include "i23dSFM/sfm/sfm_landmarks_csr.hpp"
 #include "i23dSFM/sfm/sfm_data_utils.hpp"
+#include "i23dSFM/sfm/sfm_data_colorization.hpp"
 #include "i23dSFM/sfm/sfm_data_io.hpp"
 #include "i23dSFM/sfm/sfm_data_filters.hpp"
 #include "i23dSFM/sfm/sfm_data_filters_frustum.hpp"
@@ -64,6 +64,102 @@ ceres::CostFunction * SemanticIntrinsicsToCostFunction(IntrinsicBase * intrinsic
   }
 }
 
+/// Angle axis & translation parameters [R|t] of a pose
+static std::vector<double> PoseToParameters(const Pose3 & pose)
+{
+  const Mat3 R = pose.rotation();
+  const Vec3 t = pose.translation();
+  double angleAxis[3];
+  ceres::RotationMatrixToAngleAxis((const double*)R.data(), angleAxis);
+  std::vector<double> pose_params(6); //angleAxis + translation
+  pose_params[0] = angleAxis[0];
+  pose_params[1] = angleAxis[1];
+  pose_params[2] = angleAxis[2];
+  pose_params[3] = t(0);
+  pose_params[4] = t(1);
+  pose_params[5] = t(2);
+  return pose_params;
+}
+
+/// Pose from its angle axis & translation parameters
+static Pose3 ParametersToPose(const std::vector<double> & pose_params)
+{
+  Mat3 R_refined;
+  ceres::AngleAxisToRotationMatrix(&pose_params[0], R_refined.data());
+  const Vec3 t_refined(pose_params[3], pose_params[4], pose_params[5]);
+  return Pose3(R_refined, -R_refined.transpose() * t_refined);
+}
+
+/// Add a pose parameter block, with the rotation and/or translation kept constant
+static void AddPoseParameterBlock
+(
+  ceres::Problem & problem,
+  std::vector<double> & pose_params,
+  bool bRefineRotations,
+  bool bRefineTranslations
+)
+{
+  double * parameter_block = &pose_params[0];
+  problem.AddParameterBlock(parameter_block, 6);
+  if (!bRefineTranslations && !bRefineRotations)
+  {
+    //set the whole parameter block as constant for best performance.
+    problem.SetParameterBlockConstant(parameter_block);
+  }
+  else  {
+    // Subset parametrization
+    std::vector<int> vec_constant_extrinsic;
+    if(!bRefineRotations)
+    {
+      vec_constant_extrinsic.push_back(0);
+      vec_constant_extrinsic.push_back(1);
+      vec_constant_extrinsic.push_back(2);
+    }
+    if(!bRefineTranslations)
+    {
+      vec_constant_extrinsic.push_back(3);
+      vec_constant_extrinsic.push_back(4);
+      vec_constant_extrinsic.push_back(5);
+    }
+    if (!vec_constant_extrinsic.empty())
+    {
+      ceres::SubsetParameterization *subset_parameterization =
+        new ceres::SubsetParameterization(6, vec_constant_extrinsic);
+      problem.SetParameterization(parameter_block, subset_parameterization);
+    }
+  }
+}
+
+/// Add an intrinsic parameter block, kept constant if not refined
+static void AddIntrinsicParameterBlock
+(
+  ceres::Problem & problem,
+  std::vector<double> & intrinsic_params,
+  bool bRefineIntrinsics
+)
+{
+  double * parameter_block = &intrinsic_params[0];
+  problem.AddParameterBlock(parameter_block, intrinsic_params.size());
+  if (!bRefineIntrinsics)
+  {
+    //set the whole parameter block as constant for best performance.
+    problem.SetParameterBlockConstant(parameter_block);
+  }
+}
+
+/// Ceres solver configuration of the given BA options
+static ceres::Solver::Options SolverOptions(const Bundle_Adjustment_Ceres::BA_options & ba_options)
+{
+  ceres::Solver::Options options;
+  options.preconditioner_type = ba_options._preconditioner_type;
+  options.linear_solver_type = ba_options._linear_solver_type;
+  options.sparse_linear_algebra_library_type = ba_options._sparse_linear_algebra_library_type;
+  options.minimizer_progress_to_stdout = false;
+  options.logging_type = ceres::SILENT;
+  options.num_threads = ba_options._nbThreads;
+  options.num_linear_solver_threads = ba_options._nbThreads;
+  return options;
+}
 
 Bundle_Adjustment_Ceres::BA_options::BA_options(const bool bVerbose, bool bmultithreaded)
   :_bVerbose(bVerbose),
@@ -115,6 +211,31 @@ bool Bundle_Adjustment_Ceres::Adjust(
   bool bRefineTranslations,// tell if the pose translation will be refined
   bool bRefineIntrinsics,  // tell if the camera intrinsic will be refined
   bool bRefineStructure)   // tell if the structure will be refined
+{
+  // The landmarks of sfm_data.structure are refined in place
+  return AdjustImpl(sfm_data, NULL,
+    bRefineRotations, bRefineTranslations, bRefineIntrinsics, bRefineStructure);
+}
+
+bool Bundle_Adjustment_Ceres::Adjust(
+  SfM_Data & sfm_data,     // the SfM scene to refine
+  Landmarks_CSR & landmarks, // the structure to refine
+  bool bRefineRotations,   // tell if pose rotations will be refined
+  bool bRefineTranslations,// tell if the pose translation will be refined
+  bool bRefineIntrinsics,  // tell if the camera intrinsic will be refined
+  bool bRefineStructure)   // tell if the structure will be refined
+{
+  return AdjustImpl(sfm_data, &landmarks,
+    bRefineRotations, bRefineTranslations, bRefineIntrinsics, bRefineStructure);
+}
+
+bool Bundle_Adjustment_Ceres::AdjustImpl(
+  SfM_Data & sfm_data,
+  Landmarks_CSR * landmarks,
+  bool bRefineRotations,
+  bool bRefineTranslations,
+  bool bRefineIntrinsics,
+  bool bRefineStructure)
 {
   //----------
   // Add camera parameters
@@ -134,51 +255,9 @@ bool Bundle_Adjustment_Ceres::Adjust(
   // Setup Poses data & subparametrization
   for (Poses::const_iterator itPose = sfm_data.poses.begin(); itPose != sfm_data.poses.end(); ++itPose)
   {
-    const IndexT indexPose = itPose->first;
-
-    const Pose3 & pose = itPose->second;
-    const Mat3 R = pose.rotation();
-    const Vec3 t = pose.translation();
-
-    double angleAxis[3];
-    ceres::RotationMatrixToAngleAxis((const double*)R.data(), angleAxis);
-    map_poses[indexPose].reserve(6); //angleAxis + translation
-    map_poses[indexPose].push_back(angleAxis[0]);
-    map_poses[indexPose].push_back(angleAxis[1]);
-    map_poses[indexPose].push_back(angleAxis[2]);
-    map_poses[indexPose].push_back(t(0));
-    map_poses[indexPose].push_back(t(1));
-    map_poses[indexPose].push_back(t(2));
-
-    double * parameter_block = &map_poses[indexPose][0];
-    problem.AddParameterBlock(parameter_block, 6);
-    if (!bRefineTranslations && !bRefineRotations)
-    {
-      //set the whole parameter block as constant for best performance.
-      problem.SetParameterBlockConstant(parameter_block);
-    }
-    else  {
-      // Subset parametrization
-      std::vector<int> vec_constant_extrinsic;
-      if(!bRefineRotations)
-      {
-        vec_constant_extrinsic.push_back(0);
-        vec_constant_extrinsic.push_back(1);
-        vec_constant_extrinsic.push_back(2);
-      }
-      if(!bRefineTranslations)
-      {
-        vec_constant_extrinsic.push_back(3);
-        vec_constant_extrinsic.push_back(4);
-        vec_constant_extrinsic.push_back(5);
-      }
-      if (!vec_constant_extrinsic.empty())
-      {
-        ceres::SubsetParameterization *subset_parameterization =
-          new ceres::SubsetParameterization(6, vec_constant_extrinsic);
-        problem.SetParameterization(parameter_block, subset_parameterization);
-      }
-    }
+    std::vector<double> & pose_params = map_poses[itPose->first];
+    pose_params = PoseToParameters(itPose->second);
+    AddPoseParameterBlock(problem, pose_params, bRefineRotations, bRefineTranslations);
   }
 
   // Setup Intrinsics data & subparametrization
@@ -190,14 +269,7 @@ bool Bundle_Adjustment_Ceres::Adjust(
     if (isValid(itIntrinsic->second->getType()))
     {
       map_intrinsics[indexCam] = itIntrinsic->second->getParams();
-
-      double * parameter_block = &map_intrinsics[indexCam][0];
-      problem.AddParameterBlock(parameter_block, map_intrinsics[indexCam].size());
-      if (!bRefineIntrinsics)
-      {
-        //set the whole parameter block as constant for best performance.
-        problem.SetParameterBlockConstant(parameter_block);
-      }
+      AddIntrinsicParameterBlock(problem, map_intrinsics[indexCam], bRefineIntrinsics);
     }
     else
     {
@@ -210,57 +282,73 @@ bool Bundle_Adjustment_Ceres::Adjust(
   ceres::LossFunction * p_LossFunction = new ceres::HuberLoss(Square(4.0));
   // TODO: make the LOSS function and the parameter an option
 
-  // For all visibility add reprojections errors:
-  for (Landmarks::iterator iterTracks = sfm_data.structure.begin(); iterTracks!= sfm_data.structure.end(); ++iterTracks)
+  // Parameter blocks used by each view (looked up once per view, not per observation)
+  struct ViewBlocks
   {
-    const Observations & obs = iterTracks->second.obs;
-
-    for (Observations::const_iterator itObs = obs.begin(); itObs != obs.end(); ++itObs)
-    {
-      // Build the residual block corresponding to the track observation:
-      const View * view = sfm_data.views.at(itObs->first).get();
+    IntrinsicBase * intrinsic;
+    double * intrinsic_block;
+    double * pose_block;
+  };
+  Hash_Map<IndexT, ViewBlocks> map_view_blocks;
+  for (Views::const_iterator itView = sfm_data.views.begin(); itView != sfm_data.views.end(); ++itView)
+  {
+    const View * view = itView->second.get();
+    if (!sfm_data.IsPoseAndIntrinsicDefined(view) || map_intrinsics.count(view->id_intrinsic) == 0)
+      continue;
+    ViewBlocks & blocks = map_view_blocks[itView->first];
+    blocks.intrinsic = sfm_data.intrinsics[view->id_intrinsic].get();
+    blocks.intrinsic_block = &map_intrinsics[view->id_intrinsic][0];
+    blocks.pose_block = &map_poses[view->id_pose][0];
+  }
 
-      // Each Residual block takes a point and a camera as input and outputs a 2
-      // dimensional residual. Internally, the cost function stores the observed
-      // image location and compares the reprojection against the observation.
-      ceres::CostFunction* cost_function =
-        IntrinsicsToCostFunction(sfm_data.intrinsics[view->id_intrinsic].get(), itObs->second.x);
+  // Build the residual block corresponding to a track observation:
+  // Each Residual block takes a point and a camera as input and outputs a 2
+  // dimensional residual. Internally, the cost function stores the observed
+  // image location and compares the reprojection against the observation.
+  auto add_observation = [&](const IndexT id_view, const Vec2 & x, double * point_block)
+  {
+    const ViewBlocks & blocks = map_view_blocks.at(id_view);
+    ceres::CostFunction* cost_function = IntrinsicsToCostFunction(blocks.intrinsic, x);
+    if (cost_function)
+      problem.AddResidualBlock(cost_function,
+                               p_LossFunction,
+                               blocks.intrinsic_block,
+                               blocks.pose_block,
+                               point_block);
+  };
 
-      if (cost_function)
-        problem.AddResidualBlock(cost_function,
-                                 p_LossFunction,
-                                 &map_intrinsics[view->id_intrinsic][0],
-                                 &map_poses[view->id_pose][0],
-                                 iterTracks->second.X.data()); //Do we need to copy 3D point to avoid false motion, if failure ?
-
-      // modified by chenyu
-      // ceres::CostFunction* cost_function =
-      // SemanticIntrinsicsToCostFunction(sfm_data.intrinsics[view->id_intrinsic].get(), 
-      //                                  itObs->second.x, 
-      //                                  itObs->second.semantic_label,
-      //                                  iterTracks->second.semantic_label);
-
-      // if (cost_function)
-      //   problem.AddResidualBlock(cost_function,
-      //                            p_LossFunction,
-      //                            &map_intrinsics[view->id_intrinsic][0],
-      //                            &map_poses[view->id_pose][0],
-      //                            iterTracks->second.X.data());
+  // For all visibility add reprojections errors:
+  size_t nb_tracks = 0;
+  if (landmarks)
+  {
+    for (size_t i = 0; i < landmarks->size(); ++i)
+    {
+      double * point_block = landmarks->X[i].data();
+      for (size_t k = landmarks->obs_offsets[i]; k < landmarks->obs_offsets[i+1]; ++k)
+        add_observation(landmarks->obs_view[k], landmarks->obs_x[k], point_block);
+      if (!bRefineStructure && problem.HasParameterBlock(point_block))
+        problem.SetParameterBlockConstant(point_block);
     }
-    if (!bRefineStructure)
-      problem.SetParameterBlockConstant(iterTracks->second.X.data());
+    nb_tracks = landmarks->size();
+  }
+  else
+  {
+    for (Landmarks::iterator iterTracks = sfm_data.structure.begin();
+      iterTracks != sfm_data.structure.end(); ++iterTracks)
+    {
+      double * point_block = iterTracks->second.X.data();
+      const Observations & obs = iterTracks->second.obs;
+      for (Observations::const_iterator itObs = obs.begin(); itObs != obs.end(); ++itObs)
+        add_observation(itObs->first, itObs->second.x, point_block);
+      if (!bRefineStructure && problem.HasParameterBlock(point_block))
+        problem.SetParameterBlockConstant(point_block);
+    }
+    nb_tracks = sfm_data.structure.size();
   }
 
   // Configure a BA engine and run it
   //  Make Ceres automatically detect the bundle structure.
-  ceres::Solver::Options options;
-  options.preconditioner_type = _i23dSFM_options._preconditioner_type;
-  options.linear_solver_type = _i23dSFM_options._linear_solver_type;
-  options.sparse_linear_algebra_library_type = _i23dSFM_options._sparse_linear_algebra_library_type;
-  options.minimizer_progress_to_stdout = false;
-  options.logging_type = ceres::SILENT;
-  options.num_threads = _i23dSFM_options._nbThreads;
-  options.num_linear_solver_threads = _i23dSFM_options._nbThreads;
+  const ceres::Solver::Options options = SolverOptions(_i23dSFM_options);
 
   // Solve BA
   ceres::Solver::Summary summary;
@@ -285,7 +373,7 @@ bool Bundle_Adjustment_Ceres::Adjust(
         << " #views: " << sfm_data.views.size() << "\n"
         << " #poses: " << sfm_data.poses.size() << "\n"
         << " #intrinsics: " << sfm_data.intrinsics.size() << "\n"
-        << " #tracks: " << sfm_data.structure.size() << "\n"
+        << " #tracks: " << nb_tracks << "\n"
         << " #residuals: " << summary.num_residuals << "\n"
         << " Initial RMSE: " << std::sqrt( summary.initial_cost / summary.num_residuals) << "\n"
         << " Final RMSE: " << std::sqrt( summary.final_cost / summary.num_residuals) << "\n"
@@ -299,14 +387,8 @@ bool Bundle_Adjustment_Ceres::Adjust(
       for (Poses::iterator itPose = sfm_data.poses.begin();
         itPose != sfm_data.poses.end(); ++itPose)
       {
-        const IndexT indexPose = itPose->first;
-
-        Mat3 R_refined;
-        ceres::AngleAxisToRotationMatrix(&map_poses[indexPose][0], R_refined.data());
-        Vec3 t_refined(map_poses[indexPose][3], map_poses[indexPose][4], map_poses[indexPose][5]);
         // Update the pose
-        Pose3 & pose = itPose->second;
-        pose = Pose3(R_refined, -R_refined.transpose() * t_refined);
+        itPose->second = ParametersToPose(map_poses[itPose->first]);
       }
     }
 
@@ -326,6 +408,127 @@ bool Bundle_Adjustment_Ceres::Adjust(
   }
 }
 
+bool Bundle_Adjustment_Ceres::AdjustLocal(
+  SfM_Data & sfm_data,
+  const std::set<IndexT> & refined_poses,
+  bool bRefineIntrinsics)
+{
+  ceres::Problem problem;
+
+  // Data wrapper for refinement:
+  Hash_Map<IndexT, std::vector<double> > map_intrinsics;
+  Hash_Map<IndexT, std::vector<double> > map_poses;
+
+  // Landmarks seen by at least one refined pose
+  std::vector<Landmarks::iterator> window_landmarks;
+  for (Landmarks::iterator iterTracks = sfm_data.structure.begin(); iterTracks!= sfm_data.structure.end(); ++iterTracks)
+  {
+    const Observations & obs = iterTracks->second.obs;
+    for (Observations::const_iterator itObs = obs.begin(); itObs != obs.end(); ++itObs)
+    {
+      if (refined_poses.count(sfm_data.views.at(itObs->first)->id_pose))
+      {
+        window_landmarks.push_back(iterTracks);
+        break;
+      }
+    }
+  }
+  if (window_landmarks.empty())
+    return false;
+
+  ceres::LossFunction * p_LossFunction = new ceres::HuberLoss(Square(4.0));
+
+  // Add all the observations of the window landmarks. Poses & intrinsics are
+  // added on demand: the poses outside of the window are set constant.
+  for (size_t i = 0; i < window_landmarks.size(); ++i)
+  {
+    Landmark & landmark = window_landmarks[i]->second;
+    const Observations & obs = landmark.obs;
+    for (Observations::const_iterator itObs = obs.begin(); itObs != obs.end(); ++itObs)
+    {
+      const View * view = sfm_data.views.at(itObs->first).get();
+      if (!sfm_data.IsPoseAndIntrinsicDefined(view))
+        continue;
+
+      if (map_poses.count(view->id_pose) == 0)
+      {
+        const bool bRefinePose = refined_poses.count(view->id_pose) != 0;
+        std::vector<double> & pose_params = map_poses[view->id_pose];
+        pose_params = PoseToParameters(sfm_data.poses.at(view->id_pose));
+        AddPoseParameterBlock(problem, pose_params, bRefinePose, bRefinePose);
+      }
+      if (map_intrinsics.count(view->id_intrinsic) == 0)
+      {
+        std::vector<double> & intrinsic_params = map_intrinsics[view->id_intrinsic];
+        intrinsic_params = sfm_data.intrinsics.at(view->id_intrinsic)->getParams();
+        AddIntrinsicParameterBlock(problem, intrinsic_params, bRefineIntrinsics);
+      }
+
+      ceres::CostFunction* cost_function =
+        IntrinsicsToCostFunction(sfm_data.intrinsics[view->id_intrinsic].get(), itObs->second.x);
+
+      if (cost_function)
+        problem.AddResidualBlock(cost_function,
+                                 p_LossFunction,
+                                 &map_intrinsics[view->id_intrinsic][0],
+                                 &map_poses[view->id_pose][0],
+                                 landmark.X.data());
+    }
+  }
+
+  // Configure a BA engine and run it
+  const ceres::Solver::Options options = SolverOptions(_i23dSFM_options);
+
+  // Solve BA
+  ceres::Solver::Summary summary;
+  ceres::Solve(options, &problem, &summary);
+  if (_i23dSFM_options._bCeres_Summary)
+    std::cout << summary.FullReport() << std::endl;
+
+  // If no error, get back refined parameters
+  if (!summary.IsSolutionUsable())
+  {
+    if (_i23dSFM_options._bVerbose)
+      std::cout << "Local Bundle Adjustment failed." << std::endl;
+    return false;
+  }
+
+  if (_i23dSFM_options._bVerbose)
+  {
+    // Display statistics about the minimization
+    std::cout << std::endl
+      << "Local Bundle Adjustment statistics (approximated RMSE):\n"
+      << " #refined poses: " << refined_poses.size() << "\n"
+      << " #poses: " << map_poses.size() << "\n"
+      << " #tracks: " << window_landmarks.size() << "\n"
+      << " #residuals: " << summary.num_residuals << "\n"
+      << " Initial RMSE: " << std::sqrt( summary.initial_cost / summary.num_residuals) << "\n"
+      << " Final RMSE: " << std::sqrt( summary.final_cost / summary.num_residuals) << "\n"
+      << " Time (s): " << summary.total_time_in_seconds << "\n"
+      << std::endl;
+  }
+
+  // Update the refined camera poses
+  for (Hash_Map<IndexT, std::vector<double> >::const_iterator itPose = map_poses.begin();
+    itPose != map_poses.end(); ++itPose)
+  {
+    if (refined_poses.count(itPose->first) == 0)
+      continue;
+    sfm_data.poses[itPose->first] = ParametersToPose(itPose->second);
+  }
+
+  // Update camera intrinsics with refined data
+  if (bRefineIntrinsics)
+  {
+    for (Hash_Map<IndexT, std::vector<double> >::const_iterator itIntrinsic = map_intrinsics.begin();
+      itIntrinsic != map_intrinsics.end(); ++itIntrinsic)
+    {
+      sfm_data.intrinsics[itIntrinsic->first]->updateFromParams(itIntrinsic->second);
+    }
+  }
+  return true;
+}
+
 // bool Bundle_Adjustment_Ceres::SemanticAdjust(
 //   SfM_Data & sfm_data,     // the SfM scene to refine
 //   bool bRefineRotations,   // tell if pose rotations will be refined
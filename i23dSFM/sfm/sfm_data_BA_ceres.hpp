@@ -8,9 +8,12 @@
 #define I23DSFM_SFM_DATA_BA_CERES_HPP
 
 #include "i23dSFM/sfm/sfm_data.hpp"
+#include "i23dSFM/sfm/sfm_landmarks_csr.hpp"
 #include "i23dSFM/sfm/sfm_data_BA.hpp"
 #include "i23dSFM/sfm/sfm_data_BA_ceres_camera_functor.hpp"
 #include "ceres/ceres.h"
+
+#include <set>
 // #include "sqp/include/libFmincon.h"
 // #include "sqp/include/cmlcpclass.h"
 // #include "sqp/include/mclmcrrt.h"
@@ -59,12 +62,40 @@ class Bundle_Adjustment_Ceres : public Bundle_Adjustment
     bool bRefineIntrinsics = true,  // tell if the camera intrinsic will be refined
     bool bRefineStructure = true);  // tell if the structure will be refined
 
+  /// Same as Adjust, for a scene whose structure is stored in a flat
+  /// landmark store (sfm_data.structure is not used).
+  bool Adjust(
+    SfM_Data & sfm_data,            // the SfM scene to refine (views, poses, intrinsics)
+    Landmarks_CSR & landmarks,      // the structure to refine
+    bool bRefineRotations = true,   // tell if pose rotations will be refined
+    bool bRefineTranslations = true,// tell if the pose translation will be refined
+    bool bRefineIntrinsics = true,  // tell if the camera intrinsic will be refined
+    bool bRefineStructure = true);  // tell if the structure will be refined
+
+  /// Local (windowed) bundle adjustment: refine only the given poses and the
+  /// landmarks they observe. The other poses observing these landmarks are
+  /// kept constant and anchor the window.
+  bool AdjustLocal(
+    SfM_Data & sfm_data,                   // the SfM scene to refine
+    const std::set<IndexT> & refined_poses,// poses that will be refined
+    bool bRefineIntrinsics = false);       // tell if the window camera intrinsic will be refined
+
   // bool SemanticAdjust(
   //   SfM_Data & sfm_data,            // the SfM scene to refine
   //   bool bRefineRotations = true,   // tell if pose rotations will be refined
   //   bool bRefineTranslations = true,// tell if the pose translation will be refined
   //   bool bRefineIntrinsics = true,  // tell if the camera intrinsic will be refined
   //   bool bRefineStructure = true);  // tell if the structure will be refined
+
+  private:
+  /// Refine the structure of the flat store if any, else sfm_data.structure in place
+  bool AdjustImpl(
+    SfM_Data & sfm_data,
+    Landmarks_CSR * landmarks,
+    bool bRefineRotations,
+    bool bRefineTranslations,
+    bool bRefineIntrinsics,
+    bool bRefineStructure);
 };
 
 } // namespace sfm
@@ -113,6 +113,137 @@ TEST(BUNDLE_ADJUSTMENT, EffectiveMinimization_Pinhole_Intrinsic_Brown_T2) {
 }
 
 
+TEST(BUNDLE_ADJUSTMENT, EffectiveMinimization_Pinhole_Landmarks_CSR) {
+
+  const int nviews = 3;
+  const int npoints = 6;
+  const nViewDatasetConfigurator config;
+  const NViewDataSet d = NRealisticCamerasRing(nviews, npoints, config);
+
+  // Translate the input dataset to a SfM_Data scene
+  SfM_Data sfm_data = getInputScene(d, config, PINHOLE_CAMERA);
+
+  const double dResidual_before = RMSE(sfm_data);
+
+  // Refine a flat copy of the structure
+  Landmarks_CSR landmarks(sfm_data.structure);
+  Bundle_Adjustment_Ceres ba_object;
+  EXPECT_TRUE( ba_object.Adjust(sfm_data, landmarks) );
+  landmarks.Export(sfm_data.structure);
+
+  const double dResidual_after = RMSE(sfm_data);
+  EXPECT_TRUE( dResidual_before > dResidual_after);
+}
+
+TEST(LANDMARKS_CSR, Build_Export_Filter) {
+
+  const int nviews = 4;
+  const int npoints = 8;
+  const nViewDatasetConfigurator config;
+  const NViewDataSet d = NRealisticCamerasRing(nviews, npoints, config);
+  SfM_Data sfm_data = getInputScene(d, config, PINHOLE_CAMERA);
+
+  Landmarks_CSR landmarks(sfm_data.structure);
+  EXPECT_EQ(npoints, landmarks.size());
+  EXPECT_EQ(npoints * nviews, landmarks.nb_observations());
+  EXPECT_EQ(npoints * nviews, landmarks.obs_offsets.back());
+
+  // Round trip
+  Landmarks exported;
+  landmarks.Export(exported);
+  EXPECT_EQ(sfm_data.structure.size(), exported.size());
+  for (Landmarks::const_iterator it = sfm_data.structure.begin(); it != sfm_data.structure.end(); ++it)
+  {
+    const Landmark & landmark = exported.at(it->first);
+    EXPECT_MATRIX_NEAR(it->second.X, landmark.X, 1e-8);
+    EXPECT_EQ(it->second.obs.size(), landmark.obs.size());
+    for (Observations::const_iterator itObs = it->second.obs.begin(); itObs != it->second.obs.end(); ++itObs)
+    {
+      EXPECT_EQ(itObs->second.id_feat, landmark.obs.at(itObs->first).id_feat);
+      EXPECT_MATRIX_NEAR(itObs->second.x, landmark.obs.at(itObs->first).x, 1e-8);
+    }
+  }
+
+  // Corrupt the first view observation of landmark 0 & two observations of landmark 1
+  sfm_data.structure[0].obs[0].x += Vec2(50., 50.);
+  sfm_data.structure[1].obs[0].x += Vec2(50., 50.);
+  sfm_data.structure[1].obs[1].x += Vec2(50., 50.);
+  sfm_data.structure[1].obs[2].x += Vec2(50., 50.);
+  landmarks.Build(sfm_data.structure);
+  EXPECT_EQ(1, landmarks.FindObservation(0, 1));
+
+  // Flat store version
+  Landmarks_CSR filtered = landmarks;
+  const IndexT nb_removed_flat = RemoveOutliers_PixelResidualError(sfm_data, filtered, 4.0, 2);
+  EXPECT_EQ(4, nb_removed_flat);
+  EXPECT_EQ(npoints - 1, filtered.size());
+  EXPECT_EQ(npoints * nviews - 5, filtered.nb_observations());
+
+  // SfM_Data version
+  const IndexT nb_removed = RemoveOutliers_PixelResidualError(sfm_data, 4.0, 2);
+  EXPECT_EQ(4, nb_removed);
+  EXPECT_EQ(npoints - 1, sfm_data.structure.size());
+  EXPECT_EQ(nviews - 1, sfm_data.structure[0].obs.size());
+  EXPECT_EQ(0, sfm_data.structure.count(1));
+}
+
+TEST(LANDMARKS_CSR, Triangulate_Filter_Clean) {
+
+  const int nviews = 4;
+  const int npoints = 8;
+  const nViewDatasetConfigurator config;
+  const NViewDataSet d = NRealisticCamerasRing(nviews, npoints, config);
+  SfM_Data sfm_data = getInputScene(d, config, PINHOLE_CAMERA);
+
+  // Fill a store with the tracks only (no 3D yet)
+  Landmarks_CSR landmarks;
+  for (Landmarks::const_iterator it = sfm_data.structure.begin(); it != sfm_data.structure.end(); ++it)
+  {
+    landmarks.AddLandmark(it->first);
+    for (Observations::const_iterator itObs = it->second.obs.begin(); itObs != it->second.obs.end(); ++itObs)
+      landmarks.AddObservation(itObs->first, itObs->second);
+  }
+  EXPECT_EQ(npoints * nviews, landmarks.nb_observations());
+
+  // Same triangulation as the SfM_Data version
+  SfM_Data_Structure_Computation_Blind structure_estimator;
+  structure_estimator.triangulate(sfm_data, landmarks);
+  structure_estimator.triangulate(sfm_data);
+  EXPECT_EQ(sfm_data.structure.size(), landmarks.size());
+  for (size_t i = 0; i < landmarks.size(); ++i)
+  {
+    EXPECT_MATRIX_NEAR(sfm_data.structure.at(landmarks.landmark_ids[i]).X, landmarks.X[i], 1e-6);
+  }
+
+  // Same angular filtering as the SfM_Data version
+  const double angles[] = {5.0, 30.0, 60.0, 120.0};
+  for (const double angle : angles)
+  {
+    SfM_Data scene = sfm_data;
+    Landmarks_CSR filtered = landmarks;
+    EXPECT_EQ(RemoveOutliers_AngleError(scene, angle), RemoveOutliers_AngleError(sfm_data, filtered, angle));
+    EXPECT_EQ(scene.structure.size(), filtered.size());
+  }
+
+  // Make the pose of the view 0 unstable (only seen by the landmarks 0 & 1)
+  for (Landmarks::iterator it = sfm_data.structure.begin(); it != sfm_data.structure.end(); ++it)
+  {
+    if (it->first > 1)
+      it->second.obs.erase(0);
+  }
+  landmarks.Build(sfm_data.structure);
+
+  SfM_Data sfm_data_flat = sfm_data;
+  EXPECT_TRUE(eraseUnstablePosesAndObservations(sfm_data_flat, landmarks, 3, 2));
+  EXPECT_TRUE(eraseUnstablePosesAndObservations(sfm_data, 3, 2));
+  EXPECT_EQ(nviews - 1, sfm_data.poses.size());
+  EXPECT_EQ(nviews - 1, sfm_data_flat.poses.size());
+  EXPECT_EQ(0, sfm_data_flat.poses.count(0));
+  EXPECT_EQ(sfm_data.structure.size(), landmarks.size());
+  EXPECT_EQ(npoints * (nviews - 1), landmarks.nb_observations());
+  EXPECT_EQ(-1, landmarks.FindObservation(0, 0));
+}
+
 /// Compute the Root Mean Square Error of the residuals
 double RMSE(const SfM_Data & sfm_data)
 {
@@ -159,7 +290,7 @@ SfM_Data getInputScene(const NViewDataSet & d, const nViewDatasetConfigurator &
   for (int i = 0; i < nviews; ++i)
   {
     const IndexT id_view = i, id_pose = i, id_intrinsic = 0; //(shared intrinsics)
-    sfm_data.views[i] = std::make_shared<View>("", id_view, id_intrinsic, id_pose, config._cx *2, config._cy *2);
+    sfm_data.views[i] = std::make_shared<View>("", "", id_view, id_intrinsic, id_pose, config._cx *2, config._cy *2);
   }
 
   // 2. Poses
@@ -0,0 +1,180 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/sfm/sfm_data_colorization.hpp"
+#include "i23dSFM/sfm/sfm_data.hpp"
+#include "i23dSFM/image/image.hpp"
+
+#include "third_party/progress/progress.hpp"
+#include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace i23dSFM {
+namespace sfm {
+
+Semantic_Palette DefaultSemanticPalette()
+{
+  Semantic_Palette palette;
+  palette[0] = Vec3(18, 191, 39);  // tree
+  palette[1] = Vec3(208, 41, 31);  // building
+  palette[2] = Vec3(50, 60, 229);  // road
+  return palette;
+}
+
+bool LoadSemanticPalette(const std::string & sFileName, Semantic_Palette & palette)
+{
+  std::ifstream in(sFileName.c_str());
+  if (!in.is_open())
+  {
+    std::cerr << "Cannot open the semantic palette file: " << sFileName << std::endl;
+    return false;
+  }
+  palette.clear();
+  std::string sLine;
+  while (std::getline(in, sLine))
+  {
+    if (sLine.empty() || sLine[0] == '#')
+      continue;
+    std::istringstream iss(sLine);
+    int label;
+    double r, g, b;
+    if (!(iss >> label >> r >> g >> b))
+    {
+      std::cerr << "Invalid semantic palette line: " << sLine << std::endl;
+      return false;
+    }
+    palette[label] = Vec3(r, g, b);
+  }
+  return true;
+}
+
+bool ColorizeLandmarks
+(
+  const SfM_Data & sfm_data,
+  std::vector<Vec3> & vec_3dPoints,
+  std::vector<Vec3> & vec_tracksColor,
+  const Semantic_Palette * palette
+)
+{
+  const Landmarks & landmarks = sfm_data.GetLandmarks();
+  vec_3dPoints.resize(landmarks.size());
+  vec_tracksColor.assign(landmarks.size(), Vec3(0, 0, 0));
+
+  // Number of observations of each view (view representativeness)
+  std::map<IndexT, size_t> map_view_cardinal;
+  for (const auto & landmark : landmarks)
+  {
+    for (const auto & obs : landmark.second.obs)
+      ++map_view_cardinal[obs.first];
+  }
+
+  // Group the observations to sample by view:
+  //  each landmark is colored by its most represented view
+  struct Color_Sample
+  {
+    size_t landmark_index;
+    Vec2 x;
+  };
+  std::map<IndexT, std::vector<Color_Sample> > map_view_samples;
+  size_t landmark_index = 0;
+  for (Landmarks::const_iterator it = landmarks.begin();
+    it != landmarks.end(); ++it, ++landmark_index)
+  {
+    vec_3dPoints[landmark_index] = it->second.X;
+    if (palette)
+    {
+      const Semantic_Palette::const_iterator it_color = palette->find(it->second.semantic_label);
+      if (it_color != palette->end())
+      {
+        vec_tracksColor[landmark_index] = it_color->second;
+        continue;
+      }
+    }
+    const Observations & obs = it->second.obs;
+    Observations::const_iterator it_best = obs.end();
+    size_t best_cardinal = 0;
+    for (Observations::const_iterator it_obs = obs.begin(); it_obs != obs.end(); ++it_obs)
+    {
+      const size_t cardinal = map_view_cardinal[it_obs->first];
+      if (cardinal > best_cardinal)
+      {
+        best_cardinal = cardinal;
+        it_best = it_obs;
+      }
+    }
+    if (it_best == obs.end())
+      continue;
+    const Color_Sample sample = {landmark_index, it_best->second.x};
+    map_view_samples[it_best->first].push_back(sample);
+  }
+
+  // Read each view once and sample its pixels
+  const std::vector<std::pair<IndexT, std::vector<Color_Sample> > > vec_view_samples(
+    map_view_samples.begin(), map_view_samples.end());
+  C_Progress_display my_progress_bar(vec_view_samples.size(),
+    std::cout, "\nCompute scene structure color\n");
+  bool bOk = true;
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < static_cast<int>(vec_view_samples.size()); ++i)
+  {
+    const Views::const_iterator it_view = sfm_data.GetViews().find(vec_view_samples[i].first);
+    const std::string sView_filename = (it_view == sfm_data.GetViews().end()) ? std::string() :
+      stlplus::create_filespec(sfm_data.s_root_path, it_view->second->s_Img_path);
+    // Decode only the rows range of the samples
+    image::ImageHeader imgHeader;
+    std::vector<unsigned char> pixels;
+    int w = 0, h = 0, depth = 0, row_begin = 0, row_end = 0;
+    bool bRead = !sView_filename.empty() &&
+      image::ReadImageHeader(sView_filename.c_str(), &imgHeader) && imgHeader.height > 0;
+    if (bRead)
+    {
+      row_begin = imgHeader.height;
+      for (const Color_Sample & sample : vec_view_samples[i].second)
+      {
+        const int y = std::min(std::max(static_cast<int>(sample.x(1)), 0), imgHeader.height - 1);
+        row_begin = std::min(row_begin, y);
+        row_end = std::max(row_end, y + 1);
+      }
+      bRead = image::ReadImage(sView_filename.c_str(), &pixels, &w, &h, &depth, 1, row_begin, row_end) &&
+        h == row_end - row_begin && (depth == 1 || depth == 3 || depth == 4);
+    }
+    if (!bRead)
+    {
+#ifdef I23DSFM_USE_OPENMP
+      #pragma omp critical
+#endif
+      {
+        std::cerr << "Cannot open the image: " << sView_filename << std::endl;
+        bOk = false;
+      }
+      continue;
+    }
+    for (const Color_Sample & sample : vec_view_samples[i].second)
+    {
+      const int x = std::min(std::max(static_cast<int>(sample.x(0)), 0), w - 1);
+      const int y = std::min(std::max(static_cast<int>(sample.x(1)), row_begin), row_end - 1) - row_begin;
+      const unsigned char * pixel = &pixels[(static_cast<size_t>(y) * w + x) * depth];
+      vec_tracksColor[sample.landmark_index] = (depth == 1) ?
+        Vec3(pixel[0], pixel[0], pixel[0]) : Vec3(pixel[0], pixel[1], pixel[2]);
+    }
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp critical
+#endif
+    {
+      ++my_progress_bar;
+    }
+  }
+  return bOk;
+}
+
+} // namespace sfm
+} // namespace i23dSFM
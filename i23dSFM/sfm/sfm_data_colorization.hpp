@@ -0,0 +1,47 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_SFM_DATA_COLORIZATION_HPP
+#define I23DSFM_SFM_DATA_COLORIZATION_HPP
+
+#include "i23dSFM/numeric/numeric.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace i23dSFM {
+namespace sfm {
+
+struct SfM_Data;
+
+/// Semantic label -> RGB color table
+typedef std::map<int, Vec3> Semantic_Palette;
+
+/// Default palette: tree (0), building (1), road (2)
+Semantic_Palette DefaultSemanticPalette();
+
+/// Load a palette (one line per label: <label> <r> <g> <b>, '#' comments)
+bool LoadSemanticPalette(const std::string & sFileName, Semantic_Palette & palette);
+
+/// Compute the position and the color of the SfM_Data landmarks (in landmark order).
+/// Each landmark is colored from its observation in its most represented view
+/// (the view with the most observations, the smallest id on ties), so the
+/// observations are grouped once by view and each of these views is read once
+/// (views read in parallel, only the rows of the observations are decoded).
+/// If a palette is given, the landmarks with a label of the palette get the
+/// palette color instead of the image color (the images that are only needed
+/// for such landmarks are not read).
+bool ColorizeLandmarks(
+  const SfM_Data & sfm_data,
+  std::vector<Vec3> & vec_3dPoints,
+  std::vector<Vec3> & vec_tracksColor,
+  const Semantic_Palette * palette = NULL);
+
+} // namespace sfm
+} // namespace i23dSFM
+
+#endif // I23DSFM_SFM_DATA_COLORIZATION_HPP
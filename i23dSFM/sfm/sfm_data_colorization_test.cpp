@@ -0,0 +1,99 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/sfm/sfm.hpp"
+#include "i23dSFM/image/image.hpp"
+#include "testing/testing.h"
+#include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
+
+#include <fstream>
+
+using namespace i23dSFM;
+using namespace i23dSFM::image;
+using namespace i23dSFM::sfm;
+
+// Two views of uniform color:
+//  - view 0 (red) observes the 3 landmarks,
+//  - view 1 (green) observes the landmarks 0 and 1.
+static SfM_Data Make_Colored_Scene()
+{
+  Image<RGBColor> image_red(16, 8), image_green(16, 8);
+  image_red.fill(RGBColor(255, 0, 0));
+  image_green.fill(RGBColor(0, 255, 0));
+  WriteImage("colorization_0.png", image_red);
+  WriteImage("colorization_1.png", image_green);
+
+  SfM_Data sfm_data;
+  sfm_data.s_root_path = stlplus::folder_current_full();
+  sfm_data.views[0] = std::make_shared<View>("colorization_0.png", "", 0, 0, 0, 16, 8);
+  sfm_data.views[1] = std::make_shared<View>("colorization_1.png", "", 1, 0, 1, 16, 8);
+  for (IndexT i = 0; i < 3; ++i)
+  {
+    Landmark & landmark = sfm_data.structure[i];
+    landmark.X = Vec3(i, 0, 0);
+    landmark.semantic_label = static_cast<int>(i) + 10;
+    landmark.obs[0] = Observation(Vec2(2 + i, 3), i, landmark.semantic_label);
+    if (i < 2)
+      landmark.obs[1] = Observation(Vec2(20, -1), i, landmark.semantic_label); // out of the image
+  }
+  return sfm_data;
+}
+
+TEST(SfM_Data_Colorization, ImageColors)
+{
+  const SfM_Data sfm_data = Make_Colored_Scene();
+  std::vector<Vec3> vec_3dPoints, vec_tracksColor;
+  EXPECT_TRUE(ColorizeLandmarks(sfm_data, vec_3dPoints, vec_tracksColor));
+  CHECK_EQUAL(3, vec_3dPoints.size());
+  CHECK_EQUAL(3, vec_tracksColor.size());
+  for (size_t i = 0; i < 3; ++i)
+  {
+    EXPECT_MATRIX_NEAR(Vec3(i, 0, 0), vec_3dPoints[i], 1e-8);
+    // The most represented view (view 0) is used
+    EXPECT_MATRIX_NEAR(Vec3(255, 0, 0), vec_tracksColor[i], 1e-8);
+  }
+}
+
+TEST(SfM_Data_Colorization, SemanticPalette)
+{
+  SfM_Data sfm_data = Make_Colored_Scene();
+  // A landmark observed only in view 1 (its observation is clamped to the image)
+  sfm_data.structure[3].X = Vec3(3, 0, 0);
+  sfm_data.structure[3].obs[1] = Observation(Vec2(20, -1), 3, 10);
+
+  {
+    std::ofstream file("colorization_palette.txt");
+    file << "# label r g b\n" << "11 1 2 3\n";
+  }
+  Semantic_Palette palette;
+  EXPECT_TRUE(LoadSemanticPalette("colorization_palette.txt", palette));
+  CHECK_EQUAL(1, palette.size());
+
+  std::vector<Vec3> vec_3dPoints, vec_tracksColor;
+  EXPECT_TRUE(ColorizeLandmarks(sfm_data, vec_3dPoints, vec_tracksColor, &palette));
+  CHECK_EQUAL(4, vec_tracksColor.size());
+  EXPECT_MATRIX_NEAR(Vec3(255, 0, 0), vec_tracksColor[0], 1e-8);
+  EXPECT_MATRIX_NEAR(Vec3(1, 2, 3), vec_tracksColor[1], 1e-8);
+  EXPECT_MATRIX_NEAR(Vec3(255, 0, 0), vec_tracksColor[2], 1e-8);
+  EXPECT_MATRIX_NEAR(Vec3(0, 255, 0), vec_tracksColor[3], 1e-8);
+
+  // Missing image
+  sfm_data.views[1]->s_Img_path = "colorization_missing.png";
+  EXPECT_FALSE(ColorizeLandmarks(sfm_data, vec_3dPoints, vec_tracksColor, &palette));
+}
+
+TEST(SfM_Data_Colorization, DefaultPalette)
+{
+  const Semantic_Palette palette = DefaultSemanticPalette();
+  CHECK_EQUAL(3, palette.size());
+  EXPECT_MATRIX_NEAR(Vec3(208, 41, 31), palette.at(1), 1e-8);
+  Semantic_Palette loaded_palette;
+  EXPECT_FALSE(LoadSemanticPalette("colorization_missing_palette.txt", loaded_palette));
+}
+
+/* ************************************************************************* */
+int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
+/* ************************************************************************* */
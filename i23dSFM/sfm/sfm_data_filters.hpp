@@ -8,6 +8,7 @@
 #ifndef I23DSFM_SFM_DATA_FILTERS_HPP
 #define I23DSFM_SFM_DATA_FILTERS_HPP
 
+#include "i23dSFM/sfm/sfm_landmarks_csr.hpp"
 #include "i23dSFM/stl/stl.hpp"
 #include <iterator>
 
@@ -51,8 +52,51 @@ static Pair_Set Pair_filter
   return kept_pairs;
 }
 
-// Remove tracks that have a small angle (tracks with tiny angle leads to instable 3D points)
-// Return the number of removed tracks
+/// Flag the observations of a flat landmark store whose residual is under the given threshold
+static std::vector<bool> Inliers_PixelResidualError
+(
+  const SfM_Data & sfm_data,
+  const Landmarks_CSR & landmarks,
+  const double dThresholdPixel
+)
+{
+  // std::vector<bool> is not safe for concurrent writes: use a byte per observation
+  std::vector<unsigned char> vec_inliers(landmarks.nb_observations(), 0);
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < static_cast<int>(landmarks.size()); ++i)
+  {
+    for (size_t k = landmarks.obs_offsets[i]; k < landmarks.obs_offsets[i+1]; ++k)
+    {
+      const View * view = sfm_data.views.at(landmarks.obs_view[k]).get();
+      const geometry::Pose3 & pose = sfm_data.poses.at(view->id_pose);
+      const cameras::IntrinsicBase * intrinsic = sfm_data.intrinsics.at(view->id_intrinsic).get();
+      const Vec2 residual = intrinsic->residual(pose, landmarks.X[i], landmarks.obs_x[k]);
+      vec_inliers[k] = (residual.norm() <= dThresholdPixel);
+    }
+  }
+  return std::vector<bool>(vec_inliers.begin(), vec_inliers.end());
+}
+
+// Remove observations with a too large pixel residual error and the tracks
+// that become shorter than minTrackLength (flat landmark store version)
+// Return the number of removed observations
+static IndexT RemoveOutliers_PixelResidualError
+(
+  const SfM_Data & sfm_data,
+  Landmarks_CSR & landmarks,
+  const double dThresholdPixel,
+  const unsigned int minTrackLength = 2
+)
+{
+  return landmarks.Filter(
+    Inliers_PixelResidualError(sfm_data, landmarks, dThresholdPixel), minTrackLength);
+}
+
+// Remove observations with a too large pixel residual error and the tracks
+// that become shorter than minTrackLength
+// Return the number of removed observations
 static IndexT RemoveOutliers_PixelResidualError
 (
   SfM_Data & sfm_data,
@@ -60,30 +104,41 @@ static IndexT RemoveOutliers_PixelResidualError
   const unsigned int minTrackLength = 2
 )
 {
-  IndexT outlier_count = 0;
-  Landmarks::iterator iterTracks = sfm_data.structure.begin();
-  while (iterTracks != sfm_data.structure.end())
+  // Random access to the landmarks (the structure is filtered in place)
+  std::vector<Landmarks::iterator> vec_landmarks;
+  vec_landmarks.reserve(sfm_data.structure.size());
+  for (Landmarks::iterator iterTracks = sfm_data.structure.begin();
+    iterTracks != sfm_data.structure.end(); ++iterTracks)
+    vec_landmarks.push_back(iterTracks);
+
+  // View ids of the outlier observations of each landmark
+  std::vector<std::vector<IndexT> > vec_outliers(vec_landmarks.size());
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < static_cast<int>(vec_landmarks.size()); ++i)
   {
-    Observations & obs = iterTracks->second.obs;
-    Observations::iterator itObs = obs.begin();
-    while (itObs != obs.end())
+    const Landmark & landmark = vec_landmarks[i]->second;
+    for (Observations::const_iterator itObs = landmark.obs.begin(); itObs != landmark.obs.end(); ++itObs)
     {
       const View * view = sfm_data.views.at(itObs->first).get();
-      const geometry::Pose3 pose = sfm_data.GetPoseOrDie(view);
+      const geometry::Pose3 & pose = sfm_data.poses.at(view->id_pose);
       const cameras::IntrinsicBase * intrinsic = sfm_data.intrinsics.at(view->id_intrinsic).get();
-      const Vec2 residual = intrinsic->residual(pose, iterTracks->second.X, itObs->second.x);
+      const Vec2 residual = intrinsic->residual(pose, landmark.X, itObs->second.x);
       if (residual.norm() > dThresholdPixel)
-      {
-        ++outlier_count;
-        itObs = obs.erase(itObs);
-      }
-      else
-        ++itObs;
+        vec_outliers[i].push_back(itObs->first);
     }
+  }
+
+  IndexT outlier_count = 0;
+  for (size_t i = 0; i < vec_landmarks.size(); ++i)
+  {
+    Observations & obs = vec_landmarks[i]->second.obs;
+    for (size_t k = 0; k < vec_outliers[i].size(); ++k)
+      obs.erase(vec_outliers[i][k]);
+    outlier_count += vec_outliers[i].size();
     if (obs.empty() || obs.size() < minTrackLength)
-      iterTracks = sfm_data.structure.erase(iterTracks);
-    else
-      ++iterTracks;
+      sfm_data.structure.erase(vec_landmarks[i]);
   }
   return outlier_count;
 }
@@ -134,6 +189,48 @@ static IndexT RemoveOutliers_AngleError
   return removedTrack_count;
 }
 
+// Remove tracks that have a small angle (flat landmark store version)
+// Return the number of removed tracks
+static IndexT RemoveOutliers_AngleError
+(
+  const SfM_Data & sfm_data,
+  Landmarks_CSR & landmarks,
+  const double dMinAcceptedAngle
+)
+{
+  // std::vector<bool> is not safe for concurrent writes: use a byte per landmark
+  std::vector<unsigned char> vec_valid(landmarks.size(), 0);
+#ifdef I23DSFM_USE_OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < static_cast<int>(landmarks.size()); ++i)
+  {
+    double max_angle = 0.0;
+    const size_t end = landmarks.obs_offsets[i+1];
+    for (size_t k1 = landmarks.obs_offsets[i]; k1 < end && max_angle < dMinAcceptedAngle; ++k1)
+    {
+      const View * view1 = sfm_data.views.at(landmarks.obs_view[k1]).get();
+      const geometry::Pose3 & pose1 = sfm_data.poses.at(view1->id_pose);
+      const cameras::IntrinsicBase * intrinsic1 = sfm_data.intrinsics.at(view1->id_intrinsic).get();
+      for (size_t k2 = k1 + 1; k2 < end; ++k2)
+      {
+        const View * view2 = sfm_data.views.at(landmarks.obs_view[k2]).get();
+        const geometry::Pose3 & pose2 = sfm_data.poses.at(view2->id_pose);
+        const cameras::IntrinsicBase * intrinsic2 = sfm_data.intrinsics.at(view2->id_intrinsic).get();
+
+        const double angle = AngleBetweenRay(
+          pose1, intrinsic1, pose2, intrinsic2,
+          landmarks.obs_x[k1], landmarks.obs_x[k2]);
+        max_angle = std::max(angle, max_angle);
+      }
+    }
+    vec_valid[i] = (max_angle >= dMinAcceptedAngle);
+  }
+  const size_t nb_landmarks = landmarks.size();
+  landmarks.FilterLandmarks(std::vector<bool>(vec_valid.begin(), vec_valid.end()));
+  return nb_landmarks - landmarks.size();
+}
+
 static bool eraseMissingPoses(SfM_Data & sfm_data, const IndexT min_points_per_pose)
 {
   IndexT removed_elements = 0;
@@ -212,6 +309,66 @@ static bool eraseObservationsWithMissingPoses(SfM_Data & sfm_data, const IndexT
   return removed_elements > 0;
 }
 
+/// Remove the poses observed less than min_points_per_pose times (flat landmark store version)
+static bool eraseMissingPoses
+(
+  SfM_Data & sfm_data,
+  const Landmarks_CSR & landmarks,
+  const IndexT min_points_per_pose
+)
+{
+  IndexT removed_elements = 0;
+
+  // Count the observation poses occurence
+  Hash_Map<IndexT, IndexT> map_PoseId_Count;
+  for (Poses::const_iterator itPoses = sfm_data.GetPoses().begin();
+    itPoses != sfm_data.GetPoses().end(); ++itPoses)
+  {
+    map_PoseId_Count[itPoses->first] = 0;
+  }
+  for (size_t k = 0; k < landmarks.nb_observations(); ++k)
+  {
+    const View * v = sfm_data.GetViews().at(landmarks.obs_view[k]).get();
+    if (map_PoseId_Count.count(v->id_pose))
+      map_PoseId_Count.at(v->id_pose) += 1;
+    else
+      map_PoseId_Count[v->id_pose] = 0;
+  }
+  // If usage count is smaller than the threshold, remove the Pose
+  for (Hash_Map<IndexT, IndexT>::const_iterator it = map_PoseId_Count.begin();
+    it != map_PoseId_Count.end(); ++it)
+  {
+    if (it->second < min_points_per_pose)
+    {
+      sfm_data.poses.erase(it->first);
+      ++removed_elements;
+    }
+  }
+  return removed_elements > 0;
+}
+
+/// Remove the observations of the missing poses and the landmarks with
+/// less than min_points_per_landmark observations (flat landmark store version)
+static bool eraseObservationsWithMissingPoses
+(
+  const SfM_Data & sfm_data,
+  Landmarks_CSR & landmarks,
+  const IndexT min_points_per_landmark
+)
+{
+  IndexT removed_elements = 0;
+  std::vector<bool> valid_obs(landmarks.nb_observations());
+  for (size_t k = 0; k < landmarks.nb_observations(); ++k)
+  {
+    const View * v = sfm_data.GetViews().at(landmarks.obs_view[k]).get();
+    valid_obs[k] = (sfm_data.poses.count(v->id_pose) != 0);
+    if (!valid_obs[k])
+      ++removed_elements;
+  }
+  landmarks.Filter(valid_obs, min_points_per_landmark);
+  return removed_elements > 0;
+}
+
 /// Remove unstable content from analysis of the sfm_data structure
 static bool eraseUnstablePosesAndObservations(
   SfM_Data & sfm_data,
@@ -235,6 +392,30 @@ static bool eraseUnstablePosesAndObservations(
   return remove_iteration > 0;
 }
 
+/// Remove unstable content from analysis of a scene structure stored in a flat landmark store
+static bool eraseUnstablePosesAndObservations(
+  SfM_Data & sfm_data,
+  Landmarks_CSR & landmarks,
+  const IndexT min_points_per_pose = 6,
+  const IndexT min_points_per_landmark = 2)
+{
+  IndexT remove_iteration = 0;
+  bool bRemovedContent = false;
+  do
+  {
+    bRemovedContent = false;
+    if (eraseMissingPoses(sfm_data, landmarks, min_points_per_pose))
+    {
+      bRemovedContent = eraseObservationsWithMissingPoses(sfm_data, landmarks, min_points_per_landmark);
+      // Erase some observations can make some Poses index disappear so perform the process in a loop
+    }
+    remove_iteration += bRemovedContent ? 1 : 0;
+  }
+  while (bRemovedContent);
+
+  return remove_iteration > 0;
+}
+
 } // namespace sfm
 } // namespace i23dSFM
 
@@ -14,6 +14,7 @@
 #include "i23dSFM/sfm/sfm_data_io_cereal.hpp"
 #include "i23dSFM/sfm/sfm_data_io_ply.hpp"
 #include "i23dSFM/sfm/sfm_data_io_baf.hpp"
+#include "i23dSFM/sfm/sfm_data_io_chunked.hpp"
 
 namespace i23dSFM {
 namespace sfm {
@@ -74,6 +75,8 @@ bool Load(SfM_Data & sfm_data, const std::string & filename, ESfM_Data flags_par
     bStatus = Load_Cereal<cereal::PortableBinaryInputArchive>(sfm_data, filename, flags_part);
   else if (ext == "xml")
     bStatus = Load_Cereal<cereal::XMLInputArchive>(sfm_data, filename, flags_part);
+  else if (ext == "sfmb") // Chunked binary file (partial loading)
+    bStatus = Load_Chunked(sfm_data, filename, flags_part);
   else return false;
 
   // Assert that loaded intrinsics | extrinsics are linked to valid view
@@ -96,6 +99,8 @@ bool Save(const SfM_Data & sfm_data, const std::string & filename, ESfM_Data fla
     return Save_Cereal<cereal::PortableBinaryOutputArchive>(sfm_data, filename, flags_part);
   else if (ext == "xml")
     return Save_Cereal<cereal::XMLOutputArchive>(sfm_data, filename, flags_part);
+  else if (ext == "sfmb") // Chunked binary file (partial loading)
+    return Save_Chunked(sfm_data, filename, flags_part);
   else if (ext == "ply")
     return Save_PLY(sfm_data, filename, flags_part);
   else if (ext == "baf") // Bundle Adjustment file
@@ -0,0 +1,534 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "i23dSFM/sfm/sfm_data_io_chunked.hpp"
+#include "i23dSFM/cameras/cameras.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace i23dSFM {
+namespace sfm {
+
+namespace {
+
+using namespace i23dSFM::cameras;
+using namespace i23dSFM::geometry;
+
+const char kMagic[4] = {'S', 'F', 'M', 'B'};
+const uint32_t kVersion = 1;
+const uint32_t kByteOrderMark = 0x01020304;
+
+enum ESection
+{
+  SECTION_PATHS = 1,
+  SECTION_VIEWS = 2,
+  SECTION_INTRINSICS = 3,
+  SECTION_EXTRINSICS = 4,
+  SECTION_STRUCTURE = 5,
+  SECTION_STRUCTURE_OBSERVATIONS = 6,
+  SECTION_CONTROL_POINTS = 7,
+  SECTION_CONTROL_POINTS_OBSERVATIONS = 8
+};
+
+/// Location of a section in the file
+struct Section_Entry
+{
+  uint32_t id;
+  uint64_t offset; // first byte of the section
+  uint64_t size;   // size of the section in bytes
+  uint64_t count;  // number of records
+};
+const size_t kSectionEntrySize = sizeof(uint32_t) + 3 * sizeof(uint64_t);
+
+template <typename T>
+inline void Write_Pod(std::ostream & stream, const T & value)
+{
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+inline bool Read_Pod(std::istream & stream, T & value)
+{
+  return bool(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+inline void Write_String(std::ostream & stream, const std::string & value)
+{
+  Write_Pod(stream, static_cast<uint32_t>(value.size()));
+  stream.write(value.data(), value.size());
+}
+
+/// Read the records of a section: a read past the end of the section fails
+/// (a corrupted count or length is detected before any large allocation).
+class Section_Reader
+{
+public:
+  Section_Reader(std::istream & stream, const Section_Entry & entry)
+    : _stream(stream), _remaining(entry.size) {}
+
+  bool Read(void * data, uint64_t size)
+  {
+    if (size > _remaining)
+      return false;
+    _remaining -= size;
+    return size == 0 || bool(_stream.read(reinterpret_cast<char*>(data), size));
+  }
+
+  template <typename T>
+  bool Read_Pod(T & value) { return Read(&value, sizeof(T)); }
+
+  bool Read_String(std::string & value)
+  {
+    uint32_t size;
+    if (!Read_Pod(size) || size > _remaining)
+      return false;
+    value.resize(size);
+    return size == 0 || Read(&value[0], size);
+  }
+
+  uint64_t Remaining() const { return _remaining; }
+
+private:
+  std::istream & _stream;
+  uint64_t _remaining;
+};
+
+// Size of the fixed size records
+const uint64_t kLandmarkRecordSize = sizeof(uint32_t) + 3 * sizeof(double) + sizeof(int32_t)
+  + sizeof(uint32_t) + sizeof(uint64_t);
+const uint64_t kObservationRecordSize = 2 * sizeof(uint32_t) + 2 * sizeof(double) + sizeof(int32_t);
+const uint64_t kExtrinsicRecordSize = sizeof(uint32_t) + 12 * sizeof(double);
+
+/// Does the section hold exactly its count of record_size records
+inline bool Has_Record_Size(const Section_Entry & entry, uint64_t record_size)
+{
+  return entry.size % record_size == 0 && entry.size / record_size == entry.count;
+}
+
+/// Write the sections one after the other (single forward pass)
+/// and keep track of their location for the final section table.
+class Section_Writer
+{
+public:
+  explicit Section_Writer(std::ostream & stream) : _stream(stream) {}
+
+  void Begin(ESection id)
+  {
+    Section_Entry entry = {static_cast<uint32_t>(id), Tell(), 0, 0};
+    _sections.push_back(entry);
+  }
+
+  /// A record of the current section has been written
+  void Record() { ++_sections.back().count; }
+
+  void End() { _sections.back().size = Tell() - _sections.back().offset; }
+
+  /// Write the section table and the trailer
+  void Finish()
+  {
+    const uint64_t table_offset = Tell();
+    Write_Pod(_stream, static_cast<uint32_t>(_sections.size()));
+    for (const Section_Entry & entry : _sections)
+    {
+      Write_Pod(_stream, entry.id);
+      Write_Pod(_stream, entry.offset);
+      Write_Pod(_stream, entry.size);
+      Write_Pod(_stream, entry.count);
+    }
+    Write_Pod(_stream, table_offset);
+    _stream.write(kMagic, sizeof(kMagic));
+  }
+
+private:
+  uint64_t Tell() { return static_cast<uint64_t>(_stream.tellp()); }
+
+  std::ostream & _stream;
+  std::vector<Section_Entry> _sections;
+};
+
+void Write_Landmarks
+(
+  std::ostream & stream,
+  Section_Writer & writer,
+  const Landmarks & landmarks,
+  ESection landmark_section,
+  ESection observation_section
+)
+{
+  // Landmarks: id, X, label, observation count, first observation record
+  writer.Begin(landmark_section);
+  uint64_t first_obs = 0;
+  for (const auto & landmark : landmarks)
+  {
+    Write_Pod(stream, static_cast<uint32_t>(landmark.first));
+    stream.write(reinterpret_cast<const char*>(landmark.second.X.data()), 3 * sizeof(double));
+    Write_Pod(stream, static_cast<int32_t>(landmark.second.semantic_label));
+    Write_Pod(stream, static_cast<uint32_t>(landmark.second.obs.size()));
+    Write_Pod(stream, first_obs);
+    first_obs += landmark.second.obs.size();
+    writer.Record();
+  }
+  writer.End();
+
+  // Observations, in landmark order: view id, feature id, x, label
+  writer.Begin(observation_section);
+  for (const auto & landmark : landmarks)
+  {
+    for (const auto & obs : landmark.second.obs)
+    {
+      Write_Pod(stream, static_cast<uint32_t>(obs.first));
+      Write_Pod(stream, static_cast<uint32_t>(obs.second.id_feat));
+      stream.write(reinterpret_cast<const char*>(obs.second.x.data()), 2 * sizeof(double));
+      Write_Pod(stream, static_cast<int32_t>(obs.second.semantic_label));
+      writer.Record();
+    }
+  }
+  writer.End();
+}
+
+/// Create an intrinsic of the given type (its parameters are set afterwards)
+std::shared_ptr<IntrinsicBase> Make_Intrinsic(uint32_t type, int w, int h)
+{
+  switch (type)
+  {
+    case PINHOLE_CAMERA:
+      return std::make_shared<Pinhole_Intrinsic>(w, h);
+    case PINHOLE_CAMERA_RADIAL1:
+      return std::make_shared<Pinhole_Intrinsic_Radial_K1>(w, h);
+    case PINHOLE_CAMERA_RADIAL3:
+      return std::make_shared<Pinhole_Intrinsic_Radial_K3>(w, h);
+    case PINHOLE_CAMERA_BROWN:
+      return std::make_shared<Pinhole_Intrinsic_Brown_T2>(w, h);
+    default:
+      return std::shared_ptr<IntrinsicBase>();
+  }
+}
+
+/// Read the landmarks section and their observations with two streams
+/// (the observations section is read sequentially along the landmarks).
+bool Read_Landmarks
+(
+  const std::string & filename,
+  const Section_Entry & landmark_section,
+  const Section_Entry & observation_section,
+  Landmarks & landmarks
+)
+{
+  std::ifstream landmark_stream(filename.c_str(), std::ios::binary | std::ios::in);
+  std::ifstream observation_stream(filename.c_str(), std::ios::binary | std::ios::in);
+  if (!landmark_stream.is_open() || !observation_stream.is_open())
+    return false;
+  if (!Has_Record_Size(landmark_section, kLandmarkRecordSize) ||
+      !Has_Record_Size(observation_section, kObservationRecordSize) ||
+      !landmark_stream.seekg(landmark_section.offset) ||
+      !observation_stream.seekg(observation_section.offset))
+    return false;
+  Section_Reader landmark_reader(landmark_stream, landmark_section);
+  Section_Reader observation_reader(observation_stream, observation_section);
+
+  landmarks.clear();
+  uint64_t nb_obs_read = 0;
+  for (uint64_t i = 0; i < landmark_section.count; ++i)
+  {
+    uint32_t id, nb_obs;
+    int32_t label;
+    uint64_t first_obs;
+    Vec3 X;
+    if (!landmark_reader.Read_Pod(id) ||
+        !landmark_reader.Read(X.data(), 3 * sizeof(double)) ||
+        !landmark_reader.Read_Pod(label) ||
+        !landmark_reader.Read_Pod(nb_obs) ||
+        !landmark_reader.Read_Pod(first_obs) ||
+        first_obs != nb_obs_read ||
+        first_obs + nb_obs > observation_section.count)
+      return false;
+
+    Landmark & landmark = landmarks[id];
+    landmark.X = X;
+    landmark.semantic_label = label;
+    for (uint32_t j = 0; j < nb_obs; ++j)
+    {
+      uint32_t id_view, id_feat;
+      int32_t obs_label;
+      Vec2 x;
+      if (!observation_reader.Read_Pod(id_view) ||
+          !observation_reader.Read_Pod(id_feat) ||
+          !observation_reader.Read(x.data(), 2 * sizeof(double)) ||
+          !observation_reader.Read_Pod(obs_label))
+        return false;
+      landmark.obs[id_view] = Observation(x, id_feat, obs_label);
+    }
+    nb_obs_read += nb_obs;
+  }
+  return true;
+}
+
+} // namespace
+
+bool Save_Chunked
+(
+  const SfM_Data & sfm_data,
+  const std::string & filename,
+  ESfM_Data flags_part
+)
+{
+  const bool b_views = (flags_part & VIEWS) == VIEWS;
+  const bool b_intrinsics = (flags_part & INTRINSICS) == INTRINSICS;
+  const bool b_extrinsics = (flags_part & EXTRINSICS) == EXTRINSICS;
+  const bool b_structure = (flags_part & STRUCTURE) == STRUCTURE;
+  const bool b_control_point = (flags_part & CONTROL_POINTS) == CONTROL_POINTS;
+
+  std::ofstream stream(filename.c_str(), std::ios::binary | std::ios::out);
+  if (!stream.is_open())
+    return false;
+
+  stream.write(kMagic, sizeof(kMagic));
+  Write_Pod(stream, kVersion);
+  Write_Pod(stream, kByteOrderMark);
+
+  Section_Writer writer(stream);
+
+  writer.Begin(SECTION_PATHS);
+  Write_String(stream, sfm_data.s_root_path);
+  Write_String(stream, sfm_data.s_seg_root_path);
+  writer.Record();
+  writer.End();
+
+  // The sections that are not asked are written empty
+
+  // id, intrinsic id, pose id, width, height, image path, semantic image path
+  writer.Begin(SECTION_VIEWS);
+  if (b_views)
+  {
+    for (const auto & view_it : sfm_data.GetViews())
+    {
+      const View * view = view_it.second.get();
+      Write_Pod(stream, static_cast<uint32_t>(view->id_view));
+      Write_Pod(stream, static_cast<uint32_t>(view->id_intrinsic));
+      Write_Pod(stream, static_cast<uint32_t>(view->id_pose));
+      Write_Pod(stream, static_cast<uint32_t>(view->ui_width));
+      Write_Pod(stream, static_cast<uint32_t>(view->ui_height));
+      Write_String(stream, view->s_Img_path);
+      Write_String(stream, view->semantic_img_path);
+      writer.Record();
+    }
+  }
+  writer.End();
+
+  // id, type, width, height, parameter count, parameters
+  writer.Begin(SECTION_INTRINSICS);
+  if (b_intrinsics)
+  {
+    for (const auto & intrinsic_it : sfm_data.GetIntrinsics())
+    {
+      const IntrinsicBase * intrinsic = intrinsic_it.second.get();
+      const std::vector<double> params = intrinsic->getParams();
+      Write_Pod(stream, static_cast<uint32_t>(intrinsic_it.first));
+      Write_Pod(stream, static_cast<uint32_t>(intrinsic->getType()));
+      Write_Pod(stream, static_cast<uint32_t>(intrinsic->w()));
+      Write_Pod(stream, static_cast<uint32_t>(intrinsic->h()));
+      Write_Pod(stream, static_cast<uint32_t>(params.size()));
+      if (!params.empty())
+        stream.write(reinterpret_cast<const char*>(&params[0]), params.size() * sizeof(double));
+      writer.Record();
+    }
+  }
+  writer.End();
+
+  // id, rotation (column major), center
+  writer.Begin(SECTION_EXTRINSICS);
+  if (b_extrinsics)
+  {
+    for (const auto & pose_it : sfm_data.GetPoses())
+    {
+      const Mat3 R = pose_it.second.rotation();
+      const Vec3 C = pose_it.second.center();
+      Write_Pod(stream, static_cast<uint32_t>(pose_it.first));
+      stream.write(reinterpret_cast<const char*>(R.data()), 9 * sizeof(double));
+      stream.write(reinterpret_cast<const char*>(C.data()), 3 * sizeof(double));
+      writer.Record();
+    }
+  }
+  writer.End();
+
+  static const Landmarks empty_landmarks;
+  Write_Landmarks(stream, writer, b_structure ? sfm_data.GetLandmarks() : empty_landmarks,
+    SECTION_STRUCTURE, SECTION_STRUCTURE_OBSERVATIONS);
+
+  Write_Landmarks(stream, writer, b_control_point ? sfm_data.GetControl_Points() : empty_landmarks,
+    SECTION_CONTROL_POINTS, SECTION_CONTROL_POINTS_OBSERVATIONS);
+
+  writer.Finish();
+  return stream.good();
+}
+
+bool Load_Chunked
+(
+  SfM_Data & sfm_data,
+  const std::string & filename,
+  ESfM_Data flags_part
+)
+{
+  const bool b_views = (flags_part & VIEWS) == VIEWS;
+  const bool b_intrinsics = (flags_part & INTRINSICS) == INTRINSICS;
+  const bool b_extrinsics = (flags_part & EXTRINSICS) == EXTRINSICS;
+  const bool b_structure = (flags_part & STRUCTURE) == STRUCTURE;
+  const bool b_control_point = (flags_part & CONTROL_POINTS) == CONTROL_POINTS;
+
+  std::ifstream stream(filename.c_str(), std::ios::binary | std::ios::in);
+  if (!stream.is_open())
+    return false;
+
+  // Header
+  char magic[4];
+  uint32_t version, byte_order_mark;
+  if (!stream.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      !Read_Pod(stream, version) || !Read_Pod(stream, byte_order_mark))
+  {
+    std::cerr << "Invalid chunked SfM_Data file: " << filename << std::endl;
+    return false;
+  }
+  if (version != kVersion || byte_order_mark != kByteOrderMark)
+  {
+    std::cerr << "Unsupported chunked SfM_Data version or byte order: " << filename << std::endl;
+    return false;
+  }
+
+  // Trailer and section table
+  uint64_t table_offset;
+  stream.seekg(-static_cast<std::streamoff>(sizeof(uint64_t) + sizeof(kMagic)), std::ios::end);
+  const uint64_t trailer_offset = static_cast<uint64_t>(stream.tellg());
+  uint32_t nb_sections;
+  if (!Read_Pod(stream, table_offset) || !stream.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      table_offset >= trailer_offset ||
+      !stream.seekg(table_offset) || !Read_Pod(stream, nb_sections) ||
+      table_offset + sizeof(uint32_t) + nb_sections * kSectionEntrySize != trailer_offset)
+  {
+    std::cerr << "Invalid chunked SfM_Data section table: " << filename << std::endl;
+    return false;
+  }
+  std::map<uint32_t, Section_Entry> sections;
+  for (uint32_t i = 0; i < nb_sections; ++i)
+  {
+    Section_Entry entry;
+    if (!Read_Pod(stream, entry.id) || !Read_Pod(stream, entry.offset) ||
+        !Read_Pod(stream, entry.size) || !Read_Pod(stream, entry.count) ||
+        entry.offset > table_offset || entry.size > table_offset - entry.offset)
+      return false;
+    sections[entry.id] = entry;
+  }
+  // Position the stream at the beginning of a section (false if it is missing)
+  const auto seek_section = [&](ESection id, Section_Entry & entry) -> bool
+  {
+    const std::map<uint32_t, Section_Entry>::const_iterator it = sections.find(id);
+    if (it == sections.end())
+      return false;
+    entry = it->second;
+    return bool(stream.seekg(entry.offset));
+  };
+
+  Section_Entry entry;
+  if (!seek_section(SECTION_PATHS, entry))
+    return false;
+  {
+    Section_Reader reader(stream, entry);
+    if (!reader.Read_String(sfm_data.s_root_path) ||
+        !reader.Read_String(sfm_data.s_seg_root_path))
+      return false;
+  }
+
+  if (b_views)
+  {
+    if (!seek_section(SECTION_VIEWS, entry))
+      return false;
+    Section_Reader reader(stream, entry);
+    sfm_data.views.clear();
+    for (uint64_t i = 0; i < entry.count; ++i)
+    {
+      uint32_t id_view, id_intrinsic, id_pose, width, height;
+      std::string sImgPath, sSemanticImgPath;
+      if (!reader.Read_Pod(id_view) || !reader.Read_Pod(id_intrinsic) ||
+          !reader.Read_Pod(id_pose) || !reader.Read_Pod(width) || !reader.Read_Pod(height) ||
+          !reader.Read_String(sImgPath) || !reader.Read_String(sSemanticImgPath))
+        return false;
+      sfm_data.views[id_view] = std::make_shared<View>(
+        sImgPath, sSemanticImgPath, id_view, id_intrinsic, id_pose, width, height);
+    }
+  }
+
+  if (b_intrinsics)
+  {
+    if (!seek_section(SECTION_INTRINSICS, entry))
+      return false;
+    Section_Reader reader(stream, entry);
+    sfm_data.intrinsics.clear();
+    for (uint64_t i = 0; i < entry.count; ++i)
+    {
+      uint32_t id, type, width, height, nb_params;
+      if (!reader.Read_Pod(id) || !reader.Read_Pod(type) ||
+          !reader.Read_Pod(width) || !reader.Read_Pod(height) || !reader.Read_Pod(nb_params) ||
+          nb_params > reader.Remaining() / sizeof(double))
+        return false;
+      std::vector<double> params(nb_params);
+      if (nb_params > 0 && !reader.Read(&params[0], nb_params * sizeof(double)))
+        return false;
+      std::shared_ptr<IntrinsicBase> intrinsic = Make_Intrinsic(type, width, height);
+      if (!intrinsic || !intrinsic->updateFromParams(params))
+      {
+        std::cerr << "Invalid intrinsic (id: " << id << ", type: " << type << ")" << std::endl;
+        return false;
+      }
+      sfm_data.intrinsics[id] = intrinsic;
+    }
+  }
+
+  if (b_extrinsics)
+  {
+    if (!seek_section(SECTION_EXTRINSICS, entry) ||
+        !Has_Record_Size(entry, kExtrinsicRecordSize))
+      return false;
+    Section_Reader reader(stream, entry);
+    sfm_data.poses.clear();
+    for (uint64_t i = 0; i < entry.count; ++i)
+    {
+      uint32_t id;
+      Mat3 R;
+      Vec3 C;
+      if (!reader.Read_Pod(id) ||
+          !reader.Read(R.data(), 9 * sizeof(double)) ||
+          !reader.Read(C.data(), 3 * sizeof(double)))
+        return false;
+      sfm_data.poses[id] = Pose3(R, C);
+    }
+  }
+
+  if (b_structure)
+  {
+    Section_Entry observation_entry;
+    if (!seek_section(SECTION_STRUCTURE, entry) ||
+        !seek_section(SECTION_STRUCTURE_OBSERVATIONS, observation_entry) ||
+        !Read_Landmarks(filename, entry, observation_entry, sfm_data.structure))
+      return false;
+  }
+
+  if (b_control_point)
+  {
+    Section_Entry observation_entry;
+    if (!seek_section(SECTION_CONTROL_POINTS, entry) ||
+        !seek_section(SECTION_CONTROL_POINTS_OBSERVATIONS, observation_entry) ||
+        !Read_Landmarks(filename, entry, observation_entry, sfm_data.control_points))
+      return false;
+  }
+  return true;
+}
+
+} // namespace sfm
+} // namespace i23dSFM
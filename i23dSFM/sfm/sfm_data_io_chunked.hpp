@@ -0,0 +1,52 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_SFM_DATA_IO_CHUNKED_HPP
+#define I23DSFM_SFM_DATA_IO_CHUNKED_HPP
+
+#include "i23dSFM/sfm/sfm_data_io.hpp"
+
+#include <string>
+
+namespace i23dSFM {
+namespace sfm {
+
+/// Chunked binary SfM_Data file (.sfmb)
+///
+/// The scene is stored as independent sections of fixed layout records
+/// (paths, views, intrinsics, poses, landmarks, observations, control points,
+/// control points observations) followed by a table of the sections
+/// (id, offset, size, record count) and a trailer pointing to this table:
+///
+///   "SFMB" version byte_order_mark
+///   section 0 ... section N
+///   section_count {id offset size count} x section_count
+///   table_offset "SFMB"
+///
+/// - Save writes the records in a single streaming pass (no scene copy),
+///   the sections that are not asked are written empty,
+/// - Load only reads the sections asked by the ESfM_Data flags (the other
+///   sections are not parsed),
+/// - each landmark record stores the index of its first observation record,
+///   so the observations of a landmark can be accessed directly.
+/// The records are stored in the host byte order (checked at loading).
+
+/// Load the asked parts of a chunked binary SfM_Data file
+bool Load_Chunked(
+  SfM_Data & sfm_data,
+  const std::string & filename,
+  ESfM_Data flags_part);
+
+/// Save the asked parts of a SfM_Data scene as a chunked binary file
+bool Save_Chunked(
+  const SfM_Data & sfm_data,
+  const std::string & filename,
+  ESfM_Data flags_part);
+
+} // namespace sfm
+} // namespace i23dSFM
+
+#endif // I23DSFM_SFM_DATA_IO_CHUNKED_HPP
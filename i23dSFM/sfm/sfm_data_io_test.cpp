@@ -9,6 +9,7 @@
 #include "testing/testing.h"
 #include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
 
+#include <fstream>
 #include <sstream>
 
 using namespace i23dSFM;
@@ -30,7 +31,7 @@ SfM_Data create_test_scene(IndexT viewsCount, bool bSharedIntrinsic)
     os << "dataset/" << i << ".jpg";
     const IndexT id_view = i, id_pose = i;
     const IndexT id_intrinsic = bSharedIntrinsic ? 0 : i; //(shared or not intrinsics)
-    sfm_data.views[id_view] = std::make_shared<View>(os.str(),id_view, id_intrinsic, id_pose, 1000, 1000);
+    sfm_data.views[id_view] = std::make_shared<View>(os.str(), "", id_view, id_intrinsic, id_pose, 1000, 1000);
 
     // Add poses
     sfm_data.poses[i] = Pose3();
@@ -58,7 +59,7 @@ SfM_Data create_test_scene(IndexT viewsCount, bool bSharedIntrinsic)
 
 TEST(SfM_Data_IO, SAVE_LOAD_JSON) {
 
-  const std::vector<std::string> ext_Type = {"json", "bin", "xml"};
+  const std::vector<std::string> ext_Type = {"json", "bin", "xml", "sfmb"};
 
   for (int i=0; i < ext_Type.size(); ++i)
   {
@@ -159,6 +160,103 @@ TEST(SfM_Data_IO, SAVE_LOAD_JSON) {
   }
 }
 
+TEST(SfM_Data_IO, SAVE_LOAD_SFMB_CONTENT) {
+
+  const std::string filename = "SAVE_LOAD_CONTENT.sfmb";
+  SfM_Data sfm_data = create_test_scene(2, false);
+  sfm_data.s_seg_root_path = "./semantic/";
+  sfm_data.views[1]->semantic_img_path = "1.png";
+  sfm_data.intrinsics[1] = std::make_shared<Pinhole_Intrinsic_Brown_T2>
+    (1000, 1000, 1100.0, 499.0, 501.0, 0.1, 0.01, 0.001, 0.02, 0.03);
+  sfm_data.poses[1] = Pose3(RotationAroundZ(0.5), Vec3(1, 2, 3));
+  sfm_data.structure[0].semantic_label = 2;
+  sfm_data.structure[0].obs[1].semantic_label = 1;
+  sfm_data.structure[5].X = Vec3(-1, -2, -3);
+  sfm_data.structure[5].obs[1] = Observation(Vec2(5, 6), 7, 0);
+  sfm_data.control_points[3].X = Vec3(4, 5, 6);
+  sfm_data.control_points[3].obs[0] = Observation(Vec2(8, 9), 0, 1);
+  EXPECT_TRUE( Save(sfm_data, filename, ALL) );
+
+  // LOAD (everything)
+  {
+    SfM_Data sfm_data_load;
+    EXPECT_TRUE( Load(sfm_data_load, filename, ALL) );
+    EXPECT_EQ( sfm_data.s_root_path, sfm_data_load.s_root_path );
+    EXPECT_EQ( sfm_data.s_seg_root_path, sfm_data_load.s_seg_root_path );
+    CHECK_EQUAL( 2, sfm_data_load.views.size() );
+    const View * view = sfm_data_load.views.at(1).get();
+    EXPECT_EQ( "dataset/1.jpg", view->s_Img_path );
+    EXPECT_EQ( "1.png", view->semantic_img_path );
+    EXPECT_EQ( 1, view->id_view );
+    EXPECT_EQ( 1, view->id_intrinsic );
+    EXPECT_EQ( 1, view->id_pose );
+    EXPECT_EQ( 1000, view->ui_width );
+
+    CHECK_EQUAL( 2, sfm_data_load.intrinsics.size() );
+    const IntrinsicBase * intrinsic = sfm_data_load.intrinsics.at(1).get();
+    EXPECT_EQ( PINHOLE_CAMERA_BROWN, intrinsic->getType() );
+    EXPECT_EQ( sfm_data.intrinsics.at(1)->hashValue(), intrinsic->hashValue() );
+
+    CHECK_EQUAL( 2, sfm_data_load.poses.size() );
+    EXPECT_MATRIX_NEAR( sfm_data.poses.at(1).rotation(), sfm_data_load.poses.at(1).rotation(), 1e-12 );
+    EXPECT_MATRIX_NEAR( sfm_data.poses.at(1).center(), sfm_data_load.poses.at(1).center(), 1e-12 );
+
+    CHECK_EQUAL( 2, sfm_data_load.structure.size() );
+    const Landmark & landmark = sfm_data_load.structure.at(0);
+    EXPECT_MATRIX_NEAR( Vec3(11,22,33), landmark.X, 1e-12 );
+    EXPECT_EQ( 2, landmark.semantic_label );
+    CHECK_EQUAL( 2, landmark.obs.size() );
+    EXPECT_MATRIX_NEAR( Vec2(30,10), landmark.obs.at(1).x, 1e-12 );
+    EXPECT_EQ( 1, landmark.obs.at(1).id_feat );
+    EXPECT_EQ( 1, landmark.obs.at(1).semantic_label );
+    EXPECT_EQ( 7, sfm_data_load.structure.at(5).obs.at(1).id_feat );
+
+    CHECK_EQUAL( 1, sfm_data_load.control_points.size() );
+    EXPECT_MATRIX_NEAR( Vec2(8,9), sfm_data_load.control_points.at(3).obs.at(0).x, 1e-12 );
+  }
+
+  // LOAD (only a subpart: STRUCTURE)
+  {
+    SfM_Data sfm_data_load;
+    EXPECT_TRUE( Load(sfm_data_load, filename, STRUCTURE) );
+    EXPECT_EQ( 0, sfm_data_load.views.size() );
+    CHECK_EQUAL( 2, sfm_data_load.structure.size() );
+    EXPECT_EQ( 1, sfm_data_load.structure.at(5).obs.size() );
+  }
+
+  // SAVE (only a subpart: STRUCTURE), the other sections are empty
+  {
+    EXPECT_TRUE( Save(sfm_data, filename, STRUCTURE) );
+    SfM_Data sfm_data_load;
+    EXPECT_TRUE( Load(sfm_data_load, filename, ALL) );
+    EXPECT_EQ( 0, sfm_data_load.views.size() );
+    EXPECT_EQ( 0, sfm_data_load.intrinsics.size() );
+    EXPECT_EQ( 2, sfm_data_load.structure.size() );
+  }
+
+  // Not a chunked file
+  {
+    EXPECT_TRUE( Save(sfm_data, "SAVE_LOAD_CONTENT.bin", ALL) );
+    EXPECT_TRUE( stlplus::file_copy("SAVE_LOAD_CONTENT.bin", "SAVE_LOAD_INVALID.sfmb") );
+    SfM_Data sfm_data_load;
+    EXPECT_FALSE( Load(sfm_data_load, "SAVE_LOAD_INVALID.sfmb", ALL) );
+  }
+
+  // A string length larger than its section (root path length, after the
+  // 12 bytes of the header) is rejected
+  {
+    EXPECT_TRUE( Save(sfm_data, "SAVE_LOAD_INVALID.sfmb", ALL) );
+    {
+      std::fstream stream("SAVE_LOAD_INVALID.sfmb", std::ios::in | std::ios::out | std::ios::binary);
+      const uint32_t length = 0xFFFFFF00;
+      stream.seekp(12);
+      stream.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    }
+    SfM_Data sfm_data_load;
+    EXPECT_FALSE( Load(sfm_data_load, "SAVE_LOAD_INVALID.sfmb", ALL) );
+  }
+}
+
 TEST(SfM_Data_IO, SAVE_PLY) {
 
   // SAVE as PLY
@@ -10,8 +10,8 @@
 #include "i23dSFM/robust_estimation/rand_sampling.hpp"
 #include "third_party/progress/progress.hpp"
 
-#include <deque>
 #include <memory>
+#include <string>
 
 namespace i23dSFM {
 namespace sfm {
@@ -19,93 +19,168 @@ namespace sfm {
 using namespace i23dSFM::geometry;
 using namespace i23dSFM::cameras;
 
-SfM_Data_Structure_Computation_Basis::SfM_Data_Structure_Computation_Basis(bool bConsoleVerbose)
-  :_bConsoleVerbose(bConsoleVerbose)
-{
-}
-
-SfM_Data_Structure_Computation_Blind::SfM_Data_Structure_Computation_Blind(bool bConsoleVerbose)
-  :SfM_Data_Structure_Computation_Basis(bConsoleVerbose)
+/// Triangulate in place the landmarks of a scene structure with the given
+/// track triangulation (called with flat arrays of view ids & observed pixels).
+/// The unsuccessful triangulated tracks are removed.
+template <typename TrackTriangulation>
+static void TriangulateStructure
+(
+  Landmarks & structure,
+  const TrackTriangulation & track_triangulation,
+  const bool bConsoleVerbose,
+  const std::string & sProgressTitle
+)
 {
-}
+  // Random access to the landmarks (the structure is modified in place)
+  std::vector<Landmarks::iterator> vec_landmarks;
+  vec_landmarks.reserve(structure.size());
+  for (Landmarks::iterator iterTracks = structure.begin(); iterTracks != structure.end(); ++iterTracks)
+    vec_landmarks.push_back(iterTracks);
 
-void SfM_Data_Structure_Computation_Blind::triangulate(SfM_Data & sfm_data) const
-{
-  std::deque<IndexT> rejectedId;
+  // std::vector<bool> is not safe for concurrent writes: use a byte per landmark
+  std::vector<unsigned char> vec_valid(vec_landmarks.size(), 0);
   std::unique_ptr<C_Progress_display> my_progress_bar;
-  if (_bConsoleVerbose)
+  if (bConsoleVerbose)
     my_progress_bar.reset( new C_Progress_display(
-    sfm_data.structure.size(),
+    vec_landmarks.size(),
     std::cout,
-    "Blind triangulation progress:\n" ));
+    sProgressTitle ));
 #ifdef I23DSFM_USE_OPENMP
-  #pragma omp parallel
+  #pragma omp parallel for schedule(dynamic)
 #endif
-  for(Landmarks::iterator iterTracks = sfm_data.structure.begin();
-    iterTracks != sfm_data.structure.end();
-    ++iterTracks)
+  for (int i = 0; i < static_cast<int>(vec_landmarks.size()); ++i)
   {
-#ifdef I23DSFM_USE_OPENMP
-  #pragma omp single nowait
-#endif
+    if (bConsoleVerbose)
     {
-      if (_bConsoleVerbose)
-      {
 #ifdef I23DSFM_USE_OPENMP
   #pragma omp critical
 #endif
-        ++(*my_progress_bar);
-      }
-      // Triangulate each landmark
-      Triangulation trianObj;
-      const Observations & obs = iterTracks->second.obs;
-      for(Observations::const_iterator itObs = obs.begin();
-        itObs != obs.end(); ++itObs)
-      {
-        const View * view = sfm_data.views.at(itObs->first).get();
-        if (sfm_data.IsPoseAndIntrinsicDefined(view))
-        {
-          const IntrinsicBase * cam = sfm_data.GetIntrinsics().at(view->id_intrinsic).get();
-          const Pose3 pose = sfm_data.GetPoseOrDie(view);
-          trianObj.add(
-            cam->get_projective_equivalent(pose),
-            cam->get_ud_pixel(itObs->second.x));
-        }
-      }
-      if (trianObj.size() < 2)
-      {
+      ++(*my_progress_bar);
+    }
+    Landmark & landmark = vec_landmarks[i]->second;
+    // Random access copy of the track observations
+    std::vector<IndexT> obs_view;
+    std::vector<Vec2, Eigen::aligned_allocator<Vec2> > obs_x;
+    obs_view.reserve(landmark.obs.size());
+    obs_x.reserve(landmark.obs.size());
+    for (Observations::const_iterator itObs = landmark.obs.begin(); itObs != landmark.obs.end(); ++itObs)
+    {
+      obs_view.push_back(itObs->first);
+      obs_x.push_back(itObs->second.x);
+    }
+    Vec3 X;
+    if (track_triangulation(obs_view.data(), obs_x.data(), obs_view.size(), X))
+    {
+      landmark.X = X;
+      vec_valid[i] = 1;
+    }
+  }
+  // Erase the unsuccessful triangulated tracks
+  for (size_t i = 0; i < vec_landmarks.size(); ++i)
+  {
+    if (!vec_valid[i])
+      structure.erase(vec_landmarks[i]);
+  }
+}
+
+/// Triangulate the landmarks of a flat store with the given track triangulation.
+/// The unsuccessful triangulated landmarks are removed from the store.
+template <typename TrackTriangulation>
+static void TriangulateStore
+(
+  Landmarks_CSR & landmarks,
+  const TrackTriangulation & track_triangulation,
+  const bool bConsoleVerbose,
+  const std::string & sProgressTitle
+)
+{
+  // std::vector<bool> is not safe for concurrent writes: use a byte per landmark
+  std::vector<unsigned char> vec_valid(landmarks.size(), 0);
+  std::unique_ptr<C_Progress_display> my_progress_bar;
+  if (bConsoleVerbose)
+    my_progress_bar.reset( new C_Progress_display(
+    landmarks.size(),
+    std::cout,
+    sProgressTitle ));
 #ifdef I23DSFM_USE_OPENMP
-        #pragma omp critical
+  #pragma omp parallel for schedule(dynamic)
 #endif
-        {
-          rejectedId.push_front(iterTracks->first);
-        }
-      }
-      else
-      {
-        // Compute the 3D point
-        const Vec3 X = trianObj.compute();
-        if (trianObj.minDepth() > 0) // Keep the point only if it have a positive depth
-        {
-          iterTracks->second.X = X;
-        }
-        else
-        {
+  for (int i = 0; i < static_cast<int>(landmarks.size()); ++i)
+  {
+    if (bConsoleVerbose)
+    {
 #ifdef I23DSFM_USE_OPENMP
-          #pragma omp critical
+  #pragma omp critical
 #endif
-          {
-            rejectedId.push_front(iterTracks->first);
-          }
-        }
-      }
+      ++(*my_progress_bar);
+    }
+    const size_t first = landmarks.obs_offsets[i];
+    Vec3 X;
+    if (track_triangulation(&landmarks.obs_view[first], &landmarks.obs_x[first],
+      landmarks.track_length(i), X))
+    {
+      landmarks.X[i] = X;
+      vec_valid[i] = 1;
     }
   }
-  // Erase the unsuccessful triangulated tracks
-  for (auto& it : rejectedId)
+  landmarks.FilterLandmarks(std::vector<bool>(vec_valid.begin(), vec_valid.end()));
+}
+
+SfM_Data_Structure_Computation_Basis::SfM_Data_Structure_Computation_Basis(bool bConsoleVerbose)
+  :_bConsoleVerbose(bConsoleVerbose)
+{
+}
+
+SfM_Data_Structure_Computation_Blind::SfM_Data_Structure_Computation_Blind(bool bConsoleVerbose)
+  :SfM_Data_Structure_Computation_Basis(bConsoleVerbose)
+{
+}
+
+void SfM_Data_Structure_Computation_Blind::triangulate(SfM_Data & sfm_data) const
+{
+  TriangulateStructure(sfm_data.structure,
+    [&](const IndexT * obs_view, const Vec2 * obs_x, const size_t nb_obs, Vec3 & X)
+    {
+      return track_triangulation(sfm_data, obs_view, obs_x, nb_obs, X);
+    },
+    _bConsoleVerbose, "Blind triangulation progress:\n");
+}
+
+void SfM_Data_Structure_Computation_Blind::triangulate(const SfM_Data & sfm_data, Landmarks_CSR & landmarks) const
+{
+  TriangulateStore(landmarks,
+    [&](const IndexT * obs_view, const Vec2 * obs_x, const size_t nb_obs, Vec3 & X)
+    {
+      return track_triangulation(sfm_data, obs_view, obs_x, nb_obs, X);
+    },
+    _bConsoleVerbose, "Blind triangulation progress:\n");
+}
+
+bool SfM_Data_Structure_Computation_Blind::track_triangulation(
+  const SfM_Data & sfm_data,
+  const IndexT * obs_view,
+  const Vec2 * obs_x,
+  const size_t nb_obs,
+  Vec3 & X) const
+{
+  Triangulation trianObj;
+  for (size_t k = 0; k < nb_obs; ++k)
   {
-    sfm_data.structure.erase(it);
+    const View * view = sfm_data.views.at(obs_view[k]).get();
+    if (sfm_data.IsPoseAndIntrinsicDefined(view))
+    {
+      const IntrinsicBase * cam = sfm_data.GetIntrinsics().at(view->id_intrinsic).get();
+      const Pose3 pose = sfm_data.GetPoseOrDie(view);
+      trianObj.add(
+        cam->get_projective_equivalent(pose),
+        cam->get_ud_pixel(obs_x[k]));
+    }
   }
+  if (trianObj.size() < 2)
+    return false;
+  // Compute the 3D point
+  X = trianObj.compute();
+  return trianObj.minDepth() > 0; // Keep the point only if it have a positive depth
 }
 
 SfM_Data_Structure_Computation_Robust::SfM_Data_Structure_Computation_Robust(bool bConsoleVerbose)
@@ -118,56 +193,27 @@ void SfM_Data_Structure_Computation_Robust::triangulate(SfM_Data & sfm_data) con
   robust_triangulation(sfm_data);
 }
 
+void SfM_Data_Structure_Computation_Robust::triangulate(const SfM_Data & sfm_data, Landmarks_CSR & landmarks) const
+{
+  TriangulateStore(landmarks,
+    [&](const IndexT * obs_view, const Vec2 * obs_x, const size_t nb_obs, Vec3 & X)
+    {
+      return robust_triangulation(sfm_data, obs_view, obs_x, nb_obs, X);
+    },
+    _bConsoleVerbose, "Robust triangulation progress:\n");
+}
+
 /// Robust triangulation of track data contained in the structure
 /// All observations must have View with valid Intrinsic and Pose data
 /// Invalid landmark are removed.
 void SfM_Data_Structure_Computation_Robust::robust_triangulation(SfM_Data & sfm_data) const
 {
-  std::deque<IndexT> rejectedId;
-  std::unique_ptr<C_Progress_display> my_progress_bar;
-  if (_bConsoleVerbose)
-    my_progress_bar.reset( new C_Progress_display(
-    sfm_data.structure.size(),
-    std::cout,
-    "Robust triangulation progress:\n" ));
-#ifdef I23DSFM_USE_OPENMP
-  #pragma omp parallel
-#endif
-  for(Landmarks::iterator iterTracks = sfm_data.structure.begin();
-    iterTracks != sfm_data.structure.end();
-    ++iterTracks)
-  {
-#ifdef I23DSFM_USE_OPENMP
-  #pragma omp single nowait
-#endif
+  TriangulateStructure(sfm_data.structure,
+    [&](const IndexT * obs_view, const Vec2 * obs_x, const size_t nb_obs, Vec3 & X)
     {
-      if (_bConsoleVerbose)
-      {
-#ifdef I23DSFM_USE_OPENMP
-  #pragma omp critical
-#endif
-        ++(*my_progress_bar);
-      }
-      Vec3 X;
-      if (robust_triangulation(sfm_data, iterTracks->second.obs, X)) {
-        iterTracks->second.X = X;
-      }
-      else {
-        iterTracks->second.X = Vec3::Zero();
-#ifdef I23DSFM_USE_OPENMP
-  #pragma omp critical
-#endif
-        {
-          rejectedId.push_front(iterTracks->first);
-        }
-      }
-    }
-  }
-  // Erase the unsuccessful triangulated tracks
-  for (auto& it : rejectedId)
-  {
-    sfm_data.structure.erase(it);
-  }
+      return robust_triangulation(sfm_data, obs_view, obs_x, nb_obs, X);
+    },
+    _bConsoleVerbose, "Robust triangulation progress:\n");
 }
 
 /// Robustly try to estimate the best 3D point using a ransac Scheme
@@ -178,10 +224,33 @@ bool SfM_Data_Structure_Computation_Robust::robust_triangulation(
   Vec3 & X,
   const IndexT min_required_inliers,
   const IndexT min_sample_index) const
+{
+  // Random access copy of the observations
+  std::vector<IndexT> obs_view;
+  std::vector<Vec2, Eigen::aligned_allocator<Vec2> > obs_x;
+  obs_view.reserve(obs.size());
+  obs_x.reserve(obs.size());
+  for (Observations::const_iterator itObs = obs.begin(); itObs != obs.end(); ++itObs)
+  {
+    obs_view.push_back(itObs->first);
+    obs_x.push_back(itObs->second.x);
+  }
+  return robust_triangulation(sfm_data, obs_view.data(), obs_x.data(), obs.size(),
+    X, min_required_inliers, min_sample_index);
+}
+
+bool SfM_Data_Structure_Computation_Robust::robust_triangulation(
+  const SfM_Data & sfm_data,
+  const IndexT * obs_view,
+  const Vec2 * obs_x,
+  const size_t nb_obs,
+  Vec3 & X,
+  const IndexT min_required_inliers,
+  const IndexT min_sample_index) const
 {
   const double dThresholdPixel = 4.0; // TODO: make this parameter customizable
 
-  const IndexT nbIter = obs.size(); // TODO: automatic computation of the number of iterations?
+  const IndexT nbIter = nb_obs; // TODO: automatic computation of the number of iterations?
 
   // - Ransac variables
   Vec3 best_model;
@@ -192,11 +261,11 @@ bool SfM_Data_Structure_Computation_Robust::robust_triangulation(
   for (IndexT i = 0; i < nbIter; ++i)
   {
     std::vector<size_t> vec_samples;
-    robust::UniformSample(min_sample_index, obs.size(), &vec_samples);
+    robust::UniformSample(min_sample_index, nb_obs, &vec_samples);
     const std::set<IndexT> samples(vec_samples.begin(), vec_samples.end());
 
     // Hypothesis generation.
-    const Vec3 current_model = track_sample_triangulation(sfm_data, obs, samples);
+    const Vec3 current_model = track_sample_triangulation(sfm_data, obs_view, obs_x, samples);
 
     // Test validity of the hypothesis
     // - chierality (for the samples)
@@ -205,10 +274,7 @@ bool SfM_Data_Structure_Computation_Robust::robust_triangulation(
     // Chierality (Check the point is in front of the sampled cameras)
     bool bChierality = true;
     for (auto& it : samples){
-      Observations::const_iterator itObs = obs.begin();
-      std::advance(itObs, it);
-      const View * view = sfm_data.views.at(itObs->first).get();
-      const IntrinsicBase * cam = sfm_data.GetIntrinsics().at(view->id_intrinsic).get();
+      const View * view = sfm_data.views.at(obs_view[it]).get();
       const Pose3 pose = sfm_data.GetPoseOrDie(view);
       const double z = pose.depth(current_model); // TODO: cam->depth(pose(X));
       bChierality &= z > 0;
@@ -220,17 +286,16 @@ bool SfM_Data_Structure_Computation_Robust::robust_triangulation(
     std::set<IndexT> inlier_set;
     double current_error = 0.0;
     // Classification as inlier/outlier according pixel residual errors.
-    for (Observations::const_iterator itObs = obs.begin();
-        itObs != obs.end(); ++itObs)
+    for (size_t k = 0; k < nb_obs; ++k)
     {
-      const View * view = sfm_data.views.at(itObs->first).get();
+      const View * view = sfm_data.views.at(obs_view[k]).get();
       const IntrinsicBase * intrinsic = sfm_data.GetIntrinsics().at(view->id_intrinsic).get();
       const Pose3 pose = sfm_data.GetPoseOrDie(view);
-      const Vec2 residual = intrinsic->residual(pose, current_model, itObs->second.x);
+      const Vec2 residual = intrinsic->residual(pose, current_model, obs_x[k]);
       const double residual_d = residual.norm();
       if (residual_d < dThresholdPixel)
       {
-        inlier_set.insert(itObs->first);
+        inlier_set.insert(obs_view[k]);
         current_error += residual_d;
       }
       else
@@ -253,21 +318,19 @@ bool SfM_Data_Structure_Computation_Robust::robust_triangulation(
 /// Triangulate a given track from a selection of observations
 Vec3 SfM_Data_Structure_Computation_Robust::track_sample_triangulation(
   const SfM_Data & sfm_data,
-  const Observations & obs,
+  const IndexT * obs_view,
+  const Vec2 * obs_x,
   const std::set<IndexT> & samples) const
 {
   Triangulation trianObj;
   for (auto& it : samples)
   {
-    const IndexT & idx = it;
-    Observations::const_iterator itObs = obs.begin();
-    std::advance(itObs, idx);
-    const View * view = sfm_data.views.at(itObs->first).get();
+    const View * view = sfm_data.views.at(obs_view[it]).get();
     const IntrinsicBase * cam = sfm_data.GetIntrinsics().at(view->id_intrinsic).get();
     const Pose3 pose = sfm_data.GetPoseOrDie(view);
     trianObj.add(
       cam->get_projective_equivalent(pose),
-      cam->get_ud_pixel(itObs->second.x));
+      cam->get_ud_pixel(obs_x[it]));
   }
   return trianObj.compute();
 }
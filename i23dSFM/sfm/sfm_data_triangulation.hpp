@@ -8,6 +8,7 @@
 #define I23DSFM_SFM_DATA_TRIANGULATION_HPP
 
 #include "i23dSFM/sfm/sfm_data.hpp"
+#include "i23dSFM/sfm/sfm_landmarks_csr.hpp"
 
 namespace i23dSFM {
 namespace sfm {
@@ -21,6 +22,10 @@ struct SfM_Data_Structure_Computation_Basis
   SfM_Data_Structure_Computation_Basis(bool bConsoleVerbose = false);
 
   virtual void triangulate(SfM_Data & sfm_data) const = 0;
+
+  /// Triangulate a flat landmark store (sfm_data.structure is not used).
+  /// Invalid landmarks are removed from the store.
+  virtual void triangulate(const SfM_Data & sfm_data, Landmarks_CSR & landmarks) const = 0;
 };
 
 
@@ -33,6 +38,17 @@ struct SfM_Data_Structure_Computation_Blind: public SfM_Data_Structure_Computati
   SfM_Data_Structure_Computation_Blind(bool bConsoleVerbose = false);
 
   virtual void triangulate(SfM_Data & sfm_data) const;
+  virtual void triangulate(const SfM_Data & sfm_data, Landmarks_CSR & landmarks) const;
+
+private:
+  /// Triangulate a track given as flat arrays of nb_obs view ids & observed pixels
+  /// Return true if the point is in front of the cameras
+  bool track_triangulation(
+    const SfM_Data & sfm_data,
+    const IndexT * obs_view,
+    const Vec2 * obs_x,
+    const size_t nb_obs,
+    Vec3 & X) const;
 };
 
 /// Triangulation of track data contained in the structure of a SfM_Data scene.
@@ -44,6 +60,7 @@ struct SfM_Data_Structure_Computation_Robust: public SfM_Data_Structure_Computat
   SfM_Data_Structure_Computation_Robust(bool bConsoleVerbose = false);
 
   virtual void triangulate(SfM_Data & sfm_data) const;
+  virtual void triangulate(const SfM_Data & sfm_data, Landmarks_CSR & landmarks) const;
 
   /// Robust triangulation of track data contained in the structure
   /// All observations must have View with valid Intrinsic and Pose data
@@ -59,11 +76,23 @@ struct SfM_Data_Structure_Computation_Robust: public SfM_Data_Structure_Computat
     const IndexT min_required_inliers = 3,
     const IndexT min_sample_index = 3) const;
 
+  /// Robustly try to estimate the best 3D point of a track given as flat arrays
+  /// of nb_obs view ids & observed pixels (i.e. a Landmarks_CSR range)
+  bool robust_triangulation(
+    const SfM_Data & sfm_data,
+    const IndexT * obs_view,
+    const Vec2 * obs_x,
+    const size_t nb_obs,
+    Vec3 & X,
+    const IndexT min_required_inliers = 3,
+    const IndexT min_sample_index = 3) const;
+
 private:
   /// Triangulate a given track from a selection of observations
   Vec3 track_sample_triangulation(
     const SfM_Data & sfm_data,
-    const Observations & obs,
+    const IndexT * obs_view,
+    const Vec2 * obs_x,
     const std::set<IndexT> & samples) const;
 };
 
@@ -0,0 +1,215 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_SFM_LANDMARKS_CSR_HPP
+#define I23DSFM_SFM_LANDMARKS_CSR_HPP
+
+#include "i23dSFM/sfm/sfm_data.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace i23dSFM {
+namespace sfm {
+
+/// Flat (CSR: compressed sparse row) storage of a scene structure.
+/// All the observations are stored contiguously (structure of arrays) and
+/// the observations of the i-th landmark are in [obs_offsets[i], obs_offsets[i+1]),
+/// sorted by view id. It avoids the per-track node based containers of
+/// Landmarks/Observations for the heavy loops (BA, triangulation, filtering).
+struct Landmarks_CSR
+{
+  //-- Landmarks
+  std::vector<IndexT> landmark_ids;     // track id of each landmark
+  std::vector<Vec3> X;                  // 3D position of each landmark
+  std::vector<int> semantic_labels;     // semantic label of each landmark
+  std::vector<size_t> obs_offsets;      // size: landmark count + 1
+
+  //-- Observations
+  std::vector<IndexT> obs_view;         // view id of each observation
+  std::vector<IndexT> obs_feat;         // feature id of each observation
+  std::vector<Vec2, Eigen::aligned_allocator<Vec2> > obs_x; // observed pixel
+  std::vector<int> obs_semantic_labels; // semantic label of each observation
+
+  Landmarks_CSR() : obs_offsets(1, 0) {}
+
+  explicit Landmarks_CSR(const Landmarks & landmarks)
+  {
+    Build(landmarks);
+  }
+
+  size_t size() const { return landmark_ids.size(); }
+  size_t nb_observations() const { return obs_view.size(); }
+  size_t track_length(size_t i) const { return obs_offsets[i+1] - obs_offsets[i]; }
+
+  /// Fill the flat storage from the landmarks of a SfM_Data scene
+  void Build(const Landmarks & landmarks)
+  {
+    size_t nb_obs = 0;
+    for (Landmarks::const_iterator it = landmarks.begin(); it != landmarks.end(); ++it)
+      nb_obs += it->second.obs.size();
+
+    clear();
+    landmark_ids.reserve(landmarks.size());
+    X.reserve(landmarks.size());
+    semantic_labels.reserve(landmarks.size());
+    obs_offsets.reserve(landmarks.size() + 1);
+    obs_view.reserve(nb_obs);
+    obs_feat.reserve(nb_obs);
+    obs_x.reserve(nb_obs);
+    obs_semantic_labels.reserve(nb_obs);
+
+    std::vector<std::pair<IndexT, const Observation *> > track;
+    for (Landmarks::const_iterator it = landmarks.begin(); it != landmarks.end(); ++it)
+    {
+      landmark_ids.push_back(it->first);
+      X.push_back(it->second.X);
+      semantic_labels.push_back(it->second.semantic_label);
+
+      // Hash_Map may be unordered: sort the observations by view id
+      track.clear();
+      for (Observations::const_iterator itObs = it->second.obs.begin(); itObs != it->second.obs.end(); ++itObs)
+        track.push_back(std::make_pair(itObs->first, &itObs->second));
+      std::sort(track.begin(), track.end());
+      for (size_t i = 0; i < track.size(); ++i)
+      {
+        obs_view.push_back(track[i].first);
+        obs_feat.push_back(track[i].second->id_feat);
+        obs_x.push_back(track[i].second->x);
+        obs_semantic_labels.push_back(track[i].second->semantic_label);
+      }
+      obs_offsets.push_back(obs_view.size());
+    }
+  }
+
+  /// Append a landmark without observation (see AddObservation)
+  void AddLandmark(IndexT landmark_id, const Vec3 & point = Vec3::Zero(), int semantic_label = -1)
+  {
+    landmark_ids.push_back(landmark_id);
+    X.push_back(point);
+    semantic_labels.push_back(semantic_label);
+    obs_offsets.push_back(obs_view.size());
+  }
+
+  /// Append an observation to the last landmark
+  /// (the observations of a landmark must be added by increasing view id)
+  void AddObservation(IndexT id_view, const Observation & observation)
+  {
+    obs_view.push_back(id_view);
+    obs_feat.push_back(observation.id_feat);
+    obs_x.push_back(observation.x);
+    obs_semantic_labels.push_back(observation.semantic_label);
+    obs_offsets.back() = obs_view.size();
+  }
+
+  /// Export the flat storage as SfM_Data landmarks
+  void Export(Landmarks & landmarks) const
+  {
+    landmarks.clear();
+    for (size_t i = 0; i < size(); ++i)
+    {
+      Landmark & landmark = landmarks[landmark_ids[i]];
+      landmark.X = X[i];
+      landmark.semantic_label = semantic_labels[i];
+      for (size_t k = obs_offsets[i]; k < obs_offsets[i+1]; ++k)
+        landmark.obs[obs_view[k]] = Observation(obs_x[k], obs_feat[k], obs_semantic_labels[k]);
+    }
+  }
+
+  /// Copy back the 3D positions to the SfM_Data landmarks it was built from
+  void UpdatePositions(Landmarks & landmarks) const
+  {
+    for (size_t i = 0; i < size(); ++i)
+    {
+      Landmarks::iterator it = landmarks.find(landmark_ids[i]);
+      if (it != landmarks.end())
+        it->second.X = X[i];
+    }
+  }
+
+  /// Index of the observation of view id_view in the i-th landmark (or -1)
+  std::ptrdiff_t FindObservation(size_t i, IndexT id_view) const
+  {
+    const std::vector<IndexT>::const_iterator begin = obs_view.begin() + obs_offsets[i];
+    const std::vector<IndexT>::const_iterator end = obs_view.begin() + obs_offsets[i+1];
+    const std::vector<IndexT>::const_iterator it = std::lower_bound(begin, end, id_view);
+    return (it != end && *it == id_view) ? std::distance(obs_view.begin(), it) : -1;
+  }
+
+  /// Keep only the valid observations (one flag per observation) and the
+  /// landmarks with at least minTrackLength of them.
+  /// Return the number of removed observations.
+  size_t Filter(const std::vector<bool> & valid_obs, size_t minTrackLength = 2)
+  {
+    size_t removed = 0;
+    size_t nb_landmarks = 0, nb_obs = 0;
+    size_t begin = obs_offsets[0]; // offsets are overwritten while compacting
+    for (size_t i = 0; i < size(); ++i)
+    {
+      const size_t first_obs = nb_obs;
+      const size_t end = obs_offsets[i+1];
+      for (size_t k = begin; k < end; ++k)
+      {
+        if (!valid_obs[k])
+        {
+          ++removed;
+          continue;
+        }
+        obs_view[nb_obs] = obs_view[k];
+        obs_feat[nb_obs] = obs_feat[k];
+        obs_x[nb_obs] = obs_x[k];
+        obs_semantic_labels[nb_obs] = obs_semantic_labels[k];
+        ++nb_obs;
+      }
+      begin = end;
+      if (nb_obs == first_obs || nb_obs - first_obs < minTrackLength)
+      {
+        nb_obs = first_obs; // discard the landmark
+        continue;
+      }
+      landmark_ids[nb_landmarks] = landmark_ids[i];
+      X[nb_landmarks] = X[i];
+      semantic_labels[nb_landmarks] = semantic_labels[i];
+      obs_offsets[nb_landmarks+1] = nb_obs;
+      ++nb_landmarks;
+    }
+    landmark_ids.resize(nb_landmarks);
+    X.resize(nb_landmarks);
+    semantic_labels.resize(nb_landmarks);
+    obs_offsets.resize(nb_landmarks + 1);
+    obs_view.resize(nb_obs);
+    obs_feat.resize(nb_obs);
+    obs_x.resize(nb_obs);
+    obs_semantic_labels.resize(nb_obs);
+    return removed;
+  }
+
+  /// Remove the landmarks flagged as invalid (one flag per landmark)
+  void FilterLandmarks(const std::vector<bool> & valid_landmarks)
+  {
+    std::vector<bool> valid_obs(nb_observations());
+    for (size_t i = 0; i < size(); ++i)
+      std::fill(valid_obs.begin() + obs_offsets[i], valid_obs.begin() + obs_offsets[i+1], bool(valid_landmarks[i]));
+    Filter(valid_obs, 1);
+  }
+
+  void clear()
+  {
+    landmark_ids.clear();
+    X.clear();
+    semantic_labels.clear();
+    obs_offsets.assign(1, 0);
+    obs_view.clear();
+    obs_feat.clear();
+    obs_x.clear();
+    obs_semantic_labels.clear();
+  }
+};
+
+} // namespace sfm
+} // namespace i23dSFM
+
+#endif // I23DSFM_SFM_LANDMARKS_CSR_HPP
@@ -0,0 +1,76 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_SYSTEM_BOUNDED_QUEUE_HPP
+#define I23DSFM_SYSTEM_BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace i23dSFM {
+namespace system {
+
+/// Blocking FIFO with a maximal capacity, used to chain the stages of a
+/// producer/consumer pipeline while bounding the amount of data in flight.
+/// Push blocks while the queue is full, Pop blocks while it is empty.
+/// Once Close() is called, Push fails and Pop drains the remaining items.
+template <typename T>
+class Bounded_Queue
+{
+public:
+  explicit Bounded_Queue(size_t capacity)
+    : _capacity(capacity > 0 ? capacity : 1), _bClosed(false) {}
+
+  /// Enqueue an item (return false if the queue is closed)
+  bool Push(T && item)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_full.wait(lock, [this]{ return _bClosed || _queue.size() < _capacity; });
+    if (_bClosed)
+      return false;
+    _queue.push_back(std::move(item));
+    _not_empty.notify_one();
+    return true;
+  }
+
+  /// Dequeue an item (return false if the queue is closed and empty)
+  bool Pop(T & item)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_empty.wait(lock, [this]{ return _bClosed || !_queue.empty(); });
+    if (_queue.empty())
+      return false;
+    item = std::move(_queue.front());
+    _queue.pop_front();
+    _not_full.notify_one();
+    return true;
+  }
+
+  /// Signal that no more item will be pushed
+  void Close()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _bClosed = true;
+    _not_empty.notify_all();
+    _not_full.notify_all();
+  }
+
+  size_t capacity() const { return _capacity; }
+
+private:
+  const size_t _capacity;
+  bool _bClosed;
+  std::deque<T> _queue;
+  std::mutex _mutex;
+  std::condition_variable _not_empty, _not_full;
+};
+
+} // namespace system
+} // namespace i23dSFM
+
+#endif // I23DSFM_SYSTEM_BOUNDED_QUEUE_HPP
@@ -39,6 +39,8 @@ using namespace lemon;
 #include "i23dSFM/matching/indMatch.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <functional>
 #include <vector>
@@ -313,6 +315,495 @@ struct TracksBuilder
   }
 };
 
+/// Tracks stored as a CSR table:
+///  the (view, feature) of the track i are the elements
+///  [obs_offsets[i], obs_offsets[i+1][ of obs_view and obs_feat (sorted by view).
+/// Once the tracks are made semantically consistent, the track i has the
+/// label semantic_labels[i] with the confidence semantic_confidences[i]
+/// (ratio of its labelled observations that agree with this label).
+struct Tracks_CSR
+{
+  std::vector<size_t> obs_offsets = std::vector<size_t>(1, 0);
+  std::vector<IndexT> obs_view;
+  std::vector<IndexT> obs_feat;
+  std::vector<int> semantic_labels;          // empty if the tracks are not labelled
+  std::vector<float> semantic_confidences;
+
+  size_t NbTracks() const { return obs_offsets.size() - 1; }
+  size_t track_length(size_t i) const { return obs_offsets[i+1] - obs_offsets[i]; }
+
+  /// Keep only the tracks flagged as valid (track order is kept)
+  void Filter(const std::vector<bool> & valid_tracks)
+  {
+    size_t nb_tracks = 0, nb_obs = 0;
+    for (size_t i = 0; i < NbTracks(); ++i)
+    {
+      if (!valid_tracks[i])
+        continue;
+      const size_t begin = obs_offsets[i], end = obs_offsets[i+1];
+      for (size_t k = begin; k < end; ++k, ++nb_obs)
+      {
+        obs_view[nb_obs] = obs_view[k];
+        obs_feat[nb_obs] = obs_feat[k];
+      }
+      if (!semantic_labels.empty())
+      {
+        semantic_labels[nb_tracks] = semantic_labels[i];
+        semantic_confidences[nb_tracks] = semantic_confidences[i];
+      }
+      obs_offsets[++nb_tracks] = nb_obs;
+    }
+    obs_offsets.resize(nb_tracks + 1);
+    obs_view.resize(nb_obs);
+    obs_feat.resize(nb_obs);
+    if (!semantic_labels.empty())
+    {
+      semantic_labels.resize(nb_tracks);
+      semantic_confidences.resize(nb_tracks);
+    }
+  }
+
+  void clear()
+  {
+    obs_offsets.assign(1, 0);
+    obs_view.clear();
+    obs_feat.clear();
+    semantic_labels.clear();
+    semantic_confidences.clear();
+  }
+};
+
+/// Handling of the tracks whose observations have different semantic labels
+enum ESemanticTrackMode
+{
+  SEMANTIC_TRACK_NONE,  // tracks are kept as built
+  SEMANTIC_TRACK_SPLIT, // tracks are split in one track per label
+  SEMANTIC_TRACK_VOTE   // tracks keep their majority label observations
+};
+
+/// Tracks builder with a flat union-find forest (same API and same tracks
+/// as TracksBuilder):
+/// - the node of the feature f of the view I is offset[I] + f, where the
+///   offsets are computed from the per view feature count (max matched
+///   feature index + 1), so no feature set and no node lookup are needed,
+/// - the union-find is a flat array of parents with path halving, the unions
+///   are lock-free (compare and swap) and run in parallel over chunks of
+///   matches; the root of a class is always its smallest node,
+/// - the tracks are exported as a CSR table (track order: smallest
+///   (view, feature) of the track, as TracksBuilder), the tracks can be
+///   made semantically consistent before their filtering (SemanticFilter).
+/// Memory is 4 bytes per node during Build, then the CSR table.
+class FlatTracksBuilder
+{
+public:
+  /// Build tracks for a given series of pairWise matches
+  bool Build(const PairWiseMatches & map_pair_wise_matches)
+  {
+    _tracks.clear();
+
+    //-- Per view feature count (largest matched feature index + 1)
+    std::map<IndexT, uint64_t> map_view_featCount;
+    for (PairWiseMatches::const_iterator iter = map_pair_wise_matches.begin();
+      iter != map_pair_wise_matches.end(); ++iter)
+    {
+      IndexT max_i = 0, max_j = 0;
+      for (const IndMatch & match : iter->second)
+      {
+        max_i = std::max(max_i, match._i);
+        max_j = std::max(max_j, match._j);
+      }
+      if (iter->second.empty())
+        continue;
+      uint64_t & count_I = map_view_featCount[iter->first.first];
+      count_I = std::max(count_I, uint64_t(max_i) + 1);
+      uint64_t & count_J = map_view_featCount[iter->first.second];
+      count_J = std::max(count_J, uint64_t(max_j) + 1);
+    }
+
+    //-- Node offsets: node = _view_offsets[slot of the view] + feature
+    _view_ids.clear();
+    _view_offsets.assign(1, 0);
+    for (const auto & view_count : map_view_featCount)
+    {
+      _view_ids.push_back(view_count.first);
+      _view_offsets.push_back(_view_offsets.back() + view_count.second);
+    }
+    const uint64_t nb_nodes = _view_offsets.back();
+    if (nb_nodes >= uint64_t(ROOT_FLAG) - 1)
+    {
+      std::cerr << "FlatTracksBuilder: too many features (" << nb_nodes << ")" << std::endl;
+      return false;
+    }
+
+    //-- Chunks of matches (parallel unions)
+    struct Match_Chunk
+    {
+      const std::vector<IndMatch> * matches;
+      uint32_t offset_I, offset_J;
+      size_t begin, end;
+    };
+    const size_t chunk_size = 1 << 16;
+    std::vector<Match_Chunk> vec_chunks;
+    for (PairWiseMatches::const_iterator iter = map_pair_wise_matches.begin();
+      iter != map_pair_wise_matches.end(); ++iter)
+    {
+      const uint32_t offset_I = static_cast<uint32_t>(_view_offsets[ViewSlot(iter->first.first)]);
+      const uint32_t offset_J = static_cast<uint32_t>(_view_offsets[ViewSlot(iter->first.second)]);
+      for (size_t begin = 0; begin < iter->second.size(); begin += chunk_size)
+      {
+        const Match_Chunk chunk = {&iter->second, offset_I, offset_J,
+          begin, std::min(begin + chunk_size, iter->second.size())};
+        vec_chunks.push_back(chunk);
+      }
+    }
+
+    //-- Union-find forest (unmatched nodes are UNUSED)
+    std::vector< std::atomic<uint32_t> > parents(nb_nodes);
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(nb_nodes); ++i)
+      parents[i].store(UNUSED, std::memory_order_relaxed);
+
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < static_cast<int>(vec_chunks.size()); ++i)
+    {
+      const Match_Chunk & chunk = vec_chunks[i];
+      for (size_t k = chunk.begin; k < chunk.end; ++k)
+      {
+        const IndMatch & match = (*chunk.matches)[k];
+        Union(parents, chunk.offset_I + match._i, chunk.offset_J + match._j);
+      }
+    }
+
+    //-- Point each node to its root
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(nb_nodes); ++i)
+    {
+      if (parents[i].load(std::memory_order_relaxed) != UNUSED)
+        parents[i].store(Find(parents, static_cast<uint32_t>(i)), std::memory_order_relaxed);
+    }
+
+    //-- Number the tracks by increasing root (root = smallest node of the track)
+    //   and count their length: a root node is relabeled as ROOT_FLAG | track id
+    std::vector<size_t> & obs_offsets = _tracks.obs_offsets;
+    for (uint32_t i = 0; i < nb_nodes; ++i)
+    {
+      const uint32_t parent = parents[i].load(std::memory_order_relaxed);
+      if (parent == UNUSED)
+        continue;
+      uint32_t track_id;
+      if (parent == i)
+      {
+        track_id = static_cast<uint32_t>(obs_offsets.size() - 1);
+        obs_offsets.push_back(0);
+      }
+      else
+        track_id = parents[parent].load(std::memory_order_relaxed) & ~ROOT_FLAG;
+      parents[i].store(ROOT_FLAG | track_id, std::memory_order_relaxed);
+      ++obs_offsets[track_id + 1];
+    }
+    for (size_t i = 1; i < obs_offsets.size(); ++i)
+      obs_offsets[i] += obs_offsets[i-1];
+
+    //-- Fill the CSR table (nodes are visited by increasing view)
+    _tracks.obs_view.resize(obs_offsets.back());
+    _tracks.obs_feat.resize(obs_offsets.back());
+    std::vector<size_t> cursors(obs_offsets.begin(), obs_offsets.end() - 1);
+    for (size_t slot = 0; slot < _view_ids.size(); ++slot)
+    {
+      for (uint64_t node = _view_offsets[slot]; node < _view_offsets[slot+1]; ++node)
+      {
+        const uint32_t label = parents[node].load(std::memory_order_relaxed);
+        if (label == UNUSED)
+          continue;
+        const size_t pos = cursors[label & ~ROOT_FLAG]++;
+        _tracks.obs_view[pos] = _view_ids[slot];
+        _tracks.obs_feat[pos] = static_cast<IndexT>(node - _view_offsets[slot]);
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Make the tracks semantically consistent (to call before Filter).
+   *
+   * A negative label stands for an unknown label: such observations agree
+   * with any label and go with the majority label of their track.
+   * - SEMANTIC_TRACK_SPLIT: a track is split at the label boundaries, in one
+   *   track per label (confidence 1),
+   * - SEMANTIC_TRACK_VOTE: the track gets its majority label, the observations
+   *   with another label are removed and the track is removed if its
+   *   confidence is not above min_confidence (i.e. no strict majority for 0.5).
+   * Tracks without labelled observation get the label -1 (confidence 0).
+   *
+   * @param[in] label_of: functor (view, feature) -> semantic label (thread safe)
+   * @param[in] mode: handling of the label conflicts
+   * @param[in] min_confidence: minimal ratio of the majority label (vote only)
+   */
+  template <typename LabelFunctor>
+  void SemanticFilter(
+    const LabelFunctor & label_of,
+    ESemanticTrackMode mode,
+    float min_confidence = 0.5f)
+  {
+    if (mode == SEMANTIC_TRACK_NONE)
+      return;
+
+    //-- Label of the observations and majority label of the tracks
+    const size_t nb_tracks = _tracks.NbTracks();
+    std::vector<int> obs_labels(_tracks.obs_view.size());
+    std::vector<int> majority_labels(nb_tracks, -1);
+    std::vector<float> confidences(nb_tracks, 0.f);
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 1024)
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(nb_tracks); ++i)
+    {
+      const size_t begin = _tracks.obs_offsets[i], end = _tracks.obs_offsets[i+1];
+      std::map<int, size_t> map_label_count;
+      size_t nb_labelled = 0;
+      for (size_t k = begin; k < end; ++k)
+      {
+        obs_labels[k] = label_of(_tracks.obs_view[k], _tracks.obs_feat[k]);
+        if (obs_labels[k] >= 0)
+        {
+          ++map_label_count[obs_labels[k]];
+          ++nb_labelled;
+        }
+      }
+      // Majority label (smallest label on ties)
+      size_t majority_count = 0;
+      for (const auto & label_count : map_label_count)
+      {
+        if (label_count.second > majority_count)
+        {
+          majority_count = label_count.second;
+          majority_labels[i] = label_count.first;
+        }
+      }
+      if (nb_labelled > 0)
+        confidences[i] = static_cast<float>(majority_count) / nb_labelled;
+    }
+
+    //-- Rebuild the CSR table
+    Tracks_CSR tracks;
+    tracks.obs_view.reserve(_tracks.obs_view.size());
+    tracks.obs_feat.reserve(_tracks.obs_feat.size());
+    tracks.semantic_labels.reserve(nb_tracks);
+    tracks.semantic_confidences.reserve(nb_tracks);
+    const auto add_observations = [&](size_t i, int label)
+    {
+      for (size_t k = _tracks.obs_offsets[i]; k < _tracks.obs_offsets[i+1]; ++k)
+      {
+        const bool bUnknown = obs_labels[k] < 0;
+        if (obs_labels[k] == label || (bUnknown && label == majority_labels[i]))
+        {
+          tracks.obs_view.push_back(_tracks.obs_view[k]);
+          tracks.obs_feat.push_back(_tracks.obs_feat[k]);
+        }
+      }
+      tracks.obs_offsets.push_back(tracks.obs_view.size());
+    };
+    std::vector<int> track_labels;
+    for (size_t i = 0; i < nb_tracks; ++i)
+    {
+      const size_t begin = _tracks.obs_offsets[i], end = _tracks.obs_offsets[i+1];
+      if (majority_labels[i] < 0 || confidences[i] == 1.f)
+      {
+        // Consistent track
+        add_observations(i, majority_labels[i]);
+        tracks.semantic_labels.push_back(majority_labels[i]);
+        tracks.semantic_confidences.push_back(confidences[i]);
+      }
+      else if (mode == SEMANTIC_TRACK_SPLIT)
+      {
+        // One track per label (in the order of their first observation)
+        track_labels.clear();
+        for (size_t k = begin; k < end; ++k)
+        {
+          if (obs_labels[k] >= 0 &&
+            std::find(track_labels.begin(), track_labels.end(), obs_labels[k]) == track_labels.end())
+            track_labels.push_back(obs_labels[k]);
+        }
+        for (const int label : track_labels)
+        {
+          add_observations(i, label);
+          tracks.semantic_labels.push_back(label);
+          tracks.semantic_confidences.push_back(1.f);
+        }
+      }
+      else if (confidences[i] > min_confidence)
+      {
+        add_observations(i, majority_labels[i]);
+        tracks.semantic_labels.push_back(majority_labels[i]);
+        tracks.semantic_confidences.push_back(confidences[i]);
+      }
+    }
+    std::swap(_tracks, tracks);
+  }
+
+  /// Remove bad tracks (too short or track with ids collision)
+  bool Filter(size_t nLengthSupTo = 2, bool bMultithread = true)
+  {
+    // (std::vector<bool> does not support concurrent writes)
+    std::vector<unsigned char> valid(_tracks.NbTracks());
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(static) if(bMultithread)
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(valid.size()); ++i)
+    {
+      // Elements are sorted by view: a conflict is two consecutive equal views
+      const size_t begin = _tracks.obs_offsets[i], end = _tracks.obs_offsets[i+1];
+      bool bValid = (end - begin) >= nLengthSupTo;
+      for (size_t k = begin + 1; bValid && k < end; ++k)
+        bValid = _tracks.obs_view[k] != _tracks.obs_view[k-1];
+      valid[i] = bValid;
+    }
+    _tracks.Filter(std::vector<bool>(valid.begin(), valid.end()));
+    return false;
+  }
+
+  /// Remove the tracks lying on a pair of views (or a view) observed by too few tracks.
+  bool FilterPairWiseMinimumMatches(size_t minMatchesOccurences, bool bMultithread = true)
+  {
+    // View pair of a track (slots of the views, I <= J)
+    const auto pair_key = [this](IndexT I, IndexT J) -> uint64_t
+    {
+      return (uint64_t(ViewSlot(I)) << 32) | uint64_t(ViewSlot(J));
+    };
+
+    //-- Count the tracks per view pair
+    std::vector<uint64_t> vec_keys;
+    for (size_t i = 0; i < _tracks.NbTracks(); ++i)
+    {
+      const size_t begin = _tracks.obs_offsets[i], end = _tracks.obs_offsets[i+1];
+      for (size_t k = begin; k < end; ++k)
+        for (size_t l = k; l < end; ++l)
+          vec_keys.push_back(pair_key(_tracks.obs_view[k], _tracks.obs_view[l]));
+    }
+    std::sort(vec_keys.begin(), vec_keys.end());
+    std::vector<uint64_t> vec_weakPairs;
+    for (size_t k = 0; k < vec_keys.size(); )
+    {
+      size_t l = k;
+      while (l < vec_keys.size() && vec_keys[l] == vec_keys[k])
+        ++l;
+      if (l - k < minMatchesOccurences)
+        vec_weakPairs.push_back(vec_keys[k]);
+      k = l;
+    }
+    if (vec_weakPairs.empty())
+      return false;
+
+    //-- Remove the tracks lying on a weak pair
+    std::vector<unsigned char> valid(_tracks.NbTracks());
+#ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 1024) if(bMultithread)
+#endif
+    for (int64_t i = 0; i < static_cast<int64_t>(valid.size()); ++i)
+    {
+      const size_t begin = _tracks.obs_offsets[i], end = _tracks.obs_offsets[i+1];
+      bool bValid = true;
+      for (size_t k = begin; bValid && k < end; ++k)
+        for (size_t l = k; bValid && l < end; ++l)
+          bValid = !std::binary_search(vec_weakPairs.begin(), vec_weakPairs.end(),
+            pair_key(_tracks.obs_view[k], _tracks.obs_view[l]));
+      valid[i] = bValid;
+    }
+    _tracks.Filter(std::vector<bool>(valid.begin(), valid.end()));
+    return false;
+  }
+
+  bool ExportToStream(std::ostream & os) const
+  {
+    for (size_t i = 0; i < _tracks.NbTracks(); ++i)
+    {
+      os << "Class: " << i << std::endl
+        << "\t" << "track length: " << _tracks.track_length(i) << std::endl;
+      for (size_t k = _tracks.obs_offsets[i]; k < _tracks.obs_offsets[i+1]; ++k)
+        os << _tracks.obs_view[k] << "  " << _tracks.obs_feat[k] << std::endl;
+    }
+    return os.good();
+  }
+
+  /// Return the number of tracks
+  size_t NbTracks() const { return _tracks.NbTracks(); }
+
+  /// Tracks as a CSR table
+  const Tracks_CSR & GetTracks() const { return _tracks; }
+
+  /// Export tracks as a map (each entry is a sequence of imageId and featureIndex):
+  ///  {TrackIndex => {(imageIndex, featureIndex), ... ,(imageIndex, featureIndex)}
+  void ExportToSTL(STLMAPTracks & map_tracks) const
+  {
+    map_tracks.clear();
+    for (size_t i = 0; i < _tracks.NbTracks(); ++i)
+    {
+      submapTrack & track = map_tracks.insert(map_tracks.end(),
+        std::make_pair(i, submapTrack()))->second;
+      for (size_t k = _tracks.obs_offsets[i]; k < _tracks.obs_offsets[i+1]; ++k)
+        track.insert(track.end(), std::make_pair(size_t(_tracks.obs_view[k]), size_t(_tracks.obs_feat[k])));
+    }
+  }
+
+private:
+  static const uint32_t ROOT_FLAG = 0x80000000u;
+  static const uint32_t UNUSED = 0xFFFFFFFFu;
+
+  size_t ViewSlot(IndexT view) const
+  {
+    return std::distance(_view_ids.begin(),
+      std::lower_bound(_view_ids.begin(), _view_ids.end(), view));
+  }
+
+  /// Root of a node (path halving). Parents are always smaller than their
+  /// children, so any ancestor read concurrently is a valid shortcut.
+  static uint32_t Find(std::vector< std::atomic<uint32_t> > & parents, uint32_t x)
+  {
+    while (true)
+    {
+      uint32_t parent = parents[x].load();
+      if (parent == x)
+        return x;
+      const uint32_t grand_parent = parents[parent].load();
+      if (grand_parent != parent)
+        parents[x].compare_exchange_weak(parent, grand_parent);
+      x = grand_parent;
+    }
+  }
+
+  /// Lock-free union: the larger root is linked to the smaller one
+  static void Union(std::vector< std::atomic<uint32_t> > & parents, uint32_t a, uint32_t b)
+  {
+    // Insert the nodes in the forest at their first use
+    uint32_t expected = UNUSED;
+    parents[a].compare_exchange_strong(expected, a);
+    expected = UNUSED;
+    parents[b].compare_exchange_strong(expected, b);
+    while (true)
+    {
+      a = Find(parents, a);
+      b = Find(parents, b);
+      if (a == b)
+        return;
+      if (a < b)
+        std::swap(a, b);
+      expected = a;
+      if (parents[a].compare_exchange_strong(expected, b))
+        return;
+    }
+  }
+
+  std::vector<IndexT> _view_ids;          // sorted ids of the matched views
+  std::vector<uint64_t> _view_offsets;    // first node of each view
+  Tracks_CSR _tracks;
+};
+
 struct TracksUtilsMap
 {
   /**
@@ -471,6 +962,156 @@ struct TracksUtilsMap
   }
 };
 
+/// Incremental view <-> track index used by the incremental SfM.
+/// For each view: the (sorted) list of the tracks it observes,
+/// for each track: a "reconstructed" flag,
+/// and per view the number of reconstructed tracks it observes,
+/// kept up to date when a track is flagged/unflagged as reconstructed.
+/// The 2D-3D candidate search is then O(#tracks in the view) instead of
+/// a scan of all the tracks.
+class TracksViewIndex
+{
+public:
+  /// (track id, feature id in the view)
+  typedef std::pair<size_t, size_t> TrackFeature;
+
+  /// Build the index from the tracks (no track is reconstructed)
+  void Init(const STLMAPTracks & map_tracks)
+  {
+    _track_ids.clear();
+    _track_offsets.assign(1, 0);
+    _track_views.clear();
+    _map_view_tracks.clear();
+    _map_view_reconstructed.clear();
+
+    _track_ids.reserve(map_tracks.size());
+    for (STLMAPTracks::const_iterator iterT = map_tracks.begin();
+      iterT != map_tracks.end(); ++iterT)
+    {
+      _track_ids.push_back(iterT->first);
+      for (submapTrack::const_iterator iter = iterT->second.begin();
+        iter != iterT->second.end(); ++iter)
+      {
+        _track_views.push_back(iter->first);
+        // tracks are visited by increasing id: the view lists are sorted
+        _map_view_tracks[iter->first].push_back(TrackFeature(iterT->first, iter->second));
+        _map_view_reconstructed[iter->first] = 0;
+      }
+      _track_offsets.push_back(_track_views.size());
+    }
+    _reconstructed.assign(_track_ids.size(), false);
+    _bContiguous = _track_ids.empty() || _track_ids.back() == _track_ids.size() - 1;
+  }
+
+  /// Tracks observed by a view, sorted by track id
+  const std::vector<TrackFeature> & TracksInView(size_t view) const
+  {
+    static const std::vector<TrackFeature> empty;
+    const std::map<size_t, std::vector<TrackFeature> >::const_iterator iter =
+      _map_view_tracks.find(view);
+    return (iter != _map_view_tracks.end()) ? iter->second : empty;
+  }
+
+  /// Number of the reconstructed tracks observed by a view
+  size_t ReconstructedCount(size_t view) const
+  {
+    const std::map<size_t, size_t>::const_iterator iter = _map_view_reconstructed.find(view);
+    return (iter != _map_view_reconstructed.end()) ? iter->second : 0;
+  }
+
+  /// Reconstructed tracks observed by a view, sorted by track id
+  void ReconstructedTracksInView(size_t view, std::vector<TrackFeature> & tracks) const
+  {
+    tracks.clear();
+    const std::vector<TrackFeature> & view_tracks = TracksInView(view);
+    tracks.reserve(ReconstructedCount(view));
+    for (size_t i = 0; i < view_tracks.size(); ++i)
+      if (IsReconstructed(view_tracks[i].first))
+        tracks.push_back(view_tracks[i]);
+  }
+
+  /// Tracks observed by the two views: (track id, feature id in I, feature id in J)
+  void CommonTracks(size_t I, size_t J,
+    std::vector<std::pair<size_t, std::pair<size_t, size_t> > > & tracks) const
+  {
+    tracks.clear();
+    const std::vector<TrackFeature> & tracks_I = TracksInView(I);
+    const std::vector<TrackFeature> & tracks_J = TracksInView(J);
+    std::vector<TrackFeature>::const_iterator iterI = tracks_I.begin(), iterJ = tracks_J.begin();
+    while (iterI != tracks_I.end() && iterJ != tracks_J.end())
+    {
+      if (iterI->first < iterJ->first)
+        ++iterI;
+      else if (iterJ->first < iterI->first)
+        ++iterJ;
+      else
+      {
+        tracks.push_back(std::make_pair(iterI->first, std::make_pair(iterI->second, iterJ->second)));
+        ++iterI;
+        ++iterJ;
+      }
+    }
+  }
+
+  bool IsReconstructed(size_t track_id) const
+  {
+    const size_t slot = Slot(track_id);
+    return slot != size_t(-1) && _reconstructed[slot];
+  }
+
+  /// Flag a track as reconstructed or not (update the view counters)
+  void SetReconstructed(size_t track_id, bool bReconstructed = true)
+  {
+    const size_t slot = Slot(track_id);
+    if (slot == size_t(-1) || _reconstructed[slot] == bReconstructed)
+      return;
+    _reconstructed[slot] = bReconstructed;
+    for (size_t k = _track_offsets[slot]; k < _track_offsets[slot+1]; ++k)
+    {
+      size_t & count = _map_view_reconstructed[_track_views[k]];
+      count = bReconstructed ? count + 1 : count - 1;
+    }
+  }
+
+  /// Flag as reconstructed exactly the tracks whose id is a key of the given
+  /// (sorted) associative container, i.e. the SfM_Data landmarks.
+  /// Used after filtering steps that remove landmarks.
+  template <typename MapT>
+  void Synchronize(const MapT & map_reconstructed)
+  {
+    typename MapT::const_iterator iter = map_reconstructed.begin();
+    for (size_t slot = 0; slot < _track_ids.size(); ++slot)
+    {
+      while (iter != map_reconstructed.end() && iter->first < _track_ids[slot])
+        ++iter;
+      const bool bReconstructed =
+        (iter != map_reconstructed.end() && iter->first == _track_ids[slot]);
+      if (_reconstructed[slot] != bReconstructed)
+        SetReconstructed(_track_ids[slot], bReconstructed);
+    }
+  }
+
+private:
+  /// Position of a track in the index (size_t(-1) if unknown)
+  size_t Slot(size_t track_id) const
+  {
+    if (_bContiguous)
+      return track_id < _track_ids.size() ? track_id : size_t(-1);
+    const std::vector<size_t>::const_iterator iter =
+      std::lower_bound(_track_ids.begin(), _track_ids.end(), track_id);
+    return (iter != _track_ids.end() && *iter == track_id) ?
+      std::distance(_track_ids.begin(), iter) : size_t(-1);
+  }
+
+  std::vector<size_t> _track_ids;      // sorted track ids
+  std::vector<size_t> _track_offsets;  // views of the track i: [_track_offsets[i], _track_offsets[i+1][
+  std::vector<size_t> _track_views;
+  std::vector<bool> _reconstructed;
+  bool _bContiguous = true;            // track ids are [0, #tracks[
+  std::map<size_t, std::vector<TrackFeature> > _map_view_tracks;
+  std::map<size_t, size_t> _map_view_reconstructed;
+};
+
 } // namespace tracks
 } // namespace i23dSFM
 
@@ -10,9 +10,12 @@
 
 #include "i23dSFM/tracks/tracks.hpp"
 #include "i23dSFM/matching/indMatch.hpp"
+using namespace i23dSFM;
 using namespace i23dSFM::tracks;
 using namespace i23dSFM::matching;
 
+#include <cstdlib>
+#include <set>
 #include <vector>
 #include <utility>
 
@@ -171,6 +174,211 @@ TEST(Tracks, Conflict) {
   }
 }
 
+// Build filtered tracks with a given builder
+template <typename BuilderT>
+static void BuildTracks(
+  const PairWiseMatches & map_pairwisematches,
+  size_t nLengthSupTo,
+  size_t minPairWiseMatches,
+  STLMAPTracks & map_tracks)
+{
+  BuilderT trackBuilder;
+  trackBuilder.Build(map_pairwisematches);
+  trackBuilder.Filter(nLengthSupTo);
+  if (minPairWiseMatches > 0)
+    trackBuilder.FilterPairWiseMinimumMatches(minPairWiseMatches);
+  trackBuilder.ExportToSTL(map_tracks);
+}
+
+static bool SameTracks(
+  const PairWiseMatches & map_pairwisematches,
+  size_t nLengthSupTo,
+  size_t minPairWiseMatches = 0)
+{
+  STLMAPTracks map_tracks, map_flatTracks;
+  BuildTracks<TracksBuilder>(map_pairwisematches, nLengthSupTo, minPairWiseMatches, map_tracks);
+  BuildTracks<FlatTracksBuilder>(map_pairwisematches, nLengthSupTo, minPairWiseMatches, map_flatTracks);
+  // Same tracks (the track ids of TracksBuilder follow its class order)
+  std::set<submapTrack> set_tracks, set_flatTracks;
+  for (const auto & track : map_tracks)
+    set_tracks.insert(track.second);
+  for (const auto & track : map_flatTracks)
+    set_flatTracks.insert(track.second);
+  return map_tracks.size() == map_flatTracks.size() && set_tracks == set_flatTracks;
+}
+
+TEST(FlatTracks, SameAsTracksBuilder) {
+
+  // Simple, conflict and filter_3viewAtLeast configurations
+  PairWiseMatches map_pairwisematches;
+  map_pairwisematches[std::make_pair(0,1)] = {IndMatch(0,0), IndMatch(1,1), IndMatch(2,3)};
+  map_pairwisematches[std::make_pair(1,2)] = {IndMatch(0,0), IndMatch(1,6)};
+  CHECK(SameTracks(map_pairwisematches, 2));
+  CHECK(SameTracks(map_pairwisematches, 3));
+
+  map_pairwisematches[std::make_pair(2,0)] = {IndMatch(0,0), IndMatch(6,2)};
+  CHECK(SameTracks(map_pairwisematches, 2));
+  CHECK(SameTracks(map_pairwisematches, 3));
+
+  // Random matches between 10 views: 1000 points observed by a random
+  //  feature in each view, matched with a probability of 1/4, and outliers
+  srand(0);
+  map_pairwisematches.clear();
+  for (int I = 0; I < 10; ++I)
+    for (int J = I + 1; J < 10; ++J)
+    {
+      std::vector<IndMatch> & matches = map_pairwisematches[std::make_pair(I,J)];
+      for (int k = 0; k < 1000; ++k)
+      {
+        if (rand() % 4 == 0)
+          matches.push_back(IndMatch((k * 7 + I) % 1000, (k * 7 + J) % 1000));
+      }
+      for (int k = 0; k < 20; ++k)
+        matches.push_back(IndMatch(rand() % 1000, rand() % 1000));
+    }
+  CHECK(SameTracks(map_pairwisematches, 2));
+  CHECK(SameTracks(map_pairwisematches, 2, 20));
+  CHECK(SameTracks(map_pairwisematches, 3, 30));
+}
+
+TEST(FlatTracks, CSR) {
+
+  /*
+  A    B    C
+  0 -> 0 -> 0
+  1 -> 1 -> 6
+  2 -> 3
+  */
+  PairWiseMatches map_pairwisematches;
+  map_pairwisematches[std::make_pair(5,7)] = {IndMatch(0,0), IndMatch(1,1), IndMatch(2,3)};
+  map_pairwisematches[std::make_pair(7,9)] = {IndMatch(0,0), IndMatch(1,6)};
+
+  FlatTracksBuilder trackBuilder;
+  EXPECT_TRUE(trackBuilder.Build(map_pairwisematches));
+  const Tracks_CSR & tracks = trackBuilder.GetTracks();
+  CHECK_EQUAL(3, tracks.NbTracks());
+  const size_t GT_offsets[] = {0, 3, 6, 8};
+  const IndexT GT_views[] = {5, 7, 9, 5, 7, 9, 5, 7};
+  const IndexT GT_feats[] = {0, 0, 0, 1, 1, 6, 2, 3};
+  CHECK(tracks.obs_offsets == std::vector<size_t>(GT_offsets, GT_offsets + 4));
+  CHECK(tracks.obs_view == std::vector<IndexT>(GT_views, GT_views + 8));
+  CHECK(tracks.obs_feat == std::vector<IndexT>(GT_feats, GT_feats + 8));
+
+  // Keep the tracks of length 3
+  trackBuilder.Filter(3);
+  CHECK_EQUAL(2, trackBuilder.NbTracks());
+  CHECK_EQUAL(3, tracks.track_length(1));
+  CHECK_EQUAL(6, tracks.obs_feat[5]);
+}
+
+TEST(FlatTracks, SemanticFilter) {
+
+  /*
+  A    B    C    D
+  0 -> 0 -> 0 -> 0   labels: 1 1 2 -1 (conflict)
+  1 -> 1 -> 1        labels: 3 3 3    (consistent)
+  2 -> 2             labels: 1 2      (no majority)
+  */
+  PairWiseMatches map_pairwisematches;
+  map_pairwisematches[std::make_pair(0,1)] = {IndMatch(0,0), IndMatch(1,1), IndMatch(2,2)};
+  map_pairwisematches[std::make_pair(1,2)] = {IndMatch(0,0), IndMatch(1,1)};
+  map_pairwisematches[std::make_pair(2,3)] = {IndMatch(0,0)};
+  std::map<std::pair<IndexT,IndexT>, int> map_labels;
+  map_labels[std::make_pair(0,0)] = 1; map_labels[std::make_pair(1,0)] = 1;
+  map_labels[std::make_pair(2,0)] = 2; map_labels[std::make_pair(3,0)] = -1;
+  map_labels[std::make_pair(0,1)] = 3; map_labels[std::make_pair(1,1)] = 3;
+  map_labels[std::make_pair(2,1)] = 3;
+  map_labels[std::make_pair(0,2)] = 1; map_labels[std::make_pair(1,2)] = 2;
+  const auto label_of = [&map_labels](IndexT view, IndexT feat)
+  {
+    return map_labels.at(std::make_pair(view, feat));
+  };
+
+  {
+    // Majority vote: the label 2 feature of the first track is removed,
+    //  the last track has no majority
+    FlatTracksBuilder trackBuilder;
+    trackBuilder.Build(map_pairwisematches);
+    trackBuilder.SemanticFilter(label_of, SEMANTIC_TRACK_VOTE);
+    trackBuilder.Filter();
+    const Tracks_CSR & tracks = trackBuilder.GetTracks();
+    CHECK_EQUAL(2, tracks.NbTracks());
+    CHECK_EQUAL(3, tracks.track_length(0));
+    CHECK_EQUAL(3, tracks.obs_view[2]); // unknown label feature is kept
+    CHECK_EQUAL(1, tracks.semantic_labels[0]);
+    EXPECT_NEAR(2.0/3.0, tracks.semantic_confidences[0], 1e-6);
+    CHECK_EQUAL(3, tracks.semantic_labels[1]);
+    EXPECT_NEAR(1.0, tracks.semantic_confidences[1], 1e-6);
+  }
+  {
+    // Split: one track per label, the single feature tracks are filtered
+    FlatTracksBuilder trackBuilder;
+    trackBuilder.Build(map_pairwisematches);
+    trackBuilder.SemanticFilter(label_of, SEMANTIC_TRACK_SPLIT);
+    CHECK_EQUAL(5, trackBuilder.NbTracks());
+    trackBuilder.Filter();
+    const Tracks_CSR & tracks = trackBuilder.GetTracks();
+    CHECK_EQUAL(2, tracks.NbTracks());
+    CHECK_EQUAL(1, tracks.semantic_labels[0]);
+    CHECK_EQUAL(3, tracks.semantic_labels[1]);
+    const IndexT GT_views[] = {0, 1, 3, 0, 1, 2};
+    CHECK(tracks.obs_view == std::vector<IndexT>(GT_views, GT_views + 6));
+
+    STLMAPTracks map_tracks;
+    trackBuilder.ExportToSTL(map_tracks);
+    CHECK_EQUAL(2, map_tracks.size());
+    CHECK_EQUAL(3, map_tracks[1].size());
+  }
+}
+
+TEST(TracksViewIndex, Reconstructed) {
+
+  // 0, {(A,0) (B,0) (C,0)}
+  // 1, {(A,1) (B,1)}
+  // 2, {(B,3) (C,6)}
+  STLMAPTracks map_tracks;
+  map_tracks[0][0] = 0; map_tracks[0][1] = 0; map_tracks[0][2] = 0;
+  map_tracks[1][0] = 1; map_tracks[1][1] = 1;
+  map_tracks[2][1] = 3; map_tracks[2][2] = 6;
+
+  TracksViewIndex index;
+  index.Init(map_tracks);
+
+  CHECK_EQUAL(2, index.TracksInView(0).size());
+  CHECK_EQUAL(3, index.TracksInView(1).size());
+  CHECK_EQUAL(0, index.TracksInView(3).size());
+  CHECK_EQUAL(0, index.ReconstructedCount(1));
+
+  // Common tracks of B and C: tracks 0 and 2 with their features
+  std::vector<std::pair<size_t, std::pair<size_t, size_t> > > common;
+  index.CommonTracks(1, 2, common);
+  CHECK_EQUAL(2, common.size());
+  CHECK(common[1] == std::make_pair(size_t(2), std::make_pair(size_t(3), size_t(6))));
+
+  index.SetReconstructed(0);
+  index.SetReconstructed(2);
+  index.SetReconstructed(2); // no double count
+  CHECK_EQUAL(1, index.ReconstructedCount(0));
+  CHECK_EQUAL(2, index.ReconstructedCount(1));
+  CHECK_EQUAL(2, index.ReconstructedCount(2));
+
+  std::vector<TracksViewIndex::TrackFeature> tracks;
+  index.ReconstructedTracksInView(1, tracks);
+  CHECK_EQUAL(2, tracks.size());
+  CHECK(tracks[1] == std::make_pair(size_t(2), size_t(3)));
+
+  // Track 0 is rejected, track 1 is reconstructed
+  std::map<size_t, int> landmarks;
+  landmarks[1] = 0;
+  landmarks[2] = 0;
+  index.Synchronize(landmarks);
+  CHECK(!index.IsReconstructed(0));
+  CHECK(index.IsReconstructed(1));
+  CHECK_EQUAL(1, index.ReconstructedCount(0));
+  CHECK_EQUAL(2, index.ReconstructedCount(1));
+  CHECK_EQUAL(1, index.ReconstructedCount(2));
+}
+
 /* ************************************************************************* */
 int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
 /* ************************************************************************* */
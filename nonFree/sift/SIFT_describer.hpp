@@ -10,6 +10,7 @@
 #include <cereal/cereal.hpp>
 #include <iostream>
 #include <numeric>
+#include <vector>
 
 extern "C" {
 #include "nonFree/sift/vl/sift.h"
@@ -38,6 +39,15 @@ inline void siftDescToUChar(
     descriptor[k] = static_cast<unsigned char>(512.f*descr[k]);
 }
 
+/// Initialize the VLFeat global state once per process.
+/// vl_constructor/vl_destructor are not reentrant: calling them for every
+/// Describe would race when several images are described concurrently.
+inline void vl_init_once()
+{
+  static const bool bInitialized = (vl_constructor(), true);
+  (void)bInitialized;
+}
+
 struct SiftParams
 {
   SiftParams(
@@ -120,7 +130,7 @@ public:
     const image::Image<float> If(image.GetMat().cast<float>());
 
     // Configure VLFeat
-    vl_constructor();
+    vl_init_once();
 
     VlSiftFilt *filt = vl_sift_new(w, h,
       _params._num_octaves, _params._num_scales, _params._first_octave);
@@ -129,9 +139,6 @@ public:
     if (_params._peak_threshold >= 0)
       vl_sift_set_peak_thresh(filt, 255*_params._peak_threshold/_params._num_scales);
 
-    Descriptor<vl_sift_pix, 128> descr;
-    Descriptor<unsigned char, 128> descriptor;
-
     // Process SIFT computation
     vl_sift_process_first_octave(filt, If.data());
 
@@ -152,48 +159,13 @@ public:
       // Update gradient before launching parallel extraction
       vl_sift_update_gradient(filt);
 
-      #ifdef I23DSFM_USE_OPENMP
-      #pragma omp parallel for private(descr, descriptor)
-      #endif
-      for (int i = 0; i < nkeys; ++i) {
-
-        // Feature masking
-        if (mask)
-        {
-          const image::Image<unsigned char> & maskIma = *mask;
-          if (maskIma(keys[i].y, keys[i].x) == 0)
-            continue;
-        }
-
-        double angles [4] = {0.0, 0.0, 0.0, 0.0};
-        int nangles = 1; // by default (1 upright feature)
-        if (_bOrientation)
-        { // compute from 1 to 4 orientations
-          nangles = vl_sift_calc_keypoint_orientations(filt, angles, keys+i);
-        }
-
-        for (int q=0 ; q < nangles ; ++q) {
-          vl_sift_calc_keypoint_descriptor(filt, &descr[0], keys+i, angles[q]);
-          const SIOPointFeature fp(keys[i].x, keys[i].y,
-            keys[i].sigma, static_cast<float>(angles[q]));
-
-          siftDescToUChar(&descr[0], descriptor, _params._root_sift);
-          #ifdef I23DSFM_USE_OPENMP
-          #pragma omp critical
-          #endif
-          {
-            regionsCasted->Descriptors().push_back(descriptor);
-            regionsCasted->Features().push_back(fp);
-          }
-        }
-      }
+      Describe_octave(filt, keys, nkeys, mask, NULL, regionsCasted);
+
       if (vl_sift_process_next_octave(filt))
         break; // Last octave
     }
     vl_sift_delete(filt);
 
-    vl_destructor();
-
     return true;
   };
 
@@ -219,7 +191,7 @@ public:
     const image::Image<int> sif(semantic_image.GetMat().cast<int>());
 
     // Configure VLFeat
-    vl_constructor();
+    vl_init_once();
 
     VlSiftFilt *filt = vl_sift_new(w, h,
       _params._num_octaves, _params._num_scales, _params._first_octave);
@@ -228,9 +200,6 @@ public:
     if (_params._peak_threshold >= 0)
       vl_sift_set_peak_thresh(filt, 255*_params._peak_threshold/_params._num_scales);
 
-    Descriptor<vl_sift_pix, 128> descr;
-    Descriptor<unsigned char, 128> descriptor;
-
     // Process SIFT computation
     vl_sift_process_first_octave(filt, If.data());
 
@@ -251,50 +220,13 @@ public:
       // Update gradient before launching parallel extraction
       vl_sift_update_gradient(filt);
 
-      #ifdef I23DSFM_USE_OPENMP
-      #pragma omp parallel for private(descr, descriptor)
-      #endif
-      for (int i = 0; i < nkeys; ++i) {
-
-        // Feature masking
-        if (mask)
-        {
-          const image::Image<unsigned char> & maskIma = *mask;
-          if (maskIma(keys[i].y, keys[i].x) == 0)
-            continue;
-        }
-
-        double angles [4] = {0.0, 0.0, 0.0, 0.0};
-        int nangles = 1; // by default (1 upright feature)
-        if (_bOrientation)
-        { // compute from 1 to 4 orientations
-          nangles = vl_sift_calc_keypoint_orientations(filt, angles, keys+i);
-        }
-
-        for (int q=0 ; q < nangles ; ++q) {
-          vl_sift_calc_keypoint_descriptor(filt, &descr[0], keys+i, angles[q]);
-          // const SIOPointFeature fp(keys[i].x, keys[i].y, keys[i].sigma, static_cast<float>(angles[q]));
-          // cout << keys[i].x << ", " << keys[i].y << endl << endl;
-          // cout << semantic_image(keys[i].y, keys[i].x) << endl;
-          const SIOPointFeature fp(keys[i].x, keys[i].y, semantic_image(keys[i].y, keys[i].x), keys[i].sigma, static_cast<float>(angles[q]));          
-
-          siftDescToUChar(&descr[0], descriptor, _params._root_sift);
-          #ifdef I23DSFM_USE_OPENMP
-          #pragma omp critical
-          #endif
-          {
-            regionsCasted->Descriptors().push_back(descriptor);
-            regionsCasted->Features().push_back(fp);
-          }
-        }
-      }
+      Describe_octave(filt, keys, nkeys, mask, &semantic_image, regionsCasted);
+
       if (vl_sift_process_next_octave(filt))
         break; // Last octave
     }
     vl_sift_delete(filt);
 
-    vl_destructor();
-
     return true;
   };
 
@@ -314,6 +246,76 @@ public:
   }
 
 private:
+
+  /**
+  @brief Compute the regions of the keypoints detected on the current octave.
+  The keypoint orientations are computed first, then a prefix sum gives the
+  position of each region so that the descriptors are written in place
+  (no lock, same keypoint order whatever the number of threads).
+  @param semantic_image Semantic image used to label the features (optional).
+  */
+  void Describe_octave(VlSiftFilt * filt,
+    VlSiftKeypoint const * keys,
+    const int nkeys,
+    const image::Image<unsigned char> * mask,
+    const image::Image<unsigned char> * semantic_image,
+    SIFT_Regions * regionsCasted) const
+  {
+    // 1. Orientations of each keypoint (0 if the keypoint is masked)
+    std::vector<double> angles(4 * nkeys, 0.0);
+    std::vector<int> nangles(nkeys, 0);
+    #ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 64)
+    #endif
+    for (int i = 0; i < nkeys; ++i) {
+
+      // Feature masking
+      if (mask)
+      {
+        const image::Image<unsigned char> & maskIma = *mask;
+        if (maskIma(keys[i].y, keys[i].x) == 0)
+          continue;
+      }
+
+      nangles[i] = 1; // by default (1 upright feature)
+      if (_bOrientation)
+      { // compute from 1 to 4 orientations
+        nangles[i] = vl_sift_calc_keypoint_orientations(filt, &angles[4*i], keys+i);
+      }
+    }
+
+    // 2. Offset of the regions of each keypoint
+    std::vector<size_t> offsets(nkeys + 1);
+    offsets[0] = regionsCasted->Features().size();
+    for (int i = 0; i < nkeys; ++i)
+      offsets[i+1] = offsets[i] + nangles[i];
+    regionsCasted->Features().resize(offsets[nkeys]);
+    regionsCasted->Descriptors().resize(offsets[nkeys]);
+
+    // 3. Descriptors, written at their final position
+    #ifdef I23DSFM_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic, 64)
+    #endif
+    for (int i = 0; i < nkeys; ++i) {
+      // Label of the keypoint pixel (-1 if outside of the semantic image)
+      int semantic_label = -1;
+      if (semantic_image)
+      {
+        const int x = static_cast<int>(keys[i].x), y = static_cast<int>(keys[i].y);
+        if (x >= 0 && y >= 0 && x < semantic_image->Width() && y < semantic_image->Height())
+          semantic_label = static_cast<int>((*semantic_image)(y, x));
+      }
+      Descriptor<vl_sift_pix, 128> descr;
+      for (int q = 0; q < nangles[i]; ++q) {
+        const double angle = angles[4*i+q];
+        vl_sift_calc_keypoint_descriptor(filt, &descr[0], keys+i, angle);
+        regionsCasted->Features()[offsets[i]+q] = SIOPointFeature(keys[i].x, keys[i].y,
+          semantic_label, keys[i].sigma, static_cast<float>(angle));
+        siftDescToUChar(&descr[0], regionsCasted->Descriptors()[offsets[i]+q], _params._root_sift);
+      }
+    }
+  }
+
   SiftParams _params;
   bool _bOrientation;
 };
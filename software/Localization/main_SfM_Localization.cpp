@@ -11,6 +11,7 @@
 #include <i23dSFM/image/image.hpp>
 
 #include <i23dSFM/system/timer.hpp>
+#include <i23dSFM/system/bounded_queue.hpp>
 
 using namespace i23dSFM;
 using namespace i23dSFM::sfm;
@@ -19,6 +20,12 @@ using namespace i23dSFM::sfm;
 #include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
 
 #include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#ifdef I23DSFM_USE_OPENMP
+#include <omp.h>
+#endif
 
 // ---------------------------------------------------------------------------
 // Image localization API sample:
@@ -27,8 +34,75 @@ using namespace i23dSFM::sfm;
 //   if 3D-2D matches are found
 // - A demonstration mode (default):
 //   - try to locate all the view of the SfM_Data reconstruction
+// - A service mode (query list):
+//   - localize concurrently a stream of images (a list file or stdin) and
+//     write the poses as soon as they are found
+// The retrieval database can be saved and reloaded (no regions loading and
+// no matching structure building at startup).
 // ---------------------------------------------------------------------------
-//
+
+/// Localize a query image and refine its pose
+/// (the intrinsic is initialized from the found projection matrix)
+static bool LocalizeQueryImage
+(
+  const sfm::SfM_Localization_Single_3DTrackObservation_Database & localizer,
+  features::Image_describer & image_describer,
+  const std::string & sQueryImage,
+  const double dMaxResidualError,
+  const robust::ACRANSAC_Options & robust_options,
+  geometry::Pose3 & pose,
+  std::shared_ptr<cameras::IntrinsicBase> & intrinsic
+)
+{
+  using namespace i23dSFM::features;
+  std::unique_ptr<Regions> query_regions;
+  image::Image<unsigned char> imageGray;
+  {
+    if (!image::ReadImage(sQueryImage.c_str(), &imageGray))
+    {
+      std::cerr << "Cannot open the input provided image: " << sQueryImage << std::endl;
+      return false;
+    }
+    // Compute features and descriptors
+    image_describer.Describe(imageGray, query_regions);
+  }
+
+  sfm::Image_Localizer_Match_Data matching_data;
+  matching_data.error_max = dMaxResidualError;
+  matching_data.robust_options = robust_options;
+
+  // Try to localize the image in the database thanks to its regions
+  // (suppose intrinsic as unknown)
+  if (!localizer.Localize(
+    Pair(imageGray.Width(), imageGray.Height()),
+    nullptr,
+    *(query_regions.get()),
+    pose,
+    &matching_data))
+  {
+    return false;
+  }
+
+  // A valid pose has been found (try to refine it):
+  //  init a new intrinsic from the projection matrix decomposition
+  Mat3 K, R;
+  Vec3 t;
+  KRt_From_P(matching_data.projection_matrix, &K, &R, &t);
+
+  const double focal = (K(0,0) + K(1,1))/2.0;
+  const Vec2 principal_point(K(0,2), K(1,2));
+  intrinsic = std::make_shared<cameras::Pinhole_Intrinsic_Radial_K3>(
+    imageGray.Width(), imageGray.Height(),
+    focal, principal_point(0), principal_point(1));
+  sfm::SfM_Localizer::RefinePose
+  (
+    intrinsic.get(),
+    pose, matching_data,
+    true, true
+  );
+  return true;
+}
+
 int main(int argc, char **argv)
 {
   using namespace std;
@@ -44,13 +118,23 @@ int main(int argc, char **argv)
   std::string sMatchesDir;
   std::string sOutDir = "";
   std::string sQueryImage;
+  std::string sQueryList;
+  std::string sDatabaseDir;
   double dMaxResidualError = std::numeric_limits<double>::infinity();
+  int iNumThreads = 0;
+  double dRansacConfidence = 0.0;
+  bool bSPRT = false;
 
   cmd.add( make_option('i', sSfM_Data_Filename, "input_file") );
   cmd.add( make_option('m', sMatchesDir, "match_dir") );
   cmd.add( make_option('o', sOutDir, "out_dir") );
   cmd.add( make_option('q', sQueryImage, "query_image"));
   cmd.add( make_option('r', dMaxResidualError, "residual_error"));
+  cmd.add( make_option('l', sQueryList, "query_list"));
+  cmd.add( make_option('d', sDatabaseDir, "database_dir"));
+  cmd.add( make_option('n', iNumThreads, "numThreads"));
+  cmd.add( make_option('c', dRansacConfidence, "ransac_confidence"));
+  cmd.add( make_option('s', bSPRT, "sprt"));
 
   try {
     if (argc == 1) throw std::string("Invalid parameter.");
@@ -63,12 +147,29 @@ int main(int argc, char **argv)
     << "(optional)\n"
     << "[-q|--query_image] path to the image that must be localized\n"
     << "[-r|--residual_error] upper bound of the residual error tolerance\n"
+    << "[-l|--query_list] file listing the images to localize (one per line, '-': stdin)\n"
+    << "  the images are localized concurrently and their poses are written\n"
+    << "  to out_dir/localized_poses.txt as soon as they are found\n"
+    << "[-d|--database_dir] directory of the saved retrieval database\n"
+    << "  (loaded if it is valid, else built from the regions and saved)\n"
+    << "[-n|--numThreads] number of concurrent localizations (query list mode)\n"
+    << "[-c|--ransac_confidence] stop the robust resection once a better pose is\n"
+    << "  found with a probability lower than 1-confidence (i.e. 0.99),\n"
+    << "  0: run all the iterations (default)\n"
+    << "[-s|--sprt] 1: reject the bad resection models early (SPRT), 0: no (default)\n"
     << std::endl;
 
     std::cerr << s << std::endl;
     return EXIT_FAILURE;
   }
 
+  if (dRansacConfidence < 0.0 || dRansacConfidence >= 1.0)
+  {
+    std::cerr << "Invalid RANSAC confidence: " << dRansacConfidence << std::endl;
+    return EXIT_FAILURE;
+  }
+  const robust::ACRANSAC_Options robust_options(dRansacConfidence, bSPRT);
+
   // Load input SfM_Data scene
   SfM_Data sfm_data;
   if (!Load(sfm_data, sSfM_Data_Filename, ESfM_Data(ALL))) {
@@ -127,13 +228,6 @@ int main(int argc, char **argv)
     return EXIT_FAILURE;
   }
 
-  // Load the SfM_Data region's views
-  std::shared_ptr<Regions_Provider> regions_provider = std::make_shared<Regions_Provider>();
-  if (!regions_provider->load(sfm_data, sMatchesDir, regions_type)) {
-    std::cerr << std::endl << "Invalid regions." << std::endl;
-    return EXIT_FAILURE;
-  }
-
   if (sOutDir.empty())  {
     std::cerr << "\nIt is an invalid output directory" << std::endl;
     return EXIT_FAILURE;
@@ -153,75 +247,126 @@ int main(int argc, char **argv)
   std::vector<Vec3> vec_found_poses;
 
   sfm::SfM_Localization_Single_3DTrackObservation_Database localizer;
-  if (!localizer.Init(sfm_data, *regions_provider.get()))
+  if (sDatabaseDir.empty() || !localizer.Load(sfm_data, *regions_type, sDatabaseDir))
   {
-    std::cerr << "Cannot initialize the SfM localizer" << std::endl;
+    // Load the SfM_Data region's views
+    std::shared_ptr<Regions_Provider> regions_provider = std::make_shared<Regions_Provider>();
+    if (!regions_provider->load(sfm_data, sMatchesDir, regions_type)) {
+      std::cerr << std::endl << "Invalid regions." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (!localizer.Init(sfm_data, *regions_provider.get()))
+    {
+      std::cerr << "Cannot initialize the SfM localizer" << std::endl;
+    }
+    // Since we have copied interesting data, release some memory
+    regions_provider.reset();
+
+    // Save the database for the next sessions
+    if (!sDatabaseDir.empty() && localizer.Save(sDatabaseDir))
+      std::cout << "Retrieval database saved to: " << sDatabaseDir << std::endl;
   }
-  // Since we have copied interesting data, release some memory
-  regions_provider.reset();
 
   if (!sQueryImage.empty())
   {
     std::cout << "SfM::localization => try with image: " << sQueryImage << std::endl;
-    std::unique_ptr<Regions> query_regions;
-    image::Image<unsigned char> imageGray;
+
+    geometry::Pose3 pose;
+    std::shared_ptr<cameras::IntrinsicBase> intrinsic;
+    if (!LocalizeQueryImage(localizer, *image_describer, sQueryImage, dMaxResidualError, robust_options, pose, intrinsic))
     {
-      if (!image::ReadImage(sQueryImage.c_str(), &imageGray))
+      std::cerr << "Cannot locate the image" << std::endl;
+      return EXIT_FAILURE;
+    }
+    vec_found_poses.push_back(pose.center());
+  }
+  else if (!sQueryList.empty())
+  {
+    // Service mode: the query images are read as a stream and localized by
+    // concurrent workers (the database is shared in read only mode)
+    std::ifstream query_list_file;
+    if (sQueryList != "-")
+    {
+      query_list_file.open(sQueryList.c_str());
+      if (!query_list_file.is_open())
       {
-        std::cerr << "Cannot open the input provided image" << std::endl;
+        std::cerr << "Cannot open the query list: " << sQueryList << std::endl;
         return EXIT_FAILURE;
       }
-      // Compute features and descriptors
-      image_describer->Describe(imageGray, query_regions);
-      std::cout << "#regions detected in query image: " << query_regions->RegionCount() << std::endl;
     }
+    std::istream & query_stream = (sQueryList == "-") ? std::cin : query_list_file;
 
-    // Suppose intrinsic as unkown
-    std::shared_ptr<cameras::IntrinsicBase> optional_intrinsic (nullptr);
-
-    geometry::Pose3 pose;
-    sfm::Image_Localizer_Match_Data matching_data;
-    matching_data.error_max = dMaxResidualError;
-
-    // Try to localize the image in the database thanks to its regions
-    if (!localizer.Localize(
-      Pair(imageGray.Width(), imageGray.Height()),
-      optional_intrinsic.get(),
-      *(query_regions.get()),
-      pose,
-      &matching_data))
+    // One line per query: image_path 1 R(row major) C, or image_path 0 if not found
+    const std::string sPosesFile = stlplus::create_filespec(sOutDir, "localized_poses", "txt");
+    std::ofstream poses_file(sPosesFile.c_str());
+    if (!poses_file.is_open())
     {
-      std::cerr << "Cannot locate the image" << std::endl;
+      std::cerr << "Cannot create the output pose file: " << sPosesFile << std::endl;
+      return EXIT_FAILURE;
     }
-    else
+    poses_file.precision(16);
+
+    const int nb_workers = iNumThreads > 0 ? iNumThreads :
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    std::cout << "Localize the query images with " << nb_workers << " worker(s)" << std::endl;
+
+    i23dSFM::system::Bounded_Queue<std::string> query_queue(2 * nb_workers);
+    std::mutex result_mutex;
+    size_t nb_queries = 0;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < nb_workers; ++i)
     {
-      const bool b_new_intrinsic = (optional_intrinsic == nullptr);
-      // A valid pose has been found (try to refine it):
-      // If not intrinsic as input:
-      //  init a new one from the projection matrix decomposition
-      // Else use the existing one and consider as static.
-      if (b_new_intrinsic)
+      workers.emplace_back([&]()
       {
-        // setup a default camera model from the found projection matrix
-        Mat3 K, R;
-        Vec3 t;
-        KRt_From_P(matching_data.projection_matrix, &K, &R, &t);
-
-        const double focal = (K(0,0) + K(1,1))/2.0;
-        const Vec2 principal_point(K(0,2), K(1,2));
-        optional_intrinsic = std::make_shared<cameras::Pinhole_Intrinsic_Radial_K3>(
-          imageGray.Width(), imageGray.Height(),
-          focal, principal_point(0), principal_point(1));
-      }
-      sfm::SfM_Localizer::RefinePose
-      (
-        optional_intrinsic.get(),
-        pose, matching_data,
-        true, b_new_intrinsic
-      );
+#ifdef I23DSFM_USE_OPENMP
+        // Do not oversubscribe the cores with the matching parallelism
+        omp_set_num_threads(std::max(1, omp_get_max_threads() / nb_workers));
+#endif
+        std::string sImage;
+        while (query_queue.Pop(sImage))
+        {
+          geometry::Pose3 pose;
+          std::shared_ptr<cameras::IntrinsicBase> intrinsic;
+          const bool bLocalized =
+            LocalizeQueryImage(localizer, *image_describer, sImage, dMaxResidualError, robust_options, pose, intrinsic);
+
+          std::lock_guard<std::mutex> lock(result_mutex);
+          poses_file << sImage << ' ' << (bLocalized ? 1 : 0);
+          if (bLocalized)
+          {
+            const Mat3 & R = pose.rotation();
+            for (int r = 0; r < 3; ++r)
+              for (int c = 0; c < 3; ++c)
+                poses_file << ' ' << R(r, c);
+            poses_file << ' ' << pose.center().transpose();
+            vec_found_poses.push_back(pose.center());
+          }
+          poses_file << std::endl; // flush: the pose is available as soon as it is found
+        }
+      });
+    }
 
-      vec_found_poses.push_back(pose.center());
+    std::string sLine;
+    while (std::getline(query_stream, sLine))
+    {
+      // Trim the line (allow Windows line endings and blank lines)
+      const size_t first = sLine.find_first_not_of(" \t\r");
+      if (first == std::string::npos)
+        continue;
+      const size_t last = sLine.find_last_not_of(" \t\r");
+      query_queue.Push(sLine.substr(first, last - first + 1));
+      ++nb_queries;
     }
+    query_queue.Close();
+    for (size_t i = 0; i < workers.size(); ++i)
+      workers[i].join();
+
+    std::cout
+      << "\n#images found: " << vec_found_poses.size()
+      << "\n#query images: " << nb_queries
+      << "\nPoses written to: " << sPosesFile
+      << std::endl;
   }
   else
   {
@@ -330,5 +475,5 @@ int main(int argc, char **argv)
     }
   }
 
-  return EXIT_FAILURE;
+  return EXIT_SUCCESS;
 }
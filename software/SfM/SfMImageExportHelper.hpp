@@ -0,0 +1,285 @@
+// Copyright (c) 2015 i23dSFM authors.
+
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef I23DSFM_SFM_IMAGE_EXPORT_HELPER_HPP
+#define I23DSFM_SFM_IMAGE_EXPORT_HELPER_HPP
+
+#include "i23dSFM/types.hpp"
+#include "i23dSFM/cameras/cameras.hpp"
+#include "i23dSFM/image/image.hpp"
+#include "i23dSFM/system/bounded_queue.hpp"
+
+#include "third_party/progress/progress.hpp"
+#include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef I23DSFM_USE_OPENMP
+#include <omp.h>
+#endif
+
+namespace i23dSFM{
+namespace SfMImageExport{
+
+/// An image to export: the source image, undistorted by cam (if it has some
+/// distortion), is saved to sDstImage (the format is given by its extension).
+struct Image_Export_Job
+{
+  IndexT id_view;
+  IndexT id_intrinsic;
+  const cameras::IntrinsicBase * cam; // NULL: no undistortion
+  std::string sSrcImage;
+  std::string sDstImage;
+  bool bCopy; // the source file can be copied as is (no decode/encode)
+
+  Image_Export_Job() :
+    id_view(UndefinedIndexT), id_intrinsic(UndefinedIndexT), cam(NULL), bCopy(false) {}
+};
+
+/// Case insensitive extension comparison
+inline bool SameExtension(const std::string & sFileA, const std::string & sFileB)
+{
+  std::string extA = stlplus::extension_part(sFileA), extB = stlplus::extension_part(sFileB);
+  std::transform(extA.begin(), extA.end(), extA.begin(), ::tolower);
+  std::transform(extB.begin(), extB.end(), extB.begin(), ::tolower);
+  if (extA == "jpeg") extA = "jpg";
+  if (extB == "jpeg") extB = "jpg";
+  return extA == extB;
+}
+
+/// Setup the export of an image with its camera
+/// (the file is copied if there is no distortion and the formats match).
+inline Image_Export_Job MakeImageExportJob
+(
+  const IndexT id_view,
+  const IndexT id_intrinsic,
+  const cameras::IntrinsicBase * cam,
+  const std::string & sSrcImage,
+  const std::string & sDstImage
+)
+{
+  Image_Export_Job job;
+  job.id_view = id_view;
+  job.id_intrinsic = id_intrinsic;
+  job.cam = cam;
+  job.sSrcImage = sSrcImage;
+  job.sDstImage = sDstImage;
+  job.bCopy = (cam == NULL || !cam->have_disto()) && SameExtension(sSrcImage, sDstImage);
+  return job;
+}
+
+/// Export pipeline parameters (0: automatic value)
+struct Image_Export_Options
+{
+  int _nb_decoders;      // image decoding threads
+  int _nb_undistorters;  // image undistortion threads
+  int _nb_encoders;      // image encoding threads
+  int _nb_max_in_flight; // max number of images alive in the pipeline
+  int _jpeg_quality;     // quality of the JPEG outputs
+
+  Image_Export_Options
+  (
+    int nb_decoders = 0,
+    int nb_undistorters = 0,
+    int nb_encoders = 0,
+    int nb_max_in_flight = 0,
+    int jpeg_quality = 90
+  )
+  : _nb_decoders(nb_decoders), _nb_undistorters(nb_undistorters),
+    _nb_encoders(nb_encoders), _nb_max_in_flight(nb_max_in_flight),
+    _jpeg_quality(jpeg_quality)
+  {}
+};
+
+/// Optional processing of each exported (undistorted) image, called from the
+/// encoding threads once the image is saved (i.e. thumbnail generation).
+typedef std::function<bool(const Image_Export_Job &, const image::Image<image::RGBColor> &)>
+  Image_Export_Callback;
+
+/// Export a set of images with a pipeline of concurrent stages:
+/// - decoder threads read the source images (or copy the files),
+/// - undistorter threads remap the images (one map per intrinsic, shared),
+/// - encoder threads save the images.
+/// The image decoding/encoding is mostly single threaded, so the speed-up
+/// comes from processing several images at once. At most _nb_max_in_flight
+/// images are alive at any time, bounding the memory footprint.
+/// Return false if an image cannot be read or written.
+inline bool ExportImages
+(
+  const std::vector<Image_Export_Job> & jobs,
+  const Image_Export_Options & options = Image_Export_Options(),
+  const Image_Export_Callback & callback = Image_Export_Callback(),
+  C_Progress * progress_bar = NULL
+)
+{
+  using namespace i23dSFM::image;
+  using i23dSFM::system::Bounded_Queue;
+
+  const int nb_hardware_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int nb_decoders = options._nb_decoders > 0 ? options._nb_decoders : nb_hardware_threads;
+  const int nb_undistorters = options._nb_undistorters > 0 ? options._nb_undistorters
+    : std::max(1, nb_hardware_threads / 2);
+  const int nb_encoders = options._nb_encoders > 0 ? options._nb_encoders : nb_hardware_threads;
+  const int nb_max_in_flight = std::max(options._nb_max_in_flight > 0 ? options._nb_max_in_flight
+    : 2 * nb_hardware_threads, std::max(nb_decoders, nb_encoders));
+
+  struct Export_Image
+  {
+    size_t job_index;
+    Image<RGBColor> image;
+  };
+
+  std::atomic<bool> bOk(true);
+  std::mutex log_mutex;
+  auto progress = [&]()
+  {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (progress_bar)
+      ++(*progress_bar);
+  };
+  auto error = [&](const std::string & sMessage, const std::string & sFile)
+  {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cerr << sMessage << sFile << std::endl;
+    bOk = false;
+  };
+
+  cameras::Undistortion_Map_Cache undistortion_maps; // one map per intrinsic
+  Bounded_Queue<std::unique_ptr<Export_Image> > decoded_queue(nb_max_in_flight);
+  Bounded_Queue<std::unique_ptr<Export_Image> > undistorted_queue(nb_max_in_flight);
+  // One token per image in flight: taken before decoding, released once saved
+  Bounded_Queue<char> in_flight(nb_max_in_flight);
+  const auto release = [&]()
+  {
+    char token;
+    in_flight.Pop(token);
+    progress();
+  };
+
+  // Decoding stage
+  std::atomic<size_t> next_job(0);
+  std::atomic<int> nb_running_decoders(nb_decoders);
+  std::vector<std::thread> decoder_threads;
+  for (int i = 0; i < nb_decoders; ++i)
+  {
+    decoder_threads.emplace_back([&]()
+    {
+      for (size_t job_index = next_job++; job_index < jobs.size(); job_index = next_job++)
+      {
+        const Image_Export_Job & job = jobs[job_index];
+        in_flight.Push(char(0));
+        if (job.bCopy)
+        {
+          if (!stlplus::file_copy(job.sSrcImage, job.sDstImage))
+            error("Cannot copy the image: ", job.sSrcImage);
+          if (!callback)
+          {
+            release();
+            continue;
+          }
+        }
+        std::unique_ptr<Export_Image> export_image(new Export_Image);
+        export_image->job_index = job_index;
+        if (!ReadImage(job.sSrcImage.c_str(), &export_image->image))
+        {
+          error("Cannot read the image: ", job.sSrcImage);
+          release();
+          continue;
+        }
+        decoded_queue.Push(std::move(export_image));
+      }
+      if (--nb_running_decoders == 0)
+        decoded_queue.Close();
+    });
+  }
+
+  // Undistortion stage
+  const int nb_omp_threads_per_undistorter =
+#ifdef I23DSFM_USE_OPENMP
+    std::max(1, omp_get_max_threads() / nb_undistorters);
+#else
+    1;
+#endif
+  std::atomic<int> nb_running_undistorters(nb_undistorters);
+  std::vector<std::thread> undistorter_threads;
+  for (int i = 0; i < nb_undistorters; ++i)
+  {
+    undistorter_threads.emplace_back([&]()
+    {
+#ifdef I23DSFM_USE_OPENMP
+      // Do not oversubscribe the cores with the pixel level parallelism
+      omp_set_num_threads(nb_omp_threads_per_undistorter);
+#endif
+      std::unique_ptr<Export_Image> export_image;
+      while (decoded_queue.Pop(export_image))
+      {
+        const Image_Export_Job & job = jobs[export_image->job_index];
+        if (!job.bCopy && job.cam && job.cam->have_disto())
+        {
+          const std::shared_ptr<const cameras::Undistortion_Map> undistortion_map =
+            undistortion_maps.Acquire(job.id_intrinsic, job.cam,
+              export_image->image.Width(), export_image->image.Height());
+          Image<RGBColor> image_ud;
+          cameras::UndistortImage(export_image->image, *undistortion_map, image_ud, BLACK);
+          export_image->image.swap(image_ud);
+        }
+        undistorted_queue.Push(std::move(export_image));
+      }
+      if (--nb_running_undistorters == 0)
+        undistorted_queue.Close();
+    });
+  }
+
+  // Encoding stage
+  std::vector<std::thread> encoder_threads;
+  for (int i = 0; i < nb_encoders; ++i)
+  {
+    encoder_threads.emplace_back([&]()
+    {
+      std::unique_ptr<Export_Image> export_image;
+      while (undistorted_queue.Pop(export_image))
+      {
+        const Image_Export_Job & job = jobs[export_image->job_index];
+        if (!job.bCopy)
+        {
+          const bool bJpg = SameExtension(job.sDstImage, "image.jpg");
+          const int res = bJpg ?
+            WriteJpg(job.sDstImage.c_str(), export_image->image, options._jpeg_quality) :
+            WriteImage(job.sDstImage.c_str(), export_image->image);
+          if (!res)
+            error("Cannot write the image: ", job.sDstImage);
+        }
+        if (callback && !callback(job, export_image->image))
+          error("Cannot process the exported image: ", job.sDstImage);
+        export_image.reset(); // release the image as soon as possible
+        release();
+      }
+    });
+  }
+
+  for (size_t i = 0; i < decoder_threads.size(); ++i)
+    decoder_threads[i].join();
+  for (size_t i = 0; i < undistorter_threads.size(); ++i)
+    undistorter_threads[i].join();
+  for (size_t i = 0; i < encoder_threads.size(); ++i)
+    encoder_threads[i].join();
+
+  return bOk;
+}
+
+} // namespace SfMImageExport
+} // namespace i23dSFM
+
+#endif // I23DSFM_SFM_IMAGE_EXPORT_HELPER_HPP
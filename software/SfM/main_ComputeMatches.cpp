@@ -8,11 +8,14 @@
 #include "i23dSFM/matching_image_collection/Matcher_Regions_AllInMemory.hpp"
 #include "i23dSFM/matching_image_collection/Cascade_Hashing_Matcher_Regions_AllInMemory.hpp"
 #include "i23dSFM/matching_image_collection/GeometricFilter.hpp"
+#include "i23dSFM/matching_image_collection/Vocabulary_Tree.hpp"
+#include "i23dSFM/matching_image_collection/Semantic_Pair_Filter.hpp"
 #include "i23dSFM/matching_image_collection/F_ACRobust.hpp"
 #include "i23dSFM/matching_image_collection/E_ACRobust.hpp"
 #include "i23dSFM/matching_image_collection/H_ACRobust.hpp"
 #include "i23dSFM/matching/pairwiseAdjacencyDisplay.hpp"
 #include "i23dSFM/matching/indMatch_utils.hpp"
+#include "i23dSFM/matching/semantic_label_compatibility.hpp"
 #include "i23dSFM/system/timer.hpp"
 #include "third_party/gms/gms_matcher.h"
 #include "i23dSFM/graph/graph.hpp"
@@ -23,6 +26,8 @@
 
 #include <cstdlib>
 #include <fstream>
+#include <memory>
+#include <mutex>
 
 using namespace i23dSFM;
 using namespace i23dSFM::cameras;
@@ -43,10 +48,236 @@ enum EGeometricModel {
 enum EPairMode {
     PAIR_EXHAUSTIVE = 0,
     PAIR_CONTIGUOUS = 1,
-    PAIR_FROM_FILE = 2
+    PAIR_FROM_FILE = 2,
+    PAIR_VOCABULARY_TREE = 3
 };
 
 
+/// Options of the per pair filtering stage
+struct Pair_Filtering_Options
+{
+    bool _bSemanticGate;            // discard the matches with incompatible semantic labels
+    bool _bGMS;                     // grid motion statistics filtering before the robust estimation
+    bool _bGuided_matching;         // use the found model to improve the pairwise correspondences
+    double _dGuided_distance_ratio; // guided matching distance ratio (-1: geometry only)
+    bool _bCheck_overlap;           // discard the pairs with a poor inlier count/ratio
+
+    Pair_Filtering_Options()
+        : _bSemanticGate(true), _bGMS(true), _bGuided_matching(false),
+          _dGuided_distance_ratio(0.6), _bCheck_overlap(false) {}
+};
+
+/// Matches of a pair after each filtering step
+struct Filtered_Pair
+{
+    Pair pair;
+    IndMatches putative_matches;  // semantically compatible putative matches
+    IndMatches geometric_matches; // geometric inliers
+    bool bGeometric;              // true if a geometric model has been found
+};
+
+/// Export the filtered pairs to the matches files in the putative pair order
+/// (the output does not depend on the thread scheduling).
+/// A result is kept in memory only until all the previous pairs are written.
+class Ordered_Matches_Writer
+{
+public:
+    Ordered_Matches_Writer(
+        size_t nb_pairs,
+        const SfM_Data & sfm_data,
+        const Features_Provider & feats_provider,
+        const std::string & sPutativeFilename,
+        const std::string & sGeometricFilename,
+        const std::string & sPointsFilename)
+        : _sfm_data(sfm_data), _feats_provider(feats_provider),
+          _putative_stream(sPutativeFilename.c_str()),
+          _geometric_stream(sGeometricFilename.c_str()),
+          _points_stream(sPointsFilename.c_str()),
+          _pending(nb_pairs), _next(0) {}
+
+    bool IsOpen() const {
+        return _putative_stream.is_open() && _geometric_stream.is_open() && _points_stream.is_open();
+    }
+
+    /// Store the result of the index-th pair and write all the results that are ready (thread safe)
+    void Push(size_t index, std::unique_ptr<Filtered_Pair> result) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending[index] = std::move(result);
+        while (_next < _pending.size() && _pending[_next]) {
+            Write(*_pending[_next]);
+            _pending[_next].reset();
+            ++_next;
+        }
+    }
+
+    // The pairs that have putative/geometric matches
+    Pair_Set putative_pairs, geometric_pairs;
+
+private:
+    static void WriteMatches(std::ostream & os, const Pair & pair, const IndMatches & matches) {
+        os << pair.first << " " << pair.second << '\n' << matches.size() << '\n';
+        std::copy(matches.begin(), matches.end(), std::ostream_iterator<IndMatch>(os, "\n"));
+    }
+
+    void Write(const Filtered_Pair & result) {
+        WriteMatches(_putative_stream, result.pair, result.putative_matches);
+        if (!result.putative_matches.empty())
+            putative_pairs.insert(result.pair);
+        if (!result.bGeometric)
+            return;
+        WriteMatches(_geometric_stream, result.pair, result.geometric_matches);
+        if (!result.geometric_matches.empty())
+            geometric_pairs.insert(result.pair);
+
+        // Export the coordinates of the geometric matches
+        const View * view_i = _sfm_data.GetViews().at(result.pair.first).get();
+        const View * view_j = _sfm_data.GetViews().at(result.pair.second).get();
+        _points_stream << view_i->ui_width << "-" << view_i->ui_height << '\n'
+                       << view_j->ui_width << "-" << view_j->ui_height << '\n';
+        const features::PointFeatures & landmarks_i = _feats_provider.getFeatures(result.pair.first);
+        const features::PointFeatures & landmarks_j = _feats_provider.getFeatures(result.pair.second);
+        for (const IndMatch & match : result.geometric_matches) {
+            const Vec2f & point_i = landmarks_i[match._i].coords();
+            const Vec2f & point_j = landmarks_j[match._j].coords();
+            _points_stream << "[" << point_i(0) << "," << point_i(1) << "]" << "-"
+                           << "[" << point_j(0) << "," << point_j(1) << "]" << '\n';
+        }
+    }
+
+    const SfM_Data & _sfm_data;
+    const Features_Provider & _feats_provider;
+    std::ofstream _putative_stream, _geometric_stream, _points_stream;
+    std::vector<std::unique_ptr<Filtered_Pair> > _pending;
+    size_t _next;
+    std::mutex _mutex;
+};
+
+/// Filter the putative matches of every pair in a single pass:
+/// semantic gate -> GMS -> AContrario robust model estimation,
+/// and stream the results to the writer.
+template<typename GeometryFunctor>
+void Filter_pairs(
+    const GeometryFunctor & functor,
+    const Pair_Filtering_Options & options,
+    const PairWiseMatches & putative_matches,
+    const SfM_Data & sfm_data,
+    const std::shared_ptr<Regions_Provider> & regions_provider,
+    const Features_Provider & feats_provider,
+    const SemanticLabelCompatibility & semantic_compatibility,
+    Ordered_Matches_Writer & writer)
+{
+    // Random access to the pairs
+    std::vector<PairWiseMatches::const_iterator> vec_pairs;
+    vec_pairs.reserve(putative_matches.size());
+    for (PairWiseMatches::const_iterator iter = putative_matches.begin(); iter != putative_matches.end(); ++iter)
+        vec_pairs.push_back(iter);
+
+    // The GMS keypoints of each view are built once and shared by all its pairs
+    std::map<IndexT, std::vector<KeyPoint> > gms_keypoints;
+    if (options._bGMS) {
+        for (const PairWiseMatches::const_iterator & iter : vec_pairs) {
+            gms_keypoints[iter->first.first];
+            gms_keypoints[iter->first.second];
+        }
+        std::vector<std::map<IndexT, std::vector<KeyPoint> >::iterator> vec_views;
+        for (auto iter = gms_keypoints.begin(); iter != gms_keypoints.end(); ++iter)
+            vec_views.push_back(iter);
+#ifdef I23DSFM_USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int i = 0; i < static_cast<int>(vec_views.size()); ++i) {
+            const features::PointFeatures & features = feats_provider.getFeatures(vec_views[i]->first);
+            std::vector<KeyPoint> & keypoints = vec_views[i]->second;
+            keypoints.reserve(features.size());
+            for (const features::PointFeature & feature : features)
+                keypoints.emplace_back(Point2f(feature.x(), feature.y()), 20);
+        }
+    }
+
+    C_Progress_display my_progress_bar(vec_pairs.size());
+#ifdef I23DSFM_USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int pi = 0; pi < static_cast<int>(vec_pairs.size()); ++pi) {
+        const Pair pair = vec_pairs[pi]->first;
+        const IndMatches & matches = vec_pairs[pi]->second;
+
+        std::unique_ptr<Filtered_Pair> result(new Filtered_Pair);
+        result->pair = pair;
+        result->bGeometric = false;
+
+        //-- Semantic gate
+        if (options._bSemanticGate) {
+            const features::PointFeatures & landmarks_i = feats_provider.getFeatures(pair.first);
+            const features::PointFeatures & landmarks_j = feats_provider.getFeatures(pair.second);
+            result->putative_matches.reserve(matches.size());
+            for (const IndMatch & match : matches) {
+                if (semantic_compatibility.IsCompatible(
+                        landmarks_i[match._i].semanticLabel(),
+                        landmarks_j[match._j].semanticLabel()))
+                    result->putative_matches.push_back(match);
+            }
+        }
+        else
+            result->putative_matches = matches;
+
+        //-- GMS
+        IndMatches gms_matches;
+        const IndMatches * filtered_matches = &result->putative_matches;
+        if (options._bGMS) {
+            const View * view_i = sfm_data.GetViews().at(pair.first).get();
+            const View * view_j = sfm_data.GetViews().at(pair.second).get();
+            vector<DMatch> dmatchs;
+            dmatchs.reserve(result->putative_matches.size());
+            for (const IndMatch & match : result->putative_matches)
+                dmatchs.emplace_back(match._i, match._j, 0);
+
+            gms_matcher gms(gms_keypoints.at(pair.first), Size(view_i->ui_height, view_i->ui_width),
+                            gms_keypoints.at(pair.second), Size(view_j->ui_height, view_j->ui_width),
+                            dmatchs);
+            std::vector<bool> vbInliers;
+            gms.GetInlierMask(vbInliers, true, true);
+            for (size_t i = 0; i < vbInliers.size(); ++i) {
+                if (vbInliers[i])
+                    gms_matches.emplace_back(dmatchs[i].queryIdx, dmatchs[i].trainIdx);
+            }
+            filtered_matches = &gms_matches;
+        }
+
+        //-- Apply the geometric filter (robust model estimation)
+        GeometryFunctor geometricFilter = functor; // use a copy since we are in a multi-thread context
+        if (geometricFilter.Robust_estimation(&sfm_data, regions_provider, pair, *filtered_matches,
+                                              result->geometric_matches)) {
+            if (options._bGuided_matching) {
+                IndMatches guided_geometric_inliers;
+                geometricFilter.Geometry_guided_matching(&sfm_data, regions_provider, pair,
+                                                         options._dGuided_distance_ratio, guided_geometric_inliers);
+                std::swap(result->geometric_matches, guided_geometric_inliers);
+            }
+            result->bGeometric = true;
+            if (options._bCheck_overlap) {
+                const size_t putativePhotometricCount = filtered_matches->size();
+                const size_t putativeGeometricCount = result->geometric_matches.size();
+                const float ratio = putativeGeometricCount / (float) putativePhotometricCount;
+                if (putativeGeometricCount < 50 || ratio < .3f) {
+                    // the pair is removed
+                    result->bGeometric = false;
+                }
+            }
+        }
+        if (!result->bGeometric)
+            result->geometric_matches.clear();
+
+        writer.Push(pi, std::move(result));
+#ifdef I23DSFM_USE_OPENMP
+#pragma omp critical
+#endif
+        {
+            ++my_progress_bar;
+        }
+    }
+}
+
 /// Compute corresponding features between a series of views:
 /// - Load view images description (regions: features & descriptors)
 /// - Compute putative local feature matches (descriptors matching)
@@ -62,13 +293,21 @@ int main(int argc, char **argv) {
     int iMatchingVideoMode = -1;
 
     std::string sPredefinedPairList = "";
+    int iVocabularyTreeNeighbors = 0;
+    std::string sVocabularyTreeFilename = "";
+    std::string sSemanticWeightsFilename = "";
+    float fSemanticMinOverlap = 0.f;
+    int iSemanticMaxPairs = 0;
     bool bUpRight = false;
 
     std::string sNearestMatchingMethod = "AUTO";
     bool bForce = false;
     bool bGuided_matching = false;
     int imax_iteration = 2048;
+    double dRansac_confidence = 0.0;
+    bool bSPRT = false;
     bool gms = true;
+    std::string sSemanticCompatibilityFilename = "";
 
     //required
     cmd.add(make_option('i', sSfM_Data_Filename, "input_file"));
@@ -79,11 +318,19 @@ int main(int argc, char **argv) {
     cmd.add(make_option('g', sGeometricModel, "geometric_model"));
     cmd.add(make_option('v', iMatchingVideoMode, "video_mode_matching"));
     cmd.add(make_option('l', sPredefinedPairList, "pair_list"));
+    cmd.add(make_option('k', iVocabularyTreeNeighbors, "vocabulary_tree"));
+    cmd.add(make_option('T', sVocabularyTreeFilename, "vocabulary_tree_file"));
+    cmd.add(make_option('W', sSemanticWeightsFilename, "semantic_weights"));
+    cmd.add(make_option('P', fSemanticMinOverlap, "semantic_pair_overlap"));
+    cmd.add(make_option('N', iSemanticMaxPairs, "semantic_pair_max"));
     cmd.add(make_option('n', sNearestMatchingMethod, "nearest_matching_method"));
     cmd.add(make_option('f', bForce, "force"));
     cmd.add(make_option('m', bGuided_matching, "guided_matching"));
     cmd.add(make_option('I', imax_iteration, "max_iteration"));
+    cmd.add(make_option('c', dRansac_confidence, "ransac_confidence"));
+    cmd.add(make_option('S', bSPRT, "sprt"));
     cmd.add(make_option('G', gms, "use gms method"));
+    cmd.add(make_option('s', sSemanticCompatibilityFilename, "semantic_compatibility"));
 
     try {
         if (argc == 1)
@@ -104,6 +351,21 @@ int main(int argc, char **argv) {
                   << "  (sequence matching with an overlap of X images)\n" << "   X: with match 0 with (1->X), ...]\n"
                   << "   2: will match 0 with (1,2), 1 with (2,3), ...\n"
                   << "   3: will match 0 with (1,2,3), 1 with (2,3,4), ...\n" << "[-l]--pair_list] file\n"
+                  << "[-k|--vocabulary_tree] K\n"
+                  << "  match each image with the K most similar images\n"
+                  << "  (retrieved with a vocabulary tree trained on the regions).\n"
+                  << "[-T|--vocabulary_tree_file] file\n"
+                  << "  vocabulary tree loaded from this file if it exists,\n"
+                  << "  else the trained tree is saved to it for the next runs.\n"
+                  << "[-W|--semantic_weights] file\n"
+                  << "  vocabulary tree weight of the features of each semantic label\n"
+                  << "  (one line per label: <label> <weight>, default weight: 1).\n"
+                  << "[-P|--semantic_pair_overlap] ratio\n"
+                  << "  discard the pairs whose feature labels histograms overlap less than ratio\n"
+                  << "  (0 (default): no filtering, e.g. 0.05).\n"
+                  << "[-N|--semantic_pair_max] N\n"
+                  << "  keep only the N pairs of each image with the best semantic overlap and layout\n"
+                  << "  (0 (default): keep all the pairs).\n"
                   << "[-n|--nearest_matching_method]\n" << "  AUTO: auto choice from regions type,\n"
                   << "  For Scalar based regions descriptor:\n" << "    BRUTEFORCEL2: L2 BruteForce matching,\n"
                   << "	ANNL2: L2 Approximate Nearest Neighbor matching,\n"
@@ -111,7 +373,16 @@ int main(int argc, char **argv) {
                   << "	   L2 Cascade Hashing with precomputed hashed regions\n"
                   << "	  (faster than CASCADEHASHINGL2 but use more memory).\n" << "  For Binary based descriptor:\n"
                   << "    BRUTEFORCEHAMMING: BruteForce Hamming matching.\n" << "[-m|--guided_matching]\n"
-                  << "  use the found model to improve the pairwise correspondences." << std::endl;
+                  << "  use the found model to improve the pairwise correspondences.\n"
+                  << "[-c|--ransac_confidence] stop the robust estimation once a better model\n"
+                  << "  would be found with a probability lower than 1-confidence\n"
+                  << "  (0 (default): run all the iterations, e.g. 0.999).\n"
+                  << "[-S|--sprt] reject the bad models of the robust estimation after a\n"
+                  << "  subset of the correspondences (Sequential Probability Ratio Test).\n"
+                  << "[-s|--semantic_compatibility] file\n"
+                  << "  semantic label compatibility table (one line per label:\n"
+                  << "  <label> <compatible labels...>, a label alone never matches).\n"
+                  << "  Default: only features with the same label are matched." << std::endl;
 
         std::cerr << s << std::endl;
         return EXIT_FAILURE;
@@ -121,8 +392,21 @@ int main(int argc, char **argv) {
               << "--out_dir " << sMatchesDirectory << "\n" << "Optional parameters:" << "\n" << "--force " << bForce
               << "\n" << "--ratio " << fDistRatio << "\n" << "--geometric_model " << sGeometricModel << "\n"
               << "--video_mode_matching " << iMatchingVideoMode << "\n" << "--pair_list " << sPredefinedPairList << "\n"
+              << "--vocabulary_tree " << iVocabularyTreeNeighbors << "\n"
+              << "--vocabulary_tree_file " << sVocabularyTreeFilename << "\n"
+              << "--semantic_weights " << sSemanticWeightsFilename << "\n"
+              << "--semantic_pair_overlap " << fSemanticMinOverlap << "\n"
+              << "--semantic_pair_max " << iSemanticMaxPairs << "\n"
               << "--nearest_matching_method " << sNearestMatchingMethod << "\n" << "--guided_matching "
-              << bGuided_matching << std::endl;
+              << bGuided_matching << "\n"
+              << "--ransac_confidence " << dRansac_confidence << "\n"
+              << "--sprt " << bSPRT << "\n"
+              << "--semantic_compatibility " << sSemanticCompatibilityFilename << std::endl;
+
+    if (dRansac_confidence < 0.0 || dRansac_confidence >= 1.0) {
+        std::cerr << "\nThe ransac confidence must be in [0,1[" << std::endl;
+        return EXIT_FAILURE;
+    }
 
     EPairMode ePairmode = (iMatchingVideoMode == -1) ? PAIR_EXHAUSTIVE : PAIR_CONTIGUOUS;
 
@@ -135,6 +419,18 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (iVocabularyTreeNeighbors > 0) {
+        if (ePairmode != PAIR_EXHAUSTIVE) {
+            std::cerr << "\nIncompatible options: --vocabulary_tree and --videoModeMatching/--pairList" << std::endl;
+            return EXIT_FAILURE;
+        }
+        ePairmode = PAIR_VOCABULARY_TREE;
+    }
+    else if (!sVocabularyTreeFilename.empty()) {
+        std::cerr << "\nThe --vocabulary_tree_file option requires --vocabulary_tree" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     if (sMatchesDirectory.empty() || !stlplus::is_folder(sMatchesDirectory)) {
         std::cerr << "\nIt is an invalid output directory" << std::endl;
         return EXIT_FAILURE;
@@ -218,9 +514,18 @@ int main(int argc, char **argv) {
                   << "Invalid features." << std::endl;
         return EXIT_FAILURE;
     }
+    // Semantic label compatibility (by default a label only matches itself)
+    std::shared_ptr<SemanticLabelCompatibility> semantic_compatibility =
+        std::make_shared<SemanticLabelCompatibility>();
+    if (!sSemanticCompatibilityFilename.empty() &&
+        !semantic_compatibility->Load(sSemanticCompatibilityFilename)) {
+        std::cerr << "Invalid semantic compatibility file." << std::endl;
+        return EXIT_FAILURE;
+    }
+
     PairWiseMatches map_PutativesMatches;
-    PairWiseMatches map_SemanticMatches;
-    
+    // Tell if the matcher already discards the semantically incompatible matches
+    bool bSemanticAwareMatcher = false;
 
     // Build some alias from SfM_Data Views data:
     // - List views as a vector of filenames & image sizes
@@ -263,6 +568,10 @@ int main(int argc, char **argv) {
             case PAIR_FROM_FILE:
                 std::cout << "user defined pairwise matching" << std::endl;
                 break;
+
+            case PAIR_VOCABULARY_TREE:
+                std::cout << "vocabulary tree retrieved pairwise matching" << std::endl;
+                break;
         }
 
         // Allocate the right Matcher according the Matching requested method
@@ -271,7 +580,8 @@ int main(int argc, char **argv) {
         if (sNearestMatchingMethod == "AUTO") {
             if (regions_type->IsScalar()) {
                 std::cout << "Using FAST_CASCADE_HASHING_L2 matcher" << std::endl;
-                collectionMatcher.reset(new Cascade_Hashing_Matcher_Regions_AllInMemory(fDistRatio));
+                collectionMatcher.reset(new Cascade_Hashing_Matcher_Regions_AllInMemory(fDistRatio, semantic_compatibility));
+                bSemanticAwareMatcher = true;
             } else if (regions_type->IsBinary()) {
                 std::cout << "Using BRUTE_FORCE_HAMMING matcher" << std::endl;
                 collectionMatcher.reset(new Matcher_Regions_AllInMemory(fDistRatio, BRUTE_FORCE_HAMMING));
@@ -290,7 +600,8 @@ int main(int argc, char **argv) {
             collectionMatcher.reset(new Matcher_Regions_AllInMemory(fDistRatio, CASCADE_HASHING_L2));
         } else if (sNearestMatchingMethod == "FASTCASCADEHASHINGL2") {
             std::cout << "Using FAST_CASCADE_HASHING_L2 matcher" << std::endl;
-            collectionMatcher.reset(new Cascade_Hashing_Matcher_Regions_AllInMemory(fDistRatio));
+            collectionMatcher.reset(new Cascade_Hashing_Matcher_Regions_AllInMemory(fDistRatio, semantic_compatibility));
+            bSemanticAwareMatcher = true;
         }
 
         if (!collectionMatcher) {
@@ -319,301 +630,134 @@ int main(int argc, char **argv) {
                     };
 
                     break;
+
+                case PAIR_VOCABULARY_TREE: {
+                    Vocabulary_Tree_Options voctree_options(iVocabularyTreeNeighbors);
+                    voctree_options._sTreeFilename = sVocabularyTreeFilename;
+                    if (!sSemanticWeightsFilename.empty() &&
+                        !loadSemanticWeights(sSemanticWeightsFilename, voctree_options._semantic_weights)) {
+                        return EXIT_FAILURE;
+                    }
+                    if (!vocabularyTreePairs(sfm_data, *regions_provider, voctree_options, pairs)) {
+                        return EXIT_FAILURE;
+                    }
+                    std::cout << "#Retrieved pairs: " << pairs.size() << std::endl;
+                    break;
+                }
             }
 
             // Photometric matching of putative pairs
-            for (auto it: map_PutativesMatches) {
+            for (const auto & it: map_PutativesMatches) {
                 if (pairs.find(it.first) != pairs.end()) {
                     //std::cout << "Pair " << it.first.first << " " << it.first.second << " has been loaded" << std::endl;
                     pairs.erase(it.first);
                 }
             }
 
-            collectionMatcher->Match(sfm_data, regions_provider, pairs, map_PutativesMatches);
-            
-
-            for(auto pairedIndMatch : map_PutativesMatches)
-            {
-                auto p = pairedIndMatch.first;
-                auto landmarks_i = feats_provider->getFeatures(p.first);
-                auto landmarks_j = feats_provider->getFeatures(p.second);
-                auto indMatches = pairedIndMatch.second;
-                
-                IndMatches iMatches;
-                for(auto imIte = indMatches.begin(); imIte != indMatches.end(); imIte++)
-                {
-                    if(landmarks_i[imIte->_i].semanticLabel() == landmarks_j[imIte->_j].semanticLabel())
-                    {
-                        // indMatches.erase(imIte++);
-                        iMatches.push_back(matching::IndMatch(imIte->_i, imIte->_j));
-                    }
-                }
-                map_SemanticMatches[p] = iMatches;
+            // Semantic pre-filter: skip the pairs whose semantic content cannot overlap
+            if (fSemanticMinOverlap > 0.f || iSemanticMaxPairs > 0) {
+                const Semantic_Pair_Filter_Options semantic_filter_options(
+                    fSemanticMinOverlap, static_cast<size_t>(std::max(0, iSemanticMaxPairs)));
+                const size_t nb_pairs = pairs.size();
+                const size_t nb_rejected = semanticPairFilter(sfm_data, *regions_provider,
+                    *semantic_compatibility, semantic_filter_options, pairs);
+                std::cout << "Semantic pair filter: " << nb_rejected << "/" << nb_pairs
+                          << " pairs discarded" << std::endl;
             }
 
+            collectionMatcher->Match(sfm_data, regions_provider, pairs, map_PutativesMatches);
+        }
+        std::cout << "Task (Regions Matching) done in (s): " << timer.elapsed() << std::endl;
+    }
 
+    //---------------------------------------
+    // b. Filtering of putative matches (one fused stage per pair):
+    //	  - semantic gate (if not already done by the matcher)
+    //	  - GMS grid motion statistics filter (optional)
+    //	  - AContrario Estimation of the desired geometric model
+    //	    (use an upper bound for the a contrario estimated threshold)
+    //	  The filtered pairs are exported as soon as they are available.
+    //---------------------------------------
+    system::Timer timer;
+    std::cout << std::endl << " - Geometric filtering - " << std::endl;
+
+    Pair_Filtering_Options filtering_options;
+    filtering_options._bSemanticGate = !bSemanticAwareMatcher;
+    filtering_options._bGMS = gms;
+    filtering_options._bGuided_matching = bGuided_matching;
+
+    Ordered_Matches_Writer writer(map_PutativesMatches.size(), sfm_data, *feats_provider,
+        sMatchesDirectory + "/matches.putative.txt",
+        sMatchesDirectory + "/" + sGeometricMatchesFilename,
+        sMatchesDirectory + "/points.txt");
+    if (!writer.IsOpen()) {
+        std::cerr << "Cannot create the matches files in: " << sMatchesDirectory << std::endl;
+        return EXIT_FAILURE;
+    }
 
-            //---------------------------------------
-            //-- Export putative matches
-            //---------------------------------------
-            std::ofstream file(std::string(sMatchesDirectory + "/matches.putative.txt").c_str());
+    const robust::ACRANSAC_Options ransac_options(dRansac_confidence, bSPRT);
+    switch (eGeometricModelToCompute) {
+        case HOMOGRAPHY_MATRIX: {
+            const bool bGeometric_only_guided_matching = true;
+            filtering_options._dGuided_distance_ratio = bGeometric_only_guided_matching ? -1.0 : 0.6;
+            Filter_pairs(GeometricFilter_HMatrix_AC(4.0, imax_iteration, ransac_options), filtering_options,
+                         map_PutativesMatches, sfm_data, regions_provider, *feats_provider,
+                         *semantic_compatibility, writer);
+        }
+            break;
 
-            if (file.is_open())
-            {
-                // PairedIndMatchToStream(map_PutativesMatches, file);
-                PairedIndMatchToStream(map_SemanticMatches, file);
-            }
+        case FUNDAMENTAL_MATRIX: {
+            Filter_pairs(GeometricFilter_FMatrix_AC(4.0, imax_iteration, ransac_options), filtering_options,
+                         map_PutativesMatches, sfm_data, regions_provider, *feats_provider,
+                         *semantic_compatibility, writer);
+        }
+            break;
 
-            file.close();
+        case ESSENTIAL_MATRIX: {
+            //-- Perform an additional check to remove pairs with poor overlap
+            filtering_options._bCheck_overlap = true;
+            Filter_pairs(GeometricFilter_EMatrix_AC(4.0, imax_iteration, ransac_options), filtering_options,
+                         map_PutativesMatches, sfm_data, regions_provider, *feats_provider,
+                         *semantic_compatibility, writer);
         }
-        std::cout << "Task (Regions Matching) done in (s): " << timer.elapsed() << std::endl;
+            break;
     }
+    // The putative matches are no longer needed
+    PairWiseMatches().swap(map_PutativesMatches);
+
+    ofstream ftime(sMatchesDirectory+"/matchfiler_time.txt");
+    ftime<<timer.elapsed()<<endl;
+    std::cout << "Task done in (s): " << timer.elapsed() << std::endl;
 
     //-- export putative matches Adjacency matrix
     PairWiseMatchingToAdjacencyMatrixSVG(vec_fileNames.size(),
-                                        //  map_PutativesMatches,
-                                        map_SemanticMatches,
+                                         writer.putative_pairs,
                                          stlplus::create_filespec(sMatchesDirectory, "PutativeAdjacencyMatrix", "svg"));
 
     //-- export view pair graph once putative graph matches have been computed
+    std::set<IndexT> set_ViewIds;
+    std::transform(sfm_data.GetViews().begin(), sfm_data.GetViews().end(),
+                   std::inserter(set_ViewIds, set_ViewIds.begin()), stl::RetrieveKey());
     {
-        std::set<IndexT> set_ViewIds;
-        std::transform(sfm_data.GetViews().begin(), sfm_data.GetViews().end(),
-                       std::inserter(set_ViewIds, set_ViewIds.begin()), stl::RetrieveKey());
-        // graph::indexedGraph putativeGraph(set_ViewIds, getPairs(map_PutativesMatches));
-        graph::indexedGraph putativeGraph(set_ViewIds, getPairs(map_SemanticMatches));        
+        graph::indexedGraph putativeGraph(set_ViewIds, writer.putative_pairs);
         graph::exportToGraphvizData(stlplus::create_filespec(sMatchesDirectory, "putative_matches"),
                                     putativeGraph.g);
     }
 
+    //-- export Adjacency matrix
+    std::cout << "\n Export Adjacency Matrix of the pairwise's geometric matches" << std::endl;
+    PairWiseMatchingToAdjacencyMatrixSVG(vec_fileNames.size(),
+                                         writer.geometric_pairs,
+                                         stlplus::create_filespec(sMatchesDirectory, "GeometricAdjacencyMatrix",
+                                                                  "svg"));
 
-
-
-
-
-    //---------------------------------------
-    // b. Geometric filtering of putative matches
-    //	  - AContrario Estimation of the desired geometric model
-    //	  - Use an upper bound for the a contrario estimated threshold
-    //---------------------------------------
-    std::unique_ptr<ImageCollectionGeometricFilter> filter_ptr(
-            new ImageCollectionGeometricFilter(&sfm_data, regions_provider));
-
-    if (filter_ptr) {
-
-
-        system::Timer timer;
-        std::cout << std::endl << " - Geometric filtering - " << std::endl;
-        PairWiseMatches map_GeometricMatches;
-        /*
-            * gms
-            */
-        if (gms) {
-
-
-#ifdef I23DSFM_USE_OPENMP
-#pragma omp     parallel for schedule(dynamic)
-#endif
-
-            // for (int pi = 0; pi < map_PutativesMatches.size(); ++pi) {
-            //     PairWiseMatches::const_iterator iter = map_PutativesMatches.begin();
-            for (int pi = 0; pi < map_SemanticMatches.size(); ++pi) {
-                PairWiseMatches::const_iterator iter = map_SemanticMatches.begin();
-                std::advance(iter, pi);
-
-                auto p = *iter;
-                auto pair_ids = p.first;
-                auto keyPoint1 =
-                        regions_provider.get()->regions_per_view[pair_ids.first].get()->GetRegionsPositions();
-
-                vector<KeyPoint> scvKp1;
-
-                for (auto p: keyPoint1) {
-                    scvKp1.emplace_back(Point2f(p.x(), p.y()), 20);
-                }
-
-                auto keyPoint2 =
-                        regions_provider.get()->regions_per_view[pair_ids.second].get()->GetRegionsPositions();
-
-                vector<KeyPoint> scvKp2;
-
-                for (auto p: keyPoint2) {
-                    scvKp2.emplace_back(Point2f(p.x(), p.y()), 20);
-                }
-
-                vector<DMatch> dmatchs;
-
-                for (auto m: p.second) {
-                    dmatchs.emplace_back(m._i, m._j, 0);
-                }
-
-                gms_matcher gms(scvKp1,
-                                Size(sfm_data.views[pair_ids.first].get()->ui_height,
-                                     sfm_data.views[pair_ids.first].get()->ui_width),
-
-                                scvKp2,
-                                Size(sfm_data.views[pair_ids.second].get()->ui_height,
-                                     sfm_data.views[pair_ids.second].get()->ui_width),
-
-                                dmatchs);
-
-                cout << p.first.first << "-" << p.first.second << ":" << dmatchs.size() << endl;
-                std::vector<bool> vbInliers;
-                auto num_inliers = gms.GetInlierMask(vbInliers, true, true);
-
-                cout << "Get total " << num_inliers << " matches." << endl;
-                IndMatches matches;
-
-                // draw matches
-                for (size_t i = 0; i < vbInliers.size(); ++i) {
-                    if (vbInliers[i] == true) {
-                        matches.emplace_back(dmatchs[i].queryIdx, dmatchs[i].trainIdx);
-                    }
-                }
-
-#ifdef I23DSFM_USE_OPENMP
-#pragma  omp critical
-#endif
-
-                map_GeometricMatches.emplace(pair_ids, matches);
-
-            }
-
-        }
-
-        {
-            if(gms){
-                // map_PutativesMatches = map_GeometricMatches;
-                map_SemanticMatches = map_GeometricMatches;                
-                map_GeometricMatches.clear();
-
-            }
-            /*
-           * ac_ransac
-           *
-           */
-//			map_PutativesMatches = map_GeometricMatches;
-//			map_GeometricMatches.clear();
-
-            switch (eGeometricModelToCompute) {
-                case HOMOGRAPHY_MATRIX: {
-                    const bool bGeometric_only_guided_matching = true;
-
-                    filter_ptr->Robust_model_estimation(GeometricFilter_HMatrix_AC(4.0, imax_iteration),
-                                                        // map_PutativesMatches, 
-                                                        map_SemanticMatches,                                                         
-                                                        bGuided_matching,
-                                                        bGeometric_only_guided_matching ? -1.0 : 0.6);
-                    map_GeometricMatches = filter_ptr->Get_geometric_matches();
-
-                }
-                    break;
-
-                case FUNDAMENTAL_MATRIX: {
-                    filter_ptr->Robust_model_estimation(GeometricFilter_FMatrix_AC(4.0, imax_iteration),
-                                                        // map_PutativesMatches, 
-                                                        map_SemanticMatches,
-                                                        bGuided_matching);
-                    map_GeometricMatches = filter_ptr->Get_geometric_matches();
-                }
-                    break;
-
-                case ESSENTIAL_MATRIX: {
-                    filter_ptr->Robust_model_estimation(GeometricFilter_EMatrix_AC(4.0, imax_iteration),
-                                                        // map_PutativesMatches, 
-                                                        map_SemanticMatches,
-                                                        bGuided_matching);
-                    map_GeometricMatches = filter_ptr->Get_geometric_matches();
-
-                    //-- Perform an additional check to remove pairs with poor overlap
-                    std::vector<PairWiseMatches::key_type> vec_toRemove;
-                    for (PairWiseMatches::const_iterator iterMap = map_GeometricMatches.begin();
-                         iterMap != map_GeometricMatches.end(); ++iterMap) {
-                        // const size_t putativePhotometricCount = map_PutativesMatches.find(
-                        //         iterMap->first)->second.size();
-                        const size_t putativePhotometricCount = map_SemanticMatches.find(
-                                iterMap->first)->second.size();
-                        const size_t putativeGeometricCount = iterMap->second.size();
-                        const float ratio = putativeGeometricCount / (float) putativePhotometricCount;
-                        if (putativeGeometricCount < 50 || ratio < .3f) {
-                            // the pair will be removed
-                            vec_toRemove.push_back(iterMap->first);
-                        }
-                    }
-                    //-- remove discarded pairs
-                    for (std::vector<PairWiseMatches::key_type>::const_iterator
-                                 iter = vec_toRemove.begin(); iter != vec_toRemove.end(); ++iter) {
-                        map_GeometricMatches.erase(*iter);
-                    }
-
-                }
-                    break;
-            }
-        }
-
-
-
-
-
-        //---------------------------------------
-        //-- Export geometric filtered matches
-        //---------------------------------------
-        std::ofstream file(string(sMatchesDirectory + "/" + sGeometricMatchesFilename).c_str());
-
-        if (file.is_open())
-            PairedIndMatchToStream(map_GeometricMatches, file);
-
-        file.close();
-
-
-        ofstream ftime(sMatchesDirectory+"/matchfiler_time.txt");
-        ftime<<timer.elapsed()<<endl;
-        std::cout << "Task done in (s): " << timer.elapsed() << std::endl;
-        //-- export Adjacency matrix
-        std::cout << "\n Export Adjacency Matrix of the pairwise's geometric matches" << std::endl;
-        PairWiseMatchingToAdjacencyMatrixSVG(vec_fileNames.size(),
-                                             map_GeometricMatches,
-                                             stlplus::create_filespec(sMatchesDirectory, "GeometricAdjacencyMatrix",
-                                                                      "svg"));
-
-        //-- export view pair graph once geometric filter have been done
-        {
-            std::set<IndexT> set_ViewIds;
-            std::transform(sfm_data.GetViews().begin(), sfm_data.GetViews().end(),
-                           std::inserter(set_ViewIds, set_ViewIds.begin()), stl::RetrieveKey());
-            graph::indexedGraph putativeGraph(set_ViewIds, getPairs(map_GeometricMatches));
-            graph::exportToGraphvizData(stlplus::create_filespec(sMatchesDirectory, "geometric_matches"),
-                                        putativeGraph.g);
-        }
-        ofstream ofp(sMatchesDirectory+"/points.txt");
-        for(auto pairedIndMatch:map_GeometricMatches){
-            auto p=pairedIndMatch.first;
-            auto width_i=sfm_data.GetViews().at(p.first).get()->ui_width;
-            auto height_i=sfm_data.GetViews().at(p.first).get()->ui_height;
-            ofp<<width_i<<"-"<<height_i<<endl;
-            auto width_j=sfm_data.GetViews().at(p.second).get()->ui_width;
-            auto height_j=sfm_data.GetViews().at(p.second).get()->ui_height;
-            ofp<<width_j<<"-"<<height_j<<endl;
-
-            auto landmarks_i=feats_provider->getFeatures(p.first);
-
-            auto landmarks_j=feats_provider->getFeatures(p.second);
-
-
-            for(auto match : pairedIndMatch.second){
-                auto point_i=landmarks_i[match._i].coords();
-                ofp<<"["<<point_i(0,0)<<","<<point_i(1,0)<<"]";
-                ofp<<"-";
-                auto point_j=landmarks_j.at(match._j).coords();
-                ofp<<"["<<point_j(0,0)<<","<<point_j(1,0)<<"]";
-                ofp<<endl;
-            }
-
-        }
-        ofp.close();
+    //-- export view pair graph once geometric filter have been done
+    {
+        graph::indexedGraph putativeGraph(set_ViewIds, writer.geometric_pairs);
+        graph::exportToGraphvizData(stlplus::create_filespec(sMatchesDirectory, "geometric_matches"),
+                                    putativeGraph.g);
     }
 
-
     return EXIT_SUCCESS;
 }
 
@@ -4,16 +4,26 @@
 
 /// Feature/Regions & Image describer interfaces
 #include "i23dSFM/features/features.hpp"
+#include "i23dSFM/features/regions_container.hpp"
 #include "nonFree/sift/SIFT_describer.hpp"
 #include <cereal/archives/json.hpp>
 #include "i23dSFM/system/timer.hpp"
+#include "i23dSFM/system/bounded_queue.hpp"
 
 #include "third_party/cmdLine/cmdLine.h"
 #include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
 #include "third_party/progress/progress.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <fstream>
+#include <mutex>
+#include <thread>
+
+#ifdef I23DSFM_USE_OPENMP
+#include <omp.h>
+#endif
 
 
 
@@ -21,8 +31,28 @@ using namespace i23dSFM;
 using namespace i23dSFM::image;
 using namespace i23dSFM::features;
 using namespace i23dSFM::sfm;
+using namespace i23dSFM::system;
 using namespace std;
 
+/// Images of a view decoded by the prefetch stage
+struct DecodedView
+{
+  Image<unsigned char> imageGray, semanticImgGray, maskGray;
+  IndexT id_view;
+  bool bMask;
+  bool bSemantic; // false if the semantic image could not be read
+  std::string sFeat, sDesc;
+};
+
+/// Regions of a view waiting to be saved by the writer stage
+struct DescribedView
+{
+  IndexT id_view;
+  std::unique_ptr<Regions> regions;
+  std::string sFeat, sDesc;
+  bool bSave; // false if the regions were loaded from existing files
+};
+
 features::EDESCRIBER_PRESET stringToEnum(const std::string & sPreset)
 {
   features::EDESCRIBER_PRESET preset;
@@ -51,6 +81,9 @@ int main(int argc, char **argv)
   std::string sImage_Describer_Method = "SIFT";
   bool bForce = false;
   std::string sFeaturePreset = "";
+  int nb_workers = 0;
+  int nb_max_in_flight = 0;
+  bool bBinaryContainer = false;
 
   // required
   cmd.add( make_option('i', sSfM_Data_Filename, "input_file") );
@@ -60,6 +93,9 @@ int main(int argc, char **argv)
   cmd.add( make_option('u', bUpRight, "upright") );
   cmd.add( make_option('f', bForce, "force") );
   cmd.add( make_option('p', sFeaturePreset, "describerPreset") );
+  cmd.add( make_option('n', nb_workers, "numThreads") );
+  cmd.add( make_option('q', nb_max_in_flight, "maxInFlightImages") );
+  cmd.add( make_option('b', bBinaryContainer, "binaryContainer") );
 
   try {
       if (argc == 1) throw std::string("Invalid command line parameter.");
@@ -81,6 +117,13 @@ int main(int argc, char **argv)
       << "   NORMAL (default),\n"
       << "   HIGH,\n"
       << "   ULTRA: !!Can take long time!!\n"
+      << "[-n|--numThreads] number of images described concurrently\n"
+      << "   0 (default): number of hardware threads\n"
+      << "[-q|--maxInFlightImages] maximal number of images held in memory\n"
+      << "   0 (default): 2 * numThreads\n"
+      << "[-b|--binaryContainer] Also export the regions of all the views in a\n"
+      << "  single memory mappable file (regions.bin), used when present to\n"
+      << "  load the regions without parsing the .feat/.desc files\n"
       << std::endl;
 
       std::cerr << s << std::endl;
@@ -94,7 +137,17 @@ int main(int argc, char **argv)
             << "--describerMethod " << sImage_Describer_Method << std::endl
             << "--upright " << bUpRight << std::endl
             << "--describerPreset " << (sFeaturePreset.empty() ? "NORMAL" : sFeaturePreset) << std::endl
-            << "--force " << bForce << std::endl;
+            << "--force " << bForce << std::endl
+            << "--numThreads " << nb_workers << std::endl
+            << "--maxInFlightImages " << nb_max_in_flight << std::endl
+            << "--binaryContainer " << bBinaryContainer << std::endl;
+
+  if (nb_workers <= 0)
+    nb_workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  if (nb_max_in_flight <= 0)
+    nb_max_in_flight = 2 * nb_workers;
+  // every worker needs an image to describe
+  nb_max_in_flight = std::max(nb_max_in_flight, nb_workers);
 
 
   if (sOutDir.empty())  {
@@ -192,61 +245,199 @@ int main(int argc, char **argv)
   // For each View of the SfM_Data container:
   // - if regions file exist continue,
   // - if no file, compute features
+  //
+  // The views are processed by a pipeline:
+  // - a prefetch thread decodes the images (image, segmentation, mask),
+  // - nb_workers describer threads compute the regions (each Describe call
+  //   owns its VlSiftFilt),
+  // - a writer thread saves the regions to disk.
+  // At most nb_max_in_flight images are alive (decoded, described or waiting
+  // to be saved) at any time, bounding the memory footprint.
+  //
+  // With --binaryContainer the writer also appends the regions of every view
+  // (computed or loaded from the existing files) to the regions container.
   {
+    const std::string sContainer = stlplus::create_filespec(sOutDir,
+      REGIONS_CONTAINER_BASENAME, "bin");
+    Regions_Container_Writer container_writer;
+    if (bBinaryContainer)
+    {
+      std::unique_ptr<Regions> regionsType;
+      image_describer->Allocate(regionsType);
+      if (!container_writer.Open(sContainer, *regionsType, sfm_data.GetViews().size()))
+      {
+        std::cerr << "Cannot create the regions container: " << sContainer << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    std::atomic<int> nb_computed_views(0);
+    bool bContainerError = false; // set by the writer stage
+
     system::Timer timer;
-    Image<unsigned char> imageGray, maskGray, semanticImgGray;
     C_Progress_display my_progress_bar( sfm_data.GetViews().size(),
       std::cout, "\n- EXTRACT FEATURES -\n" );
-    for(Views::const_iterator iterViews = sfm_data.views.begin();
-        iterViews != sfm_data.views.end();
-        ++iterViews, ++my_progress_bar)
+    std::mutex progress_mutex;
+    auto progress = [&]()
+    {
+      std::lock_guard<std::mutex> lock(progress_mutex);
+      ++my_progress_bar;
+    };
+
+    Bounded_Queue<std::unique_ptr<DecodedView> > decoded_queue(nb_max_in_flight);
+    Bounded_Queue<std::unique_ptr<DescribedView> > described_queue(nb_max_in_flight);
+    // One token per image in flight: taken before decoding, released once saved
+    Bounded_Queue<char> in_flight(nb_max_in_flight);
+
+    // Prefetch stage
+    std::thread prefetch_thread([&]()
     {
-      const View * view = iterViews->second.get();
-      const std::string sView_filename = stlplus::create_filespec(sfm_data.s_root_path,
-        view->s_Img_path);
-      const std::string sView_semantic_filename = stlplus::create_filespec(sfm_data.s_seg_root_path,
-        view->semantic_img_path);
-      const std::string sFeat = stlplus::create_filespec(sOutDir,
-        stlplus::basename_part(sView_filename), "feat");
-      const std::string sDesc = stlplus::create_filespec(sOutDir,
-        stlplus::basename_part(sView_filename), "desc");
-      const std::string sMask_filename = stlplus::create_filespec(sfm_data.s_root_path + "mask/",
-        stlplus::basename_part(sView_filename), "msk");
-      // cout << "image name: " << sView_filename << endl;
-      // cout << "semantic segmentation image name: " << sView_semantic_filename << endl;
-      //If features or descriptors file are missing, compute them
-      if (bForce || !stlplus::file_exists(sFeat) || !stlplus::file_exists(sDesc))
+      for (Views::const_iterator iterViews = sfm_data.views.begin();
+        iterViews != sfm_data.views.end(); ++iterViews)
       {
-        // if (!ReadImage(sView_filename.c_str(), &imageGray))
-        //   continue;
-        if (!ReadImage(sView_filename.c_str(), &imageGray) )
+        const View * view = iterViews->second.get();
+        std::unique_ptr<DecodedView> job(new DecodedView);
+        job->id_view = view->id_view;
+        const std::string sView_filename = stlplus::create_filespec(sfm_data.s_root_path,
+          view->s_Img_path);
+        const std::string sView_semantic_filename = stlplus::create_filespec(sfm_data.s_seg_root_path,
+          view->semantic_img_path);
+        job->sFeat = stlplus::create_filespec(sOutDir,
+          stlplus::basename_part(sView_filename), "feat");
+        job->sDesc = stlplus::create_filespec(sOutDir,
+          stlplus::basename_part(sView_filename), "desc");
+        const std::string sMask_filename = stlplus::create_filespec(sfm_data.s_root_path + "mask/",
+          stlplus::basename_part(sView_filename), "msk");
+
+        //If features or descriptors file are missing, compute them
+        if (!bForce && stlplus::file_exists(job->sFeat) && stlplus::file_exists(job->sDesc))
+        {
+          if (bBinaryContainer)
+          {
+            // Forward the existing regions to the container
+            std::unique_ptr<DescribedView> result(new DescribedView);
+            image_describer->Allocate(result->regions);
+            if (result->regions->Load(job->sFeat, job->sDesc))
+            {
+              result->id_view = view->id_view;
+              result->bSave = false;
+              in_flight.Push(char(0));
+              described_queue.Push(std::move(result));
               continue;
-        if (!ReadImage(sView_semantic_filename.c_str(), &semanticImgGray) )
+            }
+          }
+          progress();
+          continue;
+        }
+
+        in_flight.Push(char(0));
+        if (!ReadImage(sView_filename.c_str(), &job->imageGray))
         {
+          char token;
+          in_flight.Pop(token);
+          progress();
+          continue;
+        }
+        job->bSemantic = ReadImage(sView_semantic_filename.c_str(), &job->semanticImgGray);
+        if (!job->bSemantic)
+        {
+          std::lock_guard<std::mutex> lock(progress_mutex);
           cout << "cannot read semantic segmentation file: " << sView_semantic_filename << endl;
         }
+        job->bMask = stlplus::file_exists(sMask_filename)
+          && ReadImage(sMask_filename.c_str(), &job->maskGray);
+        decoded_queue.Push(std::move(job));
+      }
+      decoded_queue.Close();
+    });
+
+    // Describer stage
+    const int nb_omp_threads_per_worker =
+#ifdef I23DSFM_USE_OPENMP
+      std::max(1, omp_get_max_threads() / nb_workers);
+#else
+      1;
+#endif
+    std::vector<std::thread> describer_threads;
+    std::atomic<int> nb_running_workers(nb_workers);
+    for (int i = 0; i < nb_workers; ++i)
+    {
+      describer_threads.emplace_back([&]()
+      {
+#ifdef I23DSFM_USE_OPENMP
+        // Do not oversubscribe the cores with the keypoint level parallelism
+        omp_set_num_threads(nb_omp_threads_per_worker);
+#endif
+        std::unique_ptr<DecodedView> job;
+        while (decoded_queue.Pop(job))
+        {
+          // Compute features and descriptors
+          std::unique_ptr<DescribedView> result(new DescribedView);
+          // Without semantic image the features are labelled -1
+          if (job->bSemantic)
+            image_describer->Describe(job->imageGray, job->semanticImgGray, result->regions,
+              job->bMask ? &job->maskGray : NULL);
+          else
+            image_describer->Describe(job->imageGray, result->regions,
+              job->bMask ? &job->maskGray : NULL);
+          result->id_view = job->id_view;
+          result->sFeat = job->sFeat;
+          result->sDesc = job->sDesc;
+          result->bSave = true;
+          job.reset(); // release the decoded images as soon as possible
+          described_queue.Push(std::move(result));
+        }
+        if (--nb_running_workers == 0)
+          described_queue.Close();
+      });
+    }
 
-        // Compute features and descriptors and export them to files
-        std::unique_ptr<Regions> regions;
-        if (!stlplus::file_exists(sMask_filename))
+    // Writer stage
+    std::thread writer_thread([&]()
+    {
+      std::unique_ptr<DescribedView> result;
+      while (described_queue.Pop(result))
+      {
+        if (result->bSave)
         {
-          //std::cout << "No mask file for : " << sView_filename << std::endl;
-          // image_describer->Describe(imageGray, regions);          
-          image_describer->Describe(imageGray, semanticImgGray, regions);
+          image_describer->Save(result->regions.get(), result->sFeat, result->sDesc);
+          ++nb_computed_views;
         }
-        else
+        if (container_writer.IsOpen() && !bContainerError
+          && !container_writer.Add(result->id_view, *result->regions))
         {
-          ReadImage(sMask_filename.c_str(), &maskGray);
-          //std::cout << "Read mask successfully : " << sMask_filename << std::endl;
-          // image_describer->Describe(imageGray, regions, &maskGray);          
-          image_describer->Describe(imageGray, semanticImgGray, regions, &maskGray);
+          std::lock_guard<std::mutex> lock(progress_mutex);
+          std::cerr << "Cannot add the regions of the view " << result->id_view
+            << " to the regions container: " << sContainer << std::endl;
+          bContainerError = true;
         }
-        // load semantic label of features
-        // image_describer->LoadSemanticLabel(regions, semantic_img_path);
-        
-        image_describer->Save(regions.get(), sFeat, sDesc);
+        result.reset();
+        char token;
+        in_flight.Pop(token);
+        progress();
+      }
+    });
+
+    prefetch_thread.join();
+    for (size_t i = 0; i < describer_threads.size(); ++i)
+      describer_threads[i].join();
+    writer_thread.join();
+
+    if (container_writer.IsOpen())
+    {
+      if (!container_writer.Close() || bContainerError)
+      {
+        std::cerr << "Cannot write the regions container: " << sContainer << std::endl;
+        // Do not leave an incomplete container
+        stlplus::file_delete(sContainer);
+        return EXIT_FAILURE;
       }
     }
+    else if (nb_computed_views > 0 && stlplus::file_exists(sContainer))
+    {
+      // The existing container is outdated
+      stlplus::file_delete(sContainer);
+    }
+
     std::cout << "Task done in (s): " << timer.elapsed() << std::endl;
   }
   return EXIT_SUCCESS;
@@ -7,6 +7,7 @@
 
 #include "i23dSFM/sfm/sfm.hpp"
 #include "i23dSFM/image/image.hpp"
+#include "software/SfM/SfMImageExportHelper.hpp"
 
 using namespace i23dSFM;
 using namespace i23dSFM::cameras;
@@ -24,9 +25,17 @@ int main(int argc, char *argv[]) {
   CmdLine cmd;
   std::string sSfM_Data_Filename;
   std::string sOutDir = "";
+  std::string sOutExtension = "";
+  SfMImageExport::Image_Export_Options export_options;
 
   cmd.add( make_option('i', sSfM_Data_Filename, "sfmdata") );
   cmd.add( make_option('o', sOutDir, "outdir") );
+  cmd.add( make_option('e', sOutExtension, "extension") );
+  cmd.add( make_option('d', export_options._nb_decoders, "numDecoders") );
+  cmd.add( make_option('u', export_options._nb_undistorters, "numUndistorters") );
+  cmd.add( make_option('w', export_options._nb_encoders, "numEncoders") );
+  cmd.add( make_option('q', export_options._nb_max_in_flight, "maxInFlightImages") );
+  cmd.add( make_option('j', export_options._jpeg_quality, "jpegQuality") );
 
   try {
       if (argc == 1) throw std::string("Invalid command line parameter.");
@@ -37,6 +46,16 @@ int main(int argc, char *argv[]) {
       << "Usage: " << argv[0] << '\n'
       << "[-i|--sfmdata] filename, the SfM_Data file to convert\n"
       << "[-o|--outdir] path\n"
+      << "\n[Optional]\n"
+      << "[-e|--extension] output image format (i.e. jpg, png),\n"
+      << "   default: the format of the input images\n"
+      << "[-d|--numDecoders] number of image decoding threads\n"
+      << "[-u|--numUndistorters] number of image undistortion threads\n"
+      << "[-w|--numEncoders] number of image encoding threads\n"
+      << "   0 (default): automatic, from the number of hardware threads\n"
+      << "[-q|--maxInFlightImages] max number of images loaded at once\n"
+      << "   0 (default): twice the number of hardware threads\n"
+      << "[-j|--jpegQuality] quality of the JPEG images (default 90)\n"
       << std::endl;
 
       std::cerr << s << std::endl;
@@ -54,42 +73,29 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
-  bool bOk = true;
+  // Export views as undistorted images (those with valid Intrinsics)
+  std::vector<SfMImageExport::Image_Export_Job> export_jobs;
+  for(Views::const_iterator iter = sfm_data.GetViews().begin();
+    iter != sfm_data.GetViews().end(); ++iter)
   {
-    // Export views as undistorted images (those with valid Intrinsics)
-    Image<RGBColor> image, image_ud;
-    C_Progress_display my_progress_bar( sfm_data.GetViews().size() );
-    for(Views::const_iterator iter = sfm_data.GetViews().begin();
-      iter != sfm_data.GetViews().end(); ++iter, ++my_progress_bar)
-    {
-      const View * view = iter->second.get();
-      bool bIntrinsicDefined = view->id_intrinsic != UndefinedIndexT &&
-        sfm_data.GetIntrinsics().find(view->id_intrinsic) != sfm_data.GetIntrinsics().end();
-
-      Intrinsics::const_iterator iterIntrinsic = sfm_data.GetIntrinsics().find(view->id_intrinsic);
-
-      const std::string srcImage = stlplus::create_filespec(sfm_data.s_root_path, view->s_Img_path);
-      const std::string dstImage = stlplus::create_filespec(
-        sOutDir, stlplus::filename_part(srcImage));
-
-      const IntrinsicBase * cam = iterIntrinsic->second.get();
-      if (cam->have_disto())
-      {
-        // undistort the image and save it
-        if (ReadImage( srcImage.c_str(), &image))
-        {
-          UndistortImage(image, cam, image_ud, BLACK);
-          bOk &= WriteImage(dstImage.c_str(), image_ud);
-        }
-      }
-      else // (no distortion)
-      {
-        // copy the image since there is no distortion
-        stlplus::file_copy(srcImage, dstImage);
-      }
-    }
+    const View * view = iter->second.get();
+    Intrinsics::const_iterator iterIntrinsic = sfm_data.GetIntrinsics().find(view->id_intrinsic);
+    const bool bIntrinsicDefined = view->id_intrinsic != UndefinedIndexT &&
+      iterIntrinsic != sfm_data.GetIntrinsics().end();
+
+    const std::string srcImage = stlplus::create_filespec(sfm_data.s_root_path, view->s_Img_path);
+    const std::string dstImage = sOutExtension.empty() ?
+      stlplus::create_filespec(sOutDir, stlplus::filename_part(srcImage)) :
+      stlplus::create_filespec(sOutDir, stlplus::basename_part(srcImage), sOutExtension);
+
+    export_jobs.push_back(SfMImageExport::MakeImageExportJob(view->id_view, view->id_intrinsic,
+      bIntrinsicDefined ? iterIntrinsic->second.get() : NULL, srcImage, dstImage));
   }
 
+  C_Progress_display my_progress_bar( export_jobs.size() );
+  const bool bOk = SfMImageExport::ExportImages(export_jobs, export_options,
+    SfMImageExport::Image_Export_Callback(), &my_progress_bar);
+
   // Exit program
   if (bOk)
     return( EXIT_SUCCESS );
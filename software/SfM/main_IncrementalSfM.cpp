@@ -75,6 +75,13 @@ int main(int argc, char **argv)
   bool bRefineIntrinsics = true;
   int i_User_camera_model = PINHOLE_CAMERA_RADIAL3;
   bool bRepeatFocal = false;
+  bool bLocalBA = false;
+  size_t iGlobalBAFrequency = 50;
+  double dGlobalBAGrowthRatio = 0.1;
+  bool bParallelResection = false;
+  double dResectionConfidence = 0.0;
+  bool bResectionSPRT = false;
+  int iSemanticTrackMode = tracks::SEMANTIC_TRACK_VOTE;
 
   cmd.add( make_option('i', sSfM_Data_Filename, "input_file") );
   cmd.add( make_option('m', sMatchesDir, "matchdir") );
@@ -84,6 +91,13 @@ int main(int argc, char **argv)
   cmd.add( make_option('c', i_User_camera_model, "camera_model") );
   cmd.add( make_option('f', bRefineIntrinsics, "refineIntrinsics") );
   cmd.add( make_option('r', bRepeatFocal, "repeatFocal") );
+  cmd.add( make_option('l', bLocalBA, "localBA") );
+  cmd.add( make_option('g', iGlobalBAFrequency, "globalBAFrequency") );
+  cmd.add( make_option('G', dGlobalBAGrowthRatio, "globalBAGrowthRatio") );
+  cmd.add( make_option('p', bParallelResection, "parallelResection") );
+  cmd.add( make_option('C', dResectionConfidence, "resectionConfidence") );
+  cmd.add( make_option('S', bResectionSPRT, "resectionSPRT") );
+  cmd.add( make_option('s', iSemanticTrackMode, "semanticTracks") );
 
   try {
     if (argc == 1) throw std::string("Invalid parameter.");
@@ -105,12 +119,51 @@ int main(int argc, char **argv)
     << "[-r|--repeatFocal] \n"
     << "\t 0-> calculate focal length only once (default). \n"
     << "\t 1-> repeat refine focal length. \n"
+    << "[-l|--localBA] \n"
+    << "\t 0-> bundle adjust the whole scene after each resection (default). \n"
+    << "\t 1-> bundle adjust only the new views and their co-visible neighbours,\n"
+    << "\t      the whole scene is adjusted periodically. \n"
+    << "[-g|--globalBAFrequency] number of added images between two global bundle adjustments (default 50)\n"
+    << "[-G|--globalBAGrowthRatio] run a global bundle adjustment when the number of poses\n"
+    << "\t grew by this ratio since the last one (default 0.1)\n"
+    << "[-p|--parallelResection] \n"
+    << "\t 0-> add the views of a resection group one after the other (default). \n"
+    << "\t 1-> localize the views of a resection group concurrently,\n"
+    << "\t      then add them to the scene in the group order. \n"
+    << "[-C|--resectionConfidence] stop the robust resection once a better pose\n"
+    << "\t is found with a probability lower than 1-confidence (i.e. 0.99),\n"
+    << "\t 0: run all the iterations (default). \n"
+    << "[-S|--resectionSPRT] \n"
+    << "\t 0-> evaluate the resection models on all the points (default). \n"
+    << "\t 1-> reject the bad resection models early (SPRT). \n"
+    << "[-s|--semanticTracks] tracks whose features have different semantic labels:\n"
+    << "\t 0-> are kept as built. \n"
+    << "\t 1-> are split in one track per label. \n"
+    << "\t 2-> keep their majority label features (default). \n"
     << std::endl;
 
     std::cerr << s << std::endl;
     return EXIT_FAILURE;
   }
 
+  if (dResectionConfidence < 0.0 || dResectionConfidence >= 1.0)
+  {
+    std::cerr << "\n Invalid resection confidence: " << dResectionConfidence << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (dGlobalBAGrowthRatio <= 0.0)
+  {
+    std::cerr << "\n Invalid global BA growth ratio: " << dGlobalBAGrowthRatio << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (iSemanticTrackMode < tracks::SEMANTIC_TRACK_NONE || iSemanticTrackMode > tracks::SEMANTIC_TRACK_VOTE)
+  {
+    std::cerr << "\n Invalid semantic tracks mode: " << iSemanticTrackMode << std::endl;
+    return EXIT_FAILURE;
+  }
+
   // Load input SfM_Data scene
   SfM_Data sfm_data;
   if (!Load(sfm_data, sSfM_Data_Filename, ESfM_Data(VIEWS|INTRINSICS))) {
@@ -199,6 +252,10 @@ int main(int argc, char **argv)
   // Configure reconstruction parameters
   sfmEngine.Set_bFixedIntrinsics(!bRefineIntrinsics);
   sfmEngine.SetUnknownCameraType(EINTRINSIC(i_User_camera_model));
+  sfmEngine.SetLocalBundleAdjustment(bLocalBA, 20, iGlobalBAFrequency, dGlobalBAGrowthRatio);
+  sfmEngine.SetParallelResection(bParallelResection);
+  sfmEngine.SetResectionRobustOptions(robust::ACRANSAC_Options(dResectionConfidence, bResectionSPRT));
+  sfmEngine.SetSemanticTrackMode(tracks::ESemanticTrackMode(iSemanticTrackMode));
 
   // Handle Initial pair parameter
   if (!initialPairString.first.empty() && !initialPairString.second.empty())
@@ -4,19 +4,25 @@
 #include "i23dSFM/exif/sensor_width_database/ParseDatabase.hpp"
 
 #include "i23dSFM/image/image.hpp"
+#include "i23dSFM/matching_image_collection/GPS_Pair_Builder.hpp"
+#include "i23dSFM/matching_image_collection/Pair_Builder.hpp"
 #include "i23dSFM/stl/split.hpp"
 #include "i23dSFM/numeric/numeric.h"
 
 #include "i23dSFM/sfm/sfm.hpp"
 
 #include "third_party/cmdLine/cmdLine.h"
+#include "third_party/progress/progress.hpp"
 #include "third_party/stlplus3/filesystemSimplified/file_system.hpp"
 
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <iomanip>
 
@@ -55,14 +61,50 @@ bool checkIntrinsicStringValidity(const std::string & Kmatrix, double & focal, d
     return true;
 }
 
-// Vec3 : latitude, longitude, altitude
-// Return distance(m)
-float calcDistanceByGPS(Vec3 v1, Vec3 v2)
+// Image properties read from the file headers (the pixels are not decoded)
+struct Image_Metadata
 {
-    float x = (v1[0] - v2[0]) * 111000,
-            y = (v1[1] - v2[1]) * 111000,
-            z = (v1[2] - v2[2]);
-    return sqrt(x * x + y * y);
+    bool bKnownFormat;
+    bool bReadHeader;
+    double width, height;
+    bool bHaveValidExifMetadata;
+    std::string sCamName, sCamModel;
+    float exifFocal;
+    Vec3 gpsPos;  // latitude, longitude, altitude
+
+    Image_Metadata() : bKnownFormat(false), bReadHeader(false), width(-1), height(-1),
+        bHaveValidExifMetadata(false), exifFocal(0.0f), gpsPos(Vec3::Zero()) {}
+};
+
+void readImageMetadata(const std::string & sImageFilename, Image_Metadata & metadata)
+{
+    // Test if the image format is supported:
+    metadata.bKnownFormat = i23dSFM::image::GetFormat(sImageFilename.c_str()) != i23dSFM::image::Unknown;
+    if (!metadata.bKnownFormat)
+        return;
+
+    ImageHeader imgHeader;
+    metadata.bReadHeader = i23dSFM::image::ReadImageHeader(sImageFilename.c_str(), &imgHeader);
+    if (!metadata.bReadHeader)
+        return;
+    metadata.width = imgHeader.width;
+    metadata.height = imgHeader.height;
+
+    std::unique_ptr<Exif_IO> exifReader(new Exif_IO_EasyExif());
+    exifReader->open( sImageFilename );
+    metadata.sCamName = exifReader->getBrand();
+    metadata.sCamModel = exifReader->getModel();
+    metadata.bHaveValidExifMetadata =
+            exifReader->doesHaveExifInfo()
+            && !metadata.sCamName.empty()
+            && !metadata.sCamModel.empty();
+    metadata.exifFocal = exifReader->getFocal();
+    //std::cout << setprecision(6) << setiosflags(ios::fixed);
+    //std::cout << exifReader->allExifData() << std::endl;
+    metadata.gpsPos = Vec3(
+        exifReader->getLatitude(),
+        exifReader->getLongitude(),
+        exifReader->getAltitude());
 }
 
 //
@@ -87,6 +129,14 @@ int main(int argc, char **argv)
 
     double focal_pixels = -1.0;
 
+    int nb_workers = 0;
+
+    // GPS pair generation parameters
+    double dGpsRadius = 0.0;
+    int iGpsNeighbors = 0;
+    double dGpsMaxAltitudeDifference = -1.0;
+    int iNoGpsNeighbors = 10;
+
     cmd.add( make_option('i', sImageDir, "imageDirectory") );
     cmd.add( make_option('s', sSemanticImgDir, "semantic segmentation image directory") );  // added by chenyu
     cmd.add( make_option('d', sfileDatabase, "sensorWidthDatabase") );
@@ -96,6 +146,11 @@ int main(int argc, char **argv)
     cmd.add( make_option('c', i_User_camera_model, "camera_model") );
     cmd.add( make_option('g', b_Group_camera_model, "group_camera_model") );
     cmd.add( make_option('e', bExifGpsInfo, "exif_gps_info") );
+    cmd.add( make_option('r', dGpsRadius, "gps_radius") );
+    cmd.add( make_option('n', iGpsNeighbors, "gps_neighbors") );
+    cmd.add( make_option('a', dGpsMaxAltitudeDifference, "gps_altitude_difference") );
+    cmd.add( make_option('w', iNoGpsNeighbors, "no_gps_window") );
+    cmd.add( make_option('t', nb_workers, "numThreads") );
 
     try {
         if (argc == 1) throw std::string("Invalid command line parameter.");
@@ -116,7 +171,16 @@ int main(int argc, char **argv)
                   << "[-g|--group_camera_model]\n"
                   << "\t 0-> each view have it's own camera intrinsic parameters,\n"
                   << "\t 1-> (default) view can share some camera intrinsic parameters\n"
-                  << "[-e|--exif_gps_info]\n"
+                  << "[-e|--exif_gps_info] generate the image pairs from the GPS EXIF info (pair_list.txt)\n"
+                  << "[-r|--gps_radius] pair the images closer than this distance (m)\n"
+                  << "\t 0-> (default) pair the images with overlapping ground footprints\n"
+                  << "[-n|--gps_neighbors] keep only the k nearest images of each image (default 0: all)\n"
+                  << "[-a|--gps_altitude_difference] reject the pairs with a larger altitude difference (m)\n"
+                  << "\t (default -1: no altitude gating)\n"
+                  << "[-w|--no_gps_window] pair an image without GPS with this number\n"
+                  << "\t of previous and next images (default 10)\n"
+                  << "[-t|--numThreads] number of images read concurrently\n"
+                  << "\t 0 (default): 2 * number of cores (the reading is I/O bound)\n"
                   << std::endl;
 
         std::cerr << s << std::endl;
@@ -133,7 +197,26 @@ int main(int argc, char **argv)
               << "--intrinsics " << sKmatrix << std::endl
               << "--camera_model " << i_User_camera_model << std::endl
               << "--group_camera_model " << b_Group_camera_model << std::endl
-              << "--exif_gps_info " << bExifGpsInfo << std::endl;
+              << "--exif_gps_info " << bExifGpsInfo << std::endl
+              << "--gps_radius " << dGpsRadius << std::endl
+              << "--gps_neighbors " << iGpsNeighbors << std::endl
+              << "--gps_altitude_difference " << dGpsMaxAltitudeDifference << std::endl
+              << "--no_gps_window " << iNoGpsNeighbors << std::endl
+              << "--numThreads " << nb_workers << std::endl;
+
+    if (iGpsNeighbors < 0 || iNoGpsNeighbors < 0)
+    {
+        std::cerr << "\nInvalid GPS neighbors count." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (nb_workers < 0)
+    {
+        std::cerr << "\nInvalid number of threads." << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (nb_workers == 0)
+        nb_workers = 2 * std::max(1u, std::thread::hardware_concurrency());
 
     // Expected properties for each image
     double width = -1, height = -1, focal = -1, ppx = -1,  ppy = -1;
@@ -190,6 +273,7 @@ int main(int argc, char **argv)
             return EXIT_FAILURE;
         }
     }
+    const Datasheet_Database database(vec_database);
 
     // extract an array of filenames (not paths) of all the files found in the specified folder.
     // each of these names can be combined with folder and form _filespec() to give the 
@@ -228,45 +312,62 @@ int main(int argc, char **argv)
     sfm_data.s_seg_root_path = sSemanticImgDir; // Setup semantic image root_path
     Views & views = sfm_data.views;
     Intrinsics & intrinsics = sfm_data.intrinsics;
+    // Per view: GPS position (latitude, longitude, altitude) and ground footprint
     std::vector<Vec3> gpsInfo;
+    std::vector<double> gpsFootprint;
 
-    C_Progress_display my_progress_bar( vec_image.size(),
-                                        std::cout, "\n- Image listing -\n" );
+    // Read the image headers concurrently (the latency of network-mounted
+    // folders is hidden by the number of images in flight)
+    std::vector<Image_Metadata> vec_metadata(vec_image.size());
+    {
+        C_Progress_display my_progress_bar( vec_image.size(),
+                                            std::cout, "\n- Image listing -\n" );
+        std::mutex progress_mutex;
+        std::atomic<size_t> next_image(0);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < std::min<int>(nb_workers, vec_image.size()); ++i)
+        {
+            workers.emplace_back([&]()
+            {
+                for (size_t k = next_image++; k < vec_image.size(); k = next_image++)
+                {
+                    readImageMetadata(stlplus::create_filespec( sImageDir, vec_image[k] ), vec_metadata[k]);
+                    std::lock_guard<std::mutex> lock(progress_mutex);
+                    ++my_progress_bar;
+                }
+            });
+        }
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    // Build the views and intrinsics in the listing order
     std::ostringstream error_report_stream;
-    int k = 0;
-    for ( std::vector<std::string>::const_iterator iter_image = vec_image.begin();
-          iter_image != vec_image.end();
-          ++iter_image, ++my_progress_bar, ++k )
+    for (size_t k = 0; k < vec_image.size(); ++k)
     {
         // Read meta data to fill camera parameter (w,h,focal,ppx,ppy) fields.
         width = height = ppx = ppy = focal = -1.0;
 
-        const std::string sImageFilename = stlplus::create_filespec( sImageDir, *iter_image );
+        const std::string sImageFilename = stlplus::create_filespec( sImageDir, vec_image[k] );
+        const Image_Metadata & metadata = vec_metadata[k];
 
         // Test if the image format is supported:
-        if (i23dSFM::image::GetFormat(sImageFilename.c_str()) == i23dSFM::image::Unknown)
+        if (!metadata.bKnownFormat)
         {
             error_report_stream
                     << stlplus::filename_part(sImageFilename) << ": Unkown image file format." << "\n";
             continue; // image cannot be opened
         }
 
-        ImageHeader imgHeader;
-        if (!i23dSFM::image::ReadImageHeader(sImageFilename.c_str(), &imgHeader))
+        if (!metadata.bReadHeader)
             continue; // image cannot be read
 
-        width = imgHeader.width;
-        height = imgHeader.height;
+        width = metadata.width;
+        height = metadata.height;
         ppx = width / 2.0;
         ppy = height / 2.0;
 
-        std::unique_ptr<Exif_IO> exifReader(new Exif_IO_EasyExif());
-        exifReader->open( sImageFilename );
-
-        const bool bHaveValidExifMetadata =
-                exifReader->doesHaveExifInfo()
-                && !exifReader->getBrand().empty()
-                && !exifReader->getModel().empty();
+        const bool bHaveValidExifMetadata = metadata.bHaveValidExifMetadata;
 
         // Consider the case where the focal is provided manually
         if ( !bHaveValidExifMetadata || focal_pixels != -1)
@@ -282,11 +383,11 @@ int main(int argc, char **argv)
         }
         else // If image contains meta data
         {
-            const std::string sCamName = exifReader->getBrand();
-            const std::string sCamModel = exifReader->getModel();
+            const std::string & sCamName = metadata.sCamName;
+            const std::string & sCamModel = metadata.sCamModel;
 
             // Handle case where focal length is equal to 0
-            if (exifReader->getFocal() == 0.0f)
+            if (metadata.exifFocal == 0.0f)
             {
                 error_report_stream
                         << stlplus::basename_part(sImageFilename) << ": Focal length is missing." << "\n";
@@ -296,11 +397,11 @@ int main(int argc, char **argv)
                 // Create the image entry in the list file
             {
                 Datasheet datasheet;
-                if ( getInfo( sCamName, sCamModel, vec_database, datasheet ))
+                if ( database.getInfo( sCamName, sCamModel, datasheet ))
                 {
                     // The camera model was found in the database so we can compute it's approximated focal length
                     const double ccdw = datasheet._sensorSize;
-                    focal = std::max ( width, height ) * exifReader->getFocal() / ccdw;
+                    focal = std::max ( width, height ) * metadata.exifFocal / ccdw;
                 }
                 else
                 {
@@ -312,16 +413,6 @@ int main(int argc, char **argv)
             }
         }
 
-        // Add gps info
-        //std::cout << setprecision(6) << setiosflags(ios::fixed);
-        //std::cout << exifReader->allExifData() << std::endl;
-        Vec3 gpsPos;
-        gpsPos[0] = exifReader->getLatitude();
-        gpsPos[1] = exifReader->getLongitude();
-        gpsPos[2] = exifReader->getAltitude();
-        gpsPos[2] = (gpsPos[2] - LAND_HEIGHT) / focal * sqrt(width * width + height * height);
-        gpsInfo.push_back(gpsPos);
-
         // Build intrinsic parameter related to the view
         std::shared_ptr<IntrinsicBase> intrinsic (NULL);
         if(focal < 0)
@@ -330,6 +421,11 @@ int main(int argc, char **argv)
             error_report_stream << "Image " << sImageFilename << " focal length doesn't exist, set it to : " << focal << "\n";
         }
 
+        // Add gps info: the ground footprint is the image diagonal seen from the flight height
+        const Vec3 & gpsPos = metadata.gpsPos;
+        gpsInfo.push_back(gpsPos);
+        gpsFootprint.push_back((gpsPos[2] - LAND_HEIGHT) / focal * sqrt(width * width + height * height));
+
         if (focal > 0 && ppx > 0 && ppy > 0 && width > 0 && height > 0)
         {
             // Create the desired camera type
@@ -360,7 +456,7 @@ int main(int argc, char **argv)
         // Build the view corresponding to the image
         // View v(*iter_image, views.size(), views.size(), views.size(), width, height);
         // v.semantic_img_path = vec_semantic_image[k];
-        View v(*iter_image, vec_semantic_image[k], views.size(), views.size(), views.size(), width, height);
+        View v(vec_image[k], vec_semantic_image[k], views.size(), views.size(), views.size(), width, height);
 
         // Add intrinsic related to the image (if any)
         if (intrinsic == NULL)
@@ -390,46 +486,43 @@ int main(int argc, char **argv)
     // Generate  pair list according to the gps info
     if(bExifGpsInfo)
     {
-        ofstream ofPairList(stlplus::create_filespec( sOutputDir, "pair_list.txt" ).c_str());
-        int i, j;
-        for(i = 0; i < gpsInfo.size(); i++)
+        using namespace i23dSFM::matching_image_collection;
+
+        // Local ENU positions around the mean GPS position
+        std::vector<GPS_Image_Position> gpsPositions(gpsInfo.size());
+        Vec3 gpsReference = Vec3::Zero();
+        size_t nbGpsImages = 0;
+        for (size_t i = 0; i < gpsInfo.size(); ++i)
         {
             // No GPS EXIF infomation
-            if((fabs(gpsInfo[i][0]) < 1e-6) &&
-               (fabs(gpsInfo[i][1]) < 1e-6) &&
-               (fabs(gpsInfo[i][2]) < 1e-6))
+            gpsPositions[i]._bValid = fabs(gpsInfo[i][0]) > 1e-6 || fabs(gpsInfo[i][1]) > 1e-6;
+            if (gpsPositions[i]._bValid)
             {
-                ofPairList << i;
-                for(j = 0; j < gpsInfo.size(); j++)
-                    if(j != i)
-                        ofPairList << " " << j;
-                ofPairList << "\n";
-            }
-                // Find near photos
-            else
-            {
-                bool hasNearPhoto = false;
-                for(j = 0; j < gpsInfo.size(); j++)
-                    if(i != j)
-                    {
-                        //cout << calcDistanceByGPS(gpsInfo[i], gpsInfo[j]) << " "
-                        //     << gpsInfo[i][2] << " "
-                        //     << gpsInfo[j][2] << endl;
-                        if(calcDistanceByGPS(gpsInfo[i], gpsInfo[j]) < max(gpsInfo[i][2], gpsInfo[j][2]))
-                        {
-                            if(!hasNearPhoto)
-                            {
-                                ofPairList << i;
-                                hasNearPhoto = true;
-                            }
-                            ofPairList << " " << j;
-                        }
-                    }
-                if(hasNearPhoto)
-                    ofPairList << "\n";
+                gpsReference += gpsInfo[i];
+                ++nbGpsImages;
             }
         }
-        ofPairList.close();
+        if (nbGpsImages > 0)
+            gpsReference /= static_cast<double>(nbGpsImages);
+        for (size_t i = 0; i < gpsInfo.size(); ++i)
+        {
+            if (!gpsPositions[i]._bValid)
+                continue;
+            gpsPositions[i]._enu = GPSToLocalENU(gpsInfo[i], gpsReference);
+            gpsPositions[i]._radius = std::max(0.0, gpsFootprint[i]);
+        }
+
+        const GPS_Pair_Options gpsOptions(
+            dGpsRadius,
+            static_cast<size_t>(iGpsNeighbors),
+            dGpsMaxAltitudeDifference,
+            -1.0, // EXIF heading is not read: no heading gating
+            static_cast<size_t>(iNoGpsNeighbors));
+        const Pair_Set gpsPairs = GPSNeighborPairs(gpsPositions, gpsOptions);
+        std::cout << "\n#images with GPS: " << nbGpsImages << "/" << gpsInfo.size()
+                  << ", #GPS pairs: " << gpsPairs.size() << std::endl;
+        if (!savePairs(stlplus::create_filespec( sOutputDir, "pair_list.txt" ), gpsPairs))
+            return EXIT_FAILURE;
     }
 
     // Group camera that share common properties if desired (leads to more faster & stable BA).
@@ -105,7 +105,7 @@ int main(int argc, char ** argv)
   tracks::STLMAPTracks map_tracks;
   {
     const i23dSFM::matching::PairWiseMatches & map_Matches = matches_provider->_pairWise_matches;
-    tracks::TracksBuilder tracksBuilder;
+    tracks::FlatTracksBuilder tracksBuilder;
     tracksBuilder.Build(map_Matches);
     tracksBuilder.Filter();
     tracksBuilder.ExportToSTL(map_tracks);
@@ -80,6 +80,7 @@ bool exportToCMPMVSFormat(
     // Export (calibrated) views as undistorted images
     std::pair<int,int> w_h_image_size;
     Image<RGBColor> image, image_ud;
+    Undistortion_Map_Cache undistortion_maps; // one map per intrinsic
     for(Views::const_iterator iter = sfm_data.GetViews().begin();
       iter != sfm_data.GetViews().end(); ++iter, ++my_progress_bar)
     {
@@ -113,7 +114,8 @@ bool exportToCMPMVSFormat(
       {
         // undistort the image and save it
         ReadImage( srcImage.c_str(), &image);
-        UndistortImage(image, cam, image_ud, BLACK);
+        UndistortImage(image, undistortion_maps.Get(view->id_intrinsic, cam, image.Width(), image.Height()),
+          image_ud, BLACK);
         WriteImage(dstImage.c_str(), image_ud);
       }
       else // (no distortion)
@@ -10,6 +10,7 @@
 
 #include "i23dSFM/sfm/sfm.hpp"
 #include "i23dSFM/image/image.hpp"
+#include "software/SfM/SfMImageExportHelper.hpp"
 
 using namespace i23dSFM;
 using namespace i23dSFM::cameras;
@@ -50,7 +51,8 @@ create_thumbnail
 
 bool exportToMVE2Format(
   const SfM_Data & sfm_data,
-  const std::string & sOutDirectory // Output MVE2 files directory
+  const std::string & sOutDirectory, // Output MVE2 files directory
+  const SfMImageExport::Image_Export_Options & export_options = SfMImageExport::Image_Export_Options()
   )
 {
   bool bOk = true;
@@ -93,11 +95,10 @@ bool exportToMVE2Format(
 
     // Export (calibrated) views as undistorted images
     C_Progress_display my_progress_bar(sfm_data.GetViews().size());
-    std::pair<int,int> w_h_image_size;
-    Image<RGBColor> image, image_ud, thumbnail;
+    std::vector<SfMImageExport::Image_Export_Job> export_jobs;
     std::string sOutViewIteratorDirectory;
     for(Views::const_iterator iter = sfm_data.GetViews().begin();
-      iter != sfm_data.GetViews().end(); ++iter, ++my_progress_bar)
+      iter != sfm_data.GetViews().end(); ++iter)
     {
       const View * view = iter->second.get();
 
@@ -120,27 +121,9 @@ bool exportToMVE2Format(
 
         Intrinsics::const_iterator iterIntrinsic = sfm_data.GetIntrinsics().find(view->id_intrinsic);
         const IntrinsicBase * cam = iterIntrinsic->second.get();
-        if (cam->have_disto())
-        {
-          // Undistort and save the image
-          ReadImage(srcImage.c_str(), &image);
-          UndistortImage(image, cam, image_ud, BLACK);
-          WriteImage(dstImage.c_str(), image_ud);
-        }
-        else // (no distortion)
-        {
-          // If extensions match, copy the PNG image
-          if (stlplus::extension_part(srcImage) == "PNG" ||
-            stlplus::extension_part(srcImage) == "png")
-          {
-            stlplus::file_copy(srcImage, dstImage);
-          }
-          else
-          {
-            ReadImage( srcImage.c_str(), &image);
-            WriteImage( dstImage.c_str(), image);
-          }
-        }
+        // Undistort and save the image (copy the PNG image if there is no distortion)
+        export_jobs.push_back(SfMImageExport::MakeImageExportJob(view->id_view, view->id_intrinsic,
+          cam, srcImage, dstImage));
 
         // Prepare to write an MVE 'meta.ini' file for the current view
         const Pose3 pose = sfm_data.GetPoseOrDie(view);
@@ -195,16 +178,21 @@ bool exportToMVE2Format(
         // see: https://github.com/simonfuhrmann/mve/blob/952a80b0be48e820b8c72de1d3df06efc3953bd3/libs/mve/bundle_io.cc#L448
         for (int i = 0; i < 5 * 3; ++i)
           out << "0" << (i % 3 == 2 ? "\n" : " ");
-        continue;
+        ++my_progress_bar;
       }
-
-      // Save a thumbnail image "thumbnail.png", 50x50 pixels
-      thumbnail = create_thumbnail(image, 50, 50);
-      const std::string dstThumbnailImage =
-        stlplus::create_filespec(stlplus::folder_append_separator(sOutViewIteratorDirectory), "thumbnail","png");
-      WriteImage(dstThumbnailImage.c_str(), thumbnail);
     }
 
+    // Save the images and a thumbnail image "thumbnail.png", 50x50 pixels, per view
+    bOk &= SfMImageExport::ExportImages(export_jobs, export_options,
+      [](const SfMImageExport::Image_Export_Job & job, const Image<RGBColor> & image_ud)
+      {
+        const Image<RGBColor> thumbnail = create_thumbnail(image_ud, 50, 50);
+        const std::string dstThumbnailImage =
+          stlplus::create_filespec(stlplus::folder_part(job.sDstImage), "thumbnail","png");
+        return WriteImage(dstThumbnailImage.c_str(), thumbnail) != 0;
+      },
+      &my_progress_bar);
+
     // For each feature, write to bundle:  position XYZ[0-3], color RGB[0-2], all ref.view_id & ref.feature_id
     // The following method is adapted from Simon Fuhrmann's MVE project:
     // https://github.com/simonfuhrmann/mve/blob/e3db7bc60ce93fe51702ba77ef480e151f927c23/libs/mve/bundle_io.cc
@@ -239,8 +227,13 @@ int main(int argc, char *argv[])
   CmdLine cmd;
   std::string sSfM_Data_Filename;
   std::string sOutDir = "";
+  SfMImageExport::Image_Export_Options export_options;
   cmd.add( make_option('i', sSfM_Data_Filename, "sfmdata") );
   cmd.add( make_option('o', sOutDir, "outdir") );
+  cmd.add( make_option('d', export_options._nb_decoders, "numDecoders") );
+  cmd.add( make_option('u', export_options._nb_undistorters, "numUndistorters") );
+  cmd.add( make_option('w', export_options._nb_encoders, "numEncoders") );
+  cmd.add( make_option('q', export_options._nb_max_in_flight, "maxInFlightImages") );
   std::cout << "Note:  this program writes output in MVE file format.\n";
 
   try {
@@ -250,6 +243,11 @@ int main(int argc, char *argv[])
       std::cerr << "Usage: " << argv[0] << '\n'
       << "[-i|--sfmdata] filename, the SfM_Data file to convert\n"
       << "[-o|--outdir] path\n"
+      << "[-d|--numDecoders] number of image decoding threads\n"
+      << "[-u|--numUndistorters] number of image undistortion threads\n"
+      << "[-w|--numEncoders] number of image encoding threads\n"
+      << "   0 (default): automatic, from the number of hardware threads\n"
+      << "[-q|--maxInFlightImages] max number of images loaded at once\n"
       << std::endl;
 
       std::cerr << s << std::endl;
@@ -268,7 +266,7 @@ int main(int argc, char *argv[])
     return EXIT_FAILURE;
   }
 
-  if (exportToMVE2Format(sfm_data, stlplus::folder_append_separator(sOutDir) + "MVE"))
+  if (exportToMVE2Format(sfm_data, stlplus::folder_append_separator(sOutDir) + "MVE", export_options))
     return( EXIT_SUCCESS );
   else
     return( EXIT_FAILURE );
@@ -7,6 +7,7 @@
 
 #include "i23dSFM/sfm/sfm.hpp"
 #include "i23dSFM/image/image.hpp"
+#include "software/SfM/SfMImageExportHelper.hpp"
 
 using namespace i23dSFM;
 using namespace i23dSFM::cameras;
@@ -28,7 +29,8 @@ bool exportToPMVSFormat(
   const std::string & sOutDirectory,  //Output PMVS files directory
   const int downsampling_factor,
   const int CPU_core_count,
-  const bool b_VisData = true
+  const bool b_VisData = true,
+  const SfMImageExport::Image_Export_Options & export_options = SfMImageExport::Image_Export_Options()
   )
 {
   bool bOk = true;
@@ -90,13 +92,16 @@ bool exportToPMVSFormat(
     }
 
     // Export (calibrated) views as undistorted images
-    Image<RGBColor> image, image_ud;
+    std::vector<SfMImageExport::Image_Export_Job> export_jobs;
     for(Views::const_iterator iter = sfm_data.GetViews().begin();
-      iter != sfm_data.GetViews().end(); ++iter, ++my_progress_bar)
+      iter != sfm_data.GetViews().end(); ++iter)
     {
       const View * view = iter->second.get();
       if (!sfm_data.IsPoseAndIntrinsicDefined(view))
+      {
+        ++my_progress_bar;
         continue;
+      }
 
       Intrinsics::const_iterator iterIntrinsic = sfm_data.GetIntrinsics().find(view->id_intrinsic);
 
@@ -107,29 +112,12 @@ bool exportToPMVSFormat(
       const std::string dstImage = stlplus::create_filespec(
         stlplus::folder_append_separator(sOutDirectory) + "visualize", os.str(),"jpg");
 
-      const IntrinsicBase * cam = iterIntrinsic->second.get();
-      if (cam->have_disto())
-      {
-        // undistort the image and save it
-        ReadImage( srcImage.c_str(), &image);
-        UndistortImage(image, cam, image_ud, BLACK);
-        WriteImage(dstImage.c_str(), image_ud);
-      }
-      else // (no distortion)
-      {
-        // copy the image if extension match
-        if (stlplus::extension_part(srcImage) == "JPG" ||
-          stlplus::extension_part(srcImage) == "jpg")
-        {
-          stlplus::file_copy(srcImage, dstImage);
-        }
-        else
-        {
-          ReadImage( srcImage.c_str(), &image);
-          WriteImage( dstImage.c_str(), image);
-        }
-      }
+      // undistort the image and save it (copy the image if there is no distortion and extension match)
+      export_jobs.push_back(SfMImageExport::MakeImageExportJob(view->id_view, view->id_intrinsic,
+        iterIntrinsic->second.get(), srcImage, dstImage));
     }
+    bOk &= SfMImageExport::ExportImages(export_jobs, export_options,
+      SfMImageExport::Image_Export_Callback(), &my_progress_bar);
 
     //pmvs_options.txt
     std::ostringstream os;
@@ -308,12 +296,18 @@ int main(int argc, char *argv[]) {
   int resolution = 1;
   int CPU = 8;
   bool bVisData = true;
+  SfMImageExport::Image_Export_Options export_options;
 
   cmd.add( make_option('i', sSfM_Data_Filename, "sfmdata") );
   cmd.add( make_option('o', sOutDir, "outdir") );
   cmd.add( make_option('r', resolution, "resolution") );
   cmd.add( make_option('c', CPU, "CPU") );
   cmd.add( make_option('v', bVisData, "useVisData") );
+  cmd.add( make_option('d', export_options._nb_decoders, "numDecoders") );
+  cmd.add( make_option('u', export_options._nb_undistorters, "numUndistorters") );
+  cmd.add( make_option('w', export_options._nb_encoders, "numEncoders") );
+  cmd.add( make_option('q', export_options._nb_max_in_flight, "maxInFlightImages") );
+  cmd.add( make_option('j', export_options._jpeg_quality, "jpegQuality") );
 
   try {
       if (argc == 1) throw std::string("Invalid command line parameter.");
@@ -324,7 +318,13 @@ int main(int argc, char *argv[]) {
       << "[-o|--outdir path]\n"
       << "[-r|--resolution] divide image coefficient\n"
       << "[-c|--nb core]\n"
-      << "[-v|--useVisData] use visibility information."
+      << "[-v|--useVisData] use visibility information.\n"
+      << "[-d|--numDecoders] number of image decoding threads\n"
+      << "[-u|--numUndistorters] number of image undistortion threads\n"
+      << "[-w|--numEncoders] number of image encoding threads\n"
+      << "   0 (default): automatic, from the number of hardware threads\n"
+      << "[-q|--maxInFlightImages] max number of images loaded at once\n"
+      << "[-j|--jpegQuality] quality of the JPEG images (default 90)"
       << std::endl;
 
       std::cerr << s << std::endl;
@@ -347,7 +347,8 @@ int main(int argc, char *argv[]) {
       stlplus::folder_append_separator(sOutDir) + "PMVS",
       resolution,
       CPU,
-      bVisData);
+      bVisData,
+      export_options);
 
     exportToBundlerFormat(sfm_data,
       stlplus::folder_append_separator(sOutDir) +
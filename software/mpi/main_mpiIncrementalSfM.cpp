@@ -20,7 +20,6 @@
 #include"my_mpi.h"
 #include"mpi_bundle_adjustment.h"
 #define FOCAL_DIFF_THRESHOLD 0.04
-#define MASTER_SERVER 0
 using namespace i23dSFM;
 using namespace i23dSFM::cameras;
 using namespace i23dSFM::sfm;
@@ -62,38 +61,43 @@ bool computeIndexFromImageNames(
 }
 
 
-int main(int argc, char **argv)
+/// Sequential SfM engine running its bundle adjustments on the MPI workers
+class MPI_SequentialSfMReconstructionEngine : public SequentialSfMReconstructionEngine
+{
+public:
+    MPI_SequentialSfMReconstructionEngine(
+            const SfM_Data & sfm_data,
+            const std::string & soutDirectory,
+            const std::string & loggingFile,
+            const MPI_BA_options & ba_options)
+            :SequentialSfMReconstructionEngine(sfm_data, soutDirectory, loggingFile),
+             _ba_options(ba_options)
+    {
+    }
+
+protected:
+    bool BundleAdjustment(Landmarks_CSR & landmarks)
+    {
+        // The scene is split and sent to the workers as SfM_Data sub-scenes
+        landmarks.Export(_sfm_data.structure);
+        const bool bAdjusted = master_bundle_adjustment(_sfm_data, _bFixedIntrinsics, _ba_options);
+        landmarks.Build(_sfm_data.structure);
+        Landmarks().swap(_sfm_data.structure);
+        return bAdjusted;
+    }
+
+private:
+    MPI_BA_options _ba_options;
+};
+
+/// Master process: the sequential reconstruction itself
+int master_main(int argc, char **argv)
 {
     using namespace std;
     std::cout << "Sequential/Incremental reconstruction" << std::endl
               << " Perform incremental SfM (Initial Pair Essential + Resection)." << std::endl
               << std::endl;
 
-    MPI_Init(NULL,NULL);
-    int world_size;
-    MPI_Comm_size(MPI_COMM_WORLD, &world_size);//得到所有参加运算的进程的个数
-
-    // unsigned  Running=1;
-
-    //get the rank of the process
-    int world_rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);//得到当前正在运行的进程的标识号
-    if(world_rank!=MASTER_SERVER){
-        extern int flag;
-        do{
-            MPI_Status status;
-            MPI_Recv(&flag,1,MPI_UNSIGNED,MASTER_SERVER,STATUS,MPI_COMM_WORLD,&status);
-            if(!flag){
-                break;
-            }else{
-                //client_bundle_adjustment();
-
-                //返回结果
-            }
-        }while(flag);
-        MPI_Finalize();
-    }
-
     CmdLine cmd;
 
     std::string sSfM_Data_Filename;
@@ -103,6 +107,7 @@ int main(int argc, char **argv)
     bool bRefineIntrinsics = true;
     int i_User_camera_model = PINHOLE_CAMERA_RADIAL3;
     bool bRepeatFocal = false;
+    MPI_BA_options ba_options;
 
     cmd.add( make_option('i', sSfM_Data_Filename, "input_file") );
     cmd.add( make_option('m', sMatchesDir, "matchdir") );
@@ -112,6 +117,8 @@ int main(int argc, char **argv)
     cmd.add( make_option('c', i_User_camera_model, "camera_model") );
     cmd.add( make_option('f', bRefineIntrinsics, "refineIntrinsics") );
     cmd.add( make_option('r', bRepeatFocal, "repeatFocal") );
+    cmd.add( make_option('n', ba_options._nbMaxIterations, "admm_iterations") );
+    cmd.add( make_option('p', ba_options._minPosesPerCluster, "cluster_min_poses") );
 
     try {
         if (argc == 1) throw std::string("Invalid parameter.");
@@ -133,6 +140,9 @@ int main(int argc, char **argv)
                   << "[-r|--repeatFocal] \n"
                   << "\t 0-> calculate focal length only once (default). \n"
                   << "\t 1-> repeat refine focal length. \n"
+                  << "[-n|--admm_iterations] maximal number of distributed bundle adjustment rounds (default 20)\n"
+                  << "[-p|--cluster_min_poses] minimal number of poses per worker cluster (default 50)\n"
+                  << "\t smaller scenes are adjusted on the master only.\n"
                   << std::endl;
 
         std::cerr << s << std::endl;
@@ -216,10 +226,11 @@ int main(int argc, char **argv)
             iVec++;
         }
 
-        SequentialSfMReconstructionEngine sfmEngine(
+        MPI_SequentialSfMReconstructionEngine sfmEngine(
                 sfm_data,
                 sOutDir,
-                stlplus::create_filespec(sOutDir, "Reconstruction_Report.html"));
+                stlplus::create_filespec(sOutDir, "Reconstruction_Report.html"),
+                ba_options);
 
         // Configure the features_provider & the matches_provider
         sfmEngine.SetFeaturesProvider(feats_provider.get());
@@ -278,3 +289,26 @@ int main(int argc, char **argv)
     }
     return EXIT_FAILURE;
 }
+
+int main(int argc, char **argv)
+{
+    MPI_Init(&argc, &argv);
+
+    //get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);//得到当前正在运行的进程的标识号
+
+    int ret = EXIT_SUCCESS;
+    if (world_rank != MASTER_SERVER)
+    {
+        // Workers serve the bundle adjustment requests until the master is done
+        client_bundle_adjustment();
+    }
+    else
+    {
+        ret = master_main(argc, argv);
+        stop_bundle_adjustment_clients();
+    }
+    MPI_Finalize();
+    return ret;
+}
@@ -1,17 +1,448 @@
+
 /// Bundle adjustment to refine Structure; Motion and Intrinsics
 #include"mpi_bundle_adjustment.h"
+#include"mpi_bundle_adjustment_consensus.h"
+#include"my_mpi.h"
+
+#include "i23dSFM/sfm/sfm_data_BA_ceres.hpp"
+#include "i23dSFM/sfm/sfm_data_io_cereal.hpp"
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include"mpi.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <queue>
+#include <sstream>
 
 namespace i23dSFM{
     using namespace sfm;
-    bool master_bundle_adjustment(SfM_Data & _sfm_data,const bool& _bFixedIntrinsics){
-            //拆分数据
+    using namespace cameras;
+    using namespace geometry;
+    using namespace mpi_ba;
+
+namespace {
 
+    //----
+    //-- MPI messages
+    //----
 
-            //汇总数据
+    void SendCommand(int command, int rank)
+    {
+        MPI_Send(&command, 1, MPI_INT, rank, STATUS, MPI_COMM_WORLD);
+    }
+
+    void SendDoubles(const std::vector<double> & buffer, int rank, int tag)
+    {
+        MPI_Send(const_cast<double*>(buffer.data()), static_cast<int>(buffer.size()),
+                 MPI_DOUBLE, rank, tag, MPI_COMM_WORLD);
+    }
 
+    std::vector<double> RecvDoubles(int rank, int tag)
+    {
+        MPI_Status status;
+        MPI_Probe(rank, tag, MPI_COMM_WORLD, &status);
+        int count = 0;
+        MPI_Get_count(&status, MPI_DOUBLE, &count);
+        std::vector<double> buffer(count);
+        MPI_Recv(buffer.data(), count, MPI_DOUBLE, rank, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        return buffer;
     }
 
-    bool client_bundle_adjustment(SfM_Data & _sfm_data,const bool& _bFixedIntrinsics){
+    void SendString(const std::string & buffer, int rank, int tag)
+    {
+        MPI_Send(const_cast<char*>(buffer.data()), static_cast<int>(buffer.size()),
+                 MPI_CHAR, rank, tag, MPI_COMM_WORLD);
+    }
+
+    std::string RecvString(int rank, int tag)
+    {
+        MPI_Status status;
+        MPI_Probe(rank, tag, MPI_COMM_WORLD, &status);
+        int count = 0;
+        MPI_Get_count(&status, MPI_CHAR, &count);
+        std::string buffer(count, '\0');
+        MPI_Recv(&buffer[0], count, MPI_CHAR, rank, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        return buffer;
+    }
+
+    //----
+    //-- Parametrization (same as Bundle_Adjustment_Ceres: angleAxis + translation)
+    //----
+
+    std::vector<double> PoseToParams(const Pose3 & pose)
+    {
+        const Mat3 R = pose.rotation();
+        const Vec3 t = pose.translation();
+        double angleAxis[3];
+        ceres::RotationMatrixToAngleAxis((const double*)R.data(), angleAxis);
+        return {angleAxis[0], angleAxis[1], angleAxis[2], t(0), t(1), t(2)};
+    }
+
+    Pose3 ParamsToPose(const double * params)
+    {
+        Mat3 R_refined;
+        ceres::AngleAxisToRotationMatrix(params, R_refined.data());
+        const Vec3 t_refined(params[3], params[4], params[5]);
+        return Pose3(R_refined, -R_refined.transpose() * t_refined);
+    }
+
+    /// ADMM proximal term: sqrt(rho) * (x - target)
+    class ConsensusCostFunction : public ceres::CostFunction
+    {
+    public:
+        ConsensusCostFunction(int size, const double * target, const double * sqrt_rho)
+            :_size(size), _target(target), _sqrt_rho(sqrt_rho)
+        {
+            set_num_residuals(size);
+            mutable_parameter_block_sizes()->push_back(size);
+        }
+
+        bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const
+        {
+            for (int i = 0; i < _size; ++i)
+                residuals[i] = (*_sqrt_rho) * (parameters[0][i] - _target[i]);
+            if (jacobians && jacobians[0])
+            {
+                std::fill(jacobians[0], jacobians[0] + _size * _size, 0.0);
+                for (int i = 0; i < _size; ++i)
+                    jacobians[0][i * _size + i] = *_sqrt_rho;
+            }
+            return true;
+        }
+
+    private:
+        const int _size;
+        const double * _target;
+        const double * _sqrt_rho;
+    };
+
+    /// Worker side local solver. The Ceres problem is built once and solved
+    /// again at each ADMM round (warm started) with updated consensus targets.
+    class ClusterSolver
+    {
+    public:
+        explicit ClusterSolver(const ClusterProblem & cluster)
+            :_cluster(cluster), _sqrt_rho(0.0)
+        {
+            SfM_Data & sfm_data = _cluster.sfm_data;
+
+            for (Poses::const_iterator itPose = sfm_data.poses.begin(); itPose != sfm_data.poses.end(); ++itPose)
+            {
+                _map_poses[itPose->first] = PoseToParams(itPose->second);
+                _problem.AddParameterBlock(&_map_poses[itPose->first][0], 6);
+            }
+            for (Intrinsics::const_iterator itIntrinsic = sfm_data.intrinsics.begin();
+                 itIntrinsic != sfm_data.intrinsics.end(); ++itIntrinsic)
+            {
+                _map_intrinsics[itIntrinsic->first] = itIntrinsic->second->getParams();
+                double * parameter_block = &_map_intrinsics[itIntrinsic->first][0];
+                _problem.AddParameterBlock(parameter_block, _map_intrinsics[itIntrinsic->first].size());
+                if (!_cluster.bRefineIntrinsics)
+                    _problem.SetParameterBlockConstant(parameter_block);
+            }
+
+            // Same robust reprojection error as Bundle_Adjustment_Ceres
+            ceres::LossFunction * p_LossFunction = new ceres::HuberLoss(Square(4.0));
+            for (Landmarks::iterator iterTracks = sfm_data.structure.begin();
+                 iterTracks != sfm_data.structure.end(); ++iterTracks)
+            {
+                const Observations & obs = iterTracks->second.obs;
+                for (Observations::const_iterator itObs = obs.begin(); itObs != obs.end(); ++itObs)
+                {
+                    const View * view = sfm_data.views.at(itObs->first).get();
+                    ceres::CostFunction* cost_function =
+                        IntrinsicsToCostFunction(sfm_data.intrinsics[view->id_intrinsic].get(), itObs->second.x);
+                    if (cost_function)
+                        _problem.AddResidualBlock(cost_function,
+                                                  p_LossFunction,
+                                                  &_map_intrinsics[view->id_intrinsic][0],
+                                                  &_map_poses[view->id_pose][0],
+                                                  iterTracks->second.X.data());
+                }
+            }
+
+            // Consensus blocks (same order as the master layout)
+            for (size_t i = 0; i < _cluster.shared_poses.size(); ++i)
+                _shared_blocks.push_back(std::make_pair(&_map_poses[_cluster.shared_poses[i]][0], 6));
+            for (size_t i = 0; i < _cluster.shared_landmarks.size(); ++i)
+                _shared_blocks.push_back(std::make_pair(sfm_data.structure[_cluster.shared_landmarks[i]].X.data(), 3));
+            for (size_t i = 0; i < _cluster.shared_intrinsics.size(); ++i)
+            {
+                std::vector<double> & params = _map_intrinsics[_cluster.shared_intrinsics[i]];
+                _shared_blocks.push_back(std::make_pair(&params[0], static_cast<int>(params.size())));
+            }
+            // All the parameter blocks (restored if a local solve fails)
+            for (Hash_Map<IndexT, std::vector<double> >::iterator it = _map_poses.begin(); it != _map_poses.end(); ++it)
+                _all_blocks.push_back(std::make_pair(&it->second[0], 6));
+            for (Landmarks::iterator it = sfm_data.structure.begin(); it != sfm_data.structure.end(); ++it)
+                _all_blocks.push_back(std::make_pair(it->second.X.data(), 3));
+            for (Hash_Map<IndexT, std::vector<double> >::iterator it = _map_intrinsics.begin(); it != _map_intrinsics.end(); ++it)
+                _all_blocks.push_back(std::make_pair(&it->second[0], static_cast<int>(it->second.size())));
+
+            size_t nbShared = 0;
+            for (size_t i = 0; i < _shared_blocks.size(); ++i)
+                nbShared += _shared_blocks[i].second;
+            _targets.resize(nbShared);
+            for (size_t i = 0, offset = 0; i < _shared_blocks.size(); offset += _shared_blocks[i].second, ++i)
+            {
+                _problem.AddResidualBlock(
+                    new ConsensusCostFunction(_shared_blocks[i].second, &_targets[offset], &_sqrt_rho),
+                    NULL,
+                    _shared_blocks[i].first);
+            }
+        }
+
+        /// Solve the local problem pulled toward the given consensus targets.
+        /// If the solution is not usable the parameters are restored.
+        /// The values before the solve are kept until the master accepts or rejects the round.
+        bool Solve(double rho, const double * targets)
+        {
+            _sqrt_rho = std::sqrt(rho);
+            std::copy(targets, targets + _targets.size(), _targets.begin());
+
+            Bundle_Adjustment_Ceres::BA_options ba_options;
+            ceres::Solver::Options options;
+            options.preconditioner_type = ceres::JACOBI;
+            options.linear_solver_type = ceres::SPARSE_SCHUR;
+            options.sparse_linear_algebra_library_type = ba_options._sparse_linear_algebra_library_type;
+            if (!ceres::IsSparseLinearAlgebraLibraryTypeAvailable(options.sparse_linear_algebra_library_type))
+                options.linear_solver_type = ceres::DENSE_SCHUR;
+            options.max_num_iterations = _cluster.nbLocalIterations;
+            options.minimizer_progress_to_stdout = false;
+            options.logging_type = ceres::SILENT;
+            options.num_threads = ba_options._nbThreads;
+            options.num_linear_solver_threads = ba_options._nbThreads;
+
+            _last_accepted.Save(_all_blocks);
+
+            ceres::Solver::Summary summary;
+            ceres::Solve(options, &_problem, &summary);
+            if (summary.IsSolutionUsable() && std::isfinite(summary.final_cost))
+                return true;
+
+            std::cerr << "Local bundle adjustment failed: " << summary.BriefReport() << std::endl;
+            _last_accepted.Restore(_all_blocks);
+            return false;
+        }
+
+        /// Go back to the values of the last accepted round (the round was rejected by the master)
+        void Reject()
+        {
+            _last_accepted.Restore(_all_blocks);
+        }
+
+        /// Current value of the consensus variables
+        std::vector<double> SharedValues() const
+        {
+            std::vector<double> values;
+            values.reserve(_targets.size());
+            for (size_t i = 0; i < _shared_blocks.size(); ++i)
+                values.insert(values.end(), _shared_blocks[i].first, _shared_blocks[i].first + _shared_blocks[i].second);
+            return values;
+        }
+
+        /// Value of all the cluster parameters (poses, landmarks, refined intrinsics)
+        std::vector<double> AllValues() const
+        {
+            std::vector<double> values;
+            for (Hash_Map<IndexT, std::vector<double> >::const_iterator it = _map_poses.begin();
+                 it != _map_poses.end(); ++it)
+                values.insert(values.end(), it->second.begin(), it->second.end());
+            for (Landmarks::const_iterator it = _cluster.sfm_data.structure.begin();
+                 it != _cluster.sfm_data.structure.end(); ++it)
+                values.insert(values.end(), it->second.X.data(), it->second.X.data() + 3);
+            if (_cluster.bRefineIntrinsics)
+                for (Hash_Map<IndexT, std::vector<double> >::const_iterator it = _map_intrinsics.begin();
+                     it != _map_intrinsics.end(); ++it)
+                    values.insert(values.end(), it->second.begin(), it->second.end());
+            return values;
+        }
+
+    private:
+        ClusterProblem _cluster;
+        Hash_Map<IndexT, std::vector<double> > _map_poses;
+        Hash_Map<IndexT, std::vector<double> > _map_intrinsics;
+        std::vector<std::pair<double*, int> > _shared_blocks;
+        std::vector<std::pair<double*, int> > _all_blocks;
+        ParameterSnapshot _last_accepted;
+        std::vector<double> _targets;
+        double _sqrt_rho;
+        ceres::Problem _problem;
+    };
+
+    //----
+    //-- Scene partitioning
+    //----
+
+    typedef std::map<IndexT, std::map<IndexT, size_t> > CovisibilityGraph;
+
+    /// Number of tracks shared by each pair of poses
+    CovisibilityGraph PoseCovisibility(const SfM_Data & sfm_data)
+    {
+        CovisibilityGraph graph;
+        for (Landmarks::const_iterator itL = sfm_data.structure.begin(); itL != sfm_data.structure.end(); ++itL)
+        {
+            std::set<IndexT> poses;
+            for (Observations::const_iterator itObs = itL->second.obs.begin(); itObs != itL->second.obs.end(); ++itObs)
+                poses.insert(sfm_data.views.at(itObs->first)->id_pose);
+            for (std::set<IndexT>::const_iterator itA = poses.begin(); itA != poses.end(); ++itA)
+                for (std::set<IndexT>::const_iterator itB = std::next(itA); itB != poses.end(); ++itB)
+                {
+                    ++graph[*itA][*itB];
+                    ++graph[*itB][*itA];
+                }
+        }
+        return graph;
+    }
+
+    /// Split the poses in nb_clusters groups of similar size by growing regions
+    /// along the strongest co-visibility edges.
+    /// Note: graph/Normalized_Cut.h is not used since it builds a dense n x n
+    /// Laplacian, which does not scale to thousands of poses.
+    std::vector<std::set<IndexT> > ClusterPoses(
+        const SfM_Data & sfm_data,
+        const CovisibilityGraph & graph,
+        size_t nb_clusters)
+    {
+        const size_t cluster_size = (sfm_data.poses.size() + nb_clusters - 1) / nb_clusters;
+        std::vector<std::set<IndexT> > clusters;
+        std::set<IndexT> assigned;
+        for (Poses::const_iterator itSeed = sfm_data.poses.begin(); itSeed != sfm_data.poses.end(); ++itSeed)
+        {
+            if (assigned.count(itSeed->first))
+                continue;
+            std::set<IndexT> cluster;
+            std::map<IndexT, size_t> gain; // tracks shared with the growing cluster
+            std::priority_queue<std::pair<size_t, IndexT> > frontier;
+            frontier.push(std::make_pair(0, itSeed->first));
+            while (!frontier.empty() && cluster.size() < cluster_size)
+            {
+                const std::pair<size_t, IndexT> top = frontier.top();
+                frontier.pop();
+                if (assigned.count(top.second) || gain[top.second] != top.first)
+                    continue; // outdated entry
+                cluster.insert(top.second);
+                assigned.insert(top.second);
+                CovisibilityGraph::const_iterator itN = graph.find(top.second);
+                if (itN == graph.end())
+                    continue;
+                for (std::map<IndexT, size_t>::const_iterator it = itN->second.begin(); it != itN->second.end(); ++it)
+                {
+                    if (assigned.count(it->first))
+                        continue;
+                    gain[it->first] += it->second;
+                    frontier.push(std::make_pair(gain[it->first], it->first));
+                }
+            }
+            clusters.push_back(cluster);
+        }
+
+        // Disconnected parts may create extra clusters: merge them into the smallest ones
+        while (clusters.size() > nb_clusters)
+        {
+            std::set<IndexT> last = clusters.back();
+            clusters.pop_back();
+            size_t smallest = 0;
+            for (size_t i = 1; i < clusters.size(); ++i)
+                if (clusters[i].size() < clusters[smallest].size())
+                    smallest = i;
+            clusters[smallest].insert(last.begin(), last.end());
+        }
+        return clusters;
+    }
+
+    /// Build the cluster sub-problems: each cluster is extended with the
+    /// neighbouring poses sharing enough tracks and keeps the landmarks
+    /// observed at least twice by its poses.
+    std::vector<ClusterProblem> BuildClusterProblems(
+        const SfM_Data & sfm_data,
+        const std::vector<std::set<IndexT> > & clusters,
+        const CovisibilityGraph & graph,
+        const bool bRefineIntrinsics,
+        const MPI_BA_options & options)
+    {
+        std::map<IndexT, std::vector<size_t> > pose_clusters;
+        for (size_t c = 0; c < clusters.size(); ++c)
+        {
+            std::set<IndexT> extended = clusters[c];
+            for (std::set<IndexT>::const_iterator itP = clusters[c].begin(); itP != clusters[c].end(); ++itP)
+            {
+                CovisibilityGraph::const_iterator itN = graph.find(*itP);
+                if (itN == graph.end())
+                    continue;
+                for (std::map<IndexT, size_t>::const_iterator it = itN->second.begin(); it != itN->second.end(); ++it)
+                    if (it->second >= options._minOverlapTracks)
+                        extended.insert(it->first);
+            }
+            for (std::set<IndexT>::const_iterator itP = extended.begin(); itP != extended.end(); ++itP)
+                pose_clusters[*itP].push_back(c);
+        }
+
+        std::vector<ClusterProblem> problems(clusters.size());
+        for (Landmarks::const_iterator itL = sfm_data.structure.begin(); itL != sfm_data.structure.end(); ++itL)
+        {
+            std::map<size_t, Observations> cluster_obs;
+            for (Observations::const_iterator itObs = itL->second.obs.begin(); itObs != itL->second.obs.end(); ++itObs)
+            {
+                const std::vector<size_t> & cluster_ids = pose_clusters[sfm_data.views.at(itObs->first)->id_pose];
+                for (size_t i = 0; i < cluster_ids.size(); ++i)
+                    cluster_obs[cluster_ids[i]].insert(*itObs);
+            }
+            for (std::map<size_t, Observations>::const_iterator it = cluster_obs.begin(); it != cluster_obs.end(); ++it)
+            {
+                if (it->second.size() < 2)
+                    continue;
+                Landmark & landmark = problems[it->first].sfm_data.structure[itL->first];
+                landmark = itL->second;
+                landmark.obs = it->second;
+            }
+        }
+
+        // Add the views, poses & intrinsics used by the cluster observations
+        std::map<IndexT, size_t> pose_count, landmark_count, intrinsic_count;
+        for (size_t c = 0; c < problems.size(); ++c)
+        {
+            SfM_Data & cluster_data = problems[c].sfm_data;
+            for (Landmarks::const_iterator itL = cluster_data.structure.begin(); itL != cluster_data.structure.end(); ++itL)
+            {
+                ++landmark_count[itL->first];
+                for (Observations::const_iterator itObs = itL->second.obs.begin(); itObs != itL->second.obs.end(); ++itObs)
+                {
+                    const std::shared_ptr<View> & view = sfm_data.views.at(itObs->first);
+                    cluster_data.views[view->id_view] = view;
+                    cluster_data.poses[view->id_pose] = sfm_data.poses.at(view->id_pose);
+                    cluster_data.intrinsics[view->id_intrinsic] = sfm_data.intrinsics.at(view->id_intrinsic);
+                }
+            }
+            for (Poses::const_iterator it = cluster_data.poses.begin(); it != cluster_data.poses.end(); ++it)
+                ++pose_count[it->first];
+            for (Intrinsics::const_iterator it = cluster_data.intrinsics.begin(); it != cluster_data.intrinsics.end(); ++it)
+                ++intrinsic_count[it->first];
+            problems[c].bRefineIntrinsics = bRefineIntrinsics;
+            problems[c].nbLocalIterations = options._nbLocalIterations;
+        }
+
+        for (size_t c = 0; c < problems.size(); ++c)
+        {
+            const SfM_Data & cluster_data = problems[c].sfm_data;
+            for (Poses::const_iterator it = cluster_data.poses.begin(); it != cluster_data.poses.end(); ++it)
+                if (pose_count[it->first] > 1)
+                    problems[c].shared_poses.push_back(it->first);
+            for (Landmarks::const_iterator it = cluster_data.structure.begin(); it != cluster_data.structure.end(); ++it)
+                if (landmark_count[it->first] > 1)
+                    problems[c].shared_landmarks.push_back(it->first);
+            if (bRefineIntrinsics)
+                for (Intrinsics::const_iterator it = cluster_data.intrinsics.begin(); it != cluster_data.intrinsics.end(); ++it)
+                    if (intrinsic_count[it->first] > 1)
+                        problems[c].shared_intrinsics.push_back(it->first);
+        }
+        return problems;
+    }
+
+    bool LocalBundleAdjustment(SfM_Data & _sfm_data, const bool& _bFixedIntrinsics)
+    {
         Bundle_Adjustment_Ceres::BA_options options;
         if (_sfm_data.GetPoses().size() > 100)
         {
@@ -24,6 +455,227 @@ namespace i23dSFM{
         }
         Bundle_Adjustment_Ceres bundle_adjustment_obj(options);
         return bundle_adjustment_obj.Adjust(_sfm_data, true, true, !_bFixedIntrinsics);
+    }
+
+    /// Ask every worker for its refined parameters and receive all the answers
+    /// (no message is left pending, even if some answers are invalid)
+    std::vector<std::vector<double> > FinalizeWorkers(size_t nb_workers)
+    {
+        for (size_t c = 0; c < nb_workers; ++c)
+            SendCommand(BA_FINALIZE, c + 1);
+        std::vector<std::vector<double> > values(nb_workers);
+        for (size_t c = 0; c < nb_workers; ++c)
+            values[c] = RecvDoubles(c + 1, BA_LOCAL_VALUES);
+        return values;
+    }
+
+} // namespace
+
+    bool master_bundle_adjustment(
+        SfM_Data & _sfm_data,
+        const bool& _bFixedIntrinsics,
+        const MPI_BA_options & options)
+    {
+        int world_size = 1;
+        MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+        const size_t nb_workers = world_size - 1;
+        const size_t nb_clusters = std::min(nb_workers, _sfm_data.GetPoses().size() / std::max<size_t>(options._minPosesPerCluster, 1));
+        if (nb_clusters < 2)
+            return LocalBundleAdjustment(_sfm_data, _bFixedIntrinsics);
+
+        //拆分数据
+        const CovisibilityGraph graph = PoseCovisibility(_sfm_data);
+        const std::vector<std::set<IndexT> > clusters = ClusterPoses(_sfm_data, graph, nb_clusters);
+        const std::vector<ClusterProblem> problems =
+            BuildClusterProblems(_sfm_data, clusters, graph, !_bFixedIntrinsics, options);
+
+        for (size_t c = 0; c < problems.size(); ++c)
+        {
+            std::ostringstream stream;
+            {
+                cereal::PortableBinaryOutputArchive archive(stream);
+                archive(problems[c]);
+            }
+            SendCommand(BA_NEW_PROBLEM, c + 1);
+            SendString(stream.str(), c + 1, BA_PROBLEM);
+            if (options._bVerbose)
+                std::cout << "Cluster " << c << ": "
+                          << problems[c].sfm_data.GetPoses().size() << " poses ("
+                          << problems[c].shared_poses.size() << " shared), "
+                          << problems[c].sfm_data.GetLandmarks().size() << " landmarks ("
+                          << problems[c].shared_landmarks.size() << " shared)" << std::endl;
+        }
+
+        // Consensus initialization with the current scene, dual variables set to 0
+        ConsensusValues z;
+        for (Poses::const_iterator it = _sfm_data.poses.begin(); it != _sfm_data.poses.end(); ++it)
+            z.poses[it->first] = PoseToParams(it->second);
+        for (Landmarks::const_iterator it = _sfm_data.structure.begin(); it != _sfm_data.structure.end(); ++it)
+            z.landmarks[it->first] = std::vector<double>(it->second.X.data(), it->second.X.data() + 3);
+        for (Intrinsics::const_iterator it = _sfm_data.intrinsics.begin(); it != _sfm_data.intrinsics.end(); ++it)
+            z.intrinsics[it->first] = it->second->getParams();
+
+        std::vector<std::vector<double> > u(problems.size());
+        for (size_t c = 0; c < problems.size(); ++c)
+            u[c].assign(z.Gather(problems[c]).size(), 0.0);
+
+        double rho = options._rho;
+        for (int iter = 0; iter < options._nbMaxIterations; ++iter)
+        {
+            // x-update: local bundle adjustments toward z - u
+            for (size_t c = 0; c < problems.size(); ++c)
+            {
+                const std::vector<double> z_c = z.Gather(problems[c]);
+                std::vector<double> message(1, rho);
+                message.reserve(z_c.size() + 1);
+                for (size_t i = 0; i < z_c.size(); ++i)
+                    message.push_back(z_c[i] - u[c][i]);
+                SendCommand(BA_ITERATE, c + 1);
+                SendDoubles(message, c + 1, BA_CONSENSUS);
+            }
+            // Receive every answer before checking them: [solve status, shared values]
+            std::vector<std::vector<double> > x(problems.size());
+            bool bValidAnswers = true, bSolved = true;
+            for (size_t c = 0; c < problems.size(); ++c)
+            {
+                x[c] = RecvDoubles(c + 1, BA_LOCAL_VALUES);
+                if (x[c].size() != u[c].size() + 1)
+                {
+                    std::cerr << "Invalid answer from the bundle adjustment worker " << c + 1 << std::endl;
+                    bValidAnswers = false;
+                    continue;
+                }
+                if (x[c][0] == 0.0)
+                {
+                    std::cerr << "The bundle adjustment worker " << c + 1 << " failed at iteration " << iter << std::endl;
+                    bSolved = false;
+                }
+                x[c].erase(x[c].begin());
+            }
+            if (!bValidAnswers)
+            {
+                // Release the workers, the scene is left unchanged
+                FinalizeWorkers(problems.size());
+                return false;
+            }
+            if (!bSolved)
+            {
+                // Reject the round: the workers go back to the last accepted values
+                // so that the non-shared parameters agree with the last consensus
+                for (size_t c = 0; c < problems.size(); ++c)
+                    SendCommand(BA_REJECT, c + 1);
+                break;
+            }
+
+            const double round_rho = rho;
+            const ConsensusResiduals residuals = ConsensusUpdate(problems, x, z, u, rho, options._tolerance);
+            if (options._bVerbose)
+                std::cout << "ADMM iteration " << iter << ": primal residual " << residuals.primal
+                          << ", dual residual " << residuals.dual << ", rho " << round_rho << std::endl;
+            if (residuals.bConverged)
+                break;
+        }
+
+        //汇总数据
+        // Shared parameters take the consensus value, the others the value of their single cluster
+        const std::vector<std::vector<double> > final_values = FinalizeWorkers(problems.size());
+        for (size_t c = 0; c < problems.size(); ++c)
+        {
+            const SfM_Data & cluster_data = problems[c].sfm_data;
+            size_t expected = 6 * cluster_data.poses.size() + 3 * cluster_data.structure.size();
+            if (!_bFixedIntrinsics)
+                for (Intrinsics::const_iterator it = cluster_data.intrinsics.begin(); it != cluster_data.intrinsics.end(); ++it)
+                    expected += z.intrinsics.at(it->first).size();
+            if (final_values[c].size() != expected)
+            {
+                std::cerr << "Invalid answer from the bundle adjustment worker " << c + 1 << std::endl;
+                return false;
+            }
+        }
+        for (size_t c = 0; c < problems.size(); ++c)
+        {
+            const SfM_Data & cluster_data = problems[c].sfm_data;
+            const double * ptr = final_values[c].data();
+            for (Poses::const_iterator it = cluster_data.poses.begin(); it != cluster_data.poses.end(); ++it, ptr += 6)
+                if (!std::binary_search(problems[c].shared_poses.begin(), problems[c].shared_poses.end(), it->first))
+                    z.poses[it->first].assign(ptr, ptr + 6);
+            for (Landmarks::const_iterator it = cluster_data.structure.begin(); it != cluster_data.structure.end(); ++it, ptr += 3)
+                if (!std::binary_search(problems[c].shared_landmarks.begin(), problems[c].shared_landmarks.end(), it->first))
+                    z.landmarks[it->first].assign(ptr, ptr + 3);
+            if (!_bFixedIntrinsics)
+                for (Intrinsics::const_iterator it = cluster_data.intrinsics.begin(); it != cluster_data.intrinsics.end(); ++it)
+                {
+                    std::vector<double> & params = z.intrinsics[it->first];
+                    if (!std::binary_search(problems[c].shared_intrinsics.begin(), problems[c].shared_intrinsics.end(), it->first))
+                        params.assign(ptr, ptr + params.size());
+                    ptr += params.size();
+                }
+        }
+
+        // Update the scene (landmarks seen by no cluster are kept unchanged)
+        for (Poses::iterator it = _sfm_data.poses.begin(); it != _sfm_data.poses.end(); ++it)
+            it->second = ParamsToPose(&z.poses[it->first][0]);
+        for (Landmarks::iterator it = _sfm_data.structure.begin(); it != _sfm_data.structure.end(); ++it)
+            it->second.X = Vec3(z.landmarks[it->first][0], z.landmarks[it->first][1], z.landmarks[it->first][2]);
+        if (!_bFixedIntrinsics)
+            for (Intrinsics::iterator it = _sfm_data.intrinsics.begin(); it != _sfm_data.intrinsics.end(); ++it)
+                it->second->updateFromParams(z.intrinsics[it->first]);
+        return true;
+    }
+
+    bool client_bundle_adjustment(){
+        std::unique_ptr<ClusterSolver> solver;
+        while (true)
+        {
+            int command = BA_STOP;
+            MPI_Recv(&command, 1, MPI_INT, MASTER_SERVER, STATUS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            switch (command)
+            {
+                case BA_NEW_PROBLEM:
+                {
+                    std::istringstream stream(RecvString(MASTER_SERVER, BA_PROBLEM));
+                    ClusterProblem cluster;
+                    {
+                        cereal::PortableBinaryInputArchive archive(stream);
+                        archive(cluster);
+                    }
+                    solver.reset(new ClusterSolver(cluster));
+                }
+                break;
+                case BA_ITERATE:
+                {
+                    const std::vector<double> message = RecvDoubles(MASTER_SERVER, BA_CONSENSUS);
+                    if (!solver || message.empty())
+                    {
+                        SendDoubles(std::vector<double>(1, 0.0), MASTER_SERVER, BA_LOCAL_VALUES);
+                        break;
+                    }
+                    // Answer: solve status (1: usable solution, 0: failure) and shared values
+                    std::vector<double> answer(1, solver->Solve(message[0], message.data() + 1) ? 1.0 : 0.0);
+                    const std::vector<double> shared_values = solver->SharedValues();
+                    answer.insert(answer.end(), shared_values.begin(), shared_values.end());
+                    SendDoubles(answer, MASTER_SERVER, BA_LOCAL_VALUES);
+                }
+                break;
+                case BA_REJECT:
+                    if (solver)
+                        solver->Reject();
+                break;
+                case BA_FINALIZE:
+                    SendDoubles(solver ? solver->AllValues() : std::vector<double>(), MASTER_SERVER, BA_LOCAL_VALUES);
+                    solver.reset();
+                break;
+                case BA_STOP:
+                default:
+                    return true;
+            }
+        }
+    }
 
+    void stop_bundle_adjustment_clients(){
+        int world_size = 1;
+        MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+        for (int rank = 1; rank < world_size; ++rank)
+            SendCommand(BA_STOP, rank);
     }
 }
@@ -4,17 +4,56 @@
 
 #ifndef I23DSFM_MPI_BUNDLE_ADJUSTMENT_H
 #define I23DSFM_MPI_BUNDLE_ADJUSTMENT_H
-#include"i23dSFM/sfm/sfm_data.hpp"
-#include "i23dSFM/sfm/sfm_data_BA_ceres.hpp"
-#include "ceres/ceres.h"
+#include "i23dSFM/sfm/sfm_data.hpp"
+
 namespace i23dSFM{
-   using namespace sfm;
-    bool master_bundle_adjustment(SfM_Data & _sfm_data,const bool& _bFixedIntrinsics);
+    using namespace sfm;
+
+    /// Distributed bundle adjustment (consensus ADMM over MPI).
+    ///
+    /// The master (rank 0) splits the poses into one cluster per worker
+    /// (region growing on the pose co-visibility graph), duplicates the
+    /// strongly connected boundary poses in the neighbouring clusters and
+    /// sends each worker its sub-problem. Every ADMM round the workers solve
+    /// their local bundle adjustment pulled toward the consensus value of the
+    /// shared poses/landmarks/intrinsics; the master averages these values
+    /// and updates the dual variables until the copies agree.
+    struct MPI_BA_options
+    {
+        int _nbMaxIterations;        // maximal number of ADMM rounds
+        int _nbLocalIterations;      // maximal number of LM iterations per local solve
+        double _rho;                 // initial ADMM penalty (adapted by residual balancing)
+        double _tolerance;           // absolute & relative primal/dual stopping tolerance
+        size_t _minPosesPerCluster;  // below it the problem is solved locally on the master
+        size_t _minOverlapTracks;    // tracks a boundary pose must share to be duplicated
+        bool _bVerbose;
+
+        MPI_BA_options()
+            :_nbMaxIterations(20),
+             _nbLocalIterations(10),
+             _rho(100.0),
+             _tolerance(1e-4),
+             _minPosesPerCluster(50),
+             _minOverlapTracks(30),
+             _bVerbose(true)
+        {}
+    };
 
-    bool client_bundle_adjustment(SfM_Data & _sfm_data,const bool& _bFixedIntrinsics);
+    /// Master side: refine the scene with the workers of MPI_COMM_WORLD.
+    /// Fall back to a local Ceres bundle adjustment if the scene cannot be
+    /// split in at least two clusters (less than two workers or too few poses).
+    bool master_bundle_adjustment(
+        SfM_Data & _sfm_data,
+        const bool& _bFixedIntrinsics,
+        const MPI_BA_options & options = MPI_BA_options());
+
+    /// Worker side: serve the master requests until it sends the stop command.
+    bool client_bundle_adjustment();
+
+    /// Master side: release the workers (must be called before MPI_Finalize).
+    void stop_bundle_adjustment_clients();
 }
 
 
 
 #endif //I23DSFM_MPI_BUNDLE_ADJUSTMENT_H
-
@@ -0,0 +1,226 @@
+//
+// Consensus ADMM step of the distributed bundle adjustment (no MPI dependency)
+//
+
+#ifndef I23DSFM_MPI_BUNDLE_ADJUSTMENT_CONSENSUS_H
+#define I23DSFM_MPI_BUNDLE_ADJUSTMENT_CONSENSUS_H
+
+#include "i23dSFM/sfm/sfm_data.hpp"
+#include "i23dSFM/sfm/sfm_data_io_cereal.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace i23dSFM{
+namespace mpi_ba{
+    using namespace sfm;
+
+    /// A cluster of the scene refined by one worker
+    struct ClusterProblem
+    {
+        SfM_Data sfm_data;
+        // Parameters seen by several clusters (the ADMM consensus variables)
+        std::vector<IndexT> shared_poses;
+        std::vector<IndexT> shared_landmarks;
+        std::vector<IndexT> shared_intrinsics;
+        bool bRefineIntrinsics;
+        int nbLocalIterations;
+
+        template <class Archive>
+        void serialize(Archive & ar)
+        {
+            ar(sfm_data.views, sfm_data.intrinsics, sfm_data.poses, sfm_data.structure);
+            ar(shared_poses, shared_landmarks, shared_intrinsics);
+            ar(bRefineIntrinsics, nbLocalIterations);
+        }
+    };
+
+    /// Consensus variables of the master (z), indexed like the SfM_Data
+    struct ConsensusValues
+    {
+        Hash_Map<IndexT, std::vector<double> > poses, landmarks, intrinsics;
+
+        /// Flatten the shared parameters of a cluster (poses, landmarks, intrinsics order)
+        std::vector<double> Gather(const ClusterProblem & cluster) const
+        {
+            std::vector<double> values;
+            for (size_t i = 0; i < cluster.shared_poses.size(); ++i)
+                Append(poses.at(cluster.shared_poses[i]), values);
+            for (size_t i = 0; i < cluster.shared_landmarks.size(); ++i)
+                Append(landmarks.at(cluster.shared_landmarks[i]), values);
+            for (size_t i = 0; i < cluster.shared_intrinsics.size(); ++i)
+                Append(intrinsics.at(cluster.shared_intrinsics[i]), values);
+            return values;
+        }
+
+        /// Add a flat cluster vector to the accumulators
+        void Scatter(const ClusterProblem & cluster, const std::vector<double> & values)
+        {
+            const double * ptr = values.data();
+            for (size_t i = 0; i < cluster.shared_poses.size(); ++i)
+                ptr = Accumulate(ptr, poses[cluster.shared_poses[i]]);
+            for (size_t i = 0; i < cluster.shared_landmarks.size(); ++i)
+                ptr = Accumulate(ptr, landmarks[cluster.shared_landmarks[i]]);
+            for (size_t i = 0; i < cluster.shared_intrinsics.size(); ++i)
+                ptr = Accumulate(ptr, intrinsics[cluster.shared_intrinsics[i]]);
+        }
+
+        /// Allocate zero accumulators for the shared parameters of a cluster
+        void ZerosLike(const ClusterProblem & cluster, const ConsensusValues & reference)
+        {
+            for (size_t i = 0; i < cluster.shared_poses.size(); ++i)
+                poses[cluster.shared_poses[i]].assign(6, 0.0);
+            for (size_t i = 0; i < cluster.shared_landmarks.size(); ++i)
+                landmarks[cluster.shared_landmarks[i]].assign(3, 0.0);
+            for (size_t i = 0; i < cluster.shared_intrinsics.size(); ++i)
+                intrinsics[cluster.shared_intrinsics[i]].assign(
+                    reference.intrinsics.at(cluster.shared_intrinsics[i]).size(), 0.0);
+        }
+
+    private:
+        static void Append(const std::vector<double> & src, std::vector<double> & dst)
+        {
+            dst.insert(dst.end(), src.begin(), src.end());
+        }
+
+        static const double * Accumulate(const double * src, std::vector<double> & dst)
+        {
+            for (size_t k = 0; k < dst.size(); ++k)
+                dst[k] += src[k];
+            return src + dst.size();
+        }
+    };
+
+    /// Values of parameter blocks at the last accepted ADMM round: a worker
+    /// saves them before each local solve and restores them if its solve
+    /// fails or if the master rejects the round.
+    class ParameterSnapshot
+    {
+    public:
+        void Save(const std::vector<std::pair<double*, int> > & blocks)
+        {
+            _values.clear();
+            for (size_t i = 0; i < blocks.size(); ++i)
+                _values.insert(_values.end(), blocks[i].first, blocks[i].first + blocks[i].second);
+        }
+
+        /// Restore the saved values (nothing is done if no value was saved)
+        void Restore(const std::vector<std::pair<double*, int> > & blocks) const
+        {
+            if (_values.empty())
+                return;
+            const double * ptr = _values.data();
+            for (size_t i = 0; i < blocks.size(); ptr += blocks[i].second, ++i)
+                std::copy(ptr, ptr + blocks[i].second, blocks[i].first);
+        }
+
+    private:
+        std::vector<double> _values;
+    };
+
+    inline double SquaredNorm(const std::vector<double> & a)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < a.size(); ++i)
+            sum += a[i] * a[i];
+        return sum;
+    }
+
+    /// Residuals of a consensus step
+    struct ConsensusResiduals
+    {
+        double primal;
+        double dual;
+        bool bConverged;
+    };
+
+    /// Master reduce step of an ADMM round, from the local values x of the clusters:
+    /// - z-update: average of x + u over the clusters sharing the variable,
+    /// - u-update: u += x - z,
+    /// - primal/dual residuals and stopping test,
+    /// - residual balancing of rho (the scaled dual variables follow rho)
+    ///   if the round has not converged.
+    inline ConsensusResiduals ConsensusUpdate(
+        const std::vector<ClusterProblem> & problems,
+        const std::vector<std::vector<double> > & x,
+        ConsensusValues & z,
+        std::vector<std::vector<double> > & u,
+        double & rho,
+        const double tolerance)
+    {
+        ConsensusValues sum, count;
+        for (size_t c = 0; c < problems.size(); ++c)
+        {
+            sum.ZerosLike(problems[c], z);
+            count.ZerosLike(problems[c], z);
+        }
+        for (size_t c = 0; c < problems.size(); ++c)
+        {
+            std::vector<double> x_u(x[c]);
+            for (size_t i = 0; i < x_u.size(); ++i)
+                x_u[i] += u[c][i];
+            sum.Scatter(problems[c], x_u);
+            count.Scatter(problems[c], std::vector<double>(x_u.size(), 1.0));
+        }
+        std::vector<std::vector<double> > z_prev(problems.size());
+        for (size_t c = 0; c < problems.size(); ++c)
+            z_prev[c] = z.Gather(problems[c]);
+        for (Hash_Map<IndexT, std::vector<double> >::iterator it = sum.poses.begin(); it != sum.poses.end(); ++it)
+            for (size_t k = 0; k < it->second.size(); ++k)
+                z.poses[it->first][k] = it->second[k] / count.poses[it->first][k];
+        for (Hash_Map<IndexT, std::vector<double> >::iterator it = sum.landmarks.begin(); it != sum.landmarks.end(); ++it)
+            for (size_t k = 0; k < it->second.size(); ++k)
+                z.landmarks[it->first][k] = it->second[k] / count.landmarks[it->first][k];
+        for (Hash_Map<IndexT, std::vector<double> >::iterator it = sum.intrinsics.begin(); it != sum.intrinsics.end(); ++it)
+            for (size_t k = 0; k < it->second.size(); ++k)
+                z.intrinsics[it->first][k] = it->second[k] / count.intrinsics[it->first][k];
+
+        // u-update and primal/dual residuals
+        double r2 = 0.0, s2 = 0.0, x2 = 0.0, z2 = 0.0, u2 = 0.0;
+        size_t nb_params = 0;
+        for (size_t c = 0; c < problems.size(); ++c)
+        {
+            const std::vector<double> z_c = z.Gather(problems[c]);
+            for (size_t i = 0; i < z_c.size(); ++i)
+            {
+                const double primal = x[c][i] - z_c[i];
+                u[c][i] += primal;
+                r2 += primal * primal;
+                s2 += (rho * (z_c[i] - z_prev[c][i])) * (rho * (z_c[i] - z_prev[c][i]));
+            }
+            x2 += SquaredNorm(x[c]);
+            z2 += SquaredNorm(z_c);
+            u2 += SquaredNorm(u[c]);
+            nb_params += z_c.size();
+        }
+        ConsensusResiduals residuals;
+        residuals.primal = std::sqrt(r2);
+        residuals.dual = std::sqrt(s2);
+        const double eps_primal = tolerance * (std::sqrt(double(nb_params)) + std::sqrt(std::max(x2, z2)));
+        const double eps_dual = tolerance * (std::sqrt(double(nb_params)) + rho * std::sqrt(u2));
+        residuals.bConverged = residuals.primal <= eps_primal && residuals.dual <= eps_dual;
+        if (residuals.bConverged)
+            return residuals;
+
+        // Residual balancing
+        double scale = 1.0;
+        if (residuals.primal > 10.0 * residuals.dual)
+            scale = 2.0;
+        else if (residuals.dual > 10.0 * residuals.primal)
+            scale = 0.5;
+        if (scale != 1.0)
+        {
+            rho *= scale;
+            for (size_t c = 0; c < u.size(); ++c)
+                for (size_t i = 0; i < u[c].size(); ++i)
+                    u[c][i] /= scale;
+        }
+        return residuals;
+    }
+
+} // namespace mpi_ba
+} // namespace i23dSFM
+
+#endif //I23DSFM_MPI_BUNDLE_ADJUSTMENT_CONSENSUS_H
@@ -0,0 +1,139 @@
+//
+// Single process test of the distributed bundle adjustment reduce step
+//
+
+#include "mpi_bundle_adjustment_consensus.h"
+#include "testing/testing.h"
+
+using namespace i23dSFM;
+using namespace i23dSFM::mpi_ba;
+
+// Two clusters sharing the pose 1 and the landmark 7
+static std::vector<ClusterProblem> TwoClusters()
+{
+    std::vector<ClusterProblem> problems(2);
+    for (size_t c = 0; c < problems.size(); ++c)
+    {
+        problems[c].shared_poses.push_back(1);
+        problems[c].shared_landmarks.push_back(7);
+        problems[c].bRefineIntrinsics = false;
+        problems[c].nbLocalIterations = 1;
+    }
+    return problems;
+}
+
+static ConsensusValues ZeroConsensus()
+{
+    ConsensusValues z;
+    z.poses[1].assign(6, 0.0);
+    z.landmarks[7].assign(3, 0.0);
+    return z;
+}
+
+TEST(MPI_BA, ConsensusAverage)
+{
+    const std::vector<ClusterProblem> problems = TwoClusters();
+    ConsensusValues z = ZeroConsensus();
+    std::vector<std::vector<double> > u(2, std::vector<double>(9, 0.0));
+    // x of the cluster c: pose values c + 1, landmark values 10 * (c + 1)
+    std::vector<std::vector<double> > x(2);
+    for (size_t c = 0; c < 2; ++c)
+    {
+        x[c].assign(6, c + 1.0);
+        x[c].resize(9, 10.0 * (c + 1));
+    }
+    double rho = 1.0;
+    const ConsensusResiduals residuals = ConsensusUpdate(problems, x, z, u, rho, 1e-4);
+
+    // z is the average of x + u, u accumulates x - z
+    for (size_t k = 0; k < 6; ++k)
+        EXPECT_NEAR(1.5, z.poses[1][k], 1e-12);
+    for (size_t k = 0; k < 3; ++k)
+        EXPECT_NEAR(15.0, z.landmarks[7][k], 1e-12);
+    for (size_t k = 0; k < 6; ++k)
+    {
+        EXPECT_NEAR(-0.5, u[0][k], 1e-12);
+        EXPECT_NEAR(0.5, u[1][k], 1e-12);
+    }
+    for (size_t k = 6; k < 9; ++k)
+    {
+        EXPECT_NEAR(-5.0, u[0][k], 1e-12);
+        EXPECT_NEAR(5.0, u[1][k], 1e-12);
+    }
+    EXPECT_NEAR(std::sqrt(12 * 0.25 + 6 * 25.0), residuals.primal, 1e-9);
+    EXPECT_NEAR(std::sqrt(2 * (6 * 1.5 * 1.5 + 3 * 15.0 * 15.0)), residuals.dual, 1e-9);
+    EXPECT_FALSE(residuals.bConverged);
+    EXPECT_EQ(1.0, rho); // balanced residuals: rho is kept
+}
+
+TEST(MPI_BA, ConsensusConverged)
+{
+    const std::vector<ClusterProblem> problems = TwoClusters();
+    ConsensusValues z = ZeroConsensus();
+    z.poses[1].assign(6, 2.0);
+    z.landmarks[7].assign(3, -3.0);
+    std::vector<std::vector<double> > u(2, std::vector<double>(9, 0.0));
+    // The clusters agree with the consensus
+    const std::vector<std::vector<double> > x(2, z.Gather(problems[0]));
+    double rho = 4.0;
+    const ConsensusResiduals residuals = ConsensusUpdate(problems, x, z, u, rho, 1e-4);
+    EXPECT_TRUE(residuals.bConverged);
+    EXPECT_NEAR(0.0, residuals.primal, 1e-12);
+    EXPECT_NEAR(0.0, residuals.dual, 1e-12);
+    EXPECT_EQ(4.0, rho);
+    EXPECT_NEAR(2.0, z.poses[1][0], 1e-12);
+    EXPECT_NEAR(0.0, u[1][8], 1e-12);
+}
+
+TEST(MPI_BA, ConsensusResidualBalancing)
+{
+    const std::vector<ClusterProblem> problems = TwoClusters();
+    // The average does not move (dual residual 0) but the clusters disagree
+    ConsensusValues z = ZeroConsensus();
+    std::vector<std::vector<double> > u(2, std::vector<double>(9, 0.0));
+    std::vector<std::vector<double> > x(2);
+    x[0].assign(9, 1.0);
+    x[1].assign(9, -1.0);
+    double rho = 1.0;
+    const ConsensusResiduals residuals = ConsensusUpdate(problems, x, z, u, rho, 1e-4);
+    EXPECT_FALSE(residuals.bConverged);
+    EXPECT_NEAR(0.0, residuals.dual, 1e-12);
+    // rho is doubled and the scaled dual variables halved
+    EXPECT_EQ(2.0, rho);
+    EXPECT_NEAR(0.5, u[0][0], 1e-12);
+    EXPECT_NEAR(-0.5, u[1][0], 1e-12);
+}
+
+TEST(MPI_BA, RejectedRound)
+{
+    // A worker parameters: one pose and one landmark
+    std::vector<double> pose(6, 0.0), landmark(3, 0.0);
+    std::vector<std::pair<double*, int> > blocks;
+    blocks.push_back(std::make_pair(&pose[0], 6));
+    blocks.push_back(std::make_pair(&landmark[0], 3));
+
+    // Accepted round: the local solve moves the parameters
+    ParameterSnapshot last_accepted;
+    last_accepted.Save(blocks);
+    pose.assign(6, 1.0);
+    landmark.assign(3, 2.0);
+
+    // Rejected round: the parameters go back to the accepted round values
+    last_accepted.Save(blocks);
+    pose.assign(6, 5.0);
+    landmark.assign(3, 7.0);
+    last_accepted.Restore(blocks);
+    for (size_t k = 0; k < 6; ++k)
+        EXPECT_EQ(1.0, pose[k]);
+    for (size_t k = 0; k < 3; ++k)
+        EXPECT_EQ(2.0, landmark[k]);
+
+    // Nothing saved: the parameters are kept
+    ParameterSnapshot empty;
+    empty.Restore(blocks);
+    EXPECT_EQ(1.0, pose[0]);
+}
+
+/* ************************************************************************* */
+int main() { TestResult tr; return TestRegistry::runAllTests(tr);}
+/* ************************************************************************* */
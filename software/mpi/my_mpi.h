@@ -5,6 +5,23 @@
 #ifndef I23DSFM_MY_MPI_H
 #define I23DSFM_MY_MPI_H
 
+#define MASTER_SERVER 0
+
+/// Message tags
+enum TAG{
+    STATUS,           // command sent by the master (see BA_COMMAND)
+    BA_PROBLEM,       // serialized cluster sub-problem
+    BA_CONSENSUS,     // ADMM penalty and consensus targets
+    BA_LOCAL_VALUES   // parameters refined by a worker
+};
+
+/// Commands sent by the master to the bundle adjustment workers
+enum BA_COMMAND{
+    BA_STOP = 0,
+    BA_NEW_PROBLEM,
+    BA_ITERATE,
+    BA_REJECT,        // restore the values of the last accepted round
+    BA_FINALIZE
+};
+
 #endif //I23DSFM_MY_MPI_H
-enum TAG{STATUS};
-int flags=1;
\ No newline at end of file